@@ -0,0 +1,184 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic_map.hpp"
+
+#include "map_transformer/transformer.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+using map_transformer::SearchStrategy;
+using map_transformer::Transformer;
+using map_transformer::TriangulationMode;
+using map_transformer::benchmark::synthetic_map;
+using map_transformer::benchmark::path_points;
+using map_transformer::benchmark::random_points;
+
+
+namespace {
+
+// Loading large maps is slow, so each map is loaded once and shared between benchmarks. The walk
+// strategy needs triangulations that are valid in each map, so maps for it are triangulated per
+// direction.
+Transformer const &loaded_map(
+  std::size_t point_count,
+  bool clustered,
+  SearchStrategy strategy,
+  int &size)
+{
+  static std::map<std::tuple<std::size_t, bool, TriangulationMode>,
+    std::pair<std::unique_ptr<Transformer>, int>> maps;
+  auto mode = strategy == SearchStrategy::walk ?
+    TriangulationMode::per_direction : TriangulationMode::midpoint;
+  auto &entry = maps[{point_count, clustered, mode}];
+  if (!entry.first) {
+    auto map = synthetic_map(point_count, clustered);
+    entry.first = std::make_unique<Transformer>();
+    entry.first->set_triangulation_mode(mode);
+    entry.first->load(map.yaml_doc);
+    entry.second = map.size;
+  }
+  size = entry.second;
+  return *entry.first;
+}
+
+void build_index(benchmark::State &state, SearchStrategy strategy) {
+  int size;
+  Transformer transformer = loaded_map(state.range(0), state.range(1), strategy, size);
+  for (auto _ : state) {
+    transformer.set_search_strategy(strategy);
+  }
+  state.counters["triangles"] = transformer.triangle_indices().size();
+}
+
+void query_points(
+  benchmark::State &state,
+  SearchStrategy strategy,
+  std::vector<map_transformer::Point2D> (*make_points)(int size))
+{
+  int size;
+  Transformer transformer = loaded_map(state.range(0), state.range(1), strategy, size);
+  transformer.set_search_strategy(strategy);
+  auto points = make_points(size);
+
+  std::size_t ii{0};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(transformer.to_ref(points[ii]));
+    benchmark::DoNotOptimize(transformer.to_robot(points[ii]));
+    ii = (ii + 1) % points.size();
+  }
+  state.SetItemsProcessed(2 * state.iterations());
+  state.counters["triangles"] = transformer.triangle_indices().size();
+  state.SetLabel(
+    to_string(transformer.ref_map_search_selection().strategy) + "/" +
+    to_string(transformer.robot_map_search_selection().strategy));
+}
+
+void query(benchmark::State &state, SearchStrategy strategy) {
+  query_points(state, strategy, [](int size) {return random_points(4096, size);});
+}
+
+// Consecutive queries are close together, so benefit from the triangles being stored in spatial
+// order
+void query_path(benchmark::State &state, SearchStrategy strategy) {
+  query_points(state, strategy, [](int size) {return path_points(65536, size);});
+}
+
+// Transforms many points with either the batch or the single-point functions, to show the effect
+// of prefetching
+void transform_many(benchmark::State &state, SearchStrategy strategy, bool batch) {
+  int size;
+  Transformer transformer = loaded_map(state.range(0), state.range(1), strategy, size);
+  transformer.set_search_strategy(strategy);
+  auto points = random_points(65536, size);
+  std::vector<map_transformer::Point2D> results(points.size());
+
+  for (auto _ : state) {
+    if (batch) {
+      transformer.to_ref(points.data(), points.size(), results.data());
+      benchmark::DoNotOptimize(results.data());
+      transformer.to_robot(points.data(), points.size(), results.data());
+      benchmark::DoNotOptimize(results.data());
+    } else {
+      for (auto const &point : points) {
+        benchmark::DoNotOptimize(transformer.to_ref(point));
+      }
+      for (auto const &point : points) {
+        benchmark::DoNotOptimize(transformer.to_robot(point));
+      }
+    }
+  }
+  state.SetItemsProcessed(2 * points.size() * state.iterations());
+  state.counters["triangles"] = transformer.triangle_indices().size();
+}
+
+void query_batch(benchmark::State &state, SearchStrategy strategy) {
+  transform_many(state, strategy, true);
+}
+
+void query_single(benchmark::State &state, SearchStrategy strategy) {
+  transform_many(state, strategy, false);
+}
+
+void map_sizes(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"points", "clustered"});
+  for (int clustered : {0, 1}) {
+    for (int points : {100, 1000, 10000, 100000}) {
+      benchmark->Args({points, clustered});
+    }
+  }
+}
+
+// Maps whose triangles do not fit in the L2 cache
+void large_map_sizes(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"points", "clustered"});
+  for (int clustered : {0, 1}) {
+    benchmark->Args({100000, clustered});
+  }
+}
+
+}  // namespace
+
+
+BENCHMARK_CAPTURE(build_index, linear, SearchStrategy::linear)->Apply(map_sizes);
+BENCHMARK_CAPTURE(build_index, slab, SearchStrategy::slab)->Apply(map_sizes);
+BENCHMARK_CAPTURE(build_index, quadtree, SearchStrategy::quadtree)->Apply(map_sizes);
+BENCHMARK_CAPTURE(build_index, grid, SearchStrategy::grid)->Apply(map_sizes);
+BENCHMARK_CAPTURE(build_index, walk, SearchStrategy::walk)->Apply(map_sizes);
+BENCHMARK_CAPTURE(build_index, automatic, SearchStrategy::automatic)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, linear, SearchStrategy::linear)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, slab, SearchStrategy::slab)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, quadtree, SearchStrategy::quadtree)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, grid, SearchStrategy::grid)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, walk, SearchStrategy::walk)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query, automatic, SearchStrategy::automatic)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query_path, quadtree, SearchStrategy::quadtree)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query_path, grid, SearchStrategy::grid)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query_path, walk, SearchStrategy::walk)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query_path, automatic, SearchStrategy::automatic)->Apply(map_sizes);
+BENCHMARK_CAPTURE(query_single, grid, SearchStrategy::grid)->Apply(large_map_sizes);
+BENCHMARK_CAPTURE(query_batch, grid, SearchStrategy::grid)->Apply(large_map_sizes);
+BENCHMARK_CAPTURE(query_single, quadtree, SearchStrategy::quadtree)->Apply(large_map_sizes);
+BENCHMARK_CAPTURE(query_batch, quadtree, SearchStrategy::quadtree)->Apply(large_map_sizes);
+BENCHMARK_CAPTURE(query_single, walk, SearchStrategy::walk)->Apply(large_map_sizes);
+BENCHMARK_CAPTURE(query_batch, walk, SearchStrategy::walk)->Apply(large_map_sizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic_map.hpp"
+
+#include "map_transformer/transform_client.hpp"
+#include "map_transformer/transform_server.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+using map_transformer::Point2D;
+using map_transformer::TransformClient;
+using map_transformer::Transformer;
+using map_transformer::TransformServer;
+using map_transformer::benchmark::random_points;
+using map_transformer::benchmark::synthetic_map;
+using map_transformer::protocol::Lane;
+
+
+namespace {
+
+// The number of points in each request a bulk client sends
+constexpr std::size_t BULK_POINTS = 1 << 16;
+
+std::shared_ptr<Transformer const> loaded_map(int &size) {
+  static auto map = synthetic_map(10000);
+  static auto transformer = std::make_shared<Transformer const>(map.yaml_doc);
+  size = map.size;
+  return transformer;
+}
+
+double percentile(std::vector<double> const &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1))];
+}
+
+// Times single-point requests in the latency lane while bulk clients send large requests as fast
+// as they are answered. The bulk clients use the throughput lane, or to show what the lanes
+// prevent, the latency lane too.
+void latency_under_load(benchmark::State &state) {
+  auto bulk_clients = static_cast<std::size_t>(state.range(0));
+  auto bulk_lane = state.range(1) != 0 ? Lane::throughput : Lane::latency;
+  int size;
+  auto map = loaded_map(size);
+  auto socket_path = "/tmp/benchmark_transform_lanes_" + std::to_string(::getpid()) + ".sock";
+  TransformServer server({map}, socket_path);
+
+  std::atomic<bool> running{true};
+  std::vector<std::thread> bulk;
+  for (std::size_t ii = 0; ii < bulk_clients; ++ii) {
+    bulk.emplace_back(
+      [&, ii]() {
+        TransformClient client(socket_path, 0, bulk_lane);
+        auto points = random_points(BULK_POINTS, size, ii + 2);
+        std::vector<Point2D> results(points.size());
+        while (running) {
+          client.to_ref(points.data(), points.size(), results.data());
+        }
+      });
+  }
+
+  TransformClient client(socket_path, 0, Lane::latency);
+  auto points = random_points(4096, size);
+  std::vector<double> latencies;
+  std::size_t ii{0};
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark::DoNotOptimize(client.to_ref(points[ii]));
+    std::chrono::duration<double> latency = std::chrono::steady_clock::now() - start;
+    latencies.push_back(latency.count());
+    ii = (ii + 1) % points.size();
+  }
+  running = false;
+  for (auto &thread : bulk) {
+    thread.join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  state.counters["p50_us"] = percentile(latencies, 0.5) * 1e6;
+  state.counters["p99_us"] = percentile(latencies, 0.99) * 1e6;
+  state.counters["max_us"] = latencies.empty() ? 0.0 : latencies.back() * 1e6;
+  auto statistics = server.statistics();
+  state.counters["bulk_points"] = benchmark::Counter(
+    static_cast<double>(
+      bulk_lane == Lane::throughput ? statistics.throughput.points :
+      statistics.latency.points - state.iterations()),
+    benchmark::Counter::kIsRate);
+}
+
+}  // namespace
+
+BENCHMARK(latency_under_load)
+->ArgNames({"bulk_clients", "separate_lanes"})
+->Args({0, 1})
+->Args({4, 0})
+->Args({4, 1})
+->UseRealTime()
+->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
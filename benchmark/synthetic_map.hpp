@@ -0,0 +1,156 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__BENCHMARK__SYNTHETIC_MAP_HPP_
+#define MAP_TRANSFORMER__BENCHMARK__SYNTHETIC_MAP_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace map_transformer {
+namespace benchmark {
+
+/// A small, fast, deterministic pseudo-random number generator, so benchmarks are repeatable.
+class Random {
+public:
+  explicit Random(std::uint64_t seed) : _state(seed * 2862933555777941757ULL + 3037000493ULL) {}
+
+  /// Get a random integer in the range [low, high].
+  int integer(int low, int high) {
+    _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return low + static_cast<int>((_state >> 33) % static_cast<std::uint64_t>(high - low + 1));
+  }
+
+  /// Get a random float in the range [low, high).
+  float real(float low, float high) {
+    _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return low + (high - low) * static_cast<float>(_state >> 40) / static_cast<float>(1 << 24);
+  }
+
+private:
+  std::uint64_t _state;
+};
+
+/// A generated map information document and the size of its maps.
+struct SyntheticMap {
+  std::string yaml_doc;
+  int size;
+};
+
+/// Generate a map information document with approximately the requested number of correspondence
+/// points.
+/**
+ * The reference map correspondence points are a jittered grid. The robot map correspondence points
+ * are the same points displaced by a slowly-varying offset, small enough that no triangle is
+ * inverted in either map.
+ *
+ * If clustered is true, half of the points are packed into one corner of the map at one hundred
+ * times the density of the remainder, like a warehouse surrounded by a sparse yard.
+ */
+inline SyntheticMap synthetic_map(std::size_t point_count, bool clustered = false) {
+  Random random(point_count);
+  std::vector<std::pair<int, int>> ref_points;
+
+  int size;
+  if (clustered) {
+    int dense_spacing = 2;
+    int sparse_spacing = 20;
+    int dense_side = static_cast<int>(std::sqrt(point_count / 2.0));
+    int core = dense_side * dense_spacing;
+    int sparse_side = static_cast<int>(
+      std::sqrt(point_count / 2.0 + std::pow(core / sparse_spacing, 2)));
+    size = sparse_side * sparse_spacing + 2 * sparse_spacing;
+    int core_end = core + 2 * sparse_spacing;
+    for (int ii = 0; ii < dense_side; ++ii) {
+      for (int jj = 0; jj < dense_side; ++jj) {
+        ref_points.emplace_back(
+          sparse_spacing + ii * dense_spacing,
+          sparse_spacing + jj * dense_spacing);
+      }
+    }
+    for (int ii = 0; ii < sparse_side; ++ii) {
+      for (int jj = 0; jj < sparse_side; ++jj) {
+        int x = sparse_spacing + ii * sparse_spacing;
+        int y = sparse_spacing + jj * sparse_spacing;
+        if (x < core_end && y < core_end) {
+          continue;
+        }
+        ref_points.emplace_back(x + random.integer(-3, 3), y + random.integer(-3, 3));
+      }
+    }
+  } else {
+    int spacing = 8;
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(point_count))));
+    size = side * spacing + 2 * spacing;
+    for (int ii = 0; ii < side; ++ii) {
+      for (int jj = 0; jj < side; ++jj) {
+        ref_points.emplace_back(
+          spacing + ii * spacing + random.integer(-1, 1),
+          spacing + jj * spacing + random.integer(-1, 1));
+      }
+    }
+  }
+
+  std::ostringstream ref, robot;
+  for (auto const &p : ref_points) {
+    ref << "    - [" << p.first << ", " << p.second << "]\n";
+    int dx = static_cast<int>(std::lround(2 * std::sin(p.second / 200.0)));
+    int dy = static_cast<int>(std::lround(2 * std::cos(p.first / 300.0)));
+    robot << "    - [" << p.first + dx << ", " << p.second + dy << "]\n";
+  }
+
+  std::ostringstream doc;
+  doc << "ref_map:\n  name: reference\n  size: [" << size << ", " << size << "]\n" <<
+    "  correspondence_points:\n" << ref.str() <<
+    "robot_map:\n  name: robot\n  size: [" << size << ", " << size << "]\n" <<
+    "  correspondence_points:\n" << robot.str();
+  return SyntheticMap{doc.str(), size};
+}
+
+/// Generate uniformly-distributed random query points within a map.
+inline std::vector<Point2D> random_points(std::size_t count, int size, std::uint64_t seed = 1) {
+  Random random(seed);
+  std::vector<Point2D> points;
+  points.reserve(count);
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    points.emplace_back(random.real(0, size), random.real(0, size));
+  }
+  return points;
+}
+
+/// Generate query points along a path that sweeps back and forth across a map, as a robot or an
+/// image scan would, so that consecutive points are close together.
+inline std::vector<Point2D> path_points(std::size_t count, int size) {
+  std::vector<Point2D> points;
+  points.reserve(count);
+  auto per_row = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+  float step = static_cast<float>(size) / per_row;
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    std::size_t row = ii / per_row;
+    std::size_t column = row % 2 == 0 ? ii % per_row : per_row - 1 - ii % per_row;
+    points.emplace_back((column + 0.5f) * step, (row + 0.5f) * step);
+  }
+  return points;
+}
+
+}  // namespace benchmark
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__BENCHMARK__SYNTHETIC_MAP_HPP_
@@ -0,0 +1,186 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__C_API_H_
+#define MAP_TRANSFORMER__C_API_H_
+
+/**
+ * \file
+ * A C interface to \ref map_transformer::Transformer, for use from other languages.
+ *
+ * Functions report failure by returning a status other than MAP_TRANSFORMER_OK, and never throw.
+ * A description of the most recent failure on the calling thread is available from
+ * map_transformer_last_error(). A handle may be used by several threads at once for transforms,
+ * but must not be loaded while it is being used.
+ *
+ * The batch transforms read and write coordinates through separate x and y pointers with a stride
+ * in bytes between consecutive points, so that points can be read from and written to arrays of
+ * structures or separate coordinate arrays without copying. For example, for an array of
+ * interleaved points `float xy[2 * count]`, pass `xy`, `xy + 1` and a stride of
+ * `2 * sizeof(float)`. The input and output may be the same memory.
+ */
+
+#include "map_transformer/visibility_control.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The version of this interface; it is increased when functions are added. */
+#define MAP_TRANSFORMER_C_API_VERSION 1
+
+/** An opaque handle to a transformer. */
+typedef struct map_transformer_t map_transformer_t;
+
+/** The result of a function call. */
+typedef enum map_transformer_status_t
+{
+  /** The call succeeded. */
+  MAP_TRANSFORMER_OK = 0,
+  /** An argument was a null pointer or otherwise invalid. */
+  MAP_TRANSFORMER_INVALID_ARGUMENT = 1,
+  /** The map information or snapshot could not be loaded. */
+  MAP_TRANSFORMER_LOAD_FAILED = 2,
+  /** The transformer has no map information loaded. */
+  MAP_TRANSFORMER_NOT_LOADED = 3,
+  /** A buffer provided was too small; the size needed has been reported. */
+  MAP_TRANSFORMER_BUFFER_TOO_SMALL = 4,
+  /** Memory could not be allocated. */
+  MAP_TRANSFORMER_OUT_OF_MEMORY = 5,
+  /** An unexpected error occurred. */
+  MAP_TRANSFORMER_INTERNAL_ERROR = 6
+} map_transformer_status_t;
+
+/** Get the version of the interface implemented by the library. */
+MAP_TRANSFORMER_PUBLIC unsigned int map_transformer_api_version(void);
+
+/**
+ * Get a description of the last failure on the calling thread.
+ *
+ * \return A string that remains valid until the next call on this thread, or an empty string.
+ */
+MAP_TRANSFORMER_PUBLIC char const * map_transformer_last_error(void);
+
+/**
+ * Create an empty transformer.
+ *
+ * \return The handle, or NULL if memory could not be allocated.
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_t * map_transformer_create(void);
+
+/** Destroy a transformer. Passing NULL does nothing. */
+MAP_TRANSFORMER_PUBLIC void map_transformer_destroy(map_transformer_t * transformer);
+
+/**
+ * Load map information from a YAML document in memory, replacing any already loaded.
+ *
+ * If loading fails, the transformer is left empty.
+ *
+ * \param yaml The YAML document; it does not need to be null-terminated.
+ * \param size The length of the document in bytes.
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_load_yaml(
+  map_transformer_t * transformer,
+  char const * yaml,
+  size_t size);
+
+/**
+ * Load map information from a snapshot in memory, replacing any already loaded.
+ *
+ * If loading fails, the transformer is left empty.
+ *
+ * \param data The snapshot, as written by map_transformer_save_snapshot().
+ * \param size The size of the snapshot in bytes.
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_load_snapshot(
+  map_transformer_t * transformer,
+  void const * data,
+  size_t size);
+
+/**
+ * Write a snapshot of the loaded map information to a buffer.
+ *
+ * Call with a null buffer to find the size needed.
+ *
+ * \param buffer The buffer to write to, or NULL.
+ * \param capacity The size of the buffer in bytes.
+ * \param size Set to the size of the snapshot in bytes.
+ * \return MAP_TRANSFORMER_BUFFER_TOO_SMALL if the buffer is too small for the snapshot.
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_save_snapshot(
+  map_transformer_t const * transformer,
+  void * buffer,
+  size_t capacity,
+  size_t * size);
+
+/** Transform points in the robot map to the reference map. */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_to_ref_float(
+  map_transformer_t const * transformer,
+  size_t count,
+  float const * x,
+  float const * y,
+  ptrdiff_t stride,
+  float * result_x,
+  float * result_y,
+  ptrdiff_t result_stride);
+
+/** Transform points in the reference map to the robot map. */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_to_robot_float(
+  map_transformer_t const * transformer,
+  size_t count,
+  float const * x,
+  float const * y,
+  ptrdiff_t stride,
+  float * result_x,
+  float * result_y,
+  ptrdiff_t result_stride);
+
+/**
+ * Transform points in the robot map to the reference map.
+ *
+ * The transformer works in single precision, so the coordinates are rounded to float, and the
+ * results are exactly those of map_transformer_to_ref_float().
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_to_ref_double(
+  map_transformer_t const * transformer,
+  size_t count,
+  double const * x,
+  double const * y,
+  ptrdiff_t stride,
+  double * result_x,
+  double * result_y,
+  ptrdiff_t result_stride);
+
+/**
+ * Transform points in the reference map to the robot map.
+ *
+ * \see map_transformer_to_ref_double()
+ */
+MAP_TRANSFORMER_PUBLIC map_transformer_status_t map_transformer_to_robot_double(
+  map_transformer_t const * transformer,
+  size_t count,
+  double const * x,
+  double const * y,
+  ptrdiff_t stride,
+  double * result_x,
+  double * result_y,
+  ptrdiff_t result_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MAP_TRANSFORMER__C_API_H_
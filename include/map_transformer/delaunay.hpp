@@ -0,0 +1,40 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__DELAUNAY_HPP_
+#define MAP_TRANSFORMER__DELAUNAY_HPP_
+
+#include "map_transformer/types.hpp"
+
+
+namespace map_transformer {
+
+/// Calculate the Delaunay triangulation of a set of points.
+/**
+ * The triangulation is built by incremental insertion (the Bowyer-Watson algorithm), with the
+ * points inserted in Morton curve order so that each is found by a short walk from the last. All
+ * geometric decisions use the exact predicates in predicates.hpp, so the result does not depend on
+ * rounding. Where four or more points are cocircular, the triangulation is one of the valid
+ * choices, chosen deterministically by the insertion order.
+ *
+ * \param points The points to triangulate.
+ * \return The triangles, as indices into points, with their vertices in counterclockwise order.
+ * Where a point appears more than once, only its first index is used. If there are fewer than
+ * three distinct points or all of the points are collinear, no triangles are returned.
+ */
+TriangleList delaunay_triangulation(CorrespondencePoints const &points);
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__DELAUNAY_HPP_
@@ -0,0 +1,339 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__EMBEDDED_HPP_
+#define MAP_TRANSFORMER__EMBEDDED_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace map_transformer {
+
+/// Transformation of points using map data compiled into a program.
+/**
+ * The data for a map is generated by the `generate_embedded_map` tool, which loads the map
+ * information with a \ref Transformer and writes out everything it calculates as `constexpr`
+ * arrays in a header. This header contains the code to use that data. It needs no other part of
+ * the library, does not allocate memory, and gives bit-for-bit the same results as
+ * \ref Transformer::to_ref() and \ref Transformer::to_robot(), provided that, like the library, it
+ * is compiled without contracting floating-point multiplications and additions into fused
+ * multiply-adds (`-ffp-contract=off` with GCC and Clang).
+ *
+ * For example, for a header generated with the name `my_map`:
+ *
+ *     auto ref_point = map_transformer::embedded::to_ref<my_map::Map>({12.5f, 3.0f});
+ */
+namespace embedded {
+
+/// A point in one of the maps.
+struct Point {
+  float x;
+  float y;
+};
+
+/// A correspondence point and the point it corresponds to in the other map.
+struct CorrespondencePoint {
+  Point point;
+  Point target;
+};
+
+/// The vertices of a triangle, in the map the points to transform are in.
+struct Triangle {
+  Point vertices[3];
+};
+
+/// An affine transform of points from one map to another, as a row-major 2x3 matrix.
+struct AffineTransform {
+  double matrix[6];
+};
+
+/// The transform between the maps used for points outside the triangulation.
+struct MapTransform {
+  float scale_x;
+  float scale_y;
+  bool rotated;
+  double cos_rotation;
+  double sin_rotation;
+  float translation_x;
+  float translation_y;
+  /// True if the points are divided by the scale and the translation is subtracted, as when
+  /// transforming from the reference map to the robot map.
+  bool inverse;
+};
+
+/// Everything needed to transform points from one map to the other.
+struct Direction {
+  /// The correspondence points, sorted by their coordinates, without duplicates.
+  CorrespondencePoint const *corr_points;
+  std::size_t corr_point_count;
+  /// The triangles and their transforms, in the order the \ref Transformer stores them.
+  Triangle const *triangles;
+  AffineTransform const *transforms;
+  std::size_t triangle_count;
+  /// A uniform grid over the triangles. Each cell lists the triangles whose bounding boxes overlap
+  /// it, in ascending order, from cell_triangles[cell_offsets[cell]] up to
+  /// cell_triangles[cell_offsets[cell + 1]].
+  float min_x, min_y, max_x, max_y;
+  float scale_x, scale_y;
+  std::int32_t columns, rows;
+  std::uint32_t const *cell_offsets;
+  std::int32_t const *cell_triangles;
+  MapTransform map_transform;
+};
+
+namespace detail {
+
+// Calculate a + b exactly, as x + y where x is the rounded sum
+inline void two_sum(double a, double b, double &x, double &y) {
+  x = a + b;
+  double b_virtual = x - a;
+  double a_virtual = x - b_virtual;
+  y = (a - a_virtual) + (b - b_virtual);
+}
+
+// Calculate a * b exactly, as x + y where x is the rounded product
+inline void two_product(double a, double b, double &x, double &y) {
+  x = a * b;
+  y = std::fma(a, b, -x);
+}
+
+// Add a double to an expansion of non-overlapping doubles in order of increasing magnitude, in
+// place, returning its new length
+inline int grow(double *expansion, int length, double b) {
+  double q = b;
+  int result{0};
+  for (int ii = 0; ii < length; ++ii) {
+    double hh;
+    two_sum(q, expansion[ii], q, hh);
+    if (hh != 0) {
+      expansion[result++] = hh;
+    }
+  }
+  if (q != 0 || result == 0) {
+    expansion[result++] = q;
+  }
+  return result;
+}
+
+inline int sign(double value) {
+  return (value > 0) - (value < 0);
+}
+
+// The sign of the orientation of three points, calculated as by the library's orient2d(), with
+// the exact calculation done in a fixed-size expansion
+inline int orient2d_sign(Point const &a, Point const &b, Point const &c) {
+  double left = (static_cast<double>(a.x) - c.x) * (static_cast<double>(b.y) - c.y);
+  double right = (static_cast<double>(a.y) - c.y) * (static_cast<double>(b.x) - c.x);
+  double det = left - right;
+  double sum;
+  if (left > 0) {
+    if (right <= 0) {
+      return sign(det);
+    }
+    sum = left + right;
+  } else if (left < 0) {
+    if (right >= 0) {
+      return sign(det);
+    }
+    sum = -left - right;
+  } else {
+    return sign(det);
+  }
+  double const epsilon = 1.1102230246251565e-16;
+  double error_bound = (3.0 + 16.0 * epsilon) * epsilon * sum;
+  if (det >= error_bound || -det >= error_bound) {
+    return sign(det);
+  }
+
+  // Each difference of two floats is exactly the sum of two doubles, so the determinant is exactly
+  // the sum of sixteen products' rounded values and errors
+  double acx[2], acy[2], bcx[2], bcy[2];
+  two_sum(a.x, -static_cast<double>(c.x), acx[1], acx[0]);
+  two_sum(a.y, -static_cast<double>(c.y), acy[1], acy[0]);
+  two_sum(b.x, -static_cast<double>(c.x), bcx[1], bcx[0]);
+  two_sum(b.y, -static_cast<double>(c.y), bcy[1], bcy[0]);
+  double expansion[32];
+  int length{0};
+  for (int ii = 0; ii < 2; ++ii) {
+    for (int jj = 0; jj < 2; ++jj) {
+      double product, error;
+      two_product(acx[ii], bcy[jj], product, error);
+      length = grow(expansion, length, error);
+      length = grow(expansion, length, product);
+      two_product(acy[ii], bcx[jj], product, error);
+      length = grow(expansion, length, -error);
+      length = grow(expansion, length, -product);
+    }
+  }
+  return sign(expansion[length - 1]);
+}
+
+// Whether a triangle contains a point, including its edges, as by the library's
+// triangle_contains()
+inline bool triangle_contains(Triangle const &triangle, Point const &point) {
+  Point const *v = triangle.vertices;
+  int o0 = orient2d_sign(v[0], v[1], point);
+  int o1 = orient2d_sign(v[1], v[2], point);
+  int o2 = orient2d_sign(v[2], v[0], point);
+  bool negative = o0 < 0 || o1 < 0 || o2 < 0;
+  bool positive = o0 > 0 || o1 > 0 || o2 > 0;
+  if (negative && positive) {
+    return false;
+  }
+  if (negative || positive) {
+    return true;
+  }
+  float min_x = std::fmin(v[0].x, std::fmin(v[1].x, v[2].x));
+  float max_x = std::fmax(v[0].x, std::fmax(v[1].x, v[2].x));
+  float min_y = std::fmin(v[0].y, std::fmin(v[1].y, v[2].y));
+  float max_y = std::fmax(v[0].y, std::fmax(v[1].y, v[2].y));
+  return point.x >= min_x && point.x <= max_x && point.y >= min_y && point.y <= max_y;
+}
+
+}  // namespace detail
+
+/// The grid cell along one axis containing a coordinate.
+/**
+ * This is monotonic in value, so a point inside a triangle's bounding box is always in one of the
+ * cells the bounding box overlaps.
+ */
+inline std::int32_t grid_cell(float value, float min, float scale, std::int32_t count) {
+  float position = (value - min) * scale;
+  if (!(position >= 0)) {
+    return 0;
+  }
+  if (position >= count) {
+    return count - 1;
+  }
+  return static_cast<std::int32_t>(position);
+}
+
+/// Find the correspondence point equal to a point.
+/**
+ * \return The index of the correspondence point in the direction's sorted list, or -1.
+ */
+inline int find_corr_point(Direction const &direction, Point const &point) {
+  std::size_t low{0}, high{direction.corr_point_count};
+  while (low < high) {
+    std::size_t middle = low + (high - low) / 2;
+    Point const &candidate = direction.corr_points[middle].point;
+    if (candidate.x < point.x || (candidate.x == point.x && candidate.y < point.y)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < direction.corr_point_count && direction.corr_points[low].point.x == point.x &&
+    direction.corr_points[low].point.y == point.y)
+  {
+    return static_cast<int>(low);
+  }
+  return -1;
+}
+
+/// Find the lowest-indexed triangle containing a point.
+/**
+ * \return The index of the triangle, or -1 if no triangle contains the point.
+ */
+inline int find_triangle(Direction const &direction, Point const &point) {
+  if (direction.triangle_count == 0 ||
+    !(point.x >= direction.min_x && point.x <= direction.max_x &&
+    point.y >= direction.min_y && point.y <= direction.max_y))
+  {
+    return -1;
+  }
+  auto column = grid_cell(point.x, direction.min_x, direction.scale_x, direction.columns);
+  auto row = grid_cell(point.y, direction.min_y, direction.scale_y, direction.rows);
+  auto cell = static_cast<std::size_t>(row) * direction.columns + column;
+  for (auto ii = direction.cell_offsets[cell]; ii < direction.cell_offsets[cell + 1]; ++ii) {
+    auto triangle = direction.cell_triangles[ii];
+    if (detail::triangle_contains(direction.triangles[triangle], point)) {
+      return triangle;
+    }
+  }
+  return -1;
+}
+
+/// Transform a point by an affine transform, as the \ref Transformer does.
+inline Point apply_transform(AffineTransform const &transform, Point const &point) {
+  double const *m = transform.matrix;
+  Point result;
+  result.x = m[0] * point.x + m[1] * point.y + m[2];
+  result.y = m[3] * point.x + m[4] * point.y + m[5];
+  return result;
+}
+
+/// Transform a point by the transform between the maps, as the \ref Transformer does.
+inline Point apply_map_transform(MapTransform const &transform, Point const &point) {
+  Point result;
+  if (transform.inverse) {
+    result.x = point.x / transform.scale_x;
+    result.y = point.y / transform.scale_y;
+  } else {
+    result.x = point.x * transform.scale_x;
+    result.y = point.y * transform.scale_y;
+  }
+  if (transform.rotated) {
+    Point pre = result;
+    result.x = transform.cos_rotation * pre.x - transform.sin_rotation * pre.y;
+    result.y = transform.sin_rotation * pre.x + transform.cos_rotation * pre.y;
+  }
+  if (transform.inverse) {
+    result.x -= transform.translation_x;
+    result.y -= transform.translation_y;
+  } else {
+    result.x += transform.translation_x;
+    result.y += transform.translation_y;
+  }
+  return result;
+}
+
+/// Transform a point from one map to the other.
+inline Point transform(Direction const &direction, Point const &point) {
+  int corr_point = find_corr_point(direction, point);
+  if (corr_point >= 0) {
+    return direction.corr_points[corr_point].target;
+  }
+  int triangle = find_triangle(direction, point);
+  if (triangle < 0) {
+    return apply_map_transform(direction.map_transform, point);
+  }
+  return apply_transform(direction.transforms[triangle], point);
+}
+
+/// Transform a point in the robot map of a generated map to the reference map.
+/**
+ * \tparam Map The `Map` type of a generated header.
+ */
+template<typename Map>
+Point to_ref(Point const &point) {
+  return transform(Map::to_ref, point);
+}
+
+/// Transform a point in the reference map of a generated map to the robot map.
+/**
+ * \tparam Map The `Map` type of a generated header.
+ */
+template<typename Map>
+Point to_robot(Point const &point) {
+  return transform(Map::to_robot, point);
+}
+
+}  // namespace embedded
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__EMBEDDED_HPP_
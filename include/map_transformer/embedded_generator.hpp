@@ -0,0 +1,46 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__EMBEDDED_GENERATOR_HPP_
+#define MAP_TRANSFORMER__EMBEDDED_GENERATOR_HPP_
+
+#include "map_transformer/transformer.hpp"
+
+#include <ostream>
+#include <string>
+
+
+namespace map_transformer {
+
+/// Writes the data calculated by a Transformer as a C++ header for \ref embedded.
+class EmbeddedMapGenerator {
+public:
+  /// Write a header containing a loaded map's data.
+  /**
+   * The header defines a namespace with the given name, containing `constexpr` arrays of the
+   * correspondence points, triangles, transforms and a grid index for each direction, and a type
+   * `Map` to pass to \ref embedded::to_ref() and \ref embedded::to_robot().
+   *
+   * \param transformer The Transformer, with its map information loaded.
+   * \param name The name of the namespace, which must be a valid C++ identifier.
+   * \param output The stream to write the header to.
+   * \throw std::invalid_argument if the name is not a valid identifier.
+   * \throw std::logic_error if the Transformer has no loaded map information.
+   */
+  static void write(Transformer const &transformer, std::string const &name, std::ostream &output);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__EMBEDDED_GENERATOR_HPP_
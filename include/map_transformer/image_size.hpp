@@ -0,0 +1,62 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__IMAGE_SIZE_HPP_
+#define MAP_TRANSFORMER__IMAGE_SIZE_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <functional>
+#include <optional>
+#include <string>
+
+
+namespace map_transformer {
+
+/// A function that finds the width and height in pixels of a map image file.
+/**
+ * The function throws std::runtime_error if the file cannot be read as an image, so the map
+ * information fails to load. To skip the check of the size given in the map information, it may
+ * instead return no value; none of the readers provided by the library do.
+ */
+using ImageSizeReader = std::function<std::optional<Vector2D>(std::string const &path)>;
+
+/// Read the size of a map image from the header of the file.
+/**
+ * This is the default \ref ImageSizeReader of the `map_transformer_core` library. It needs no
+ * image library, and recognises PNG files and the Netpbm formats (PGM, PPM and PBM) that map
+ * servers commonly use.
+ *
+ * \param path The path to the image file.
+ * \return The width and height of the image.
+ * \throw std::runtime_error if the file cannot be opened, is not in one of the recognised formats,
+ * or its header is truncated or invalid.
+ */
+std::optional<Vector2D> read_image_header_size(std::string const &path);
+
+/// Set the \ref ImageSizeReader that \ref Transformer objects are created with.
+/**
+ * The default is \ref read_image_header_size(), or \ref read_image_size_with_opencv() in programs
+ * linked with the `map_transformer` add-on library. Existing transformers are not affected.
+ *
+ * \param[in] reader The function to read image sizes with. If empty, image sizes are not checked.
+ */
+void set_default_image_size_reader(ImageSizeReader reader);
+
+/// Get the \ref ImageSizeReader that \ref Transformer objects are created with.
+ImageSizeReader default_image_size_reader();
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__IMAGE_SIZE_HPP_
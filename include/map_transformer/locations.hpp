@@ -0,0 +1,92 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__LOCATIONS_HPP_
+#define MAP_TRANSFORMER__LOCATIONS_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// The maps a point can be given in.
+enum class MapFrame {
+  /// The reference map.
+  ref,
+  /// The robot map.
+  robot,
+};
+
+/// A named point, such as a waypoint or docking station, with its position in both maps.
+struct NamedLocation {
+  /// The location's name, which is unique among the locations of a map.
+  std::string name;
+  /// The map the location's position was given in; its position in the other map is calculated.
+  MapFrame frame{MapFrame::ref};
+  /// The location's position in the reference map.
+  Point2D ref_position{0, 0};
+  /// The location's position in the robot map.
+  Point2D robot_position{0, 0};
+};
+
+/// A table of named locations, which can be looked up by name or by index in constant time.
+/**
+ * The names are stored in an open-addressing hash table with linear probing, so that a lookup
+ * usually reads a single slot of a flat array and compares a single name.
+ */
+class LocationTable {
+public:
+  /// Replace the locations in the table.
+  /**
+   * \param locations The locations. Their indices are their positions in this list.
+   * \throw std::runtime_error if two locations have the same name.
+   */
+  void build(std::vector<NamedLocation> locations);
+
+  /// Remove all locations from the table.
+  void clear();
+
+  /// Find a location by name.
+  /**
+   * \return The index of the location, or -1 if there is no location with the name.
+   */
+  int find(std::string const &name) const;
+
+  /// Get all locations, in the order they were given.
+  std::vector<NamedLocation> const &locations() const;
+
+  /// Get all locations, in the order they were given, to update their positions.
+  /**
+   * The names must not be changed.
+   */
+  std::vector<NamedLocation> &locations();
+
+private:
+  std::vector<NamedLocation> _locations;
+  // The index of the location in each slot, or -1 for an empty slot
+  std::vector<std::int32_t> _slots;
+  // The hash of each location's name, to avoid comparing names that cannot match
+  std::vector<std::size_t> _hashes;
+
+  std::size_t slot_mask() const;
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__LOCATIONS_HPP_
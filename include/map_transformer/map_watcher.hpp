@@ -0,0 +1,103 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__MAP_WATCHER_HPP_
+#define MAP_TRANSFORMER__MAP_WATCHER_HPP_
+
+#include "map_transformer/transformer.hpp"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+
+
+namespace map_transformer {
+
+/// How a \ref MapWatcher loads a map and reports reloading it.
+struct MapWatcherOptions {
+  /// How long the files must go without changing before the map is reloaded, so that a burst of
+  /// writes, such as a file being copied into place, causes a single reload.
+  std::chrono::milliseconds debounce{200};
+  /// Called with each new transformer before the map information is loaded into it, to set its
+  /// triangulation mode, search strategy and other settings.
+  std::function<void(Transformer &)> configure;
+  /// Called on the watcher's thread with each transformer published after the first.
+  std::function<void(std::shared_ptr<Transformer const> const &)> on_reload;
+  /// Called on the watcher's thread with the error when the map cannot be reloaded.
+  std::function<void(std::string const &)> on_error;
+};
+
+/// Keeps a map up to date with its map information file and image files.
+/**
+ * The watcher loads the map when it is created, then watches the directories holding the map
+ * information file and the image files it names with inotify, so that files replaced by renaming
+ * another over them are seen as well as those written in place. If a directory is itself removed,
+ * moved or replaced, the directory at its path is watched in its place, once it exists. When the
+ * files have stopped changing, it loads them into a new \ref Transformer on its own thread, and
+ * publishes it in place of the previous one if it loads; otherwise the previous one is kept, so a
+ * map that is invalid or part way through being written is never used.
+ *
+ * Each transformer is immutable once published, so a caller can keep using the one it got from
+ * \ref current() for as long as it holds it, such as for the rest of a batch of points.
+ *
+ * \note The watcher is only available on Linux, where it is built into the
+ * `map_transformer_server` library.
+ */
+class MapWatcher {
+public:
+  /// Load a map and start watching its files.
+  /**
+   * \param[in] map_info_file The path of the map information file.
+   * \param[in] options How to load the map and report reloading it.
+   * \throws std::runtime_error if the map cannot be loaded, or its files cannot be watched.
+   */
+  explicit MapWatcher(std::string const &map_info_file, MapWatcherOptions options = {});
+
+  MapWatcher(MapWatcher const &) = delete;
+  MapWatcher & operator=(MapWatcher const &) = delete;
+
+  /// Stop watching, without waiting for a reload that has not started.
+  virtual ~MapWatcher();
+
+  /// Get the most recently loaded map. Safe to call from any thread.
+  std::shared_ptr<Transformer const> current() const;
+
+  /// Get the path of the map information file.
+  std::string const &map_info_file() const;
+
+private:
+  std::string _map_info_file;
+  MapWatcherOptions _options;
+  // Only accessed with std::atomic_load() and std::atomic_store()
+  std::shared_ptr<Transformer const> _current;
+  int _inotify{-1};
+  // Written to when the watcher stops, to wake its thread
+  int _stop_pipe[2]{-1, -1};
+  // The names of the map's files in each watched directory, by watch descriptor
+  std::map<int, std::set<std::string>> _watched;
+  std::thread _thread;
+
+  std::shared_ptr<Transformer const> load() const;
+  void watch_files(Transformer const &map);
+  void watch();
+  void reload();
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__MAP_WATCHER_HPP_
@@ -0,0 +1,40 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__OPENCV_IMAGE_SIZE_HPP_
+#define MAP_TRANSFORMER__OPENCV_IMAGE_SIZE_HPP_
+
+#include "map_transformer/image_size.hpp"
+
+#include <optional>
+#include <string>
+
+
+namespace map_transformer {
+
+/// Read the size of a map image by loading it with OpenCV.
+/**
+ * This is provided by the `map_transformer` library, which adds OpenCV support to
+ * `map_transformer_core`, and checks the sizes of images in any format OpenCV can read. Programs
+ * linked with the library use it by default; see \ref set_default_image_size_reader().
+ *
+ * \param path The path to the image file.
+ * \return The width and height of the image.
+ * \throw std::runtime_error if OpenCV cannot read the image.
+ */
+std::optional<Vector2D> read_image_size_with_opencv(std::string const &path);
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__OPENCV_IMAGE_SIZE_HPP_
@@ -0,0 +1,530 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__POINT_LOCATION_HPP_
+#define MAP_TRANSFORMER__POINT_LOCATION_HPP_
+
+#include "map_transformer/types.hpp"
+#include "map_transformer/visibility_control.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// The methods available for finding the triangle that contains a point.
+enum class SearchStrategy {
+  /// Test every triangle in turn. Needs no additional memory.
+  linear,
+  /// Binary search through a slab decomposition of the triangulation, in O(log n) time.
+  /**
+   * The slab decomposition can only be used when the triangles do not overlap in the map being
+   * searched. If they do, the linear search is used instead.
+   */
+  slab,
+  /// Search an adaptive quadtree over the triangles' bounding boxes.
+  /**
+   * The quadtree subdivides more finely where triangles are dense, so it suits maps where the
+   * density of correspondence points varies greatly. It can be used with any triangulation.
+   */
+  quadtree,
+  /// Look up the triangle in a uniform grid of cells over the triangulation.
+  /**
+   * The grid is fastest when the correspondence points are spread evenly over the map, and can be
+   * used with any triangulation. If the triangles are very large compared to the cells, the grid
+   * would use too much memory, and the linear search is used instead.
+   */
+  grid,
+  /// Walk across the triangulation from a nearby triangle towards the point.
+  /**
+   * The walk starts from a triangle recorded for a coarse grid of cells, or, in a batch, from the
+   * triangle found for the previous point if it was nearby, so it is fastest for a series of
+   * points along a path. It needs little memory, but can only be used when the triangles form a
+   * valid triangulation of a convex region, such as those built with
+   * \ref TriangulationMode::per_direction. If they do not, the linear search is used instead.
+   */
+  walk,
+  /// Choose a strategy to suit the triangulation when the map information is loaded.
+  /**
+   * The choice is based on the number of triangles, how evenly they are spread, and the memory
+   * available, and is checked by timing a sample of searches. See \ref select_search_strategy().
+   */
+  automatic,
+};
+
+/// Get the name of a search strategy.
+std::string to_string(SearchStrategy strategy);
+
+/// A search strategy chosen for a triangulation, and the reason it was chosen.
+struct SearchStrategySelection {
+  /// The strategy in use.
+  SearchStrategy strategy{SearchStrategy::linear};
+  /// A short explanation of the choice, for diagnostics.
+  std::string reason;
+};
+
+/// Choose the search strategy that best suits a triangulation.
+/**
+ * Triangulations with few triangles are searched linearly, as that is quickest without an index.
+ * Otherwise, triangulations whose density is roughly uniform use the grid, and those whose density
+ * varies greatly use the quadtree. An index is only chosen if its estimated size is within the
+ * memory limit.
+ *
+ * \param triangles The triangles to be searched.
+ * \param memory_limit The maximum number of bytes an index may use. If zero, one eighth of the
+ * available physical memory is used.
+ * \return The chosen strategy, never \ref SearchStrategy::automatic.
+ */
+SearchStrategySelection select_search_strategy(
+  TriangleGeometry const &triangles,
+  std::size_t memory_limit = 0);
+
+/// Order a set of triangles along a space-filling curve.
+/**
+ * The triangles are ordered by the position of their centroids along a Morton (Z-order) curve over
+ * their bounding box, so triangles that are close together in the map are usually close together
+ * in the order. Storing triangles and their data in this order means that searches for nearby
+ * points use nearby memory.
+ *
+ * \param triangles The triangles to order.
+ * \return The indices of the triangles, in curve order. Triangles at the same position on the
+ * curve are in ascending index order.
+ */
+std::vector<std::int32_t> spatial_order(TriangleGeometry const &triangles);
+
+/// Order a set of points along a space-filling curve.
+/**
+ * \param points The points to order.
+ * \return The indices of the points, in Morton curve order over their bounding box. Points at the
+ * same position on the curve are in ascending index order.
+ */
+std::vector<std::int32_t> spatial_order(CorrespondencePoints const &points);
+
+/// Test if a point is inside or on the boundary of a triangle.
+/**
+ * The test uses exact orientation predicates, so a point on an edge shared by two triangles is
+ * always found to be in both of them, whatever rounding the coordinates have, and the search
+ * strategies' rule of returning the lowest-indexed triangle gives every strategy the same answer.
+ * The triangle's vertices may be in either order. Infinite and NaN points are in no triangle.
+ */
+bool triangle_contains(TriangleVertices const &triangle, Point2D const &point);
+
+/// A slab decomposition of a triangulation, for point location in logarithmic time.
+/**
+ * The triangulation is divided into vertical slabs at the X coordinate of every vertex. No vertex
+ * lies inside a slab, so the triangles crossing a slab can be sorted from top to bottom, and the
+ * triangle containing a point is found by a binary search for the point's slab followed by a
+ * binary search within that slab.
+ *
+ * Sorting within a slab requires that the triangles do not overlap. This is checked when the index
+ * is built; if it does not hold, or if the decomposition would be too large, the index is marked
+ * as invalid and must not be used.
+ */
+class SlabIndex {
+public:
+  /// Build the index over a set of triangles.
+  void build(TriangleGeometry const &triangles);
+
+  /// Remove all triangles from the index.
+  void clear();
+
+  /// Check if the index was built successfully and can be searched.
+  bool valid() const;
+
+  /// Find the lowest-indexed triangle containing a point.
+  /**
+   * \param point The point to locate.
+   * \param triangles The triangles the index was built over.
+   * \return The index of the triangle containing the point, or -1 if no triangle contains it.
+   */
+  int find(Point2D const &point, TriangleGeometry const &triangles) const;
+
+  /// Get the approximate number of bytes used by the index.
+  std::size_t memory_usage() const;
+
+private:
+  bool _valid{false};
+  // Slab boundaries, in ascending order
+  std::vector<float> _boundaries;
+  // The triangles crossing slab k are _slab_triangles[_slab_offsets[k], _slab_offsets[k + 1])
+  std::vector<std::uint32_t> _slab_offsets;
+  std::vector<std::int32_t> _slab_triangles;
+  // Triangles with no width; they cross no slab so are always tested
+  std::vector<std::int32_t> _unsorted_triangles;
+
+  void add_slab_candidates(
+    std::size_t slab,
+    Point2D const &point,
+    TriangleGeometry const &triangles,
+    int &result) const;
+};
+
+/// An adaptive quadtree over the bounding boxes of a set of triangles.
+/**
+ * Each node of the tree is split into four equal quadrants until it holds no more than a given
+ * number of triangles, so the tree is deepest where triangles are smallest. A triangle is stored in
+ * every leaf its bounding box overlaps. The nodes are stored in one flat array, with the four
+ * children of a node adjacent to each other, and the triangle lists of all leaves in a second
+ * array, so searching the tree follows no pointers.
+ *
+ * As well as finding the triangle containing a point, the tree can find the triangles in a region.
+ */
+class QuadtreeIndex {
+public:
+  /// The default maximum number of triangles in a leaf.
+  static constexpr std::size_t DEFAULT_LEAF_CAPACITY = 8;
+  /// The maximum depth of the tree. Leaves at this depth may hold any number of triangles.
+  static constexpr int MAX_DEPTH = 24;
+
+  /// Build the tree over a set of triangles.
+  /**
+   * \param triangles The triangles to index.
+   * \param leaf_capacity Nodes holding more than this many triangles are split.
+   */
+  void build(TriangleGeometry const &triangles, std::size_t leaf_capacity = DEFAULT_LEAF_CAPACITY);
+
+  /// Remove all triangles from the tree.
+  void clear();
+
+  /// Find the lowest-indexed triangle containing a point.
+  /**
+   * \param point The point to locate.
+   * \param triangles The triangles the tree was built over.
+   * \return The index of the triangle containing the point, or -1 if no triangle contains it.
+   */
+  int find(Point2D const &point, TriangleGeometry const &triangles) const;
+
+  /// Find the lowest-indexed triangle containing each of a batch of points.
+  /**
+   * The leaves and triangles needed for later points are prefetched while earlier points are
+   * tested, so that fewer searches wait on memory.
+   *
+   * \param points The points to locate.
+   * \param count The number of points.
+   * \param triangles The triangles the tree was built over.
+   * \param[out] results For each point, the index of the triangle containing it, or -1.
+   */
+  void find(
+    Point2D const *points,
+    std::size_t count,
+    TriangleGeometry const &triangles,
+    int *results) const;
+
+  /// Find the triangles whose bounding boxes overlap a rectangular region.
+  /**
+   * \param top_left The minimum corner of the region.
+   * \param bottom_right The maximum corner of the region.
+   * \param[out] result The indices of the triangles found, in ascending order.
+   */
+  void find_in_region(
+    Point2D const &top_left,
+    Point2D const &bottom_right,
+    std::vector<int> &result) const;
+
+  /// Get the number of nodes in the tree.
+  std::size_t node_count() const;
+
+  /// Get the approximate number of bytes used by the tree.
+  std::size_t memory_usage() const;
+
+private:
+  struct Node {
+    float min_x, min_y, max_x, max_y;
+    // Index of the first of the four children, or -1 for a leaf
+    std::int32_t first_child;
+    // The triangles in a leaf are _items[first_item, first_item + item_count)
+    std::uint32_t first_item;
+    std::uint32_t item_count;
+  };
+
+  std::vector<Node> _nodes;
+  std::vector<std::int32_t> _items;
+  // Bounding box of each triangle, as min x, min y, max x, max y
+  std::vector<std::array<float, 4>> _bounds;
+
+  // Find the leaf containing a point, or -1 if the point is outside the tree
+  std::int32_t leaf(Point2D const &point) const;
+  int find_in_leaf(
+    std::int32_t leaf,
+    Point2D const &point,
+    TriangleGeometry const &triangles) const;
+};
+
+/// A uniform grid of cells over a set of triangles.
+/**
+ * The grid has roughly as many cells as there are triangles. Each cell lists, in ascending order,
+ * the triangles whose bounding boxes overlap it, so finding the triangle containing a point takes
+ * constant time when the triangles are of similar sizes.
+ *
+ * If the lists would be too large, the grid is marked as invalid and must not be used.
+ */
+class GridIndex {
+public:
+  /// Build the grid over a set of triangles.
+  void build(TriangleGeometry const &triangles);
+
+  /// Remove all triangles from the grid.
+  void clear();
+
+  /// Check if the grid was built successfully and can be searched.
+  bool valid() const;
+
+  /// Find the lowest-indexed triangle containing a point.
+  /**
+   * \param point The point to locate.
+   * \param triangles The triangles the grid was built over.
+   * \return The index of the triangle containing the point, or -1 if no triangle contains it.
+   */
+  int find(Point2D const &point, TriangleGeometry const &triangles) const;
+
+  /// Find the lowest-indexed triangle containing each of a batch of points.
+  /**
+   * The cells and triangles needed for later points are prefetched while earlier points are
+   * tested, so that fewer searches wait on memory.
+   *
+   * \param points The points to locate.
+   * \param count The number of points.
+   * \param triangles The triangles the grid was built over.
+   * \param[out] results For each point, the index of the triangle containing it, or -1.
+   */
+  void find(
+    Point2D const *points,
+    std::size_t count,
+    TriangleGeometry const &triangles,
+    int *results) const;
+
+  /// Get the approximate number of bytes used by the grid.
+  std::size_t memory_usage() const;
+
+  /// Write the grid to a binary stream, in the host's byte order.
+  void write(std::ostream &out) const;
+
+  /// Read a grid written by \ref write().
+  /**
+   * \param in The stream to read from.
+   * \param[in,out] remaining The number of bytes left in the stream; reduced by those read.
+   * \param triangle_count The number of triangles the grid was built over.
+   * \return False if the stream is too short or does not hold a grid over that many triangles, in
+   * which case the grid is cleared.
+   */
+  bool read(std::istream &in, std::uint64_t &remaining, std::size_t triangle_count);
+
+private:
+  bool _valid{false};
+  // Position of the grid, and the number of cells per unit distance
+  float _min_x{0}, _min_y{0}, _max_x{0}, _max_y{0};
+  float _scale_x{0}, _scale_y{0};
+  std::int32_t _columns{0}, _rows{0};
+  // The triangles overlapping cell (c, r) are
+  // _cell_triangles[_cell_offsets[r * _columns + c], _cell_offsets[r * _columns + c + 1])
+  std::vector<std::uint32_t> _cell_offsets;
+  std::vector<std::int32_t> _cell_triangles;
+
+  // Find the cell containing a point, or the number of cells if the point is outside the grid
+  std::size_t cell(Point2D const &point) const;
+  int find_in_cell(std::size_t cell, Point2D const &point, TriangleGeometry const &triangles) const;
+};
+
+/// Finds the triangle containing a point by walking across a triangulation.
+/**
+ * Each step of the walk moves to the neighbouring triangle across an edge that the point is
+ * beyond, until the triangle containing the point is reached. If the point is beyond an edge on the
+ * boundary of the triangulation, it is outside the triangulation.
+ *
+ * The index can only be built if the triangles all have the same orientation, each edge is shared
+ * by at most two triangles, and together they cover a convex region with no holes. Otherwise it is
+ * marked as invalid and must not be used.
+ */
+class WalkIndex {
+public:
+  /// Build the index over a set of triangles.
+  void build(TriangleGeometry const &triangles);
+
+  /// Remove all triangles from the index.
+  void clear();
+
+  /// Check if the index was built successfully and can be searched.
+  bool valid() const;
+
+  /// Find the lowest-indexed triangle containing a point.
+  /**
+   * \param point The point to locate.
+   * \param triangles The triangles the index was built over.
+   * \return The index of the triangle containing the point, or -1 if no triangle contains it.
+   */
+  int find(Point2D const &point, TriangleGeometry const &triangles) const;
+
+  /// Find the lowest-indexed triangle containing each of a batch of points.
+  /**
+   * Each walk starts from the triangle found for the previous point if the two points are in the
+   * same or neighbouring cells.
+   *
+   * \param points The points to locate.
+   * \param count The number of points.
+   * \param triangles The triangles the index was built over.
+   * \param[out] results For each point, the index of the triangle containing it, or -1.
+   */
+  void find(
+    Point2D const *points,
+    std::size_t count,
+    TriangleGeometry const &triangles,
+    int *results) const;
+
+  /// Get the approximate number of bytes used by the index.
+  std::size_t memory_usage() const;
+
+private:
+  bool _valid{false};
+  // One if the triangles are counterclockwise, minus one if they are clockwise
+  double _orientation{1};
+  // The triangle across the edge opposite each vertex of each triangle, or -1 on the boundary
+  std::vector<std::array<std::int32_t, 3>> _neighbours;
+  // A coarse grid of cells, recording a triangle near the centre of each to start walks from
+  float _min_x{0}, _min_y{0}, _max_x{0}, _max_y{0};
+  float _scale_x{0}, _scale_y{0};
+  std::int32_t _columns{0}, _rows{0};
+  std::vector<std::int32_t> _cell_starts;
+
+  // Walk from a triangle towards a point. Returns the triangle containing the point, -1 if the
+  // point is outside the triangulation, or -2 if the walk did not finish. The last triangle
+  // visited is stored in last.
+  int walk(
+    std::int32_t start,
+    Point2D const &point,
+    TriangleGeometry const &triangles,
+    std::int32_t &last) const;
+  // Find the lowest-indexed of the triangles around a point on an edge or vertex of a triangle
+  int lowest_containing(
+    int found,
+    Point2D const &point,
+    TriangleGeometry const &triangles) const;
+  int locate(
+    std::int32_t start,
+    Point2D const &point,
+    TriangleGeometry const &triangles,
+    std::int32_t &last) const;
+  bool inside_bounds(Point2D const &point) const;
+};
+
+/// Finds correspondence points by their exact coordinates in constant time.
+class CorrespondencePointIndex {
+public:
+  /// Index a list of correspondence points.
+  void build(CorrespondencePoints const &points);
+
+  /// Remove all points from the index.
+  void clear();
+
+  /// Find a correspondence point.
+  /**
+   * \return The lowest index of a correspondence point equal to the given point, or -1 if there
+   * is no such correspondence point.
+   */
+  int find(Point2D const &point) const;
+
+private:
+  std::unordered_map<std::uint64_t, int> _indices;
+
+  static std::uint64_t key(Point2D const &point);
+};
+
+/// Finds the triangle of a triangulation that contains a point, using a chosen search strategy.
+/**
+ * All strategies give identical results: when a point is on the boundary between triangles, the
+ * triangle with the lowest index is chosen.
+ */
+class PointLocator {
+public:
+  /// Prepare to search a set of triangles using a given strategy.
+  /**
+   * If the strategy cannot be used with these triangles, the linear search is used instead.
+   *
+   * If the strategy is \ref SearchStrategy::automatic, one is chosen using
+   * \ref select_search_strategy(). The chosen index is then timed against the linear search on a
+   * sample of points, and the linear search is used if it is faster.
+   *
+   * \param triangles The triangles to search.
+   * \param strategy The search strategy to use.
+   * \param memory_limit The memory limit for an automatically-chosen index, as for
+   * \ref select_search_strategy().
+   * \param overlapping True if the triangles are already known to overlap, such as when some are
+   * folded over, so that indexes that need a valid triangulation are not attempted.
+   */
+  void build(
+    TriangleGeometry triangles,
+    SearchStrategy strategy,
+    std::size_t memory_limit = 0,
+    bool overlapping = false);
+
+  /// Remove all triangles.
+  void clear();
+
+  /// Find the lowest-indexed triangle containing a point.
+  /**
+   * \return The index of the triangle containing the point, or -1 if no triangle contains it.
+   */
+  int find(Point2D const &point) const;
+
+  /// Find the lowest-indexed triangle containing each of a batch of points.
+  /**
+   * The results are the same as calling \ref find() for each point, but the grid and quadtree
+   * search large batches faster by prefetching the data for later points.
+   *
+   * \param points The points to locate.
+   * \param count The number of points.
+   * \param[out] results For each point, the index of the triangle containing it, or -1.
+   */
+  void find(Point2D const *points, std::size_t count, int *results) const;
+
+  /// Find the triangles whose bounding boxes overlap a rectangular region.
+  /**
+   * The quadtree is used if it has been built; otherwise every triangle is tested.
+   *
+   * \param top_left The minimum corner of the region.
+   * \param bottom_right The maximum corner of the region.
+   * \return The indices of the triangles found, in ascending order.
+   */
+  std::vector<int> find_in_region(Point2D const &top_left, Point2D const &bottom_right) const;
+
+  /// Get the search strategy actually in use.
+  SearchStrategy strategy() const;
+
+  /// Get the search strategy actually in use and the reason it is used.
+  SearchStrategySelection const &selection() const;
+
+  /// Get the triangles being searched.
+  TriangleGeometry const &triangles() const;
+
+private:
+  SearchStrategySelection _selection;
+  TriangleGeometry _triangles;
+  SlabIndex _slab_index;
+  QuadtreeIndex _quadtree;
+  GridIndex _grid;
+  WalkIndex _walk;
+
+  bool build_index(SearchStrategy strategy);
+  bool linear_is_faster() const;
+  int find_linear(Point2D const &point) const;
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__POINT_LOCATION_HPP_
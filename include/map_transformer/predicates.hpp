@@ -0,0 +1,122 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__PREDICATES_HPP_
+#define MAP_TRANSFORMER__PREDICATES_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <cmath>
+#include <limits>
+
+
+namespace map_transformer {
+
+/// Geometric predicates whose signs are always exact.
+/**
+ * The predicates first evaluate their determinant in double precision along with a bound on its
+ * rounding error. Only if the error could change the sign of the result, which happens when the
+ * points are collinear or cocircular or very nearly so, is the determinant evaluated again using
+ * exact arbitrary-precision arithmetic. This follows J. R. Shewchuk, "Adaptive Precision
+ * Floating-Point Arithmetic and Fast Robust Geometric Predicates", 1997.
+ */
+namespace predicates {
+
+// Half of the distance between 1 and the next larger double
+constexpr double EPSILON = std::numeric_limits<double>::epsilon() / 2;
+constexpr double ORIENT2D_ERROR_BOUND = (3.0 + 16.0 * EPSILON) * EPSILON;
+constexpr double INCIRCLE_ERROR_BOUND = (10.0 + 96.0 * EPSILON) * EPSILON;
+
+double orient2d_exact(Point2D const &a, Point2D const &b, Point2D const &c);
+double incircle_exact(Point2D const &a, Point2D const &b, Point2D const &c, Point2D const &d);
+
+}  // namespace predicates
+
+/// Find the orientation of three points.
+/**
+ * \return A positive value if a, b and c are in counterclockwise order when the Y axis points up,
+ * a negative value if they are in clockwise order, and zero if they are collinear. The sign is
+ * exact; the magnitude is approximately twice the area of the triangle abc.
+ */
+inline double orient2d(Point2D const &a, Point2D const &b, Point2D const &c) {
+  double left =
+    (static_cast<double>(a.first) - c.first) * (static_cast<double>(b.second) - c.second);
+  double right =
+    (static_cast<double>(a.second) - c.second) * (static_cast<double>(b.first) - c.first);
+  double det = left - right;
+
+  // If the two products have different signs, the sign of the difference cannot be wrong
+  double sum;
+  if (left > 0) {
+    if (right <= 0) {
+      return det;
+    }
+    sum = left + right;
+  } else if (left < 0) {
+    if (right >= 0) {
+      return det;
+    }
+    sum = -left - right;
+  } else {
+    return det;
+  }
+
+  double error_bound = predicates::ORIENT2D_ERROR_BOUND * sum;
+  if (det >= error_bound || -det >= error_bound) {
+    return det;
+  }
+  return predicates::orient2d_exact(a, b, c);
+}
+
+/// Find whether a point is inside the circle through three other points.
+/**
+ * \param a, b, c Three points, in counterclockwise order as defined by \ref orient2d().
+ * \param d The point to test.
+ * \return A positive value if d is inside the circle through a, b and c, a negative value if it
+ * is outside, and zero if the four points are cocircular. The sign is exact. If a, b and c are
+ * in clockwise order, the sign is reversed.
+ */
+inline double incircle(Point2D const &a, Point2D const &b, Point2D const &c, Point2D const &d) {
+  double adx = static_cast<double>(a.first) - d.first;
+  double bdx = static_cast<double>(b.first) - d.first;
+  double cdx = static_cast<double>(c.first) - d.first;
+  double ady = static_cast<double>(a.second) - d.second;
+  double bdy = static_cast<double>(b.second) - d.second;
+  double cdy = static_cast<double>(c.second) - d.second;
+
+  double bdxcdy = bdx * cdy;
+  double cdxbdy = cdx * bdy;
+  double alift = adx * adx + ady * ady;
+  double cdxady = cdx * ady;
+  double adxcdy = adx * cdy;
+  double blift = bdx * bdx + bdy * bdy;
+  double adxbdy = adx * bdy;
+  double bdxady = bdx * ady;
+  double clift = cdx * cdx + cdy * cdy;
+
+  double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+  double permanent =
+    (std::abs(bdxcdy) + std::abs(cdxbdy)) * alift +
+    (std::abs(cdxady) + std::abs(adxcdy)) * blift +
+    (std::abs(adxbdy) + std::abs(bdxady)) * clift;
+  double error_bound = predicates::INCIRCLE_ERROR_BOUND * permanent;
+  if (det > error_bound || -det > error_bound) {
+    return det;
+  }
+  return predicates::incircle_exact(a, b, c, d);
+}
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__PREDICATES_HPP_
@@ -0,0 +1,122 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__QUERY_CACHE_HPP_
+#define MAP_TRANSFORMER__QUERY_CACHE_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// Counts of how a query cache has been used.
+struct QueryCacheStatistics {
+  /// The number of points whose results were found in the cache.
+  std::uint64_t hits{0};
+  /// The number of points whose results were not found in the cache.
+  std::uint64_t misses{0};
+  /// The number of results removed from the cache to make room for others.
+  std::uint64_t evictions{0};
+  /// The number of results in the cache.
+  std::size_t size{0};
+  /// The maximum number of results the cache can hold.
+  std::size_t capacity{0};
+
+  /// The fraction of points looked up whose results were found, or zero if none have been.
+  double hit_rate() const;
+};
+
+/// A bounded cache of the results of transforming points, safe to use from several threads.
+/**
+ * Points are matched by the exact bits of their coordinates, so a result is only reused for a point
+ * that would be transformed to an identical result. The cache is split into shards, each with its
+ * own lock and its own least-recently-used list, so that threads looking up different points
+ * rarely wait for each other. When a shard is full, the result used least recently in it is
+ * removed.
+ *
+ * Copying a cache copies its capacity and number of shards, but not its contents or statistics.
+ */
+class QueryCache {
+public:
+  /// Create a cache.
+  /**
+   * \param capacity The maximum number of results to hold. If zero, the cache is disabled and
+   * holds nothing.
+   * \param shard_count The number of shards to split the cache into. If zero, a default suited to
+   * the capacity is used.
+   */
+  explicit QueryCache(std::size_t capacity = 0, std::size_t shard_count = 0);
+
+  QueryCache(QueryCache const &other);
+  QueryCache & operator=(QueryCache const &other);
+
+  /// Check if the cache can hold any results.
+  bool enabled() const;
+
+  /// Get the maximum number of results the cache can hold.
+  std::size_t capacity() const;
+
+  /// Look up the result for a point.
+  /**
+   * \param point The point to look up.
+   * \param[out] result The cached result, if there is one.
+   * \return True if a result was found.
+   */
+  bool find(Point2D const &point, Point2D &result);
+
+  /// Add the result for a point to the cache, replacing any result already held for it.
+  void insert(Point2D const &point, Point2D const &result);
+
+  /// Remove every result from the cache, keeping the statistics.
+  void clear();
+
+  /// Get the statistics summed over every shard.
+  QueryCacheStatistics statistics() const;
+
+  /// Set the hit, miss and eviction counts back to zero.
+  void reset_statistics();
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    std::size_t capacity{0};
+    // The most recently used results are at the front
+    std::list<std::pair<std::uint64_t, Point2D>> entries;
+    std::unordered_map<std::uint64_t,
+      std::list<std::pair<std::uint64_t, Point2D>>::iterator> index;
+    std::uint64_t hits{0};
+    std::uint64_t misses{0};
+    std::uint64_t evictions{0};
+  };
+
+  std::size_t _capacity{0};
+  std::vector<std::unique_ptr<Shard>> _shards;
+
+  void create_shards(std::size_t shard_count);
+  Shard & shard(std::uint64_t key);
+  static std::uint64_t key(Point2D const &point);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__QUERY_CACHE_HPP_
@@ -0,0 +1,180 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__SHARED_MEMORY_CLIENT_HPP_
+#define MAP_TRANSFORMER__SHARED_MEMORY_CLIENT_HPP_
+
+#include "map_transformer/transform_protocol.hpp"
+#include "map_transformer/types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// Transforms points using a \ref TransformServer through memory shared with it.
+/**
+ * The client opens a channel through the server's socket: a ring of points in memory that both
+ * processes map. Points are written straight into the ring, the server transforms them in place,
+ * and the results are read straight out of it, so no data passes through the socket. The two
+ * processes poll the channel briefly before sleeping on a futex, so a request that arrives soon
+ * after the previous one is picked up without a system call.
+ *
+ * Points can be written into the ring by the caller with \ref reserve(), \ref submit() and
+ * \ref wait(), which allow several requests to be in the channel at once, or copied in and out by
+ * the same `to_ref()` and `to_robot()` functions as \ref TransformClient. Results are identical
+ * to those of the \ref Transformer the server loaded.
+ *
+ * A client must not be used by several threads at once; give each thread its own client.
+ */
+class SharedMemoryClient {
+public:
+  /// The number of points a channel holds unless another capacity is given.
+  static constexpr std::uint32_t DEFAULT_CAPACITY = 1 << 20;
+
+  /// Open a channel to a server.
+  /**
+   * \param[in] socket_path The path of the server's Unix domain socket.
+   * \param[in] map The index of the map to use, in the order the server loaded its maps.
+   * \param[in] capacity The number of points the channel holds.
+   * \throws std::invalid_argument if the capacity is zero or more than
+   * \ref protocol::MAX_CHANNEL_POINTS.
+   * \throws std::runtime_error if the server cannot be connected to, has no map with the given
+   * index, or cannot create the channel.
+   */
+  explicit SharedMemoryClient(
+    std::string const &socket_path,
+    std::uint32_t map = 0,
+    std::uint32_t capacity = DEFAULT_CAPACITY);
+
+  SharedMemoryClient(SharedMemoryClient const &) = delete;
+  SharedMemoryClient & operator=(SharedMemoryClient const &) = delete;
+
+  /// Close the channel, without waiting for requests in it.
+  virtual ~SharedMemoryClient();
+
+  /// Get the number of points the channel holds.
+  std::uint32_t capacity() const;
+
+  /// Get space in the channel for the points of the next request, to be written by the caller.
+  /**
+   * Space used by requests that have been waited for is reused. Reserving again before submitting
+   * replaces the earlier reservation.
+   *
+   * \param[in] count The number of points in the request.
+   * \return The space for the points.
+   * \throws std::invalid_argument if count is zero or more than the channel's capacity.
+   * \throws std::logic_error if there is not enough space that is not used by requests that have
+   * not been waited for.
+   */
+  Point2D * reserve(std::size_t count);
+
+  /// Submit the points written to the space last reserved, for the server to transform.
+  /**
+   * \param[in] operation Whether to transform the points to the reference map or the robot map.
+   * \return The request's number, to pass to \ref wait().
+   * \throws std::logic_error if nothing has been reserved, or \ref protocol::CHANNEL_SLOTS
+   * requests have been submitted and not waited for.
+   */
+  std::uint64_t submit(protocol::Operation operation);
+
+  /// Wait for the server to transform the points of a request.
+  /**
+   * Requests are transformed in the order they are submitted, so waiting for one also waits for
+   * all those submitted before it.
+   *
+   * \param[in] request The number returned by \ref submit().
+   * \return The transformed points, which replace the submitted points in the channel. They are
+   * valid until the next call to \ref reserve().
+   * \throws std::logic_error if the request has not been submitted.
+   * \throws std::runtime_error if the server failed to transform the points, including if it has
+   * no map with the index this client was created with, or has stopped.
+   */
+  Point2D const * wait(std::uint64_t request);
+
+  /// Transform a point in the robot map to its equivalent point in the reference map.
+  /**
+   * \throws std::runtime_error if the server fails.
+   * \throws std::logic_error if a request submitted with \ref submit() has not been waited for.
+   * \sa Transformer::to_ref()
+   */
+  Point2D to_ref(Point2D const &point);
+
+  /// Transform a point in the reference map to its equivalent point in the robot map.
+  /**
+   * \sa to_ref(Point2D const &)
+   */
+  Point2D to_robot(Point2D const &point);
+
+  /// Transform a batch of points in the robot map to the reference map.
+  /**
+   * The points are copied into the channel and the results out of it. Batches larger than the
+   * channel are sent as several requests. `results` may be the same array as `points`.
+   *
+   * \throws std::runtime_error if the server fails.
+   * \throws std::logic_error if a request submitted with \ref submit() has not been waited for.
+   */
+  void to_ref(Point2D const *points, std::size_t count, Point2D *results);
+
+  /// Transform a batch of points in the robot map to the reference map.
+  std::vector<Point2D> to_ref(std::vector<Point2D> const &points);
+
+  /// Transform a batch of points in the reference map to the robot map.
+  /**
+   * \sa to_ref(Point2D const *, std::size_t, Point2D *)
+   */
+  void to_robot(Point2D const *points, std::size_t count, Point2D *results);
+
+  /// Transform a batch of points in the reference map to the robot map.
+  std::vector<Point2D> to_robot(std::vector<Point2D> const &points);
+
+private:
+  // A submitted request, and the position in the ring just past its points
+  struct Submitted {
+    std::uint64_t request;
+    std::uint64_t end;
+  };
+
+  int _socket{-1};
+  std::uint32_t _map;
+  std::uint32_t _capacity;
+  protocol::ChannelHeader *_channel{nullptr};
+  Point2D *_points{nullptr};
+
+  // Positions in the ring only increase, and are taken modulo the capacity to find the points.
+  // Points from _tail up to _head belong to submitted requests.
+  std::uint64_t _head{0};
+  std::uint64_t _tail{0};
+  std::deque<Submitted> _submitted_requests;
+  std::uint64_t _submitted{0};
+  // Every request before this one has been waited for
+  std::uint64_t _waited{0};
+  bool _reserved{false};
+  std::uint64_t _reserved_start{0};
+  std::uint32_t _reserved_count{0};
+
+  void transform(
+    protocol::Operation operation,
+    Point2D const *points,
+    std::size_t count,
+    Point2D *results);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__SHARED_MEMORY_CLIENT_HPP_
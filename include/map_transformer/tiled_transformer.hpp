@@ -0,0 +1,196 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TILED_TRANSFORMER_HPP_
+#define MAP_TRANSFORMER__TILED_TRANSFORMER_HPP_
+
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/transformer.hpp"
+#include "map_transformer/visibility_control.h"
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// One spatial tile of a tiled triangulation.
+/**
+ * A tile covers a square area of one map (the query frame) and holds everything needed to
+ * transform points inside that area: the correspondence points that lie in it and every triangle
+ * whose bounding box overlaps it, along with the affine transforms of those triangles and a grid
+ * index over them. Triangles that cross a tile border are stored in every tile they touch, so no
+ * query needs to look beyond the tile its point falls in.
+ */
+struct Tile {
+  /// Indices of the correspondence points in this tile, in ascending order.
+  std::vector<int> corr_point_ids;
+  /// The correspondence points in this tile, in the query frame.
+  CorrespondencePoints corr_points;
+  /// The matching correspondence points in the other map.
+  CorrespondencePoints corr_point_targets;
+  /// Indices of the triangles overlapping this tile, in the order the transformer stores them.
+  std::vector<int> triangle_ids;
+  /// Vertices of each triangle in the query frame.
+  TriangleGeometry triangle_vertices;
+  /// Affine transform of each triangle into the other map, as a row-major 2x3 matrix.
+  std::vector<AffineTransform> transforms;
+  /// Finds the triangle containing a point; if it is not valid, the triangles are tested in turn.
+  GridIndex index;
+};
+
+/// Transforms points using a triangulation that has been split into separately-stored tiles.
+/**
+ * Large maps with many correspondence points produce triangulations that may not fit in memory
+ * on small devices. A \ref TiledTransformer loads tiles from disk only when a query falls inside
+ * them, keeping at most a fixed number of tiles resident and evicting the least-recently used
+ * tile when that limit is reached.
+ *
+ * The tiles are produced from a loaded \ref Transformer by \ref TiledTransformer::write_tiles().
+ * Results are identical to those of the \ref Transformer the tiles were written from, including
+ * for points on tile borders.
+ */
+class TiledTransformer {
+public:
+  /// Write the triangulation of a loaded transformer to a directory as a set of tiles.
+  /**
+   * A manifest file, `tiles.yaml`, is written describing the maps, the tile grids and the
+   * non-empty tiles in each, along with one binary file per non-empty tile for each transform
+   * direction. Tile files use the host's byte order.
+   *
+   * \param[in] transformer The transformer to write tiles from. Must have map information loaded.
+   * \param[in] directory The directory to write the tiles to. It will be created if necessary.
+   * \param[in] tile_size The width and height of each tile, in map units.
+   * \throws std::LogicError if the transformer has no loaded map information.
+   * \throws std::InvalidArgument if the tile size is not finite and positive, or is so small that
+   * a grid would have more than 2^24 tiles.
+   * \throws std::RuntimeError if the tiles cannot be written.
+   */
+  static void write_tiles(
+    Transformer const &transformer,
+    std::string const &directory,
+    float tile_size);
+
+  /// Create a new tiled transformer using the tiles in a directory.
+  /**
+   * Only the manifest is read on construction; tiles are read as they are needed.
+   *
+   * \param[in] directory The directory containing the tiles, as written by \ref write_tiles().
+   * \param[in] max_resident_tiles The maximum number of tiles to keep in memory at once.
+   * \throws std::RuntimeError if the manifest cannot be read, or its tile size, grids or lists of
+   * tiles are not valid.
+   * \throws std::InvalidArgument if max_resident_tiles is zero.
+   */
+  explicit TiledTransformer(std::string const &directory, std::size_t max_resident_tiles = 64);
+
+  virtual ~TiledTransformer() {};
+
+  /// Get the name of the reference map.
+  std::string ref_map_name() const;
+
+  /// Get the name of the robot map.
+  std::string robot_map_name() const;
+
+  /// Get the width and height of each tile, in map units.
+  float tile_size() const;
+
+  /// Transform a point in the robot map to its equivalent point in the reference map.
+  /**
+   * \param point The point in the robot map to transform.
+   * \return The transformed point in the reference map.
+   * \throw std::RuntimeError if a tile cannot be read.
+   * \sa Transformer::to_ref()
+   */
+  Point2D to_ref(Point2D const &point) const;
+
+  /// Transform a point in the reference map to its equivalent point in the robot map.
+  /**
+   * \param point The point in the reference map to transform.
+   * \return The transformed point in the robot map.
+   * \throw std::RuntimeError if a tile cannot be read.
+   * \sa Transformer::to_robot()
+   */
+  Point2D to_robot(Point2D const &point) const;
+
+  /// Load the tiles needed to transform points in a region of the robot map to the reference map.
+  /**
+   * Tiles beyond the resident tile limit are not loaded.
+   *
+   * \param top_left The minimum corner of the region, in the robot map.
+   * \param bottom_right The maximum corner of the region, in the robot map.
+   * \throw std::RuntimeError if a tile cannot be read.
+   */
+  void preload_to_ref(Point2D const &top_left, Point2D const &bottom_right) const;
+
+  /// Load the tiles needed to transform points in a region of the reference map to the robot map.
+  /**
+   * Tiles beyond the resident tile limit are not loaded.
+   *
+   * \param top_left The minimum corner of the region, in the reference map.
+   * \param bottom_right The maximum corner of the region, in the reference map.
+   * \throw std::RuntimeError if a tile cannot be read.
+   */
+  void preload_to_robot(Point2D const &top_left, Point2D const &bottom_right) const;
+
+  /// Get the number of tiles currently held in memory.
+  std::size_t resident_tile_count() const;
+
+  /// Release all tiles held in memory.
+  void evict_all() const;
+
+private:
+  // The layout of the tiles for one transform direction
+  struct TileGrid {
+    std::string prefix;
+    Point2D origin;
+    int columns;
+    int rows;
+    // The column and row of each non-empty tile, which has a tile file
+    std::set<std::pair<int, int>> tiles;
+  };
+  // Identifies one tile: grid index (0 = to_ref, 1 = to_robot), column, row
+  using TileKey = std::tuple<int, int, int>;
+
+  std::string _directory;
+  std::size_t _max_resident_tiles;
+  float _tile_size;
+  TileGrid _grids[2];
+  // Holds the map names and the relative map transform; has no triangulation
+  Transformer _maps;
+
+  // Resident tiles, most-recently used first
+  mutable std::mutex _tiles_mutex;
+  mutable std::list<TileKey> _lru;
+  mutable std::map<
+    TileKey,
+    std::pair<std::shared_ptr<const Tile>, std::list<TileKey>::iterator>> _resident;
+
+  std::shared_ptr<const Tile> tile_at(int grid, Point2D const &point) const;
+  std::shared_ptr<const Tile> fetch_tile(TileKey const &key) const;
+  void preload(int grid, Point2D const &top_left, Point2D const &bottom_right) const;
+  static Point2D transform_in_tile(Tile const &tile, Point2D const &point, bool &found);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TILED_TRANSFORMER_HPP_
@@ -0,0 +1,112 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TRANSFORM_CLIENT_HPP_
+#define MAP_TRANSFORMER__TRANSFORM_CLIENT_HPP_
+
+#include "map_transformer/transform_protocol.hpp"
+#include "map_transformer/types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// Transforms points using a map loaded by a \ref TransformServer in another process.
+/**
+ * The client holds no map information of its own, so it is cheap to create and needs only this
+ * small library. Results are identical to those of the \ref Transformer the server loaded.
+ *
+ * A client has a single connection and must not be used by several threads at once; give each
+ * thread its own client. Small requests from many clients are combined into batches by the
+ * server, so there is no need to collect points into batches to get good throughput.
+ *
+ * Clients doing bulk work that is not urgent should use \ref protocol::Lane::throughput, so that
+ * they do not delay clients that need answers quickly.
+ */
+class TransformClient {
+public:
+  /// Connect to a server.
+  /**
+   * \param[in] socket_path The path of the server's Unix domain socket.
+   * \param[in] map The index of the map to use, in the order the server loaded its maps.
+   * \param[in] lane The lane of the server to send requests to.
+   * \throws std::runtime_error if the server cannot be connected to.
+   */
+  explicit TransformClient(
+    std::string const &socket_path,
+    std::uint32_t map = 0,
+    protocol::Lane lane = protocol::Lane::latency);
+
+  TransformClient(TransformClient const &) = delete;
+  TransformClient & operator=(TransformClient const &) = delete;
+
+  virtual ~TransformClient();
+
+  /// Transform a point in the robot map to its equivalent point in the reference map.
+  /**
+   * \throws std::runtime_error if the server fails or cannot be reached, including if it has no
+   * map with the index this client was created with, or refuses the request because too many
+   * points are waiting in the client's lane.
+   * \sa Transformer::to_ref()
+   */
+  Point2D to_ref(Point2D const &point);
+
+  /// Transform a point in the reference map to its equivalent point in the robot map.
+  /**
+   * \throws std::runtime_error if the server fails or cannot be reached.
+   * \sa Transformer::to_robot()
+   */
+  Point2D to_robot(Point2D const &point);
+
+  /// Transform a batch of points in the robot map to the reference map.
+  /**
+   * Batches larger than \ref protocol::MAX_POINTS_PER_REQUEST are sent as several requests.
+   * `results` may be the same array as `points`.
+   *
+   * \throws std::runtime_error if the server fails or cannot be reached.
+   */
+  void to_ref(Point2D const *points, std::size_t count, Point2D *results);
+
+  /// Transform a batch of points in the robot map to the reference map.
+  std::vector<Point2D> to_ref(std::vector<Point2D> const &points);
+
+  /// Transform a batch of points in the reference map to the robot map.
+  /**
+   * \sa to_ref(Point2D const *, std::size_t, Point2D *)
+   */
+  void to_robot(Point2D const *points, std::size_t count, Point2D *results);
+
+  /// Transform a batch of points in the reference map to the robot map.
+  std::vector<Point2D> to_robot(std::vector<Point2D> const &points);
+
+private:
+  int _socket{-1};
+  std::uint32_t _map;
+  protocol::Lane _lane;
+  std::uint32_t _next_id{0};
+
+  void transform(
+    protocol::Operation operation,
+    Point2D const *points,
+    std::size_t count,
+    Point2D *results);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TRANSFORM_CLIENT_HPP_
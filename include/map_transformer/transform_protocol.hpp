@@ -0,0 +1,157 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TRANSFORM_PROTOCOL_HPP_
+#define MAP_TRANSFORMER__TRANSFORM_PROTOCOL_HPP_
+
+#include "map_transformer/types.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace map_transformer {
+
+/// The messages exchanged by \ref TransformServer and \ref TransformClient.
+/**
+ * Messages are sent over a Unix domain stream socket, so the client and server are always on the
+ * same machine and every value is in its byte order. Each request is a \ref RequestHeader followed
+ * by `count` points, each a pair of 32-bit floating point numbers, and is answered by a
+ * \ref ResponseHeader followed by the same number of transformed points if the request succeeded.
+ * Requests on one connection are answered in the order they are sent.
+ *
+ * A client may instead ask for a shared memory channel with \ref Operation::open_channel. The
+ * response then carries a memory file descriptor holding a \ref ChannelHeader followed by a ring
+ * of points, and the connection is used for nothing else: requests are placed in the ring's slots,
+ * and a thread in the server transforms their points in place.
+ */
+namespace protocol {
+
+/// Identifies a request, and the version of the protocol it uses.
+constexpr std::uint32_t REQUEST_MAGIC = 0x3251544d;  // "MTQ2"
+
+/// The largest number of points a single request may carry.
+constexpr std::uint32_t MAX_POINTS_PER_REQUEST = 1 << 20;
+
+/// What a request asks the server to do.
+enum class Operation : std::uint32_t {
+  /// Transform points from the robot map to the reference map.
+  to_ref = 0,
+  /// Transform points from the reference map to the robot map.
+  to_robot = 1,
+  /// Open a shared memory channel with room for `count` points, which are not sent.
+  open_channel = 2,
+};
+
+/// Which of the server's queues a request waits in; each has its own threads.
+enum class Lane : std::uint32_t {
+  /// For requests that must be answered quickly, such as a robot's queries.
+  latency = 0,
+  /// For bulk work, such as reprocessing logs, which is transformed in larger batches.
+  throughput = 1,
+};
+
+/// The outcome of a request.
+enum class Status : std::uint32_t {
+  ok = 0,
+  /// The request was malformed; the server closes the connection after answering it.
+  bad_request = 1,
+  /// The server has no map with the requested index.
+  unknown_map = 2,
+  /// The points could not be transformed.
+  internal_error = 3,
+  /// The request's lane already has as many points waiting as it admits, so the request was
+  /// refused; it may be sent again later.
+  overloaded = 4,
+};
+
+struct RequestHeader {
+  std::uint32_t magic;
+  /// Copied into the response, for the client's use.
+  std::uint32_t id;
+  /// The index of the map to use, in the order the server loaded its maps.
+  std::uint32_t map;
+  Operation operation;
+  std::uint32_t count;
+  Lane lane;
+};
+
+struct ResponseHeader {
+  std::uint32_t id;
+  Status status;
+  /// The number of points that follow; zero if the request failed.
+  std::uint32_t count;
+};
+
+/// The largest number of points a shared memory channel may hold.
+constexpr std::uint32_t MAX_CHANNEL_POINTS = 1 << 24;
+
+/// Identifies a shared memory channel, and the version of its layout.
+constexpr std::uint32_t CHANNEL_MAGIC = 0x3143544d;  // "MTC1"
+
+/// The number of requests a shared memory channel can hold at once.
+constexpr std::uint32_t CHANNEL_SLOTS = 256;
+
+// The channel's counters are shared between processes, so must not need a lock
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Channel counters need a lock");
+
+/// A request in a shared memory channel.
+struct ChannelSlot {
+  std::uint32_t map;
+  Operation operation;
+  /// The index in the channel's ring of the first of the request's points.
+  std::uint32_t offset;
+  std::uint32_t count;
+  /// Written by the server before it counts the request as completed.
+  Status status;
+};
+
+/// The start of a shared memory channel, which is followed by the ring of points.
+/**
+ * Requests are numbered from zero, and request `n` uses slot `n % CHANNEL_SLOTS`. The counters
+ * are 32-bit so that they can be waited on with a futex, and wrap around. Each side sets its
+ * `waiting` flag before it sleeps on the other side's counter, so that the other side only makes
+ * a system call to wake it when it is asleep.
+ */
+struct ChannelHeader {
+  std::uint32_t magic;
+  /// The number of points the ring holds.
+  std::uint32_t capacity;
+  /// The number of requests submitted by the client.
+  alignas(64) std::atomic<std::uint32_t> submitted;
+  std::atomic<std::uint32_t> server_waiting;
+  /// The number of requests completed by the server.
+  alignas(64) std::atomic<std::uint32_t> completed;
+  std::atomic<std::uint32_t> client_waiting;
+  /// Set by the client when it closes the channel.
+  alignas(64) std::atomic<std::uint32_t> closed;
+  ChannelSlot slots[CHANNEL_SLOTS];
+};
+
+/// Get the size in bytes of a shared memory channel holding a number of points.
+constexpr std::size_t channel_size(std::uint32_t capacity) {
+  return sizeof(ChannelHeader) + capacity * sizeof(Point2D);
+}
+
+/// Get the ring of points of a shared memory channel.
+inline Point2D * channel_points(ChannelHeader *header) {
+  return reinterpret_cast<Point2D *>(header + 1);
+}
+
+}  // namespace protocol
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TRANSFORM_PROTOCOL_HPP_
@@ -0,0 +1,250 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TRANSFORM_SERVER_HPP_
+#define MAP_TRANSFORMER__TRANSFORM_SERVER_HPP_
+
+#include "map_transformer/transform_protocol.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace map_transformer {
+
+/// How a lane of a \ref TransformServer transforms the requests sent to it.
+struct TransformLaneOptions {
+  /// The number of threads that transform the lane's requests; zero for one per CPU the lane
+  /// can use, less those the other lane's threads use, but at least one.
+  std::size_t threads{0};
+  /// The most points transformed in one batch. Larger requests are split into batches of this
+  /// size, and smaller ones waiting together are combined into batches of up to this size.
+  std::size_t max_batch_points{1 << 16};
+  /// The most points that may be waiting in the lane; requests that would take it over this are
+  /// refused with \ref protocol::Status::overloaded. Zero for no limit.
+  std::size_t max_queued_points{0};
+  /// The CPUs to run the lane's threads on; if empty, they run on any CPU the process may use that
+  /// is not given to the other lane.
+  std::vector<int> cpus;
+};
+
+/// How a \ref TransformServer divides its work between its lanes.
+struct TransformServerOptions {
+  /// Small batches on a few threads, so that requests are answered quickly.
+  TransformLaneOptions latency{2, 1024, 0, {}};
+  /// Large batches on the remaining CPUs.
+  TransformLaneOptions throughput;
+};
+
+/// Counts of the work done in one lane of a \ref TransformServer.
+struct TransformLaneStatistics {
+  /// The threads transforming the lane's requests.
+  std::size_t threads{0};
+  /// Requests transformed, including failed ones.
+  std::size_t requests{0};
+  /// Points transformed.
+  std::size_t points{0};
+  /// Requests refused because too many points were waiting.
+  std::size_t rejected{0};
+  /// Batches the requests were transformed in.
+  std::size_t batches{0};
+  /// The median time in seconds from a request being received to it being transformed.
+  double median_latency{0};
+  /// The 99th percentile of the time from a request being received to it being transformed.
+  double p99_latency{0};
+  /// The longest time from a request being received to it being transformed.
+  double max_latency{0};
+};
+
+/// Counts of the work a \ref TransformServer has done.
+struct TransformServerStatistics {
+  /// Requests answered, including failed and refused ones.
+  std::size_t requests{0};
+  /// Points transformed.
+  std::size_t points{0};
+  /// Shared memory channels opened by \ref SharedMemoryClient instances.
+  std::size_t channels{0};
+  /// Requests sent through the socket in \ref protocol::Lane::latency.
+  TransformLaneStatistics latency;
+  /// Requests sent through the socket in \ref protocol::Lane::throughput.
+  TransformLaneStatistics throughput;
+};
+
+/// Serves transforms from loaded maps to \ref TransformClient instances in other processes.
+/**
+ * The server listens on a Unix domain socket, and receives each connection's requests on its own
+ * thread. Each request is put in the queue of the lane the client chose, and transformed by that
+ * lane's threads: the latency lane's threads are kept free for requests that must be answered
+ * quickly, whatever load is put on the throughput lane, and may be given CPUs of their own. Small
+ * requests waiting in a lane are combined into a single batch for each map and direction, so that
+ * many processes transforming a few points at a time still use the batch transforms, and large
+ * requests are split so that several threads share them. Neither changes the results, which are
+ * identical to those of the maps' \ref Transformer::to_ref() and \ref Transformer::to_robot().
+ *
+ * A connection may instead open a shared memory channel for a \ref SharedMemoryClient, after
+ * which its thread transforms the points of each request in the channel in place as soon as the
+ * request is submitted. Channel requests do not use the lanes.
+ */
+class TransformServer {
+public:
+  /// How often a shared memory channel with no requests checks whether its client has gone.
+  static constexpr std::chrono::milliseconds CHANNEL_POLL_INTERVAL{100};
+
+  /// Start serving maps on a socket.
+  /**
+   * Any socket file already at the path is replaced.
+   *
+   * \param[in] maps The loaded maps to serve; clients select one by its index in this list.
+   * \param[in] socket_path The path to create the Unix domain socket at.
+   * \param[in] options How to divide the work between the lanes.
+   * \throws std::invalid_argument if there are no maps, one is null, a lane's batch size is zero,
+   * or a lane is given a CPU the process may not use.
+   * \throws std::logic_error if a map is empty.
+   * \throws std::runtime_error if the socket cannot be created.
+   */
+  TransformServer(
+    std::vector<std::shared_ptr<Transformer const>> maps,
+    std::string const &socket_path,
+    TransformServerOptions options = {});
+
+  TransformServer(TransformServer const &) = delete;
+  TransformServer & operator=(TransformServer const &) = delete;
+
+  /// Stop serving, closing every connection and removing the socket.
+  virtual ~TransformServer();
+
+  /// Get the path of the socket the server is listening on.
+  std::string const &socket_path() const;
+
+  /// Get counts of the work the server has done so far.
+  TransformServerStatistics statistics() const;
+
+  /// Replace one of the maps being served, such as with one reloaded by a \ref MapWatcher.
+  /**
+   * Requests already being transformed with the previous map finish with it.
+   *
+   * \param[in] index The index of the map to replace.
+   * \param[in] map The map to serve in its place.
+   * \throws std::out_of_range if there is no map with the index.
+   * \throws std::invalid_argument if the map is null.
+   * \throws std::logic_error if the map is empty.
+   */
+  void replace_map(std::size_t index, std::shared_ptr<Transformer const> map);
+
+private:
+  // A request waiting in a lane, and whether it has been transformed yet
+  struct PendingRequest {
+    std::uint32_t map;
+    protocol::Operation operation;
+    Point2D const *points;
+    Point2D *results;
+    protocol::Status status;
+    std::size_t chunks_remaining;
+  };
+
+  // Part of a request, no larger than its lane's batch size
+  struct Chunk {
+    PendingRequest *request;
+    std::size_t offset;
+    std::size_t count;
+  };
+
+  // Counts of request latencies in buckets an eighth of a power of two wide
+  struct LatencyHistogram {
+    std::vector<std::size_t> counts;
+    std::size_t total{0};
+    double maximum{0};
+
+    void add(double seconds);
+    double percentile(double fraction) const;
+  };
+
+  struct Lane {
+    TransformLaneOptions options;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable done;
+    std::deque<Chunk> queue;
+    std::size_t queued_points{0};
+    bool stopping{false};
+    // Guarded by _statistics_mutex
+    TransformLaneStatistics statistics;
+    LatencyHistogram latencies;
+  };
+
+  struct Connection {
+    int socket;
+    std::thread thread;
+    std::atomic<bool> finished{false};
+    // The shared memory channel the connection is serving, if any; guarded by _connections_mutex
+    protocol::ChannelHeader *channel{nullptr};
+  };
+
+  // The maps may be replaced while being served, so are only accessed with std::atomic_load() and
+  // std::atomic_store()
+  std::vector<std::shared_ptr<Transformer const>> _maps;
+  std::string _socket_path;
+  int _listen_socket{-1};
+  // Written to when the server stops, to wake the thread accepting connections
+  int _stop_pipe[2]{-1, -1};
+  std::atomic<bool> _stopping{false};
+
+  std::thread _acceptor;
+  std::mutex _connections_mutex;
+  std::list<Connection> _connections;
+
+  // Indexed by protocol::Lane
+  Lane _lanes[2];
+
+  mutable std::mutex _statistics_mutex;
+  TransformServerStatistics _statistics;
+
+  void accept_connections();
+  void serve(Connection &connection);
+  void serve_channel(Connection &connection, protocol::RequestHeader const &request);
+  void run_channel(
+    Connection &connection,
+    protocol::ChannelHeader &channel,
+    std::uint32_t capacity);
+  protocol::Status transform(
+    protocol::Lane lane,
+    std::uint32_t map,
+    protocol::Operation operation,
+    Point2D const *points,
+    std::size_t count,
+    Point2D *results);
+  protocol::Status transform_batch(
+    std::uint32_t map,
+    protocol::Operation operation,
+    Point2D const *points,
+    std::size_t count,
+    Point2D *results);
+  void run_lane(Lane &lane);
+};
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TRANSFORM_SERVER_HPP_
@@ -15,9 +15,16 @@
 #ifndef MAP_TRANSFORMER__TRANSFORMER_HPP_
 #define MAP_TRANSFORMER__TRANSFORMER_HPP_
 
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/triangle_quality.hpp"
+#include "map_transformer/image_size.hpp"
+#include "map_transformer/locations.hpp"
+#include "map_transformer/query_cache.hpp"
+#include "map_transformer/types.hpp"
 #include "map_transformer/visibility_control.h"
 
-#include <opencv2/imgproc.hpp>
+#include <array>
+#include <cstddef>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -25,11 +32,64 @@
 
 namespace map_transformer {
 
-using Point2D = std::pair<float, float>;
-using CorrespondencePoints = std::vector<Point2D>;
-using Vector2D = std::pair<float, float>;
-using Triangle = std::tuple<int, int, int>;
-using TriangleList = std::vector<Triangle>;
+class TiledTransformer;
+class EmbeddedMapGenerator;
+
+/// The ways the correspondence points can be triangulated.
+enum class TriangulationMode {
+  /// Triangulate the points midway between each pair of correspondence points, and use the same
+  /// triangles for both maps.
+  /**
+   * A triangle is transformed by the same pair of affine transforms in both directions, but the
+   * triangles may overlap in either map if the maps differ greatly; see
+   * \ref Transformer::folded_triangles().
+   */
+  midpoint,
+  /// Calculate a separate Delaunay triangulation of the correspondence points in each map.
+  /**
+   * Points in each map are found in a triangulation that is valid in that map, so the triangles
+   * never overlap, every point in the triangulated area is in exactly one triangle or on the edges
+   * between triangles, and the slab and walk search strategies can always be used. Transforming a
+   * point to the other map and back may not give the original point where the two triangulations
+   * differ.
+   */
+  per_direction,
+};
+
+/// The ways a point can be transformed.
+enum class TransformPath {
+  /// The point is a correspondence point, so it was replaced by its corresponding point.
+  correspondence_point,
+  /// The point is inside a triangle, so it was transformed by the triangle's affine transform.
+  triangle,
+  /// The point is outside the triangulation, so it was transformed by the map transform alone.
+  map_transform,
+};
+
+/// The result of transforming a point, with the details of how it was transformed.
+struct QueryResult {
+  /// The transformed point, identical to the result of the equivalent plain transform.
+  Point2D point{0, 0};
+  /// How the point was transformed.
+  TransformPath path{TransformPath::map_transform};
+  /// The index of the correspondence point equal to the point, or -1.
+  int correspondence_point{-1};
+  /// The triangle the point was transformed by, or -1 if it was not transformed by a triangle.
+  /**
+   * This is an index into \ref Transformer::robot_map_triangle_indices() for points transformed
+   * to the reference map, and into \ref Transformer::ref_map_triangle_indices() for points
+   * transformed to the robot map. Correspondence points are not searched for, so have no triangle.
+   */
+  int triangle{-1};
+  /// The barycentric coordinates of the point in the triangle, in the map it was transformed from.
+  /**
+   * These are the weights of the triangle's three vertices, in the order they are listed in the
+   * triangle indices, and sum to one. The transformed point is, to within rounding, the same
+   * weighting of the vertices in the other map. They are all zero if the point was not
+   * transformed by a triangle, and not a number if the triangle has no area.
+   */
+  std::array<double, 3> barycentric{{0, 0, 0}};
+};
 
 /// The Transformer class provides transformation of points between two maps.
 /**
@@ -66,9 +126,140 @@ public:
    */
   void load(std::string const &yaml_doc);
 
+  /// Load map information from a snapshot.
+  /**
+   * This gives a Transformer that transforms points identically to the one the snapshot was taken
+   * of, faster than loading the YAML document, because the triangulations are not recalculated and
+   * the map image files are not read. The triangulation mode is set to that of the snapshot.
+   *
+   * \pre The \ref Transformer object must be empty, as for \ref load().
+   * \param[in] data The snapshot, as returned by \ref snapshot().
+   * \param[in] size The size of the snapshot in bytes.
+   * \throws std::runtime_error if the data is not a valid snapshot.
+   * \throws std::logic_error if the Transformer is not empty.
+   */
+  void load_snapshot(void const *data, std::size_t size);
+
+  /// Take a snapshot of the loaded map information and triangulations.
+  /**
+   * The snapshot is a binary format, in the byte order of the machine that wrote it, which records
+   * everything loaded from the map information along with the triangulation of each map. The
+   * search strategy, search memory limit, image size reader and query cache capacity are not
+   * included.
+   *
+   * \return The snapshot.
+   * \throw std::logic_error if the Transformer has no loaded map information.
+   */
+  std::string snapshot() const;
+
   /// Clear any loaded map information.
+  /**
+   * The search strategy and search memory limit are not changed.
+   */
   void reset();
 
+  /// Set the method used to find the triangle containing a point being transformed.
+  /**
+   * The search strategy may be set before or after loading map information. The default is
+   * \ref SearchStrategy::automatic, which chooses a strategy to suit each map when the map
+   * information is loaded; setting any other strategy overrides that choice. All strategies give
+   * identical transformation results, but differ in speed and memory usage; see
+   * \ref SearchStrategy for details.
+   *
+   * \param[in] strategy The search strategy to use for both \ref to_ref() and \ref to_robot().
+   */
+  void set_search_strategy(SearchStrategy strategy);
+
+  /// Get the method used to find the triangle containing a point being transformed.
+  /**
+   * \return The search strategy set by \ref set_search_strategy(). Use
+   * \ref ref_map_search_selection() and \ref robot_map_search_selection() to find the strategies
+   * actually in use.
+   */
+  SearchStrategy search_strategy() const;
+
+  /// Set the maximum memory that an automatically-chosen search index may use for each map.
+  /**
+   * \param[in] bytes The memory limit, in bytes. If zero, which is the default, the limit is one
+   * eighth of the available physical memory.
+   */
+  void set_search_memory_limit(std::size_t bytes);
+
+  /// Get the maximum memory that an automatically-chosen search index may use for each map.
+  /**
+   * \return The memory limit set by \ref set_search_memory_limit().
+   */
+  std::size_t search_memory_limit() const;
+
+  /// Set how the correspondence points are triangulated.
+  /**
+   * The triangulation mode may be set before or after loading map information. The default is
+   * \ref TriangulationMode::midpoint.
+   *
+   * \param[in] mode The triangulation mode.
+   */
+  void set_triangulation_mode(TriangulationMode mode);
+
+  /// Get how the correspondence points are triangulated.
+  TriangulationMode triangulation_mode() const;
+
+  /// Set the function used to check the sizes of the map image files when loading.
+  /**
+   * The default is given by \ref default_image_size_reader(): \ref read_image_header_size(),
+   * which reads PNG and Netpbm headers, or \ref read_image_size_with_opencv(), for any format
+   * OpenCV can read, in programs linked with the `map_transformer` add-on library. Image files the
+   * reader cannot read fail loading.
+   *
+   * \param[in] reader The function to read image sizes with. If empty, image sizes are not checked.
+   */
+  void set_image_size_reader(ImageSizeReader reader);
+
+  /// Set the number of results to cache for each direction of single-point transforms.
+  /**
+   * When enabled, the results of \ref to_ref(Point2D const &) const and
+   * \ref to_robot(Point2D const &) const are cached, so that points which are transformed
+   * repeatedly, such as the positions of docking stations, are only searched for once. Points are
+   * matched by the exact bits of their coordinates, so cached results are identical to transformed
+   * ones. When a cache is full, the result used least recently is replaced. The batch transforms
+   * do not use the caches.
+   *
+   * The caches are emptied when the Transformer is reset, and are emptied and their statistics
+   * cleared when map information is loaded or the capacity is set. The capacity may be set before
+   * or after loading map information.
+   *
+   * \param[in] capacity The maximum number of results to cache in each direction. If zero, which
+   * is the default, the caches are disabled.
+   */
+  void set_query_cache_capacity(std::size_t capacity);
+
+  /// Get the number of results cached for each direction of single-point transforms.
+  /**
+   * \return The capacity set by \ref set_query_cache_capacity().
+   */
+  std::size_t query_cache_capacity() const;
+
+  /// Get the statistics of the cache of results of \ref to_ref(Point2D const &) const.
+  QueryCacheStatistics to_ref_cache_statistics() const;
+
+  /// Get the statistics of the cache of results of \ref to_robot(Point2D const &) const.
+  QueryCacheStatistics to_robot_cache_statistics() const;
+
+  /// Get the search strategy in use for points in the reference map, and why it was chosen.
+  /**
+   * This is the strategy used by \ref to_robot().
+   *
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  SearchStrategySelection const &ref_map_search_selection() const;
+
+  /// Get the search strategy in use for points in the robot map, and why it was chosen.
+  /**
+   * This is the strategy used by \ref to_ref().
+   *
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  SearchStrategySelection const &robot_map_search_selection() const;
+
   /// Get the name of the reference map that is loaded.
   /**
    * \return The name of the reference map, as loaded from the YAML document.
@@ -185,13 +376,86 @@ public:
 
   /// Get the list of triangles calculated by the Delaunay triangulation.
   /**
-   * This triangle list is provided for visualisation and debugging purposes.
+   * This triangle list is provided for visualisation and debugging purposes. It is the same as
+   * \ref ref_map_triangle_indices().
    *
    * \return The calculated triangles, as indices into the correspondence point lists.
    * \throw std::LogicError if the Transformer has no loaded map information.
    */
   const TriangleList& triangle_indices() const;
 
+  /// Get the triangles that points in the reference map are found in.
+  /**
+   * With \ref TriangulationMode::midpoint, these are the same as the triangles for the robot map.
+   *
+   * \return The triangles, as indices into the correspondence point lists.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  const TriangleList& ref_map_triangle_indices() const;
+
+  /// Get the triangles that points in the robot map are found in.
+  /**
+   * \sa ref_map_triangle_indices()
+   */
+  const TriangleList& robot_map_triangle_indices() const;
+
+  /// Get measurements of the shape and distortion of each triangle in both maps.
+  /**
+   * Where a triangle is folded over in a map, the triangle that a point there is transformed by is
+   * ambiguous, and the slab search strategy cannot be used for that map. This is the same as
+   * \ref ref_map_triangle_quality().
+   *
+   * \return The measurements, in the same order as \ref triangle_indices().
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  const std::vector<TriangleQuality>& triangle_quality() const;
+
+  /// Get measurements of each triangle that points in the reference map are found in, in both maps.
+  /**
+   * In \ref TriangulationMode::midpoint, both maps' points are found in the same triangles, so this
+   * is the same as \ref robot_map_triangle_quality().
+   *
+   * \return The measurements, in the same order as \ref ref_map_triangle_indices().
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  const std::vector<TriangleQuality>& ref_map_triangle_quality() const;
+
+  /// Get measurements of each triangle that points in the robot map are found in, in both maps.
+  /**
+   * \return The measurements, in the same order as \ref robot_map_triangle_indices().
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   * \sa ref_map_triangle_quality()
+   */
+  const std::vector<TriangleQuality>& robot_map_triangle_quality() const;
+
+  /// Find the triangles that are folded over or have no area in either map.
+  /**
+   * This is the same as \ref ref_map_folded_triangles().
+   *
+   * \return The indices into \ref triangle_indices() of the folded triangles, in ascending order.
+   * The list is empty if the triangulation is valid in both maps.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<int> folded_triangles() const;
+
+  /// Find the triangles that points in the reference map are found in that are folded over or
+  /// have no area in either map.
+  /**
+   * \return The indices into \ref ref_map_triangle_indices() of the folded triangles, in
+   * ascending order.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<int> ref_map_folded_triangles() const;
+
+  /// Find the triangles that points in the robot map are found in that are folded over or have no
+  /// area in either map.
+  /**
+   * \return The indices into \ref robot_map_triangle_indices() of the folded triangles, in
+   * ascending order.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<int> robot_map_folded_triangles() const;
+
   /// Get the bounding box of the two maps.
   /**
    * Returns the bounding box (with one corner at 0, 0) of the two maps. This is the total size of
@@ -204,6 +468,67 @@ public:
    */
   std::pair<Point2D, Point2D> bounding_box() const;
 
+  /// Find the triangles that may overlap a rectangular region of the reference map.
+  /**
+   * A triangle is included if its bounding box overlaps the region. The search uses the quadtree
+   * if that is the search strategy in use, and tests every triangle otherwise.
+   *
+   * \param top_left One corner of the region.
+   * \param bottom_right The opposite corner of the region.
+   * \return The indices into \ref ref_map_triangle_indices() of the triangles found, in ascending
+   * order.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<int> ref_map_triangles_in_region(
+    Point2D const &top_left,
+    Point2D const &bottom_right) const;
+
+  /// Find the triangles that may overlap a rectangular region of the robot map.
+  /**
+   * \return The indices into \ref robot_map_triangle_indices() of the triangles found.
+   * \sa ref_map_triangles_in_region()
+   */
+  std::vector<int> robot_map_triangles_in_region(
+    Point2D const &top_left,
+    Point2D const &bottom_right) const;
+
+  /// Get the named locations loaded from the map information.
+  /**
+   * Each location's position in the map it was not given in is calculated when the map
+   * information is loaded, so looking up a location involves no transformation.
+   *
+   * \return The locations, in the order they were listed. A location's index in this list is its
+   * ID.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<NamedLocation> const &locations() const;
+
+  /// Get the ID of a named location.
+  /**
+   * \param name The name of the location.
+   * \return The location's index in \ref locations(), or -1 if there is no location with the name.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  int location_id(std::string const &name) const;
+
+  /// Get a named location by name.
+  /**
+   * \param name The name of the location.
+   * \return The location, with its position in both maps.
+   * \throw std::out_of_range if there is no location with the name.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  NamedLocation const &location(std::string const &name) const;
+
+  /// Get a named location by ID.
+  /**
+   * \param id The location's index in \ref locations().
+   * \return The location, with its position in both maps.
+   * \throw std::out_of_range if there is no location with the ID.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  NamedLocation const &location(std::size_t id) const;
+
   /// Transform a point in the robot map to its equivalent point in the reference map.
   /**
    * The transform is performed according to the affine transforms of the Delaunay triangles that
@@ -240,7 +565,123 @@ public:
    */
   Point2D to_robot(Point2D const &point) const;
 
+  /// Transform a batch of points in the robot map to their equivalent points in the reference map.
+  /**
+   * Each point is transformed exactly as by \ref to_ref(Point2D const &) const, but large batches
+   * are transformed faster, as the search data for later points is fetched from memory while
+   * earlier points are transformed.
+   *
+   * The results are bit-for-bit identical to transforming each point in turn, whatever the search
+   * strategy and however a set of points is split into batches. A loaded Transformer may be used
+   * from several threads at once.
+   *
+   * \param points The points in the robot map to transform.
+   * \param count The number of points.
+   * \param[out] results The transformed points in the reference map. Must have room for count
+   * points, and may be the same as points.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  void to_ref(Point2D const *points, std::size_t count, Point2D *results) const;
+
+  /// Transform a batch of points in the robot map to their equivalent points in the reference map.
+  /**
+   * \param points The points in the robot map to transform.
+   * \return The transformed points in the reference map.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<Point2D> to_ref(std::vector<Point2D> const &points) const;
+
+  /// Transform a batch of points in the reference map to their equivalent points in the robot map.
+  /**
+   * Each point is transformed exactly as by \ref to_robot(Point2D const &) const, but large
+   * batches are transformed faster, as the search data for later points is fetched from memory
+   * while earlier points are transformed. The results do not depend on the search strategy or on
+   * how the points are split into batches.
+   *
+   * \param points The points in the reference map to transform.
+   * \param count The number of points.
+   * \param[out] results The transformed points in the robot map. Must have room for count points,
+   * and may be the same as points.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  void to_robot(Point2D const *points, std::size_t count, Point2D *results) const;
+
+  /// Transform a batch of points in the reference map to their equivalent points in the robot map.
+  /**
+   * \param points The points in the reference map to transform.
+   * \return The transformed points in the robot map.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<Point2D> to_robot(std::vector<Point2D> const &points) const;
+
+  /// Transform a point in the robot map to the reference map, and report how it was transformed.
+  /**
+   * The transformed point is bit-for-bit identical to the result of
+   * \ref to_ref(Point2D const &) const.
+   *
+   * \param point The point in the robot map to transform.
+   * \return The transformed point in the reference map, with the path taken, the triangle used
+   * and the point's barycentric coordinates in it.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  QueryResult query_to_ref(Point2D const &point) const;
+
+  /// Transform a point in the reference map to the robot map, and report how it was transformed.
+  /**
+   * The transformed point is bit-for-bit identical to the result of
+   * \ref to_robot(Point2D const &) const.
+   *
+   * \param point The point in the reference map to transform.
+   * \return The transformed point in the robot map, with the path taken, the triangle used and
+   * the point's barycentric coordinates in it.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  QueryResult query_to_robot(Point2D const &point) const;
+
+  /// Transform a batch of points in the robot map to the reference map, reporting how.
+  /**
+   * Each result is identical to that of \ref query_to_ref(Point2D const &) const; the points are
+   * searched for as by the batch \ref to_ref().
+   *
+   * \param points The points in the robot map to transform.
+   * \param count The number of points.
+   * \param[out] results The results. Must have room for count results.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  void query_to_ref(Point2D const *points, std::size_t count, QueryResult *results) const;
+
+  /// Transform a batch of points in the robot map to the reference map, reporting how.
+  /**
+   * \param points The points in the robot map to transform.
+   * \return The results, in the same order as the points.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<QueryResult> query_to_ref(std::vector<Point2D> const &points) const;
+
+  /// Transform a batch of points in the reference map to the robot map, reporting how.
+  /**
+   * Each result is identical to that of \ref query_to_robot(Point2D const &) const; the points are
+   * searched for as by the batch \ref to_robot().
+   *
+   * \param points The points in the reference map to transform.
+   * \param count The number of points.
+   * \param[out] results The results. Must have room for count results.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  void query_to_robot(Point2D const *points, std::size_t count, QueryResult *results) const;
+
+  /// Transform a batch of points in the reference map to the robot map, reporting how.
+  /**
+   * \param points The points in the reference map to transform.
+   * \return The results, in the same order as the points.
+   * \throw std::LogicError if the Transformer has no loaded map information.
+   */
+  std::vector<QueryResult> query_to_robot(std::vector<Point2D> const &points) const;
+
 private:
+  friend class TiledTransformer;
+  friend class EmbeddedMapGenerator;
+
   // Loaded data
   std::string _ref_map_name;
   std::string _ref_map_image_file;
@@ -257,27 +698,93 @@ private:
   // Loaded data management
   bool _empty() const;
   void _validate() const;
+  void _validate_image_files() const;
+
+  // Configuration
+  SearchStrategy _search_strategy{SearchStrategy::automatic};
+  std::size_t _search_memory_limit{0};
+  TriangulationMode _triangulation_mode{TriangulationMode::midpoint};
+  ImageSizeReader _image_size_reader{default_image_size_reader()};
+  // Caches of single-point results; these are filled by const member functions
+  mutable QueryCache _to_ref_cache;
+  mutable QueryCache _to_robot_cache;
+  LocationTable _locations;
+
+  // The triangles used to find and transform points in one of the maps
+  struct MapTriangulation {
+    TriangleList triangles;
+    // The triangles are stored in spatial order for the transforms and point locator; this holds
+    // the index into triangles of the triangle in each position of that order
+    std::vector<std::int32_t> order;
+    // The transforms from this map to the other map, in spatial order
+    std::vector<AffineTransform> transforms;
+    PointLocator locator;
+    // Whether any triangle is folded over or has no area in this map
+    bool folded{false};
+    // Measurements of the triangles in both maps, in the same order as triangles
+    std::vector<TriangleQuality> quality;
+
+    void clear();
+  };
 
   // Pre-calculated data for performing transforms
-  TriangleList _triangles;
-  std::vector<cv::Mat> _to_ref_transforms;
-  std::vector<cv::Mat> _to_robot_transforms;
+  MapTriangulation _ref_triangulation;
+  MapTriangulation _robot_triangulation;
+  CorrespondencePointIndex _ref_corr_point_index;
+  CorrespondencePointIndex _robot_corr_point_index;
 
   // Transformation support
   void precalculate();
+  // Pre-calculate with the triangulation of each map already known
+  void precalculate(TriangleList ref_triangles, TriangleList robot_triangles);
   CorrespondencePoints calculate_correspondence_midpoints() const;
-  void subdivide_and_index_triangles();
-  void precalculate_triangle_transforms();
-  int get_correspondence_point_index(
-    Point2D const &point,
-    CorrespondencePoints const &points) const;
-  int find_containing_triangle_in_ref(Point2D const &point) const;
-  int find_containing_triangle_in_robot(Point2D const &point) const;
-  Point2D transform_to_ref_by_map_transform(Point2D const& point) const;
-  Point2D transform_from_ref_by_map_transform(Point2D const& point) const;
-  cv::Mat triangle_points(
-    Triangle const& triangle,
-    CorrespondencePoints const& points) const;
+  static void index_triangles(
+    MapTriangulation &triangulation,
+    TriangleList triangles,
+    CorrespondencePoints const &from_points,
+    CorrespondencePoints const &to_points);
+  static void measure_triangles(
+    MapTriangulation &triangulation,
+    CorrespondencePoints const &ref_points,
+    CorrespondencePoints const &robot_points);
+  void build_point_locators();
+  void transform_locations();
+
+  // The query kernels are instantiated once for each direction, so that both directions share one
+  // implementation without choosing the maps at run time
+  enum class Direction {to_ref, to_robot};
+  // The data read when transforming points in one direction
+  struct DirectionData {
+    CorrespondencePointIndex const &corr_point_index;
+    // The points in the other map that the correspondence points transform to
+    CorrespondencePoints const &corr_point_targets;
+    MapTriangulation const &triangulation;
+    QueryCache &cache;
+  };
+  template<Direction direction>
+  DirectionData direction_data() const;
+  template<Direction direction>
+  Point2D transform_by_map_transform(Point2D const &point) const;
+  template<Direction direction>
+  Point2D transform_located(Point2D const &point, int corr_point, int stored_triangle) const;
+  template<Direction direction>
+  Point2D transform_point(Point2D const &point) const;
+  template<Direction direction>
+  void transform_points(Point2D const *points, std::size_t count, Point2D *results) const;
+  template<Direction direction>
+  QueryResult query_point(Point2D const &point, int corr_point, int stored_triangle) const;
+  template<Direction direction>
+  void query_points(Point2D const *points, std::size_t count, QueryResult *results) const;
+  template<Direction direction, typename Visitor>
+  void locate_points(Point2D const *points, std::size_t count, Visitor &&visit) const;
+  static Point2D apply_transform(AffineTransform const &transform, Point2D const &point);
+  static TriangleGeometry triangle_geometry(
+    MapTriangulation const &triangulation,
+    CorrespondencePoints const &points);
+  static std::vector<int> public_triangle_indices(
+    MapTriangulation const &triangulation,
+    std::vector<int> stored_indices);
+  static std::vector<int> folded_triangles(MapTriangulation const &triangulation);
 };
 
 }  // namespace map_transformer
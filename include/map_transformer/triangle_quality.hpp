@@ -0,0 +1,75 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TRIANGLE_QUALITY_HPP_
+#define MAP_TRANSFORMER__TRIANGLE_QUALITY_HPP_
+
+#include "map_transformer/types.hpp"
+
+
+namespace map_transformer {
+
+/// Measurements of how well-shaped a triangle is in each map, and how it is distorted between them.
+/**
+ * By default, the triangulation is calculated from the midpoints of the correspondence points, so
+ * it is not guaranteed to be valid in either map. A triangle whose vertices are in clockwise order in
+ * a map, when they are counterclockwise in the triangulation, is folded over: it overlaps its
+ * neighbours in that map, so which triangle a point there is transformed by is ambiguous.
+ */
+struct TriangleQuality {
+  /// The signed area of the triangle in the reference map.
+  /**
+   * The area is positive if the vertices are in counterclockwise order when the Y axis points up,
+   * negative if they are in clockwise order, and zero if they are collinear. The sign is exact.
+   */
+  double ref_area{0};
+  /// The signed area of the triangle in the robot map. \sa ref_area
+  double robot_area{0};
+  /// The ratio of the robot map area to the reference map area.
+  /**
+   * Negative if the triangle is folded over in one map but not the other, and infinite or not a
+   * number if the triangle has no area in the reference map.
+   */
+  double area_ratio{1};
+  /// The condition number of the triangle's shape in the reference map.
+  /**
+   * This is one for an equilateral triangle, and grows without limit as the triangle becomes
+   * thinner. It is infinite if the triangle has no area.
+   */
+  double ref_condition_number{1};
+  /// The condition number of the triangle's shape in the robot map. \sa ref_condition_number
+  double robot_condition_number{1};
+  /// The condition number of the affine transform between the two maps within the triangle.
+  /**
+   * This is one if the transform only rotates, scales uniformly and translates, and is larger the
+   * more it stretches points in one direction relative to another. It is infinite if the triangle
+   * has no area in either map.
+   */
+  double transform_condition_number{1};
+  /// Whether the triangle is folded over or has no area in either map.
+  bool folded{false};
+};
+
+/// Measure the quality of a triangle.
+/**
+ * \param ref The triangle's vertices in the reference map, in the order that is counterclockwise in
+ * the triangulation.
+ * \param robot The same vertices, in the same order, in the robot map.
+ * \return The measurements.
+ */
+TriangleQuality measure_triangle(TriangleVertices const &ref, TriangleVertices const &robot);
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TRIANGLE_QUALITY_HPP_
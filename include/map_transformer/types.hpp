@@ -0,0 +1,40 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TYPES_HPP_
+#define MAP_TRANSFORMER__TYPES_HPP_
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer {
+
+using Point2D = std::pair<float, float>;
+using CorrespondencePoints = std::vector<Point2D>;
+using Vector2D = std::pair<float, float>;
+using Triangle = std::tuple<int, int, int>;
+using TriangleList = std::vector<Triangle>;
+/// The vertices of one triangle, in the coordinates of one map.
+using TriangleVertices = std::array<Point2D, 3>;
+/// The vertices of every triangle in a triangulation, in the coordinates of one map.
+using TriangleGeometry = std::vector<TriangleVertices>;
+/// An affine transform of points from one map to another, as a row-major 2x3 matrix.
+using AffineTransform = std::array<double, 6>;
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TYPES_HPP_
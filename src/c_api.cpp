@@ -0,0 +1,252 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/c_api.h"
+#include "map_transformer/transformer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+struct map_transformer_t
+{
+  map_transformer::Transformer transformer;
+};
+
+namespace
+{
+
+// Points are copied through fixed buffers on the stack, so that batches do not allocate memory
+constexpr std::size_t CHUNK_SIZE = 256;
+
+thread_local std::string last_error;
+
+map_transformer_status_t fail(map_transformer_status_t status, std::string const &message) {
+  last_error = message;
+  return status;
+}
+
+// Run a call, turning the exceptions it throws into statuses so that none crosses the interface
+template<typename Function>
+map_transformer_status_t guarded(Function &&function) {
+  try {
+    return function();
+  } catch (std::bad_alloc const &) {
+    return fail(MAP_TRANSFORMER_OUT_OF_MEMORY, "Out of memory");
+  } catch (std::logic_error const &e) {
+    // The Transformer throws logic errors when it is used without map information
+    return fail(MAP_TRANSFORMER_NOT_LOADED, e.what());
+  } catch (std::exception const &e) {
+    return fail(MAP_TRANSFORMER_INTERNAL_ERROR, e.what());
+  } catch (...) {
+    return fail(MAP_TRANSFORMER_INTERNAL_ERROR, "Unknown error");
+  }
+}
+
+template<typename T>
+T const &at(T const *base, std::ptrdiff_t stride, std::size_t index) {
+  return *reinterpret_cast<T const *>(
+    reinterpret_cast<char const *>(base) + stride * static_cast<std::ptrdiff_t>(index));
+}
+
+template<typename T>
+T &at(T *base, std::ptrdiff_t stride, std::size_t index) {
+  return *reinterpret_cast<T *>(
+    reinterpret_cast<char *>(base) + stride * static_cast<std::ptrdiff_t>(index));
+}
+
+template<bool to_ref, typename T>
+map_transformer_status_t transform(
+  map_transformer_t const * transformer,
+  std::size_t count,
+  T const * x,
+  T const * y,
+  std::ptrdiff_t stride,
+  T * result_x,
+  T * result_y,
+  std::ptrdiff_t result_stride)
+{
+  if (transformer == nullptr ||
+    (count > 0 && (x == nullptr || y == nullptr || result_x == nullptr || result_y == nullptr)))
+  {
+    return fail(MAP_TRANSFORMER_INVALID_ARGUMENT, "Null transformer or coordinate pointer");
+  }
+  return guarded(
+    [&]() {
+      std::array<map_transformer::Point2D, CHUNK_SIZE> points, results;
+      for (std::size_t chunk = 0; chunk < count; chunk += CHUNK_SIZE) {
+        std::size_t size = std::min(CHUNK_SIZE, count - chunk);
+        for (std::size_t ii = 0; ii < size; ++ii) {
+          points[ii].first = static_cast<float>(at(x, stride, chunk + ii));
+          points[ii].second = static_cast<float>(at(y, stride, chunk + ii));
+        }
+        if (to_ref) {
+          transformer->transformer.to_ref(points.data(), size, results.data());
+        } else {
+          transformer->transformer.to_robot(points.data(), size, results.data());
+        }
+        for (std::size_t ii = 0; ii < size; ++ii) {
+          at(result_x, result_stride, chunk + ii) = results[ii].first;
+          at(result_y, result_stride, chunk + ii) = results[ii].second;
+        }
+      }
+      return MAP_TRANSFORMER_OK;
+    });
+}
+
+// Replace a transformer's map information, leaving it empty if loading fails
+template<typename Load>
+map_transformer_status_t load(map_transformer_t * transformer, Load &&load_function) {
+  return guarded(
+    [&]() {
+      transformer->transformer.reset();
+      try {
+        load_function();
+      } catch (std::bad_alloc const &) {
+        throw;
+      } catch (std::exception const &e) {
+        transformer->transformer.reset();
+        return fail(MAP_TRANSFORMER_LOAD_FAILED, e.what());
+      }
+      return MAP_TRANSFORMER_OK;
+    });
+}
+
+}  // namespace
+
+
+unsigned int map_transformer_api_version(void) {
+  return MAP_TRANSFORMER_C_API_VERSION;
+}
+
+char const * map_transformer_last_error(void) {
+  return last_error.c_str();
+}
+
+map_transformer_t * map_transformer_create(void) {
+  try {
+    return new map_transformer_t;
+  } catch (std::exception const &e) {
+    last_error = e.what();
+    return nullptr;
+  }
+}
+
+void map_transformer_destroy(map_transformer_t * transformer) {
+  delete transformer;
+}
+
+map_transformer_status_t map_transformer_load_yaml(
+  map_transformer_t * transformer,
+  char const * yaml,
+  size_t size)
+{
+  if (transformer == nullptr || (yaml == nullptr && size > 0)) {
+    return fail(MAP_TRANSFORMER_INVALID_ARGUMENT, "Null transformer or document");
+  }
+  return load(
+    transformer, [&]() {
+      transformer->transformer.load(std::string(yaml, size));
+    });
+}
+
+map_transformer_status_t map_transformer_load_snapshot(
+  map_transformer_t * transformer,
+  void const * data,
+  size_t size)
+{
+  if (transformer == nullptr || (data == nullptr && size > 0)) {
+    return fail(MAP_TRANSFORMER_INVALID_ARGUMENT, "Null transformer or snapshot");
+  }
+  return load(
+    transformer, [&]() {
+      transformer->transformer.load_snapshot(data, size);
+    });
+}
+
+map_transformer_status_t map_transformer_save_snapshot(
+  map_transformer_t const * transformer,
+  void * buffer,
+  size_t capacity,
+  size_t * size)
+{
+  if (transformer == nullptr || size == nullptr) {
+    return fail(MAP_TRANSFORMER_INVALID_ARGUMENT, "Null transformer or size");
+  }
+  return guarded(
+    [&]() {
+      auto snapshot = transformer->transformer.snapshot();
+      *size = snapshot.size();
+      if (buffer == nullptr || capacity < snapshot.size()) {
+        return fail(MAP_TRANSFORMER_BUFFER_TOO_SMALL, "Snapshot buffer is too small");
+      }
+      std::memcpy(buffer, snapshot.data(), snapshot.size());
+      return MAP_TRANSFORMER_OK;
+    });
+}
+
+map_transformer_status_t map_transformer_to_ref_float(
+  map_transformer_t const * transformer,
+  size_t count,
+  float const * x,
+  float const * y,
+  ptrdiff_t stride,
+  float * result_x,
+  float * result_y,
+  ptrdiff_t result_stride)
+{
+  return transform<true>(transformer, count, x, y, stride, result_x, result_y, result_stride);
+}
+
+map_transformer_status_t map_transformer_to_robot_float(
+  map_transformer_t const * transformer,
+  size_t count,
+  float const * x,
+  float const * y,
+  ptrdiff_t stride,
+  float * result_x,
+  float * result_y,
+  ptrdiff_t result_stride)
+{
+  return transform<false>(transformer, count, x, y, stride, result_x, result_y, result_stride);
+}
+
+map_transformer_status_t map_transformer_to_ref_double(
+  map_transformer_t const * transformer,
+  size_t count,
+  double const * x,
+  double const * y,
+  ptrdiff_t stride,
+  double * result_x,
+  double * result_y,
+  ptrdiff_t result_stride)
+{
+  return transform<true>(transformer, count, x, y, stride, result_x, result_y, result_stride);
+}
+
+map_transformer_status_t map_transformer_to_robot_double(
+  map_transformer_t const * transformer,
+  size_t count,
+  double const * x,
+  double const * y,
+  ptrdiff_t stride,
+  double * result_x,
+  double * result_y,
+  ptrdiff_t result_stride)
+{
+  return transform<false>(transformer, count, x, y, stride, result_x, result_y, result_stride);
+}
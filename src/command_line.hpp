@@ -0,0 +1,191 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__COMMAND_LINE_HPP_
+#define MAP_TRANSFORMER__COMMAND_LINE_HPP_
+
+// Option parsing for the command line tools. They only need the core library, so they parse
+// their options themselves rather than using OpenCV's command line parser as the visualiser does.
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer {
+
+namespace command_line {
+
+// The most threads an option may ask for, far more than any machine has cores, so that a
+// mistaken count fails cleanly rather than when the threads cannot be started
+constexpr unsigned long MAX_THREADS = 1024;
+
+// Parse a whole number in [min, max], throwing std::invalid_argument naming the option if the
+// text is anything else
+template<typename T>
+T parse_integer(std::string const &key, std::string const &text, T min, T max) {
+  T value{};
+  auto end = text.data() + text.size();
+  auto parsed = std::from_chars(text.data(), end, value);
+  if (parsed.ec != std::errc() || parsed.ptr != end || value < min || value > max) {
+    std::ostringstream error;
+    error << "The " << key << " option must be a whole number from " << min << " to " << max <<
+      ", not \"" << text << '"';
+    throw std::invalid_argument(error.str());
+  }
+  return value;
+}
+
+// Parse a finite number in (min, max], throwing std::invalid_argument naming the option if the
+// text is anything else
+inline double parse_real(std::string const &key, std::string const &text, double min, double max)
+{
+  // Not std::from_chars, which not every standard library supports for floating point yet
+  char *end = nullptr;
+  double value = text.empty() || std::isspace(static_cast<unsigned char>(text[0])) ?
+    NAN : std::strtod(text.c_str(), &end);
+  if (end != text.c_str() + text.size() || !(value > min && value <= max)) {
+    std::ostringstream error;
+    error << "The " << key << " option must be a number greater than " << min << " and at " <<
+      "most " << max << ", not \"" << text << '"';
+    throw std::invalid_argument(error.str());
+  }
+  return value;
+}
+
+// A tool's options, given as --option=value or -o=value, switches given as --switch, and the
+// arguments that are not options. Anything else, such as an unknown option, an option without
+// its value or a switch with one, is an error, so that a mistyped option is never ignored.
+class Options {
+public:
+  // Aliases give the full names of short options. A tool that takes no arguments besides its
+  // options treats any it is given as an error.
+  Options(
+    std::set<std::string> value_options,
+    std::set<std::string> switches,
+    std::map<std::string, std::string> aliases,
+    bool takes_arguments = true)
+  : _value_options(std::move(value_options)),
+    _switches(std::move(switches)),
+    _aliases(std::move(aliases)),
+    _takes_arguments(takes_arguments)
+  {}
+
+  // Parse the command line, throwing std::invalid_argument describing the first argument that is
+  // not valid. "-" on its own is an argument, for standard input.
+  void parse(int argc, char const * const * argv) {
+    for (int ii = 1; ii < argc; ++ii) {
+      std::string argument(argv[ii]);
+      if (argument == "-" || argument.empty() || argument[0] != '-') {
+        if (!_takes_arguments) {
+          throw std::invalid_argument("Unexpected argument: " + argument);
+        }
+        _arguments.push_back(argument);
+        continue;
+      }
+      auto start = argument.find_first_not_of('-');
+      if (start == std::string::npos) {
+        throw std::invalid_argument("Unexpected argument: " + argument);
+      }
+      auto equals = argument.find('=');
+      auto key = argument.substr(start, equals == std::string::npos ? equals : equals - start);
+      auto alias = _aliases.find(key);
+      if (alias != _aliases.end()) {
+        key = alias->second;
+      }
+      if (_switches.count(key) != 0) {
+        if (equals != std::string::npos) {
+          throw std::invalid_argument("The " + key + " option does not take a value");
+        }
+        _values[key] = "true";
+      } else if (_value_options.count(key) != 0) {
+        // A value given after a space would otherwise be taken as an argument
+        if (equals == std::string::npos) {
+          throw std::invalid_argument(
+            "The " + key + " option needs a value, given as --" + key + "=<value>");
+        }
+        _values[key] = argument.substr(equals + 1);
+      } else {
+        throw std::invalid_argument("Unknown option: " + argument);
+      }
+    }
+  }
+
+  // Whether an option or switch was given
+  bool has(std::string const &key) const {
+    return _values.count(key) != 0;
+  }
+
+  // Get an option's value, or the default if it was not given
+  std::string value(std::string const &key, std::string const &default_value = {}) const {
+    auto found = _values.find(key);
+    return found == _values.end() ? default_value : found->second;
+  }
+
+  // Get an option's value as a whole number in [min, max], or the default if it was not given
+  template<typename T>
+  T integer(std::string const &key, T default_value, T min, T max) const {
+    auto found = _values.find(key);
+    return found == _values.end() ? default_value : parse_integer(key, found->second, min, max);
+  }
+
+  // Get an option's value as a comma-separated list of whole numbers in [min, max], or an empty
+  // list if it was not given
+  template<typename T>
+  std::vector<T> integers(std::string const &key, T min, T max) const {
+    std::vector<T> values;
+    auto found = _values.find(key);
+    if (found != _values.end()) {
+      std::istringstream stream(found->second);
+      std::string value;
+      while (std::getline(stream, value, ',')) {
+        values.push_back(parse_integer(key, value, min, max));
+      }
+    }
+    return values;
+  }
+
+  // Get an option's value as a finite number in (min, max], or the default if it was not given
+  double real(std::string const &key, double default_value, double min, double max) const {
+    auto found = _values.find(key);
+    return found == _values.end() ? default_value : parse_real(key, found->second, min, max);
+  }
+
+  // The arguments that are not options, in order
+  std::vector<std::string> const &arguments() const {
+    return _arguments;
+  }
+
+private:
+  std::set<std::string> _value_options;
+  std::set<std::string> _switches;
+  std::map<std::string, std::string> _aliases;
+  bool _takes_arguments;
+  std::map<std::string, std::string> _values;
+  std::vector<std::string> _arguments;
+};
+
+}  // namespace command_line
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__COMMAND_LINE_HPP_
@@ -0,0 +1,316 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/delaunay.hpp"
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/predicates.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+// The vertex at infinity. Each edge of the convex hull has a ghost face joining it to this vertex,
+// so that points outside the hull can be inserted in the same way as points inside it.
+constexpr int GHOST = -1;
+
+// A triangle of the triangulation, with its vertices in counterclockwise order. A ghost face
+// always has the ghost vertex last.
+struct Face {
+  std::array<int, 3> vertices;
+  // The face across the edge opposite each vertex
+  std::array<int, 3> neighbours;
+  bool alive;
+
+  bool ghost() const {
+    return vertices[2] == GHOST;
+  }
+};
+
+class Triangulation {
+public:
+  explicit Triangulation(CorrespondencePoints const &points)
+  : _points(points),
+    _conflict_stamp(0),
+    _last(0),
+    _start_faces(points.size() + 1, -1),
+    _end_faces(points.size() + 1, -1) {}
+
+  bool initialise(std::vector<std::int32_t> const &order, std::array<int, 3> &first);
+  void insert(int vertex);
+  TriangleList triangles() const;
+
+private:
+  int locate(Point2D const &point) const;
+  bool in_conflict(Face const &face, Point2D const &point) const;
+  int add_face(std::array<int, 3> vertices);
+  void link(int face, int other);
+
+  // Index the edge lookups by vertex + 1, so the ghost vertex has a slot
+  int &start_face(int vertex) {
+    return _start_faces[vertex + 1];
+  }
+  int &end_face(int vertex) {
+    return _end_faces[vertex + 1];
+  }
+
+  CorrespondencePoints const &_points;
+  std::vector<Face> _faces;
+  std::vector<int> _free_faces;
+  // The faces last found to be in conflict are marked with the current stamp
+  std::vector<std::uint32_t> _conflict_marks;
+  std::uint32_t _conflict_stamp;
+  int _last;
+  // Scratch space for insertion
+  std::vector<int> _cavity;
+  std::vector<std::array<int, 3>> _boundary;
+  std::vector<int> _new_faces;
+  std::vector<int> _start_faces;
+  std::vector<int> _end_faces;
+};
+
+
+bool Triangulation::initialise(std::vector<std::int32_t> const &order, std::array<int, 3> &first) {
+  // Find three points that are not collinear, preferring the first of any duplicates
+  int a = order[0];
+  int b = -1;
+  int c = -1;
+  for (auto ii : order) {
+    if (b < 0) {
+      if (_points[ii] != _points[a]) {
+        b = ii;
+      }
+    } else if (orient2d(_points[a], _points[b], _points[ii]) != 0) {
+      c = ii;
+      break;
+    }
+  }
+  if (c < 0) {
+    return false;
+  }
+  if (orient2d(_points[a], _points[b], _points[c]) < 0) {
+    std::swap(b, c);
+  }
+  first = {a, b, c};
+
+  int finite = add_face({a, b, c});
+  int ghosts[3] = {add_face({c, b, GHOST}), add_face({a, c, GHOST}), add_face({b, a, GHOST})};
+  for (int ii = 0; ii < 3; ++ii) {
+    link(finite, ghosts[ii]);
+    link(ghosts[ii], ghosts[(ii + 1) % 3]);
+  }
+  _last = finite;
+  return true;
+}
+
+
+void Triangulation::insert(int vertex) {
+  Point2D const &point = _points[vertex];
+  int start = locate(point);
+  if (!_faces[start].ghost()) {
+    for (int v : _faces[start].vertices) {
+      if (_points[v] == point) {
+        // A duplicate of an existing vertex
+        return;
+      }
+    }
+  }
+
+  // Find the cavity of faces whose circumcircles contain the point, and the edges around it
+  ++_conflict_stamp;
+  _conflict_marks.resize(_faces.size(), 0);
+  _cavity.clear();
+  _boundary.clear();
+  _cavity.push_back(start);
+  _conflict_marks[start] = _conflict_stamp;
+  for (std::size_t ii = 0; ii < _cavity.size(); ++ii) {
+    Face const &face = _faces[_cavity[ii]];
+    for (int jj = 0; jj < 3; ++jj) {
+      int neighbour = face.neighbours[jj];
+      if (_conflict_marks[neighbour] == _conflict_stamp) {
+        continue;
+      }
+      if (in_conflict(_faces[neighbour], point)) {
+        _conflict_marks[neighbour] = _conflict_stamp;
+        _cavity.push_back(neighbour);
+      } else {
+        _boundary.push_back({face.vertices[(jj + 1) % 3], face.vertices[(jj + 2) % 3], neighbour});
+      }
+    }
+  }
+  for (int f : _cavity) {
+    _faces[f].alive = false;
+    _free_faces.push_back(f);
+  }
+
+  // Join each edge of the cavity's boundary to the new point. The cavity is star-shaped as seen
+  // from the point, so its boundary is a single loop and each vertex starts and ends one edge.
+  _new_faces.clear();
+  for (auto const &edge : _boundary) {
+    int f = add_face({edge[0], edge[1], vertex});
+    link(f, edge[2]);
+    start_face(edge[0]) = f;
+    end_face(edge[1]) = f;
+    _new_faces.push_back(f);
+  }
+  for (std::size_t ii = 0; ii < _new_faces.size(); ++ii) {
+    link(_new_faces[ii], start_face(_boundary[ii][1]));
+    link(_new_faces[ii], end_face(_boundary[ii][0]));
+  }
+  for (int f : _new_faces) {
+    if (!_faces[f].ghost()) {
+      _last = f;
+      break;
+    }
+  }
+}
+
+
+TriangleList Triangulation::triangles() const {
+  TriangleList triangles;
+  for (auto const &face : _faces) {
+    if (face.alive && !face.ghost()) {
+      triangles.emplace_back(face.vertices[0], face.vertices[1], face.vertices[2]);
+    }
+  }
+  return triangles;
+}
+
+
+int Triangulation::locate(Point2D const &point) const {
+  // Walk from the last face created towards the point. In a Delaunay triangulation this walk
+  // cannot cycle, but in case it does, fall back to testing every face.
+  int f = _last;
+  for (std::size_t steps = 0; steps < _faces.size(); ++steps) {
+    Face const &face = _faces[f];
+    int next = -1;
+    for (int ii = 0; ii < 3; ++ii) {
+      if (orient2d(
+          _points[face.vertices[(ii + 1) % 3]],
+          _points[face.vertices[(ii + 2) % 3]],
+          point) < 0)
+      {
+        next = face.neighbours[ii];
+        break;
+      }
+    }
+    if (next < 0 || _faces[next].ghost()) {
+      // Either the point is in this face, or it is outside the hull and the ghost face across the
+      // edge it is beyond is in conflict with it
+      return next < 0 ? f : next;
+    }
+    f = next;
+  }
+
+  for (std::size_t ii = 0; ii < _faces.size(); ++ii) {
+    Face const &face = _faces[ii];
+    if (!face.alive) {
+      continue;
+    }
+    if (face.ghost() ? in_conflict(face, point) : triangle_contains(
+        {_points[face.vertices[0]], _points[face.vertices[1]], _points[face.vertices[2]]}, point))
+    {
+      return static_cast<int>(ii);
+    }
+  }
+  return _last;
+}
+
+
+bool Triangulation::in_conflict(Face const &face, Point2D const &point) const {
+  Point2D const &a = _points[face.vertices[0]];
+  Point2D const &b = _points[face.vertices[1]];
+  if (!face.ghost()) {
+    return incircle(a, b, _points[face.vertices[2]], point) > 0;
+  }
+
+  // A ghost face's circumcircle is the open half-plane beyond its hull edge, plus the open edge
+  // itself
+  double orientation = orient2d(a, b, point);
+  if (orientation != 0) {
+    return orientation > 0;
+  }
+  if (a.first != b.first) {
+    return point.first > std::min(a.first, b.first) && point.first < std::max(a.first, b.first);
+  }
+  return point.second > std::min(a.second, b.second) && point.second < std::max(a.second, b.second);
+}
+
+
+int Triangulation::add_face(std::array<int, 3> vertices) {
+  // Keep the ghost vertex last
+  if (vertices[0] == GHOST) {
+    vertices = {vertices[1], vertices[2], vertices[0]};
+  } else if (vertices[1] == GHOST) {
+    vertices = {vertices[2], vertices[0], vertices[1]};
+  }
+  Face face{vertices, {-1, -1, -1}, true};
+  if (_free_faces.empty()) {
+    _faces.push_back(face);
+    return static_cast<int>(_faces.size() - 1);
+  }
+  int f = _free_faces.back();
+  _free_faces.pop_back();
+  _faces[f] = face;
+  return f;
+}
+
+
+void Triangulation::link(int face, int other) {
+  // Find the edge the two faces share, which runs in opposite directions around each
+  auto &a = _faces[face];
+  auto &b = _faces[other];
+  for (int ii = 0; ii < 3; ++ii) {
+    int u = a.vertices[(ii + 1) % 3];
+    int v = a.vertices[(ii + 2) % 3];
+    for (int jj = 0; jj < 3; ++jj) {
+      if (b.vertices[(jj + 1) % 3] == v && b.vertices[(jj + 2) % 3] == u) {
+        a.neighbours[ii] = other;
+        b.neighbours[jj] = face;
+        return;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+
+TriangleList delaunay_triangulation(CorrespondencePoints const &points) {
+  if (points.size() < 3) {
+    return TriangleList();
+  }
+
+  auto order = spatial_order(points);
+  Triangulation triangulation(points);
+  std::array<int, 3> first;
+  if (!triangulation.initialise(order, first)) {
+    return TriangleList();
+  }
+  for (auto ii : order) {
+    if (ii != first[0] && ii != first[1] && ii != first[2]) {
+      triangulation.insert(ii);
+    }
+  }
+  return triangulation.triangles();
+}
+
+}  // namespace map_transformer
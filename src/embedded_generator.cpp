@@ -0,0 +1,304 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/embedded_generator.hpp"
+#include "map_transformer/embedded.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+// Format a number so that it is read back as exactly the same value
+template<typename T>
+std::string literal(T value) {
+  std::string type = std::is_same<T, float>::value ? "float" : "double";
+  if (std::isnan(value)) {
+    return "std::numeric_limits<" + type + ">::quiet_NaN()";
+  }
+  if (std::isinf(value)) {
+    return std::string(value < 0 ? "-" : "") + "std::numeric_limits<" + type + ">::infinity()";
+  }
+  std::ostringstream stream;
+  stream.precision(std::numeric_limits<T>::max_digits10);
+  stream << value;
+  auto text = stream.str();
+  if (text.find_first_of(".e") == std::string::npos) {
+    text += ".0";
+  }
+  return std::is_same<T, float>::value ? text + "f" : text;
+}
+
+std::string point_literal(Point2D const &point) {
+  return "{" + literal(point.first) + ", " + literal(point.second) + "}";
+}
+
+bool is_identifier(std::string const &name) {
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+    return false;
+  }
+  return std::all_of(
+    std::begin(name), std::end(name), [](char c) {
+      return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    });
+}
+
+// The data for one direction of transformation, in the form written to the header
+struct DirectionData {
+  std::vector<std::pair<Point2D, Point2D>> corr_points;
+  TriangleGeometry triangles;
+  std::vector<AffineTransform> transforms;
+  float min_x{0}, min_y{0}, max_x{0}, max_y{0};
+  float scale_x{0}, scale_y{0};
+  std::int32_t columns{0}, rows{0};
+  std::vector<std::uint32_t> cell_offsets;
+  std::vector<std::int32_t> cell_triangles;
+  float map_scale_x{1}, map_scale_y{1};
+  bool rotated{false};
+  double cos_rotation{1}, sin_rotation{0};
+  float translation_x{0}, translation_y{0};
+  bool inverse{false};
+};
+
+// Sort the correspondence points for binary searching, keeping the first of any duplicates as the
+// Transformer does
+std::vector<std::pair<Point2D, Point2D>> sorted_corr_points(
+  CorrespondencePoints const &points,
+  CorrespondencePoints const &targets)
+{
+  std::vector<std::pair<Point2D, Point2D>> result;
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    if (!std::isnan(points[ii].first) && !std::isnan(points[ii].second)) {
+      result.emplace_back(points[ii], targets[ii]);
+    }
+  }
+  auto less = [](std::pair<Point2D, Point2D> const &a, std::pair<Point2D, Point2D> const &b) {
+      return a.first.first < b.first.first ||
+             (a.first.first == b.first.first && a.first.second < b.first.second);
+    };
+  std::stable_sort(std::begin(result), std::end(result), less);
+  result.erase(
+    std::unique(
+      std::begin(result), std::end(result),
+      [](std::pair<Point2D, Point2D> const &a, std::pair<Point2D, Point2D> const &b) {
+        return a.first.first == b.first.first && a.first.second == b.first.second;
+      }),
+    std::end(result));
+  return result;
+}
+
+// Build a uniform grid with roughly one cell per triangle, listing in each cell the triangles whose
+// bounding boxes overlap it
+void build_grid(DirectionData &data) {
+  auto const &triangles = data.triangles;
+  if (triangles.empty()) {
+    data.cell_offsets = {0};
+    return;
+  }
+  data.min_x = data.min_y = std::numeric_limits<float>::infinity();
+  data.max_x = data.max_y = -std::numeric_limits<float>::infinity();
+  std::vector<std::array<float, 4>> boxes;
+  for (auto const &t : triangles) {
+    auto x = std::minmax({t[0].first, t[1].first, t[2].first});
+    auto y = std::minmax({t[0].second, t[1].second, t[2].second});
+    boxes.push_back({x.first, y.first, x.second, y.second});
+    data.min_x = std::min(data.min_x, x.first);
+    data.min_y = std::min(data.min_y, y.first);
+    data.max_x = std::max(data.max_x, x.second);
+    data.max_y = std::max(data.max_y, y.second);
+  }
+  double width = static_cast<double>(data.max_x) - data.min_x;
+  double height = static_cast<double>(data.max_y) - data.min_y;
+  double cells = static_cast<double>(triangles.size());
+  double column_count = 1.0;
+  if (width > 0 && height > 0) {
+    column_count = std::sqrt(cells * width / height);
+  } else if (width > 0) {
+    column_count = cells;
+  }
+  column_count = std::clamp(std::round(column_count), 1.0, cells);
+  double row_count = height > 0 ? std::clamp(std::ceil(cells / column_count), 1.0, cells) : 1.0;
+  data.columns = static_cast<std::int32_t>(column_count);
+  data.rows = static_cast<std::int32_t>(row_count);
+  data.scale_x = width > 0 ? static_cast<float>(data.columns / width) : 0.0f;
+  data.scale_y = height > 0 ? static_cast<float>(data.rows / height) : 0.0f;
+
+  // Use the same cell calculation as the queries, so that every point in a bounding box is in a
+  // cell the box is listed in
+  std::vector<std::vector<std::int32_t>> lists(
+    static_cast<std::size_t>(data.columns) * data.rows);
+  for (std::size_t ii = 0; ii < boxes.size(); ++ii) {
+    auto first_column = embedded::grid_cell(boxes[ii][0], data.min_x, data.scale_x, data.columns);
+    auto last_column = embedded::grid_cell(boxes[ii][2], data.min_x, data.scale_x, data.columns);
+    auto first_row = embedded::grid_cell(boxes[ii][1], data.min_y, data.scale_y, data.rows);
+    auto last_row = embedded::grid_cell(boxes[ii][3], data.min_y, data.scale_y, data.rows);
+    for (auto row = first_row; row <= last_row; ++row) {
+      for (auto column = first_column; column <= last_column; ++column) {
+        lists[static_cast<std::size_t>(row) * data.columns + column].push_back(
+          static_cast<std::int32_t>(ii));
+      }
+    }
+  }
+  for (auto const &list : lists) {
+    data.cell_offsets.push_back(static_cast<std::uint32_t>(data.cell_triangles.size()));
+    data.cell_triangles.insert(std::end(data.cell_triangles), std::begin(list), std::end(list));
+  }
+  data.cell_offsets.push_back(static_cast<std::uint32_t>(data.cell_triangles.size()));
+}
+
+void write_direction(std::ostream &output, std::string const &prefix, DirectionData const &data) {
+  output << "inline constexpr map_transformer::embedded::CorrespondencePoint " << prefix <<
+    "_corr_points[] = {\n";
+  for (auto const &entry : data.corr_points) {
+    output << "  {" << point_literal(entry.first) << ", " << point_literal(entry.second) << "},\n";
+  }
+  output << "};\n\n";
+
+  // Arrays cannot be empty, so a triangulation with no triangles is given one unused entry
+  output << "inline constexpr map_transformer::embedded::Triangle " << prefix <<
+    "_triangles[] = {\n";
+  for (auto const &t : data.triangles) {
+    output << "  {{" << point_literal(t[0]) << ", " << point_literal(t[1]) << ", " <<
+      point_literal(t[2]) << "}},\n";
+  }
+  if (data.triangles.empty()) {
+    output << "  {},\n";
+  }
+  output << "};\n\n";
+
+  output << "inline constexpr map_transformer::embedded::AffineTransform " << prefix <<
+    "_transforms[] = {\n";
+  for (auto const &transform : data.transforms) {
+    output << "  {{";
+    for (std::size_t ii = 0; ii < transform.size(); ++ii) {
+      output << (ii > 0 ? ", " : "") << literal(transform[ii]);
+    }
+    output << "}},\n";
+  }
+  if (data.transforms.empty()) {
+    output << "  {},\n";
+  }
+  output << "};\n\n";
+
+  output << "inline constexpr std::uint32_t " << prefix << "_cell_offsets[] = {";
+  for (std::size_t ii = 0; ii < data.cell_offsets.size(); ++ii) {
+    output << (ii % 16 == 0 ? "\n  " : " ") << data.cell_offsets[ii] << ",";
+  }
+  output << "\n};\n\n";
+
+  output << "inline constexpr std::int32_t " << prefix << "_cell_triangles[] = {";
+  for (std::size_t ii = 0; ii < data.cell_triangles.size(); ++ii) {
+    output << (ii % 16 == 0 ? "\n  " : " ") << data.cell_triangles[ii] << ",";
+  }
+  if (data.cell_triangles.empty()) {
+    output << "\n  0,";
+  }
+  output << "\n};\n\n";
+}
+
+void write_direction_object(
+  std::ostream &output,
+  std::string const &prefix,
+  DirectionData const &data)
+{
+  output << "  static constexpr map_transformer::embedded::Direction " << prefix << "{\n" <<
+    "    data::" << prefix << "_corr_points, " << data.corr_points.size() << ",\n" <<
+    "    data::" << prefix << "_triangles, data::" << prefix << "_transforms, " <<
+    data.triangles.size() << ",\n" <<
+    "    " << literal(data.min_x) << ", " << literal(data.min_y) << ", " <<
+    literal(data.max_x) << ", " << literal(data.max_y) << ",\n" <<
+    "    " << literal(data.scale_x) << ", " << literal(data.scale_y) << ",\n" <<
+    "    " << data.columns << ", " << data.rows << ",\n" <<
+    "    data::" << prefix << "_cell_offsets, data::" << prefix << "_cell_triangles,\n" <<
+    "    {" << literal(data.map_scale_x) << ", " << literal(data.map_scale_y) << ", " <<
+    (data.rotated ? "true" : "false") << ", " << literal(data.cos_rotation) << ", " <<
+    literal(data.sin_rotation) << ", " << literal(data.translation_x) << ", " <<
+    literal(data.translation_y) << ", " << (data.inverse ? "true" : "false") << "}};\n";
+}
+
+}  // namespace
+
+
+void EmbeddedMapGenerator::write(
+  Transformer const &transformer,
+  std::string const &name,
+  std::ostream &output)
+{
+  if (!is_identifier(name)) {
+    throw std::invalid_argument("Not a valid C++ identifier: " + name);
+  }
+  if (transformer._empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  DirectionData to_ref, to_robot;
+  to_ref.corr_points = sorted_corr_points(
+    transformer._robot_corr_points, transformer._ref_corr_points);
+  to_ref.triangles = transformer._robot_triangulation.locator.triangles();
+  to_ref.transforms = transformer._robot_triangulation.transforms;
+  to_robot.corr_points = sorted_corr_points(
+    transformer._ref_corr_points, transformer._robot_corr_points);
+  to_robot.triangles = transformer._ref_triangulation.locator.triangles();
+  to_robot.transforms = transformer._ref_triangulation.transforms;
+
+  // The cosines and sines are calculated here as the Transformer calculates them, so that the
+  // results do not depend on the target's maths library
+  for (auto *data : {&to_ref, &to_robot}) {
+    data->inverse = data == &to_robot;
+    double rotation = data->inverse ? -transformer._robot_map_rotation :
+      transformer._robot_map_rotation;
+    data->map_scale_x = transformer._robot_map_scale.first;
+    data->map_scale_y = transformer._robot_map_scale.second;
+    data->rotated = transformer._robot_map_rotation != 0;
+    data->cos_rotation = std::cos(rotation);
+    data->sin_rotation = std::sin(rotation);
+    data->translation_x = transformer._robot_map_translation.first;
+    data->translation_y = transformer._robot_map_translation.second;
+    build_grid(*data);
+  }
+
+  std::string guard = name;
+  std::transform(
+    std::begin(guard), std::end(guard), std::begin(guard), [](char c) {
+      return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    });
+  guard += "_HPP_";
+
+  output << "// Generated by generate_embedded_map from the map information for\n// " <<
+    transformer._ref_map_name << " and " << transformer._robot_map_name << ". Do not edit.\n\n" <<
+    "#ifndef " << guard << "\n#define " << guard << "\n\n" <<
+    "#include \"map_transformer/embedded.hpp\"\n\n" <<
+    "#include <cstdint>\n#include <limits>\n\n\n" <<
+    "namespace " << name << " {\n\nnamespace data {\n\n";
+  write_direction(output, "to_ref", to_ref);
+  write_direction(output, "to_robot", to_robot);
+  output << "}  // namespace data\n\n" <<
+    "/// The map data, for map_transformer::embedded::to_ref() and to_robot().\n" <<
+    "struct Map {\n";
+  write_direction_object(output, "to_ref", to_ref);
+  write_direction_object(output, "to_robot", to_robot);
+  output << "};\n\n}  // namespace " << name << "\n\n#endif  // " << guard << "\n";
+}
+
+}  // namespace map_transformer
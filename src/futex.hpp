@@ -0,0 +1,106 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__FUTEX_HPP_
+#define MAP_TRANSFORMER__FUTEX_HPP_
+
+// Waiting on counters in memory shared between processes, used by shared memory channels
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+
+namespace map_transformer {
+
+namespace futex {
+
+// Sleep until woken while the value is still expected, or until the timeout passes. Returns false
+// if the timeout passed. May also return early for no reason, so the caller must check the value.
+inline bool wait(
+  std::atomic<std::uint32_t> &value,
+  std::uint32_t expected,
+  std::chrono::nanoseconds timeout)
+{
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec relative{
+    static_cast<time_t>(seconds.count()), static_cast<long>((timeout - seconds).count())};
+  // Not FUTEX_PRIVATE_FLAG, because the value may be mapped into another process
+  auto result = ::syscall(
+    SYS_futex, reinterpret_cast<std::uint32_t *>(&value), FUTEX_WAIT, expected, &relative,
+    nullptr, 0);
+  return result == 0 || errno != ETIMEDOUT;
+}
+
+// Wake every thread, in any process, sleeping on the value
+inline void wake(std::atomic<std::uint32_t> &value) {
+  ::syscall(
+    SYS_futex, reinterpret_cast<std::uint32_t *>(&value), FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+    0);
+}
+
+// How long to poll a counter before sleeping on it; waking a sleeping thread takes much longer
+constexpr std::chrono::microseconds SPIN_TIME{50};
+
+// Wait for a counter to change from its current value, polling it briefly and then sleeping with
+// the waiting flag set, for at most the timeout. Returns false if it did not change.
+inline bool wait_for_change(
+  std::atomic<std::uint32_t> &value,
+  std::uint32_t current,
+  std::atomic<std::uint32_t> &waiting,
+  std::chrono::nanoseconds timeout)
+{
+  auto spin_end = std::chrono::steady_clock::now() + SPIN_TIME;
+  do {
+    if (value.load(std::memory_order_acquire) != current) {
+      return true;
+    }
+    std::this_thread::yield();
+  } while (std::chrono::steady_clock::now() < spin_end);
+
+  // The other side changes the value before it checks the flag, and this side sets the flag
+  // before it checks the value, so at least one of them sees the other
+  waiting.store(1, std::memory_order_seq_cst);
+  if (value.load(std::memory_order_seq_cst) == current) {
+    wait(value, current, timeout);
+  }
+  waiting.store(0, std::memory_order_relaxed);
+  return value.load(std::memory_order_acquire) != current;
+}
+
+// Change a counter and wake the other side if it is sleeping on it
+inline void publish(
+  std::atomic<std::uint32_t> &value,
+  std::uint32_t new_value,
+  std::atomic<std::uint32_t> &waiting)
+{
+  value.store(new_value, std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_seq_cst) != 0) {
+    wake(value);
+  }
+}
+
+}  // namespace futex
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__FUTEX_HPP_
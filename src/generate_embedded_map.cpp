@@ -0,0 +1,94 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <map_transformer/embedded_generator.hpp>
+#include <map_transformer/transformer.hpp>
+
+#include "command_line.hpp"
+
+void print_usage() {
+  std::cout << "Generate a header embedding map information for map_transformer::embedded\n\n" <<
+    "Usage: generate_embedded_map --map-info-file=<file> --output=<file> --name=<name> " <<
+    "[--per-direction]\n\n" <<
+    "  -m, --map-info-file  the YAML file containing the map information\n" <<
+    "  -o, --output         the header file to write\n" <<
+    "  -n, --name           the namespace to put the map data in\n" <<
+    "  -p, --per-direction  triangulate each map separately\n" <<
+    "  -h, --help           print this message\n";
+}
+
+int main(int argc, char ** argv)
+{
+  map_transformer::command_line::Options options(
+    {"map-info-file", "output", "name"},
+    {"per-direction", "help"},
+    {{"m", "map-info-file"}, {"o", "output"}, {"n", "name"}, {"p", "per-direction"},
+      {"h", "help"}},
+    false);
+  try {
+    options.parse(argc, argv);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+
+  if (options.has("help")) {
+    print_usage();
+    return 0;
+  }
+  for (auto const &key : {"map-info-file", "output", "name"}) {
+    if (options.value(key).empty()) {
+      std::cerr << "No " << key << " provided\n\n";
+      print_usage();
+      return 1;
+    }
+  }
+
+  std::ifstream yaml_file(options.value("map-info-file"));
+  if (!yaml_file.is_open()) {
+    std::cerr << "Could not read YAML document\n";
+    return 1;
+  }
+  std::ostringstream sstr;
+  sstr << yaml_file.rdbuf();
+
+  // Write to a string first so that a failure does not leave a partial header behind
+  std::ostringstream header;
+  try {
+    map_transformer::Transformer transformer;
+    if (options.has("per-direction")) {
+      transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+    }
+    transformer.load(sstr.str());
+    map_transformer::EmbeddedMapGenerator::write(transformer, options.value("name"), header);
+  } catch (std::exception const &e) {
+    std::cerr << "Could not generate the header: " << e.what() << '\n';
+    return 1;
+  }
+
+  std::ofstream output(options.value("output"));
+  output << header.str();
+  if (!output) {
+    std::cerr << "Could not write " << options.value("output") << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/image_size.hpp"
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+std::uint32_t read_big_endian(unsigned char const *bytes) {
+  return (static_cast<std::uint32_t>(bytes[0]) << 24) |
+         (static_cast<std::uint32_t>(bytes[1]) << 16) |
+         (static_cast<std::uint32_t>(bytes[2]) << 8) |
+         static_cast<std::uint32_t>(bytes[3]);
+}
+
+// The width and height are the first fields of the IHDR chunk, which must come first
+Vector2D read_png_size(std::ifstream &file, std::string const &path) {
+  std::array<unsigned char, 16> header;
+  file.read(reinterpret_cast<char *>(header.data()), header.size());
+  if (!file || header[4] != 'I' || header[5] != 'H' || header[6] != 'D' || header[7] != 'R') {
+    throw std::runtime_error("Invalid PNG image file: " + path);
+  }
+  return Vector2D{
+    static_cast<float>(read_big_endian(&header[8])),
+    static_cast<float>(read_big_endian(&header[12]))};
+}
+
+// Read the next decimal number in a Netpbm header, skipping whitespace and comments
+long read_netpbm_number(std::ifstream &file, std::string const &path) {
+  int c = file.get();
+  while (c == '#' || std::isspace(c)) {
+    if (c == '#') {
+      while (c != '\n' && c != std::char_traits<char>::eof()) {
+        c = file.get();
+      }
+    }
+    c = file.get();
+  }
+  if (!std::isdigit(c)) {
+    throw std::runtime_error("Invalid Netpbm image file: " + path);
+  }
+  long value{0};
+  for (; std::isdigit(c); c = file.get()) {
+    value = value * 10 + (c - '0');
+    if (value > 1000000000L) {
+      throw std::runtime_error("Invalid Netpbm image file: " + path);
+    }
+  }
+  return value;
+}
+
+// The default reader is held in function-local statics so that libraries may set it while
+// static objects are being constructed
+std::mutex &default_reader_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+ImageSizeReader &default_reader() {
+  static ImageSizeReader reader{read_image_header_size};
+  return reader;
+}
+
+}  // namespace
+
+
+std::optional<Vector2D> read_image_header_size(std::string const &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open image file: " + path);
+  }
+  std::array<unsigned char, 8> signature{};
+  file.read(reinterpret_cast<char *>(signature.data()), 2);
+
+  if (signature[0] == 'P' && signature[1] >= '1' && signature[1] <= '6') {
+    auto width = read_netpbm_number(file, path);
+    auto height = read_netpbm_number(file, path);
+    return Vector2D{static_cast<float>(width), static_cast<float>(height)};
+  }
+
+  std::array<unsigned char, 8> const png_signature{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  if (signature[0] == png_signature[0] && signature[1] == png_signature[1]) {
+    file.read(reinterpret_cast<char *>(signature.data() + 2), 6);
+    if (file && signature == png_signature) {
+      return read_png_size(file, path);
+    }
+  }
+  // A file that is not an image, or is only partly written, must not pass for one
+  throw std::runtime_error("Unrecognised image file format: " + path);
+}
+
+void set_default_image_size_reader(ImageSizeReader reader) {
+  std::lock_guard<std::mutex> lock(default_reader_mutex());
+  default_reader() = std::move(reader);
+}
+
+ImageSizeReader default_image_size_reader() {
+  std::lock_guard<std::mutex> lock(default_reader_mutex());
+  return default_reader();
+}
+
+}  // namespace map_transformer
@@ -0,0 +1,87 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/locations.hpp"
+
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+
+namespace map_transformer
+{
+
+void LocationTable::build(std::vector<NamedLocation> locations) {
+  clear();
+  _locations = std::move(locations);
+  if (_locations.empty()) {
+    return;
+  }
+
+  // Keep the table no more than half full, so that probe sequences stay short
+  std::size_t slot_count{1};
+  while (slot_count < 2 * _locations.size()) {
+    slot_count *= 2;
+  }
+  _slots.assign(slot_count, -1);
+  _hashes.reserve(_locations.size());
+  for (std::size_t ii = 0; ii < _locations.size(); ++ii) {
+    auto const &name = _locations[ii].name;
+    if (find(name) >= 0) {
+      auto duplicated = name;
+      clear();
+      throw std::runtime_error("Duplicate location name: " + duplicated);
+    }
+    _hashes.push_back(std::hash<std::string>{}(name));
+    auto slot = _hashes.back() & slot_mask();
+    while (_slots[slot] >= 0) {
+      slot = (slot + 1) & slot_mask();
+    }
+    _slots[slot] = static_cast<std::int32_t>(ii);
+  }
+}
+
+void LocationTable::clear() {
+  _locations.clear();
+  _slots.clear();
+  _hashes.clear();
+}
+
+int LocationTable::find(std::string const &name) const {
+  if (_slots.empty()) {
+    return -1;
+  }
+  auto hash = std::hash<std::string>{}(name);
+  for (auto slot = hash & slot_mask(); _slots[slot] >= 0; slot = (slot + 1) & slot_mask()) {
+    auto index = _slots[slot];
+    if (_hashes[index] == hash && _locations[index].name == name) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+std::vector<NamedLocation> const &LocationTable::locations() const {
+  return _locations;
+}
+
+std::vector<NamedLocation> &LocationTable::locations() {
+  return _locations;
+}
+
+std::size_t LocationTable::slot_mask() const {
+  return _slots.size() - 1;
+}
+
+}  // namespace map_transformer
@@ -0,0 +1,790 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(MAP_TRANSFORM_BATCH_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <map_transformer/transformer.hpp>
+
+#include "command_line.hpp"
+
+using map_transformer::Point2D;
+using map_transformer::Transformer;
+
+namespace
+{
+
+// The input is read, transformed and written in blocks of about this many bytes
+constexpr std::size_t BLOCK_SIZE = 1 << 22;
+
+// Longest excerpt of an invalid line to include in an error message
+constexpr std::size_t MAX_EXCERPT_LENGTH = 40;
+
+enum class Format {csv, binary};
+
+// A block of the input, and what it becomes in the output
+struct Block {
+  std::size_t sequence{0};
+  // CSV text read, which is parsed into points
+  std::string text;
+  // Points read from binary input or parsed from CSV text, transformed in place
+  std::vector<Point2D> points;
+  // CSV text to write
+  std::string output;
+  // The input file the block was read from, and the position of that file among the inputs
+  std::string path;
+  std::size_t input{0};
+  // Lines of CSV text in the block, and the first invalid line, counting from one
+  std::size_t lines{0};
+  std::size_t invalid_line{0};
+  std::string invalid_text;
+};
+
+// Parse a number, returning the position after it or nullptr if there is none
+char const * parse_float(char const *begin, char const *end, float &value) {
+#if defined(__cpp_lib_to_chars)
+  auto result = std::from_chars(begin, end, value);
+  return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+  // strtof() skips leading white space, but the caller has skipped it already, and every line of
+  // a block ends with a newline, so it cannot read past the end
+  (void)end;
+  char *after;
+  value = std::strtof(begin, &after);
+  return after == begin ? nullptr : after;
+#endif
+}
+
+// Format a number with enough digits that it reads back exactly
+char * format_float(char *begin, char *end, float value) {
+#if defined(__cpp_lib_to_chars)
+  return std::to_chars(begin, end, value).ptr;
+#else
+  int length = std::snprintf(begin, end - begin, "%.9g", value);
+  return begin + length;
+#endif
+}
+
+char const * skip_spaces(char const *begin, char const *end) {
+  while (begin != end && (*begin == ' ' || *begin == '\t' || *begin == '\r')) {
+    ++begin;
+  }
+  return begin;
+}
+
+// Parse a line of the form "x,y"; blank lines are skipped
+bool parse_line(char const *begin, char const *end, std::vector<Point2D> &points) {
+  begin = skip_spaces(begin, end);
+  if (begin == end) {
+    return true;
+  }
+  Point2D point;
+  begin = parse_float(begin, end, point.first);
+  if (begin == nullptr) {
+    return false;
+  }
+  begin = skip_spaces(begin, end);
+  if (begin == end || *begin != ',') {
+    return false;
+  }
+  begin = parse_float(skip_spaces(begin + 1, end), end, point.second);
+  if (begin == nullptr || skip_spaces(begin, end) != end) {
+    return false;
+  }
+  points.push_back(point);
+  return true;
+}
+
+void parse_csv(Block &block) {
+  block.points.clear();
+  char const *line = block.text.data();
+  char const *end = line + block.text.size();
+  while (line != end) {
+    auto newline = static_cast<char const *>(std::memchr(line, '\n', end - line));
+    ++block.lines;
+    if (!parse_line(line, newline, block.points)) {
+      block.invalid_line = block.lines;
+      block.invalid_text.assign(line, std::min<std::size_t>(newline - line, MAX_EXCERPT_LENGTH));
+      return;
+    }
+    line = newline + 1;
+  }
+}
+
+void format_csv(Block &block) {
+  // Each number takes at most 15 characters
+  constexpr std::size_t MAX_LINE_LENGTH = 32;
+  block.output.resize(block.points.size() * MAX_LINE_LENGTH);
+  char *out = &block.output[0];
+  char *end = out + block.output.size();
+  for (auto const &point : block.points) {
+    out = format_float(out, end, point.first);
+    *out++ = ',';
+    out = format_float(out, end, point.second);
+    *out++ = '\n';
+  }
+  block.output.resize(out - block.output.data());
+}
+
+// Transforms blocks on several threads, and writes them in the order they were read
+class BatchPipeline {
+public:
+  BatchPipeline(
+    Transformer const &transformer,
+    bool to_ref,
+    Format format,
+    unsigned int threads,
+    std::FILE *output)
+  : _transformer(transformer),
+    _to_ref(to_ref),
+    _format(format),
+    _output(output),
+    _max_in_flight(2 * threads + 2)
+  {
+    for (unsigned int ii = 0; ii < threads; ++ii) {
+      _workers.emplace_back([this]() {work();});
+    }
+    _writer = std::thread([this]() {write();});
+  }
+
+  ~BatchPipeline() {
+    finish();
+  }
+
+  /// Queue a block to be transformed, waiting if too many are queued already.
+  /**
+   * \return false if the pipeline has failed, in which case the block is discarded.
+   */
+  bool push(std::unique_ptr<Block> block) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _space_available.wait(lock, [this]() {return _in_flight < _max_in_flight || _failed;});
+    if (_failed) {
+      return false;
+    }
+    block->sequence = _next_sequence++;
+    ++_in_flight;
+    _queue.push_back(std::move(block));
+    _work_available.notify_one();
+    return true;
+  }
+
+  /// Wait for every queued block to be written.
+  /**
+   * \return A description of the first failure, or an empty string.
+   */
+  std::string finish() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _closed = true;
+    }
+    _work_available.notify_all();
+    _block_done.notify_all();
+    for (auto &worker : _workers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+    if (_writer.joinable()) {
+      _writer.join();
+    }
+    return _error;
+  }
+
+  /// Stop accepting blocks, for example because the input could not be read.
+  void fail(std::string const &error) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_failed) {
+      _failed = true;
+      _error = error;
+    }
+    _space_available.notify_all();
+  }
+
+  bool failed() const {
+    return _failed;
+  }
+
+  std::size_t points_written() const {
+    return _points_written;
+  }
+
+private:
+  Transformer const &_transformer;
+  bool _to_ref;
+  Format _format;
+  std::FILE *_output;
+  std::size_t _max_in_flight;
+
+  std::mutex _mutex;
+  std::condition_variable _work_available;
+  std::condition_variable _block_done;
+  std::condition_variable _space_available;
+  std::deque<std::unique_ptr<Block>> _queue;
+  std::map<std::size_t, std::unique_ptr<Block>> _done;
+  std::size_t _next_sequence{0};
+  std::size_t _in_flight{0};
+  bool _closed{false};
+  std::atomic<bool> _failed{false};
+  std::string _error;
+  std::size_t _points_written{0};
+
+  std::vector<std::thread> _workers;
+  std::thread _writer;
+
+  void transform(Block &block) const {
+    if (_format == Format::csv) {
+      parse_csv(block);
+      if (block.invalid_line != 0) {
+        return;
+      }
+    }
+    if (_to_ref) {
+      _transformer.to_ref(block.points.data(), block.points.size(), block.points.data());
+    } else {
+      _transformer.to_robot(block.points.data(), block.points.size(), block.points.data());
+    }
+    if (_format == Format::csv) {
+      format_csv(block);
+    }
+  }
+
+  void work() {
+    while (true) {
+      std::unique_ptr<Block> block;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _work_available.wait(lock, [this]() {return !_queue.empty() || _closed;});
+        if (_queue.empty()) {
+          return;
+        }
+        block = std::move(_queue.front());
+        _queue.pop_front();
+      }
+      // Once the pipeline has failed, blocks are only passed on to the writer to be discarded
+      if (!_failed) {
+        transform(*block);
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto sequence = block->sequence;
+        _done.emplace(sequence, std::move(block));
+      }
+      _block_done.notify_all();
+    }
+  }
+
+  void write() {
+    std::size_t next = 0;
+    // Blocks are written in order, so the lines of earlier blocks of the same input are counted
+    // here to give each block's first line
+    std::size_t input = 0;
+    std::size_t lines = 0;
+    while (true) {
+      std::unique_ptr<Block> block;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _block_done.wait(
+          lock, [this, next]() {
+            return _done.count(next) != 0 || (_closed && next == _next_sequence);
+          });
+        if (_done.count(next) == 0) {
+          return;
+        }
+        block = std::move(_done.at(next));
+        _done.erase(next);
+      }
+
+      if (block->input != input) {
+        input = block->input;
+        lines = 0;
+      }
+      if (!_failed) {
+        if (block->invalid_line != 0) {
+          fail(
+            block->path + ":" + std::to_string(lines + block->invalid_line) +
+            ": Invalid point: " + block->invalid_text);
+        } else {
+          bool written;
+          if (_format == Format::csv) {
+            written = std::fwrite(block->output.data(), 1, block->output.size(), _output) ==
+              block->output.size();
+          } else {
+            written = std::fwrite(
+              block->points.data(), sizeof(Point2D), block->points.size(), _output) ==
+              block->points.size();
+          }
+          if (written) {
+            _points_written += block->points.size();
+          } else {
+            fail("Could not write the output");
+          }
+        }
+      }
+      lines += block->lines;
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_in_flight;
+        ++next;
+      }
+      _space_available.notify_one();
+    }
+  }
+};
+
+// Read an input file in blocks of whole points or lines, and queue them
+bool read_input(
+  std::FILE *input,
+  std::string const &path,
+  std::size_t index,
+  Format format,
+  BatchPipeline &pipeline,
+  std::string &error)
+{
+  if (format == Format::binary) {
+    constexpr std::size_t block_points = BLOCK_SIZE / sizeof(Point2D);
+    while (true) {
+      auto block = std::make_unique<Block>();
+      block->path = path;
+      block->input = index;
+      // Points are read straight into the array they are transformed in
+      block->points.resize(block_points);
+      auto bytes = std::fread(block->points.data(), 1, block_points * sizeof(Point2D), input);
+      if (bytes % sizeof(Point2D) != 0) {
+        error = "Input ends part of the way through a point";
+        return false;
+      }
+      block->points.resize(bytes / sizeof(Point2D));
+      bool end = bytes < block_points * sizeof(Point2D);
+      if (!block->points.empty() && !pipeline.push(std::move(block))) {
+        return true;
+      }
+      if (end) {
+        break;
+      }
+    }
+  } else {
+    // Each block ends at the end of a line, and the rest of the last line is carried over
+    std::string carried;
+    bool end = false;
+    while (!end) {
+      auto block = std::make_unique<Block>();
+      block->path = path;
+      block->input = index;
+      block->text = std::move(carried);
+      carried.clear();
+      std::size_t last_newline = std::string::npos;
+      while (last_newline == std::string::npos && !end) {
+        auto start = block->text.size();
+        block->text.resize(start + BLOCK_SIZE);
+        auto bytes = std::fread(&block->text[start], 1, BLOCK_SIZE, input);
+        block->text.resize(start + bytes);
+        end = bytes < BLOCK_SIZE;
+        last_newline = block->text.rfind('\n');
+      }
+      if (end) {
+        if (!block->text.empty() && block->text.back() != '\n') {
+          block->text.push_back('\n');
+        }
+      } else {
+        carried = block->text.substr(last_newline + 1);
+        block->text.resize(last_newline + 1);
+      }
+      if (!block->text.empty() && !pipeline.push(std::move(block))) {
+        return true;
+      }
+    }
+  }
+  if (std::ferror(input)) {
+    error = "Could not read the input";
+    return false;
+  }
+  return true;
+}
+
+#if defined(MAP_TRANSFORM_BATCH_MMAP)
+// Memory-mapped files are transformed a window of this many bytes at a time, so that files larger
+// than memory can be transformed; it is a multiple of any page size and of the size of a point
+constexpr std::size_t MAPPED_WINDOW_SIZE = std::size_t{1} << 24;
+
+// A file descriptor, closed on destruction
+class FileDescriptor {
+public:
+  explicit FileDescriptor(int fd)
+  : _fd(fd)
+  {}
+
+  FileDescriptor(FileDescriptor const &) = delete;
+  FileDescriptor & operator=(FileDescriptor const &) = delete;
+
+  ~FileDescriptor() {
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+  }
+
+  int get() const {
+    return _fd;
+  }
+
+  /// Close the descriptor, returning false if that fails.
+  bool close() {
+    int fd = _fd;
+    _fd = -1;
+    return ::close(fd) == 0;
+  }
+
+private:
+  int _fd;
+};
+
+// A mapping of part of a file, unmapped on destruction
+class MappedWindow {
+public:
+  MappedWindow(int fd, std::size_t offset, std::size_t size, bool writable)
+  : _size(size)
+  {
+    _data = ::mmap(
+      nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd,
+      static_cast<off_t>(offset));
+    if (_data == MAP_FAILED) {
+      throw std::runtime_error(std::string("Could not map the file: ") + std::strerror(errno));
+    }
+    // Each page is only used once, so the kernel may read ahead and drop pages behind
+    ::madvise(_data, size, MADV_SEQUENTIAL);
+  }
+
+  MappedWindow(MappedWindow const &) = delete;
+  MappedWindow & operator=(MappedWindow const &) = delete;
+
+  ~MappedWindow() {
+    ::munmap(_data, _size);
+  }
+
+  template<typename T>
+  T * data() const {
+    return static_cast<T *>(_data);
+  }
+
+private:
+  void *_data;
+  std::size_t _size;
+};
+
+// Transform a batch in contiguous slices on separate threads
+void transform_slices(
+  Transformer const &transformer,
+  bool to_ref,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results,
+  unsigned int threads)
+{
+  auto transform = [&transformer, to_ref](Point2D const *p, std::size_t n, Point2D *r) {
+      if (to_ref) {
+        transformer.to_ref(p, n, r);
+      } else {
+        transformer.to_robot(p, n, r);
+      }
+    };
+  std::size_t slice_size = (count + threads - 1) / threads;
+  std::vector<std::thread> workers;
+  for (std::size_t start = slice_size; start < count; start += slice_size) {
+    workers.emplace_back(transform, points + start, std::min(slice_size, count - start),
+      results + start);
+  }
+  transform(points, std::min(slice_size, count), results);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// Transform a binary point file into another by mapping both into memory a window at a time, so
+// that points are read from and written to the page cache directly
+std::size_t transform_mapped_file(
+  Transformer const &transformer,
+  bool to_ref,
+  unsigned int threads,
+  std::string const &input_path,
+  std::string const &output_path,
+  bool progress)
+{
+  FileDescriptor input(::open(input_path.c_str(), O_RDONLY));
+  if (input.get() < 0) {
+    throw std::runtime_error("Could not open " + input_path);
+  }
+  struct stat input_status;
+  if (::fstat(input.get(), &input_status) != 0 || !S_ISREG(input_status.st_mode)) {
+    throw std::runtime_error(input_path + " is not a regular file");
+  }
+  auto size = static_cast<std::size_t>(input_status.st_size);
+  if (size % sizeof(Point2D) != 0) {
+    throw std::runtime_error(input_path + ": Input ends part of the way through a point");
+  }
+
+  // Opening the input as the output would truncate it before it was read
+  struct stat output_status;
+  if (::stat(output_path.c_str(), &output_status) == 0 &&
+    output_status.st_dev == input_status.st_dev && output_status.st_ino == input_status.st_ino)
+  {
+    throw std::runtime_error("The output must not be the input file");
+  }
+  FileDescriptor output(::open(output_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666));
+  if (output.get() < 0) {
+    throw std::runtime_error("Could not open " + output_path);
+  }
+  if (size > 0) {
+#if defined(__linux__)
+    // Allocate the whole output first, so that running out of space is reported here rather than
+    // as a bus error when a mapped page is written
+    int result = ::posix_fallocate(output.get(), 0, static_cast<off_t>(size));
+    if (result != 0) {
+      throw std::runtime_error(
+        "Could not allocate the output: " + std::string(std::strerror(result)));
+    }
+#else
+    // Without posix_fallocate() the output can only be extended, so running out of space is not
+    // found until a mapped page is written
+    if (::ftruncate(output.get(), static_cast<off_t>(size)) != 0) {
+      throw std::runtime_error(
+        "Could not allocate the output: " + std::string(std::strerror(errno)));
+    }
+#endif
+  }
+
+  for (std::size_t offset = 0; offset < size; offset += MAPPED_WINDOW_SIZE) {
+    auto window_size = std::min(MAPPED_WINDOW_SIZE, size - offset);
+    MappedWindow points(input.get(), offset, window_size, false);
+    MappedWindow results(output.get(), offset, window_size, true);
+    transform_slices(
+      transformer, to_ref, points.data<Point2D const>(), window_size / sizeof(Point2D),
+      results.data<Point2D>(), threads);
+    if (progress) {
+      std::cerr << "\r" << (offset + window_size) * 100 / size << "% transformed" << std::flush;
+    }
+  }
+  if (progress) {
+    std::cerr << '\n';
+  }
+  if (!output.close()) {
+    throw std::runtime_error("Could not write the output");
+  }
+  return size / sizeof(Point2D);
+}
+#else
+std::size_t transform_mapped_file(
+  Transformer const &,
+  bool,
+  unsigned int,
+  std::string const &,
+  std::string const &,
+  bool)
+{
+  throw std::runtime_error("Mapping files into memory is not available on this platform");
+}
+#endif
+
+void print_usage() {
+  std::cout << "Transform a stream of points between a reference map and a robot map\n\n" <<
+    "Usage: map_transform_batch --map-info-file=<file> --direction=<to_ref|to_robot> " <<
+    "[options] [input files]\n\n" <<
+    "Points are read from the input files in turn, or from standard input if there are none " <<
+    "or a\nfile is \"-\".\n\n" <<
+    "  -m, --map-info-file  the YAML file containing the map information\n" <<
+    "  -d, --direction      to_ref to transform robot map points to the reference map, or\n" <<
+    "                       to_robot for the opposite\n" <<
+    "  -f, --format         csv (the default) for a line of \"x,y\" per point, or binary for\n" <<
+    "                       pairs of 32-bit floating point numbers in the machine's byte order\n" <<
+    "  -o, --output         the file to write the points to, instead of standard output\n" <<
+    "  -t, --threads        the number of threads to transform points with (default: one per " <<
+    "core)\n" <<
+    "  --mmap               transform a single binary input file into the output file by\n" <<
+    "                       mapping them into memory\n" <<
+    "  --progress           report progress while transforming a mapped file\n" <<
+    "  -p, --per-direction  triangulate each map separately\n" <<
+    "  -q, --quiet          do not report throughput\n" <<
+    "  -h, --help           print this message\n";
+}
+
+}  // namespace
+
+
+int main(int argc, char ** argv)
+{
+  map_transformer::command_line::Options options(
+    {"map-info-file", "direction", "format", "output", "threads"},
+    {"mmap", "progress", "per-direction", "quiet", "help"},
+    {{"m", "map-info-file"}, {"d", "direction"}, {"f", "format"}, {"o", "output"},
+      {"t", "threads"}, {"p", "per-direction"}, {"q", "quiet"}, {"h", "help"}});
+  try {
+    options.parse(argc, argv);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+
+  if (options.has("help")) {
+    print_usage();
+    return 0;
+  }
+  if (options.value("map-info-file").empty()) {
+    std::cerr << "No map-info-file provided\n\n";
+    print_usage();
+    return 1;
+  }
+  auto direction = options.value("direction");
+  if (direction != "to_ref" && direction != "to_robot") {
+    std::cerr << "The direction must be to_ref or to_robot\n\n";
+    print_usage();
+    return 1;
+  }
+  auto format_name = options.value("format", "csv");
+  if (format_name != "csv" && format_name != "binary") {
+    std::cerr << "The format must be csv or binary\n\n";
+    print_usage();
+    return 1;
+  }
+  auto format = format_name == "csv" ? Format::csv : Format::binary;
+  unsigned int threads;
+  try {
+    threads = options.integer<unsigned int>(
+      "threads", std::max(1u, std::thread::hardware_concurrency()), 1,
+      map_transformer::command_line::MAX_THREADS);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+  auto inputs = options.arguments();
+  if (inputs.empty()) {
+    inputs.push_back("-");
+  }
+  if (options.has("mmap") &&
+    (format != Format::binary || inputs.size() != 1 || inputs[0] == "-" ||
+    options.value("output").empty()))
+  {
+    std::cerr << "--mmap needs the binary format, a single input file and an output file\n\n";
+    print_usage();
+    return 1;
+  }
+
+  std::ifstream yaml_file(options.value("map-info-file"));
+  if (!yaml_file.is_open()) {
+    std::cerr << "Could not read YAML document\n";
+    return 1;
+  }
+  std::ostringstream sstr;
+  sstr << yaml_file.rdbuf();
+  Transformer transformer;
+  try {
+    if (options.has("per-direction")) {
+      transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+    }
+    transformer.load(sstr.str());
+  } catch (std::exception const &e) {
+    std::cerr << "Could not load the map information: " << e.what() << '\n';
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::string error;
+  std::size_t points{0};
+  if (options.has("mmap")) {
+    try {
+      points = transform_mapped_file(
+        transformer, direction == "to_ref", threads, inputs[0], options.value("output"),
+        options.has("progress"));
+    } catch (std::exception const &e) {
+      error = e.what();
+    }
+  } else {
+    std::FILE *output = stdout;
+    if (!options.value("output").empty()) {
+      output = std::fopen(options.value("output").c_str(), "wb");
+      if (output == nullptr) {
+        std::cerr << "Could not open " << options.value("output") << '\n';
+        return 1;
+      }
+    }
+
+    {
+      BatchPipeline pipeline(
+        transformer, direction == "to_ref", format, threads, output);
+      for (std::size_t ii = 0; ii < inputs.size(); ++ii) {
+        auto const &path = inputs[ii];
+        std::FILE *input = path == "-" ? stdin : std::fopen(path.c_str(), "rb");
+        if (input == nullptr) {
+          pipeline.fail("Could not open " + path);
+          break;
+        }
+        std::string read_error;
+        bool read = read_input(
+          input, path == "-" ? "standard input" : path, ii, format, pipeline, read_error);
+        if (input != stdin) {
+          std::fclose(input);
+        }
+        if (!read) {
+          pipeline.fail(path + ": " + read_error);
+        }
+        if (pipeline.failed()) {
+          break;
+        }
+      }
+      error = pipeline.finish();
+      points = pipeline.points_written();
+    }
+    if ((std::fflush(output) != 0 || (output != stdout && std::fclose(output) != 0)) &&
+      error.empty())
+    {
+      error = "Could not write the output";
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (!error.empty()) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  if (!options.has("quiet")) {
+    std::cerr << "Transformed " << points << " points in " << elapsed.count() << " s (" <<
+      points / std::max(elapsed.count(), 1e-9) << " points/s)\n";
+  }
+  return 0;
+}
@@ -0,0 +1,193 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <map_transformer/map_watcher.hpp>
+#include <map_transformer/transform_server.hpp>
+#include <map_transformer/transformer.hpp>
+
+#include "command_line.hpp"
+
+void print_usage() {
+  std::cout << "Serve transforms between reference maps and robot maps to other processes\n\n" <<
+    "Usage: map_transform_daemon --socket=<path> [--per-direction] <map info files>\n\n" <<
+    "Clients select a map by its index in the list of map information files, counting from 0.\n" <<
+    "The daemon runs until it receives SIGINT or SIGTERM.\n\n" <<
+    "  -s, --socket              the path to create the Unix domain socket at\n" <<
+    "  -p, --per-direction       triangulate each map separately\n" <<
+    "  -w, --watch               reload each map when its files change\n" <<
+    "  --latency-threads         the number of threads for the latency lane (default: 2)\n" <<
+    "  --throughput-threads      the number of threads for the throughput lane (default: the\n" <<
+    "                            remaining CPUs)\n" <<
+    "  --latency-cpus            CPUs to keep for the latency lane, such as 0,1\n" <<
+    "  --throughput-cpus         CPUs to run the throughput lane on\n" <<
+    "  --latency-queue-limit     refuse latency lane requests while this many points are\n" <<
+    "                            waiting (default: no limit)\n" <<
+    "  --throughput-queue-limit  refuse throughput lane requests while this many points are\n" <<
+    "                            waiting (default: no limit)\n" <<
+    "  -h, --help                print this message\n";
+}
+
+void print_lane(char const *name, map_transformer::TransformLaneStatistics const &lane) {
+  std::cout << "  " << name << " lane: " << lane.requests << " requests for " << lane.points <<
+    " points in " << lane.batches << " batches, " << lane.rejected << " refused; latency " <<
+    "median " << lane.median_latency * 1e6 << " us, 99th percentile " <<
+    lane.p99_latency * 1e6 << " us, maximum " << lane.max_latency * 1e6 << " us\n";
+}
+
+int main(int argc, char ** argv)
+{
+  map_transformer::command_line::Options options(
+    {"socket", "latency-threads", "throughput-threads", "latency-cpus", "throughput-cpus",
+      "latency-queue-limit", "throughput-queue-limit"},
+    {"per-direction", "watch", "help"},
+    {{"s", "socket"}, {"p", "per-direction"}, {"w", "watch"}, {"h", "help"}});
+  try {
+    options.parse(argc, argv);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+  auto const &map_files = options.arguments();
+
+  if (options.has("help")) {
+    print_usage();
+    return 0;
+  }
+  if (options.value("socket").empty() || map_files.empty()) {
+    std::cerr << "A socket and at least one map information file are needed\n\n";
+    print_usage();
+    return 1;
+  }
+
+  using map_transformer::command_line::MAX_THREADS;
+  map_transformer::TransformServerOptions server_options;
+  try {
+    server_options.latency.threads = options.integer<std::size_t>(
+      "latency-threads", server_options.latency.threads, 1, MAX_THREADS);
+    server_options.throughput.threads = options.integer<std::size_t>(
+      "throughput-threads", server_options.throughput.threads, 1, MAX_THREADS);
+    server_options.latency.cpus = options.integers<int>("latency-cpus", 0, CPU_SETSIZE - 1);
+    server_options.throughput.cpus = options.integers<int>("throughput-cpus", 0, CPU_SETSIZE - 1);
+    server_options.latency.max_queued_points = options.integer<std::size_t>(
+      "latency-queue-limit", 0, 0, std::numeric_limits<std::size_t>::max());
+    server_options.throughput.max_queued_points = options.integer<std::size_t>(
+      "throughput-queue-limit", 0, 0, std::numeric_limits<std::size_t>::max());
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+
+  // Block the signals before any threads start, so that only sigwait() sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  auto per_direction = options.has("per-direction");
+  auto configure = [per_direction](map_transformer::Transformer &map) {
+      if (per_direction) {
+        map.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+      }
+    };
+  // Watchers may reload a map before the server has started, so they give it the map only once
+  // it has
+  std::atomic<map_transformer::TransformServer *> serving{nullptr};
+  std::vector<std::unique_ptr<map_transformer::MapWatcher>> watchers;
+  std::vector<std::shared_ptr<map_transformer::Transformer const>> maps;
+  for (auto const &path : map_files) {
+    auto index = maps.size();
+    try {
+      if (options.has("watch")) {
+        map_transformer::MapWatcherOptions watcher_options;
+        watcher_options.configure = configure;
+        watcher_options.on_reload =
+          [&serving, index, path](std::shared_ptr<map_transformer::Transformer const> const &map) {
+            std::cout << "Reloaded map " << index << " from " << path << std::endl;
+            if (auto server = serving.load()) {
+              server->replace_map(index, map);
+            }
+          };
+        watcher_options.on_error = [index, path](std::string const &error) {
+            std::cerr << "Could not reload map " << index << " from " << path << ", so " <<
+              "serving the previous version: " << error << std::endl;
+          };
+        watchers.push_back(std::make_unique<map_transformer::MapWatcher>(path, watcher_options));
+        maps.push_back(watchers.back()->current());
+      } else {
+        std::ifstream yaml_file(path);
+        if (!yaml_file.is_open()) {
+          std::cerr << "Could not read " << path << '\n';
+          return 1;
+        }
+        std::ostringstream sstr;
+        sstr << yaml_file.rdbuf();
+        auto map = std::make_shared<map_transformer::Transformer>();
+        configure(*map);
+        map->load(sstr.str());
+        maps.push_back(std::move(map));
+      }
+    } catch (std::exception const &e) {
+      std::cerr << "Could not load " << path << ": " << e.what() << '\n';
+      return 1;
+    }
+    std::cout << "Map " << index << ": " << maps.back()->robot_map_name() << " to " <<
+      maps.back()->ref_map_name() << " (" << path << ")\n";
+  }
+
+  std::unique_ptr<map_transformer::TransformServer> server;
+  try {
+    server = std::make_unique<map_transformer::TransformServer>(
+      maps, options.value("socket"), server_options);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  serving = server.get();
+  // Serve any map reloaded while the server was starting
+  for (std::size_t index = 0; index < watchers.size(); ++index) {
+    server->replace_map(index, watchers[index]->current());
+  }
+  auto lanes = server->statistics();
+  std::cout << "Listening on " << options.value("socket") << " with " <<
+    lanes.latency.threads << " latency and " << lanes.throughput.threads <<
+    " throughput threads" << std::endl;
+
+  int signal;
+  sigwait(&signals, &signal);
+  auto statistics = server->statistics();
+  watchers.clear();
+  server.reset();
+  std::cout << "Served " << statistics.requests << " requests for " << statistics.points <<
+    " points; " << statistics.channels << " shared memory channels were opened\n";
+  print_lane("latency", statistics.latency);
+  print_lane("throughput", statistics.throughput);
+  return 0;
+}
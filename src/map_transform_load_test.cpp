@@ -0,0 +1,261 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <map_transformer/shared_memory_client.hpp>
+#include <map_transformer/transform_client.hpp>
+#include <map_transformer/transform_server.hpp>
+#include <map_transformer/transformer.hpp>
+
+#include "command_line.hpp"
+
+using map_transformer::Point2D;
+
+namespace
+{
+
+// Each client cycles through this many random points
+constexpr std::size_t POINT_POOL_SIZE = 1 << 16;
+
+struct ClientResult {
+  std::size_t requests{0};
+  std::vector<double> latencies;
+  std::string error;
+};
+
+// Send requests as fast as the server answers them until the deadline, timing each one
+template<typename Client>
+void run_client(
+  std::function<std::unique_ptr<Client>()> const &connect,
+  bool to_ref,
+  std::size_t points_per_request,
+  float range,
+  unsigned int seed,
+  std::chrono::steady_clock::time_point deadline,
+  ClientResult &result)
+{
+  try {
+    auto client = connect();
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> coordinate(0.0f, range);
+    std::vector<Point2D> points(POINT_POOL_SIZE + points_per_request);
+    for (auto &point : points) {
+      point = {coordinate(generator), coordinate(generator)};
+    }
+    std::vector<Point2D> results(points_per_request);
+    std::size_t next = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+      auto start = std::chrono::steady_clock::now();
+      if (to_ref) {
+        client->to_ref(points.data() + next, points_per_request, results.data());
+      } else {
+        client->to_robot(points.data() + next, points_per_request, results.data());
+      }
+      std::chrono::duration<double> latency = std::chrono::steady_clock::now() - start;
+      result.latencies.push_back(latency.count());
+      ++result.requests;
+      next = (next + points_per_request) % POINT_POOL_SIZE;
+    }
+  } catch (std::exception const &e) {
+    result.error = e.what();
+  }
+}
+
+double percentile(std::vector<double> const &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+void print_usage() {
+  std::cout << "Measure the throughput and latency of a transform daemon\n\n" <<
+    "Usage: map_transform_load_test (--socket=<path> | --map-info-file=<file>) [options]\n\n" <<
+    "  -s, --socket         the socket of a running map_transform_daemon\n" <<
+    "  -m, --map-info-file  start a server in this process with the map in this file instead,\n" <<
+    "                       on a socket in the temporary directory\n" <<
+    "  -c, --clients        the number of clients sending requests at once (default: 8)\n" <<
+    "  -n, --points         the number of points in each request (default: 1)\n" <<
+    "  -t, --duration       the number of seconds to send requests for (default: 5)\n" <<
+    "  --map                the index of the map to use (default: 0)\n" <<
+    "  -d, --direction      to_ref (the default) or to_robot\n" <<
+    "  -l, --lane           the server lane to send requests to: latency (the default) or\n" <<
+    "                       throughput\n" <<
+    "  -r, --range          points are chosen at random from [0, range) in each axis " <<
+    "(default: 100)\n" <<
+    "  --shared-memory      send requests through shared memory channels instead of the socket\n" <<
+    "  -h, --help           print this message\n";
+}
+
+}  // namespace
+
+
+int main(int argc, char ** argv)
+{
+  map_transformer::command_line::Options options(
+    {"socket", "map-info-file", "clients", "points", "duration", "map", "direction", "lane",
+      "range"},
+    {"shared-memory", "help"},
+    {{"s", "socket"}, {"m", "map-info-file"}, {"c", "clients"}, {"n", "points"},
+      {"t", "duration"}, {"d", "direction"}, {"l", "lane"}, {"r", "range"}, {"h", "help"}},
+    false);
+  try {
+    options.parse(argc, argv);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+  if (options.has("help")) {
+    print_usage();
+    return 0;
+  }
+
+  std::size_t clients, points_per_request;
+  double duration;
+  std::uint32_t map;
+  float range;
+  try {
+    // Each client is a thread
+    clients = options.integer<std::size_t>(
+      "clients", 8, 1, map_transformer::command_line::MAX_THREADS);
+    points_per_request = options.integer<std::size_t>(
+      "points", 1, 1, map_transformer::protocol::MAX_POINTS_PER_REQUEST);
+    // A day is long enough for any test
+    duration = options.real("duration", 5, 0, 24 * 60 * 60);
+    map = options.integer<std::uint32_t>(
+      "map", 0, 0, std::numeric_limits<std::uint32_t>::max());
+    range = static_cast<float>(
+      options.real("range", 100, 0, std::numeric_limits<float>::max()));
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 1;
+  }
+  if (options.value("socket").empty() == options.value("map-info-file").empty()) {
+    std::cerr << "Either a socket or a map-info-file is needed\n\n";
+    print_usage();
+    return 1;
+  }
+  auto direction = options.value("direction", "to_ref");
+  auto lane_name = options.value("lane", "latency");
+  if ((direction != "to_ref" && direction != "to_robot") ||
+    (lane_name != "latency" && lane_name != "throughput"))
+  {
+    std::cerr << "The direction must be to_ref or to_robot, and the lane latency or " <<
+      "throughput\n\n";
+    print_usage();
+    return 1;
+  }
+
+  std::unique_ptr<map_transformer::TransformServer> server;
+  std::string socket_path = options.value("socket");
+  if (!options.value("map-info-file").empty()) {
+    std::ifstream yaml_file(options.value("map-info-file"));
+    if (!yaml_file.is_open()) {
+      std::cerr << "Could not read YAML document\n";
+      return 1;
+    }
+    std::ostringstream sstr;
+    sstr << yaml_file.rdbuf();
+    socket_path = "/tmp/map_transform_load_test_" + std::to_string(::getpid()) + ".sock";
+    try {
+      server = std::make_unique<map_transformer::TransformServer>(
+        std::vector<std::shared_ptr<map_transformer::Transformer const>>{
+          std::make_shared<map_transformer::Transformer>(sstr.str())},
+        socket_path);
+    } catch (std::exception const &e) {
+      std::cerr << "Could not start the server: " << e.what() << '\n';
+      return 1;
+    }
+  }
+
+  std::vector<ClientResult> results(clients);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(duration));
+  auto lane = lane_name == "latency" ?
+    map_transformer::protocol::Lane::latency : map_transformer::protocol::Lane::throughput;
+  std::function<std::unique_ptr<map_transformer::SharedMemoryClient>()> connect_shared_memory =
+    [&]() {return std::make_unique<map_transformer::SharedMemoryClient>(socket_path, map);};
+  std::function<std::unique_ptr<map_transformer::TransformClient>()> connect =
+    [&]() {return std::make_unique<map_transformer::TransformClient>(socket_path, map, lane);};
+  for (std::size_t ii = 0; ii < clients; ++ii) {
+    auto to_ref = direction == "to_ref";
+    auto seed = static_cast<unsigned int>(ii);
+    if (options.has("shared-memory")) {
+      threads.emplace_back(
+        run_client<map_transformer::SharedMemoryClient>, std::cref(connect_shared_memory), to_ref,
+        points_per_request, range, seed, deadline, std::ref(results[ii]));
+    } else {
+      threads.emplace_back(
+        run_client<map_transformer::TransformClient>, std::cref(connect), to_ref,
+        points_per_request, range, seed, deadline, std::ref(results[ii]));
+    }
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::size_t requests = 0;
+  std::vector<double> latencies;
+  for (auto const &result : results) {
+    if (!result.error.empty()) {
+      std::cerr << "A client failed: " << result.error << '\n';
+      return 1;
+    }
+    requests += result.requests;
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::cout << clients << " clients sent " << requests << " requests of " <<
+    points_per_request << " points in " << elapsed.count() << " s\n" <<
+    "  " << requests / elapsed.count() << " requests/s, " <<
+    requests * points_per_request / elapsed.count() << " points/s\n" <<
+    "  latency: median " << percentile(latencies, 0.5) * 1e6 << " us, 99th percentile " <<
+    percentile(latencies, 0.99) * 1e6 << " us, maximum " <<
+    (latencies.empty() ? 0.0 : latencies.back() * 1e6) << " us\n";
+  if (server) {
+    auto statistics = server->statistics();
+    auto const &lane_statistics =
+      lane == map_transformer::protocol::Lane::latency ?
+      statistics.latency : statistics.throughput;
+    if (lane_statistics.batches != 0) {
+      std::cout << "  " << lane_statistics.requests << " requests were transformed in " <<
+        lane_statistics.batches << " batches (" <<
+        static_cast<double>(lane_statistics.requests) / lane_statistics.batches <<
+        " requests per batch)\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/map_watcher.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer {
+
+namespace
+{
+
+// Writing a file in place, creating or renaming one into place, or removing it all change it;
+// removing or moving a watched directory loses the files' watch
+constexpr std::uint32_t WATCHED_EVENTS =
+  IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM |
+  IN_DELETE_SELF | IN_MOVE_SELF;
+
+// How often to try watching a directory again after it was removed and could not be found
+constexpr std::chrono::milliseconds REWATCH_INTERVAL{500};
+
+}  // namespace
+
+
+MapWatcher::MapWatcher(std::string const &map_info_file, MapWatcherOptions options)
+: _map_info_file(map_info_file), _options(std::move(options))
+{
+  _current = load();
+  _inotify = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (_inotify < 0 || ::pipe2(_stop_pipe, O_CLOEXEC) != 0) {
+    auto error = errno;
+    if (_inotify >= 0) {
+      ::close(_inotify);
+    }
+    throw std::runtime_error(
+      "Could not watch " + map_info_file + ": " + std::strerror(error));
+  }
+  try {
+    watch_files(*_current);
+  } catch (std::exception const &) {
+    ::close(_inotify);
+    ::close(_stop_pipe[0]);
+    ::close(_stop_pipe[1]);
+    throw;
+  }
+  _thread = std::thread([this]() {watch();});
+}
+
+
+MapWatcher::~MapWatcher() {
+  char wake = 0;
+  while (::write(_stop_pipe[1], &wake, 1) < 0 && errno == EINTR) {}
+  _thread.join();
+  ::close(_inotify);
+  ::close(_stop_pipe[0]);
+  ::close(_stop_pipe[1]);
+}
+
+
+std::shared_ptr<Transformer const> MapWatcher::current() const {
+  return std::atomic_load(&_current);
+}
+
+
+std::string const & MapWatcher::map_info_file() const {
+  return _map_info_file;
+}
+
+
+std::shared_ptr<Transformer const> MapWatcher::load() const {
+  std::ifstream file(_map_info_file);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not read " + _map_info_file);
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  auto map = std::make_shared<Transformer>();
+  if (_options.configure) {
+    _options.configure(*map);
+  }
+  map->load(contents.str());
+  return map;
+}
+
+
+void MapWatcher::watch_files(Transformer const &map) {
+  // Image file paths are relative to the working directory, as when they are loaded
+  std::vector<std::string> files{
+    _map_info_file, map.ref_map_image_file(), map.robot_map_image_file()};
+  std::map<int, std::set<std::string>> watched;
+  for (auto const &file : files) {
+    if (file.empty()) {
+      continue;
+    }
+    auto path = std::filesystem::absolute(file);
+    int watch = ::inotify_add_watch(
+      _inotify, path.parent_path().c_str(), WATCHED_EVENTS | IN_ONLYDIR);
+    if (watch < 0) {
+      throw std::runtime_error(
+        "Could not watch " + path.parent_path().string() + ": " + std::strerror(errno));
+    }
+    watched[watch].insert(path.filename().string());
+  }
+  // Stop watching directories that no longer hold any of the files
+  for (auto const &[watch, names] : _watched) {
+    if (watched.count(watch) == 0) {
+      ::inotify_rm_watch(_inotify, watch);
+    }
+  }
+  _watched = std::move(watched);
+}
+
+
+void MapWatcher::watch() {
+  alignas(inotify_event) char buffer[4096];
+  pollfd events[2] = {{_inotify, POLLIN, 0}, {_stop_pipe[0], POLLIN, 0}};
+  bool reload_pending = false;
+  auto reload_at = std::chrono::steady_clock::now();
+  // Set when a watched directory has been removed or replaced, so the directories must be watched
+  // again by path before the map is reloaded
+  bool rewatch_pending = false;
+  bool rewatch_reported = false;
+  auto rewatch = [this, &rewatch_reported]() {
+      try {
+        watch_files(*current());
+      } catch (std::exception const &e) {
+        // Report the directory missing once, not every time it is looked for
+        if (!rewatch_reported && _options.on_error) {
+          _options.on_error(e.what());
+        }
+        rewatch_reported = true;
+        return false;
+      }
+      rewatch_reported = false;
+      return true;
+    };
+  while (true) {
+    int timeout = -1;
+    if (reload_pending) {
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        reload_at - std::chrono::steady_clock::now());
+      timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, remaining.count()));
+    }
+    if (::poll(events, 2, timeout) < 0) {
+      continue;
+    }
+    if (events[1].revents != 0) {
+      return;
+    }
+
+    if ((events[0].revents & POLLIN) != 0) {
+      auto length = ::read(_inotify, buffer, sizeof(buffer));
+      bool changed = false;
+      for (ssize_t offset = 0; offset < length; ) {
+        auto const *event = reinterpret_cast<inotify_event const *>(buffer + offset);
+        offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        auto names = _watched.find(event->wd);
+        // If events were lost, the map's files may have changed
+        changed = changed || (event->mask & IN_Q_OVERFLOW) != 0 ||
+          (names != _watched.end() && event->len > 0 && names->second.count(event->name) != 0);
+        // A directory that is removed loses its watch, and one that is moved takes its watch with
+        // it, so whatever is now at its path holds the map's files
+        if (names != _watched.end() &&
+          (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0)
+        {
+          if ((event->mask & IN_IGNORED) != 0) {
+            _watched.erase(names);
+          }
+          rewatch_pending = true;
+          changed = true;
+        }
+      }
+      // Wait for the files to stop changing before reloading
+      if (changed) {
+        reload_pending = true;
+        reload_at = std::chrono::steady_clock::now() + _options.debounce;
+      }
+      continue;
+    }
+
+    if (reload_pending && std::chrono::steady_clock::now() >= reload_at) {
+      if (rewatch_pending && !rewatch()) {
+        reload_at = std::chrono::steady_clock::now() + REWATCH_INTERVAL;
+        continue;
+      }
+      rewatch_pending = false;
+      reload_pending = false;
+      reload();
+    }
+  }
+}
+
+
+void MapWatcher::reload() {
+  std::shared_ptr<Transformer const> map;
+  try {
+    map = load();
+  } catch (std::exception const &e) {
+    // Keep the previous map; the files may be part way through being replaced, and the watcher
+    // tries again when they next change
+    if (_options.on_error) {
+      _options.on_error(e.what());
+    }
+    return;
+  }
+  std::atomic_store(&_current, map);
+
+  // The new map may name other image files
+  try {
+    watch_files(*map);
+  } catch (std::exception const &e) {
+    if (_options.on_error) {
+      _options.on_error(e.what());
+    }
+  }
+  if (_options.on_reload) {
+    _options.on_reload(map);
+  }
+}
+
+}  // namespace map_transformer
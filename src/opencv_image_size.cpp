@@ -0,0 +1,48 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/opencv_image_size.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <stdexcept>
+
+
+namespace map_transformer
+{
+
+std::optional<Vector2D> read_image_size_with_opencv(std::string const &path) {
+  cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+  if (image.empty()) {
+    throw std::runtime_error("Could not read image file: " + path);
+  }
+  return Vector2D{static_cast<float>(image.cols), static_cast<float>(image.rows)};
+}
+
+namespace
+{
+
+// Programs linked with this library check map images with OpenCV, as the library always did
+bool const opencv_reader_is_default =
+  (set_default_image_size_reader(read_image_size_with_opencv), true);
+
+}  // namespace
+
+}  // namespace map_transformer
+
+// The linker is told this symbol is needed by programs linked with the library, so that this file
+// and the default it sets are linked in even from a static library
+extern "C" {
+int map_transformer_opencv_image_size_reader = 0;
+}
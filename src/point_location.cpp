@@ -0,0 +1,1554 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/predicates.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+// Slab decompositions need O(n^2) memory in the worst case; beyond this many entries the index
+// is abandoned in favour of the linear search
+constexpr std::size_t MAX_SLAB_ENTRIES = std::size_t{1} << 26;
+// Likewise for the total length of the grid's cell lists
+constexpr std::size_t MAX_GRID_ENTRIES = std::size_t{1} << 26;
+
+// Quadtree nodes are not split if their children would hold more than this many times as many
+// triangles in total
+constexpr std::size_t MAX_QUADTREE_DUPLICATION = 2;
+
+// How many points ahead of the point being searched for the batch searches start fetching data
+constexpr std::size_t PREFETCH_DISTANCE = 8;
+
+// Up to this many triangles, the linear search is used by the automatic strategy
+constexpr std::size_t MAX_LINEAR_SEARCH_TRIANGLES = 128;
+// The coefficient of variation of the number of triangles per grid cell above which the density
+// of a triangulation is treated as skewed
+constexpr double SKEWED_DENSITY_VARIATION = 1.0;
+// A generous estimate of the size of the quadtree per triangle
+constexpr std::size_t QUADTREE_BYTES_PER_TRIANGLE = 64;
+// The number of steps along each axis of the Morton curve used to order triangles
+constexpr double MORTON_CELLS = 65535.0;
+// The memory limit for indexes when the available memory cannot be found
+constexpr std::size_t DEFAULT_MEMORY_LIMIT = std::size_t{256} << 20;
+// The number of points searched for when timing an automatically-chosen index
+constexpr std::size_t TIMING_SAMPLE_SIZE = 64;
+// The number of triangles per cell of the grid of starting triangles for walks
+constexpr std::size_t TRIANGLES_PER_WALK_CELL = 4;
+// M_PI is not part of standard C++, and is missing from <cmath> on some platforms
+constexpr double PI = 3.14159265358979323846;
+
+template<typename T>
+void write_value(std::ostream &out, T const &value) {
+  out.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+template<typename T>
+void write_values(std::ostream &out, std::vector<T> const &values) {
+  out.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(T));
+}
+
+// Read a value if the stream has enough bytes left
+template<typename T>
+bool read_value(std::istream &in, std::uint64_t &remaining, T &value) {
+  if (remaining < sizeof(T) || !in.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+    return false;
+  }
+  remaining -= sizeof(T);
+  return true;
+}
+
+// Read an array, checking its length against the bytes left before allocating it
+template<typename T>
+bool read_values(
+  std::istream &in,
+  std::uint64_t &remaining,
+  std::vector<T> &values,
+  std::uint64_t count)
+{
+  if (count > remaining / sizeof(T)) {
+    return false;
+  }
+  values.resize(count);
+  if (!in.read(reinterpret_cast<char *>(values.data()), count * sizeof(T))) {
+    return false;
+  }
+  remaining -= count * sizeof(T);
+  return true;
+}
+
+// The distance from a triangle within which a point may be found to be inside it when rounding
+// errors are accounted for
+double tolerance(Point2D const &point) {
+  return 1e-5 * (1.0 + std::abs(point.first) + std::abs(point.second));
+}
+
+// Find the range of Y values covered by a triangle along the vertical line at x
+void vertical_extent(TriangleVertices const &triangle, double x, double &low, double &high) {
+  low = std::numeric_limits<double>::infinity();
+  high = -std::numeric_limits<double>::infinity();
+  for (int ii = 0; ii < 3; ++ii) {
+    Point2D const &a = triangle[ii];
+    Point2D const &b = triangle[(ii + 1) % 3];
+    if (x < std::min(a.first, b.first) || x > std::max(a.first, b.first)) {
+      continue;
+    }
+    if (a.first == b.first) {
+      low = std::min({low, static_cast<double>(a.second), static_cast<double>(b.second)});
+      high = std::max({high, static_cast<double>(a.second), static_cast<double>(b.second)});
+      continue;
+    }
+    double y = a.second + (x - a.first) * (static_cast<double>(b.second) - a.second) /
+      (static_cast<double>(b.first) - a.first);
+    low = std::min(low, y);
+    high = std::max(high, y);
+  }
+}
+
+// The bounding box of a triangle, as min x, min y, max x, max y
+std::array<float, 4> bounding_box(TriangleVertices const &t) {
+  return {
+    std::min({t[0].first, t[1].first, t[2].first}),
+    std::min({t[0].second, t[1].second, t[2].second}),
+    std::max({t[0].first, t[1].first, t[2].first}),
+    std::max({t[0].second, t[1].second, t[2].second})};
+}
+
+bool boxes_overlap(std::array<float, 4> const &a, std::array<float, 4> const &b) {
+  return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+// The size and position of a uniform grid with roughly one cell per triangle, or another number of
+// cells if given
+struct GridLayout {
+  float min_x, min_y, max_x, max_y;
+  float scale_x, scale_y;
+  std::int32_t columns, rows;
+
+  explicit GridLayout(TriangleGeometry const &triangles)
+  : GridLayout(triangles, triangles.size()) {}
+
+  GridLayout(TriangleGeometry const &triangles, std::size_t cell_count) {
+    min_x = min_y = std::numeric_limits<float>::infinity();
+    max_x = max_y = -std::numeric_limits<float>::infinity();
+    for (auto const &t : triangles) {
+      auto box = bounding_box(t);
+      min_x = std::min(min_x, box[0]);
+      min_y = std::min(min_y, box[1]);
+      max_x = std::max(max_x, box[2]);
+      max_y = std::max(max_y, box[3]);
+    }
+    double width = triangles.empty() ? 0.0 : static_cast<double>(max_x) - min_x;
+    double height = triangles.empty() ? 0.0 : static_cast<double>(max_y) - min_y;
+    double cells = std::max<double>(1.0, cell_count);
+
+    double column_count = 1.0;
+    if (width > 0 && height > 0) {
+      column_count = std::sqrt(cells * width / height);
+    } else if (width > 0) {
+      column_count = cells;
+    }
+    column_count = std::clamp(std::round(column_count), 1.0, cells);
+    double row_count = height > 0 ? std::clamp(std::ceil(cells / column_count), 1.0, cells) : 1.0;
+    columns = static_cast<std::int32_t>(column_count);
+    rows = static_cast<std::int32_t>(row_count);
+    scale_x = width > 0 ? static_cast<float>(columns / width) : 0.0f;
+    scale_y = height > 0 ? static_cast<float>(rows / height) : 0.0f;
+  }
+
+  // The column containing an X coordinate. This is monotonic in x, so a point inside a triangle's
+  // bounding box is always in one of the cells the bounding box is assigned to.
+  std::int32_t column(float x) const {
+    return cell(x, min_x, scale_x, columns);
+  }
+
+  std::int32_t row(float y) const {
+    return cell(y, min_y, scale_y, rows);
+  }
+
+  static std::int32_t cell(float value, float min, float scale, std::int32_t count) {
+    float position = (value - min) * scale;
+    if (!(position >= 0)) {
+      return 0;
+    }
+    if (position >= count) {
+      return count - 1;
+    }
+    return static_cast<std::int32_t>(position);
+  }
+};
+
+// Count the triangles whose bounding boxes overlap each cell of a grid, returning false if there
+// are more than MAX_GRID_ENTRIES in total
+bool count_cell_triangles(
+  GridLayout const &layout,
+  TriangleGeometry const &triangles,
+  std::vector<std::uint32_t> &counts)
+{
+  counts.assign(static_cast<std::size_t>(layout.columns) * layout.rows, 0);
+  std::size_t entries{0};
+  for (auto const &t : triangles) {
+    auto box = bounding_box(t);
+    auto first_column = layout.column(box[0]);
+    auto last_column = layout.column(box[2]);
+    auto first_row = layout.row(box[1]);
+    auto last_row = layout.row(box[3]);
+    entries += static_cast<std::size_t>(last_column - first_column + 1) *
+      (last_row - first_row + 1);
+    if (entries > MAX_GRID_ENTRIES) {
+      return false;
+    }
+    for (auto row = first_row; row <= last_row; ++row) {
+      for (auto column = first_column; column <= last_column; ++column) {
+        ++counts[static_cast<std::size_t>(row) * layout.columns + column];
+      }
+    }
+  }
+  return true;
+}
+
+// Hint that memory will be read soon
+inline void prefetch(void const *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  static_cast<void>(address);
+#endif
+}
+
+// Spread the bits of a 16-bit value out to the even bits of a 32-bit value
+std::uint32_t spread_bits(std::uint32_t value) {
+  value = (value | (value << 8)) & 0x00ff00ffu;
+  value = (value | (value << 4)) & 0x0f0f0f0fu;
+  value = (value | (value << 2)) & 0x33333333u;
+  value = (value | (value << 1)) & 0x55555555u;
+  return value;
+}
+
+// A key that is equal for points with equal coordinates
+std::uint64_t point_key(Point2D const &point) {
+  // Adding zero turns negative zero into positive zero, so that they compare equal as they do
+  // for floating point comparisons
+  float x = point.first + 0.0f;
+  float y = point.second + 0.0f;
+  std::uint32_t x_bits, y_bits;
+  std::memcpy(&x_bits, &x, sizeof(x_bits));
+  std::memcpy(&y_bits, &y, sizeof(y_bits));
+  return (static_cast<std::uint64_t>(x_bits) << 32) | y_bits;
+}
+
+std::size_t available_memory_limit() {
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+  long pages = sysconf(_SC_AVPHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (pages > 0 && page_size > 0) {
+    return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page_size) / 8;
+  }
+#endif
+  return DEFAULT_MEMORY_LIMIT;
+}
+
+}  // namespace
+
+
+std::string to_string(SearchStrategy strategy) {
+  switch (strategy) {
+    case SearchStrategy::linear:
+      return "linear";
+    case SearchStrategy::slab:
+      return "slab";
+    case SearchStrategy::quadtree:
+      return "quadtree";
+    case SearchStrategy::grid:
+      return "grid";
+    case SearchStrategy::walk:
+      return "walk";
+    case SearchStrategy::automatic:
+      return "automatic";
+  }
+  return "unknown";
+}
+
+
+SearchStrategySelection select_search_strategy(
+  TriangleGeometry const &triangles,
+  std::size_t memory_limit)
+{
+  std::ostringstream reason;
+  if (triangles.size() <= MAX_LINEAR_SEARCH_TRIANGLES) {
+    reason << triangles.size() << " triangles are searched fastest without an index";
+    return SearchStrategySelection{SearchStrategy::linear, reason.str()};
+  }
+  if (memory_limit == 0) {
+    memory_limit = available_memory_limit();
+  }
+
+  // How evenly the triangles are spread is measured by the variation in the number of triangles
+  // overlapping each occupied grid cell
+  GridLayout layout(triangles);
+  std::vector<std::uint32_t> counts;
+  bool grid_fits = count_cell_triangles(layout, triangles, counts);
+  std::size_t entries{0};
+  double sum{0}, sum_of_squares{0};
+  std::size_t occupied{0};
+  for (auto count : counts) {
+    if (count > 0) {
+      entries += count;
+      sum += count;
+      sum_of_squares += static_cast<double>(count) * count;
+      ++occupied;
+    }
+  }
+  double mean = occupied > 0 ? sum / occupied : 0.0;
+  double variation = mean > 0 ?
+    std::sqrt(std::max(0.0, sum_of_squares / occupied - mean * mean)) / mean :
+    0.0;
+  bool skewed = !grid_fits || variation > SKEWED_DENSITY_VARIATION;
+
+  std::size_t grid_bytes = grid_fits ?
+    (counts.size() + 1) * sizeof(std::uint32_t) + entries * sizeof(std::int32_t) :
+    std::numeric_limits<std::size_t>::max();
+  std::size_t quadtree_bytes = triangles.size() * QUADTREE_BYTES_PER_TRIANGLE;
+
+  reason << triangles.size() << " triangles with ";
+  if (grid_fits) {
+    reason << (skewed ? "skewed" : "uniform") << " density (variation " << variation << ")";
+  } else {
+    reason << "too many large triangles for a grid";
+  }
+  std::array<std::pair<SearchStrategy, std::size_t>, 2> candidates{{
+    {SearchStrategy::grid, grid_bytes},
+    {SearchStrategy::quadtree, quadtree_bytes}}};
+  if (skewed) {
+    std::swap(candidates[0], candidates[1]);
+  }
+  for (auto const &candidate : candidates) {
+    if (candidate.second <= memory_limit) {
+      reason << "; " << to_string(candidate.first) << " index needs about " <<
+        candidate.second << " bytes";
+      return SearchStrategySelection{candidate.first, reason.str()};
+    }
+  }
+  reason << "; no index fits within " << memory_limit << " bytes";
+  return SearchStrategySelection{SearchStrategy::linear, reason.str()};
+}
+
+
+std::vector<std::int32_t> spatial_order(CorrespondencePoints const &points) {
+  float min_x = std::numeric_limits<float>::infinity();
+  float min_y = std::numeric_limits<float>::infinity();
+  float max_x = -std::numeric_limits<float>::infinity();
+  float max_y = -std::numeric_limits<float>::infinity();
+  for (auto const &p : points) {
+    min_x = std::min(min_x, p.first);
+    min_y = std::min(min_y, p.second);
+    max_x = std::max(max_x, p.first);
+    max_y = std::max(max_y, p.second);
+  }
+
+  // Quantise the points to 16 bits per axis and interleave the bits
+  double scale_x = max_x > min_x ? MORTON_CELLS / (static_cast<double>(max_x) - min_x) : 0.0;
+  double scale_y = max_y > min_y ? MORTON_CELLS / (static_cast<double>(max_y) - min_y) : 0.0;
+  std::vector<std::pair<std::uint32_t, std::int32_t>> keys;
+  keys.reserve(points.size());
+  auto quantise = [](double position) -> std::uint32_t {
+      return position >= 0 ? static_cast<std::uint32_t>(std::min(position, MORTON_CELLS)) : 0;
+    };
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    auto column = quantise((points[ii].first - min_x) * scale_x);
+    auto row = quantise((points[ii].second - min_y) * scale_y);
+    keys.emplace_back(spread_bits(column) | (spread_bits(row) << 1), ii);
+  }
+  std::sort(std::begin(keys), std::end(keys));
+
+  std::vector<std::int32_t> order;
+  order.reserve(keys.size());
+  for (auto const &key : keys) {
+    order.push_back(key.second);
+  }
+  return order;
+}
+
+
+std::vector<std::int32_t> spatial_order(TriangleGeometry const &triangles) {
+  CorrespondencePoints centroids;
+  centroids.reserve(triangles.size());
+  for (auto const &t : triangles) {
+    centroids.emplace_back(
+      (t[0].first + t[1].first + t[2].first) / 3,
+      (t[0].second + t[1].second + t[2].second) / 3);
+  }
+  return spatial_order(centroids);
+}
+
+
+bool triangle_contains(TriangleVertices const &triangle, Point2D const &point) {
+  // The orientations of an infinite or NaN point are infinite or NaN whichever side it is on
+  if (!std::isfinite(point.first) || !std::isfinite(point.second)) {
+    return false;
+  }
+  double o0 = orient2d(triangle[0], triangle[1], point);
+  double o1 = orient2d(triangle[1], triangle[2], point);
+  double o2 = orient2d(triangle[2], triangle[0], point);
+  bool negative = o0 < 0 || o1 < 0 || o2 < 0;
+  bool positive = o0 > 0 || o1 > 0 || o2 > 0;
+  if (negative && positive) {
+    return false;
+  }
+  if (negative || positive) {
+    return true;
+  }
+
+  // All three vertices and the point are collinear, so the triangle is a segment or a point and
+  // contains the point only if the point lies within its extent
+  auto x = std::minmax({triangle[0].first, triangle[1].first, triangle[2].first});
+  auto y = std::minmax({triangle[0].second, triangle[1].second, triangle[2].second});
+  return point.first >= x.first && point.first <= x.second &&
+         point.second >= y.first && point.second <= y.second;
+}
+
+
+void SlabIndex::build(TriangleGeometry const &triangles) {
+  clear();
+
+  for (auto const &t : triangles) {
+    for (auto const &p : t) {
+      _boundaries.push_back(p.first);
+    }
+  }
+  std::sort(std::begin(_boundaries), std::end(_boundaries));
+  _boundaries.erase(
+    std::unique(std::begin(_boundaries), std::end(_boundaries)),
+    std::end(_boundaries));
+  std::size_t slab_count = _boundaries.size() > 1 ? _boundaries.size() - 1 : 0;
+
+  // Find the range of slabs crossed by each triangle, and count the triangles in each slab
+  std::vector<std::pair<std::size_t, std::size_t>> spans(triangles.size());
+  std::vector<std::size_t> slab_sizes(slab_count + 1, 0);
+  for (TriangleGeometry::size_type ii = 0; ii < triangles.size(); ++ii) {
+    auto const &t = triangles[ii];
+    auto first = std::lower_bound(
+      std::begin(_boundaries),
+      std::end(_boundaries),
+      std::min({t[0].first, t[1].first, t[2].first})) - std::begin(_boundaries);
+    auto last = std::lower_bound(
+      std::begin(_boundaries),
+      std::end(_boundaries),
+      std::max({t[0].first, t[1].first, t[2].first})) - std::begin(_boundaries);
+    spans[ii] = {first, last};
+    if (first == last) {
+      _unsorted_triangles.push_back(ii);
+      continue;
+    }
+    for (auto slab = first; slab < last; ++slab) {
+      ++slab_sizes[slab];
+    }
+  }
+
+  _slab_offsets.resize(slab_count + 1, 0);
+  std::size_t entries{0};
+  for (std::size_t slab = 0; slab < slab_count; ++slab) {
+    _slab_offsets[slab] = entries;
+    entries += slab_sizes[slab];
+  }
+  _slab_offsets[slab_count] = entries;
+  if (entries > MAX_SLAB_ENTRIES) {
+    clear();
+    return;
+  }
+
+  _slab_triangles.resize(entries);
+  std::vector<std::size_t> fill(std::begin(_slab_offsets), std::end(_slab_offsets));
+  for (TriangleGeometry::size_type ii = 0; ii < triangles.size(); ++ii) {
+    for (auto slab = spans[ii].first; slab < spans[ii].second; ++slab) {
+      _slab_triangles[fill[slab]++] = ii;
+    }
+  }
+
+  // Sort each slab from top to bottom, then check that no triangles overlap within it
+  std::vector<std::pair<double, std::int32_t>> keys;
+  for (std::size_t slab = 0; slab < slab_count; ++slab) {
+    auto begin = std::begin(_slab_triangles) + _slab_offsets[slab];
+    auto end = std::begin(_slab_triangles) + _slab_offsets[slab + 1];
+    double left = _boundaries[slab];
+    double right = _boundaries[slab + 1];
+    double middle = left + (right - left) / 2;
+
+    keys.clear();
+    for (auto t = begin; t != end; ++t) {
+      double low, high;
+      vertical_extent(triangles[*t], middle, low, high);
+      keys.emplace_back(low + high, *t);
+    }
+    std::sort(std::begin(keys), std::end(keys));
+    for (std::size_t ii = 0; ii < keys.size(); ++ii) {
+      *(begin + ii) = keys[ii].second;
+    }
+
+    for (auto t = begin; t + 1 < end; ++t) {
+      for (double x : {left, middle, right}) {
+        double low_a, high_a, low_b, high_b;
+        vertical_extent(triangles[*t], x, low_a, high_a);
+        vertical_extent(triangles[*(t + 1)], x, low_b, high_b);
+        if (high_a > low_b + tolerance(Point2D(x, low_b))) {
+          clear();
+          return;
+        }
+      }
+    }
+  }
+
+  _valid = true;
+}
+
+void SlabIndex::clear() {
+  _valid = false;
+  _boundaries.clear();
+  _slab_offsets.clear();
+  _slab_triangles.clear();
+  _unsorted_triangles.clear();
+}
+
+bool SlabIndex::valid() const {
+  return _valid;
+}
+
+int SlabIndex::find(Point2D const &point, TriangleGeometry const &triangles) const {
+  int result = -1;
+  for (auto t : _unsorted_triangles) {
+    if ((result < 0 || t < result) && triangle_contains(triangles[t], point)) {
+      result = t;
+    }
+  }
+  if (_boundaries.size() < 2) {
+    return result;
+  }
+
+  // A point within rounding distance of a slab boundary may be inside triangles on both sides
+  double slack = tolerance(point);
+  if (point.first + slack < _boundaries.front() || point.first - slack > _boundaries.back()) {
+    return result;
+  }
+  auto slab_containing = [this](double x) -> std::size_t {
+      auto slab = std::upper_bound(std::begin(_boundaries), std::end(_boundaries), x) -
+        std::begin(_boundaries);
+      return std::clamp<std::ptrdiff_t>(slab - 1, 0, _boundaries.size() - 2);
+    };
+  auto first = slab_containing(point.first - slack);
+  auto last = slab_containing(point.first + slack);
+  for (auto slab = first; slab <= last; ++slab) {
+    add_slab_candidates(slab, point, triangles, result);
+  }
+  return result;
+}
+
+std::size_t SlabIndex::memory_usage() const {
+  return _boundaries.capacity() * sizeof(float) +
+         _slab_offsets.capacity() * sizeof(std::uint32_t) +
+         _slab_triangles.capacity() * sizeof(std::int32_t) +
+         _unsorted_triangles.capacity() * sizeof(std::int32_t);
+}
+
+void SlabIndex::add_slab_candidates(
+  std::size_t slab,
+  Point2D const &point,
+  TriangleGeometry const &triangles,
+  int &result) const
+{
+  double x = std::clamp<double>(point.first, _boundaries[slab], _boundaries[slab + 1]);
+  double y = point.second;
+  double slack = tolerance(point);
+
+  // Find the first triangle that reaches down to the point
+  auto low = _slab_offsets[slab];
+  auto high = _slab_offsets[slab + 1];
+  while (low < high) {
+    auto middle = low + (high - low) / 2;
+    double bottom, top;
+    vertical_extent(triangles[_slab_triangles[middle]], x, bottom, top);
+    if (top < y - slack) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  // Test every triangle from there that could contain the point; there is more than one only
+  // when the point is on or very close to a shared edge
+  for (auto ii = low; ii < _slab_offsets[slab + 1]; ++ii) {
+    auto t = _slab_triangles[ii];
+    double bottom, top;
+    vertical_extent(triangles[t], x, bottom, top);
+    if (bottom > y + slack) {
+      break;
+    }
+    if ((result < 0 || t < result) && triangle_contains(triangles[t], point)) {
+      result = t;
+    }
+  }
+}
+
+
+void QuadtreeIndex::build(TriangleGeometry const &triangles, std::size_t leaf_capacity) {
+  clear();
+  if (triangles.empty()) {
+    return;
+  }
+
+  std::array<float, 4> root_bounds{
+    std::numeric_limits<float>::infinity(),
+    std::numeric_limits<float>::infinity(),
+    -std::numeric_limits<float>::infinity(),
+    -std::numeric_limits<float>::infinity()};
+  _bounds.reserve(triangles.size());
+  for (auto const &t : triangles) {
+    auto box = bounding_box(t);
+    _bounds.push_back(box);
+    root_bounds[0] = std::min(root_bounds[0], box[0]);
+    root_bounds[1] = std::min(root_bounds[1], box[1]);
+    root_bounds[2] = std::max(root_bounds[2], box[2]);
+    root_bounds[3] = std::max(root_bounds[3], box[3]);
+  }
+
+  // Nodes are split depth-first; the triangle lists of the nodes waiting to be split are kept
+  // outside the tree, and only those of leaves are copied into it
+  struct Pending {
+    std::int32_t node;
+    int depth;
+    std::vector<std::int32_t> items;
+  };
+  std::vector<Pending> pending;
+  _nodes.push_back(Node{root_bounds[0], root_bounds[1], root_bounds[2], root_bounds[3], -1, 0, 0});
+  pending.push_back(Pending{0, 0, std::vector<std::int32_t>(triangles.size())});
+  for (std::size_t ii = 0; ii < triangles.size(); ++ii) {
+    pending.back().items[ii] = ii;
+  }
+
+  while (!pending.empty()) {
+    Pending current = std::move(pending.back());
+    pending.pop_back();
+    Node node = _nodes[current.node];
+
+    std::array<std::vector<std::int32_t>, 4> child_items;
+    std::array<std::array<float, 4>, 4> child_bounds;
+    bool split = current.items.size() > leaf_capacity && current.depth < MAX_DEPTH;
+    if (split) {
+      float middle_x = node.min_x + (node.max_x - node.min_x) / 2;
+      float middle_y = node.min_y + (node.max_y - node.min_y) / 2;
+      child_bounds = {{
+        {node.min_x, node.min_y, middle_x, middle_y},
+        {middle_x, node.min_y, node.max_x, middle_y},
+        {node.min_x, middle_y, middle_x, node.max_y},
+        {middle_x, middle_y, node.max_x, node.max_y}}};
+      for (auto t : current.items) {
+        for (int child = 0; child < 4; ++child) {
+          if (boxes_overlap(_bounds[t], child_bounds[child])) {
+            child_items[child].push_back(t);
+          }
+        }
+      }
+      // Once the node is as small as its triangles, most triangles overlap several children, and
+      // splitting further only copies them, as happens when many triangles share one point
+      std::size_t child_item_count{0};
+      for (auto const &items : child_items) {
+        child_item_count += items.size();
+      }
+      split = child_item_count <= MAX_QUADTREE_DUPLICATION * current.items.size();
+    }
+
+    if (!split) {
+      _nodes[current.node].first_item = _items.size();
+      _nodes[current.node].item_count = current.items.size();
+      _items.insert(std::end(_items), std::begin(current.items), std::end(current.items));
+      continue;
+    }
+
+    auto first_child = static_cast<std::int32_t>(_nodes.size());
+    _nodes[current.node].first_child = first_child;
+    for (int child = 0; child < 4; ++child) {
+      auto const &b = child_bounds[child];
+      _nodes.push_back(Node{b[0], b[1], b[2], b[3], -1, 0, 0});
+      pending.push_back(
+        Pending{first_child + child, current.depth + 1, std::move(child_items[child])});
+    }
+  }
+}
+
+void QuadtreeIndex::clear() {
+  _nodes.clear();
+  _items.clear();
+  _bounds.clear();
+}
+
+int QuadtreeIndex::find(Point2D const &point, TriangleGeometry const &triangles) const {
+  return find_in_leaf(leaf(point), point, triangles);
+}
+
+void QuadtreeIndex::find(
+  Point2D const *points,
+  std::size_t count,
+  TriangleGeometry const &triangles,
+  int *results) const
+{
+  // The leaf for each point is found two prefetch distances ahead, and its triangle list is
+  // prefetched; one distance ahead, the first triangle in the list is prefetched
+  constexpr std::size_t AHEAD = 2 * PREFETCH_DISTANCE;
+  std::array<std::int32_t, AHEAD> leaves;
+  auto start = [&](std::size_t ii) {
+      auto found = leaf(points[ii]);
+      leaves[ii % AHEAD] = found;
+      if (found >= 0) {
+        prefetch(_items.data() + _nodes[found].first_item);
+      }
+    };
+
+  for (std::size_t ii = 0; ii < std::min(count, AHEAD); ++ii) {
+    start(ii);
+  }
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    results[ii] = find_in_leaf(leaves[ii % AHEAD], points[ii], triangles);
+    if (ii + PREFETCH_DISTANCE < count) {
+      auto next = leaves[(ii + PREFETCH_DISTANCE) % AHEAD];
+      if (next >= 0 && _nodes[next].item_count > 0) {
+        prefetch(&triangles[_items[_nodes[next].first_item]]);
+      }
+    }
+    if (ii + AHEAD < count) {
+      start(ii + AHEAD);
+    }
+  }
+}
+
+void QuadtreeIndex::find_in_region(
+  Point2D const &top_left,
+  Point2D const &bottom_right,
+  std::vector<int> &result) const
+{
+  result.clear();
+  if (_nodes.empty()) {
+    return;
+  }
+  std::array<float, 4> region{
+    std::min(top_left.first, bottom_right.first),
+    std::min(top_left.second, bottom_right.second),
+    std::max(top_left.first, bottom_right.first),
+    std::max(top_left.second, bottom_right.second)};
+
+  std::vector<std::int32_t> stack{0};
+  while (!stack.empty()) {
+    Node const &node = _nodes[stack.back()];
+    stack.pop_back();
+    if (!boxes_overlap({node.min_x, node.min_y, node.max_x, node.max_y}, region)) {
+      continue;
+    }
+    if (node.first_child >= 0) {
+      for (int child = 0; child < 4; ++child) {
+        stack.push_back(node.first_child + child);
+      }
+      continue;
+    }
+    for (auto ii = node.first_item; ii < node.first_item + node.item_count; ++ii) {
+      if (boxes_overlap(_bounds[_items[ii]], region)) {
+        result.push_back(_items[ii]);
+      }
+    }
+  }
+
+  // Triangles are stored in every leaf they overlap
+  std::sort(std::begin(result), std::end(result));
+  result.erase(std::unique(std::begin(result), std::end(result)), std::end(result));
+}
+
+std::int32_t QuadtreeIndex::leaf(Point2D const &point) const {
+  if (_nodes.empty()) {
+    return -1;
+  }
+  Node const *node = &_nodes[0];
+  if (!(point.first >= node->min_x && point.first <= node->max_x &&
+    point.second >= node->min_y && point.second <= node->max_y))
+  {
+    return -1;
+  }
+
+  // The children's bounds share their edges, so a point on an edge could be in either child; every
+  // triangle whose bounding box touches the point is in both
+  std::int32_t index{0};
+  while (node->first_child >= 0) {
+    Node const *children = &_nodes[node->first_child];
+    int child = (point.first < children[0].max_x ? 0 : 1) +
+      (point.second < children[0].max_y ? 0 : 2);
+    index = node->first_child + child;
+    node = &children[child];
+  }
+  return index;
+}
+
+int QuadtreeIndex::find_in_leaf(
+  std::int32_t leaf,
+  Point2D const &point,
+  TriangleGeometry const &triangles) const
+{
+  if (leaf < 0) {
+    return -1;
+  }
+  // The items of each leaf are in ascending order, so the first match has the lowest index
+  auto begin = std::begin(_items) + _nodes[leaf].first_item;
+  auto end = begin + _nodes[leaf].item_count;
+  for (auto t = begin; t != end; ++t) {
+    if (triangle_contains(triangles[*t], point)) {
+      return *t;
+    }
+  }
+  return -1;
+}
+
+std::size_t QuadtreeIndex::node_count() const {
+  return _nodes.size();
+}
+
+std::size_t QuadtreeIndex::memory_usage() const {
+  return _nodes.capacity() * sizeof(Node) +
+         _items.capacity() * sizeof(std::int32_t) +
+         _bounds.capacity() * sizeof(std::array<float, 4>);
+}
+
+
+void GridIndex::build(TriangleGeometry const &triangles) {
+  clear();
+  if (triangles.empty()) {
+    _valid = true;
+    return;
+  }
+
+  GridLayout layout(triangles);
+  std::vector<std::uint32_t> counts;
+  if (!count_cell_triangles(layout, triangles, counts)) {
+    return;
+  }
+  _min_x = layout.min_x;
+  _min_y = layout.min_y;
+  _max_x = layout.max_x;
+  _max_y = layout.max_y;
+  _scale_x = layout.scale_x;
+  _scale_y = layout.scale_y;
+  _columns = layout.columns;
+  _rows = layout.rows;
+
+  _cell_offsets.resize(counts.size() + 1);
+  std::uint32_t entries{0};
+  for (std::size_t cell = 0; cell < counts.size(); ++cell) {
+    _cell_offsets[cell] = entries;
+    entries += counts[cell];
+  }
+  _cell_offsets[counts.size()] = entries;
+
+  // Triangles are added in order, so each cell's list is in ascending order
+  _cell_triangles.resize(entries);
+  std::vector<std::uint32_t> fill(std::begin(_cell_offsets), std::end(_cell_offsets) - 1);
+  for (TriangleGeometry::size_type ii = 0; ii < triangles.size(); ++ii) {
+    auto box = bounding_box(triangles[ii]);
+    for (auto row = layout.row(box[1]); row <= layout.row(box[3]); ++row) {
+      for (auto column = layout.column(box[0]); column <= layout.column(box[2]); ++column) {
+        _cell_triangles[fill[static_cast<std::size_t>(row) * _columns + column]++] = ii;
+      }
+    }
+  }
+  _valid = true;
+}
+
+void GridIndex::clear() {
+  _valid = false;
+  _min_x = _min_y = _max_x = _max_y = 0;
+  _scale_x = _scale_y = 0;
+  _columns = _rows = 0;
+  _cell_offsets.clear();
+  _cell_triangles.clear();
+}
+
+bool GridIndex::valid() const {
+  return _valid;
+}
+
+int GridIndex::find(Point2D const &point, TriangleGeometry const &triangles) const {
+  return find_in_cell(cell(point), point, triangles);
+}
+
+void GridIndex::find(
+  Point2D const *points,
+  std::size_t count,
+  TriangleGeometry const &triangles,
+  int *results) const
+{
+  // The cell for each point is found two prefetch distances ahead, and its offsets are prefetched;
+  // one distance ahead, its triangle list is prefetched; and half a distance ahead, the first
+  // triangle in the list is prefetched
+  constexpr std::size_t AHEAD = 2 * PREFETCH_DISTANCE;
+  constexpr std::size_t NEAR = PREFETCH_DISTANCE / 2;
+  std::size_t cell_count = _cell_offsets.empty() ? 0 : _cell_offsets.size() - 1;
+  std::array<std::size_t, AHEAD> cells;
+  auto start = [&](std::size_t ii) {
+      auto found = cell(points[ii]);
+      cells[ii % AHEAD] = found;
+      if (found < cell_count) {
+        prefetch(&_cell_offsets[found]);
+      }
+    };
+
+  for (std::size_t ii = 0; ii < std::min(count, AHEAD); ++ii) {
+    start(ii);
+  }
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    results[ii] = find_in_cell(cells[ii % AHEAD], points[ii], triangles);
+    if (ii + NEAR < count) {
+      auto next = cells[(ii + NEAR) % AHEAD];
+      if (next < cell_count && _cell_offsets[next] < _cell_offsets[next + 1]) {
+        prefetch(&triangles[_cell_triangles[_cell_offsets[next]]]);
+      }
+    }
+    if (ii + PREFETCH_DISTANCE < count) {
+      auto next = cells[(ii + PREFETCH_DISTANCE) % AHEAD];
+      if (next < cell_count) {
+        prefetch(_cell_triangles.data() + _cell_offsets[next]);
+      }
+    }
+    if (ii + AHEAD < count) {
+      start(ii + AHEAD);
+    }
+  }
+}
+
+std::size_t GridIndex::cell(Point2D const &point) const {
+  std::size_t cell_count = _cell_offsets.empty() ? 0 : _cell_offsets.size() - 1;
+  if (cell_count == 0 ||
+    !(point.first >= _min_x && point.first <= _max_x &&
+    point.second >= _min_y && point.second <= _max_y))
+  {
+    return cell_count;
+  }
+  auto column = GridLayout::cell(point.first, _min_x, _scale_x, _columns);
+  auto row = GridLayout::cell(point.second, _min_y, _scale_y, _rows);
+  return static_cast<std::size_t>(row) * _columns + column;
+}
+
+int GridIndex::find_in_cell(
+  std::size_t cell,
+  Point2D const &point,
+  TriangleGeometry const &triangles) const
+{
+  if (cell + 1 >= _cell_offsets.size()) {
+    return -1;
+  }
+  for (auto ii = _cell_offsets[cell]; ii < _cell_offsets[cell + 1]; ++ii) {
+    if (triangle_contains(triangles[_cell_triangles[ii]], point)) {
+      return _cell_triangles[ii];
+    }
+  }
+  return -1;
+}
+
+std::size_t GridIndex::memory_usage() const {
+  return _cell_offsets.capacity() * sizeof(std::uint32_t) +
+         _cell_triangles.capacity() * sizeof(std::int32_t);
+}
+
+void GridIndex::write(std::ostream &out) const {
+  write_value(out, static_cast<std::uint32_t>(_valid));
+  if (!_valid) {
+    return;
+  }
+  write_value(out, _min_x);
+  write_value(out, _min_y);
+  write_value(out, _max_x);
+  write_value(out, _max_y);
+  write_value(out, _scale_x);
+  write_value(out, _scale_y);
+  write_value(out, _columns);
+  write_value(out, _rows);
+  write_value(out, static_cast<std::uint32_t>(_cell_offsets.size()));
+  write_value(out, static_cast<std::uint32_t>(_cell_triangles.size()));
+  write_values(out, _cell_offsets);
+  write_values(out, _cell_triangles);
+}
+
+bool GridIndex::read(std::istream &in, std::uint64_t &remaining, std::size_t triangle_count) {
+  clear();
+  std::uint32_t valid, offset_count, entry_count;
+  if (!read_value(in, remaining, valid)) {
+    return false;
+  }
+  if (valid == 0) {
+    return true;
+  }
+  if (!read_value(in, remaining, _min_x) || !read_value(in, remaining, _min_y) ||
+    !read_value(in, remaining, _max_x) || !read_value(in, remaining, _max_y) ||
+    !read_value(in, remaining, _scale_x) || !read_value(in, remaining, _scale_y) ||
+    !read_value(in, remaining, _columns) || !read_value(in, remaining, _rows) ||
+    !read_value(in, remaining, offset_count) || !read_value(in, remaining, entry_count) ||
+    !read_values(in, remaining, _cell_offsets, offset_count) ||
+    !read_values(in, remaining, _cell_triangles, entry_count))
+  {
+    clear();
+    return false;
+  }
+
+  // An empty grid has no cells; otherwise every cell's list must lie within the list of entries
+  // and name one of the triangles
+  bool consistent = _columns >= 0 && _rows >= 0;
+  if (consistent && offset_count != 0) {
+    consistent = offset_count == static_cast<std::uint64_t>(_columns) * _rows + 1 &&
+      _columns > 0 && _rows > 0 && _cell_offsets.front() == 0 &&
+      _cell_offsets.back() == entry_count &&
+      std::is_sorted(std::begin(_cell_offsets), std::end(_cell_offsets));
+  } else if (consistent) {
+    consistent = entry_count == 0;
+  }
+  for (auto triangle : _cell_triangles) {
+    if (triangle < 0 || static_cast<std::size_t>(triangle) >= triangle_count) {
+      consistent = false;
+    }
+  }
+  if (!consistent) {
+    clear();
+    return false;
+  }
+  _valid = true;
+  return true;
+}
+
+
+void WalkIndex::build(TriangleGeometry const &triangles) {
+  clear();
+  if (triangles.empty()) {
+    _valid = true;
+    return;
+  }
+
+  // Every triangle must have the same orientation as the first
+  double first = orient2d(triangles[0][0], triangles[0][1], triangles[0][2]);
+  if (first == 0) {
+    return;
+  }
+  _orientation = first > 0 ? 1 : -1;
+  for (auto const &t : triangles) {
+    if (orient2d(t[0], t[1], t[2]) * _orientation <= 0) {
+      return;
+    }
+  }
+
+  // Match up the edges of the triangles by the coordinates of their ends. The edge opposite
+  // vertex k runs from vertex k + 1 to vertex k + 2.
+  struct Edge {
+    std::uint64_t low, high;
+    std::int32_t triangle;
+    std::int32_t side;
+    bool reversed;
+  };
+  std::vector<Edge> edges;
+  edges.reserve(triangles.size() * 3);
+  std::vector<std::uint64_t> vertices;
+  vertices.reserve(triangles.size() * 3);
+  for (TriangleGeometry::size_type ii = 0; ii < triangles.size(); ++ii) {
+    for (std::int32_t side = 0; side < 3; ++side) {
+      auto from = point_key(triangles[ii][(side + 1) % 3]);
+      auto to = point_key(triangles[ii][(side + 2) % 3]);
+      edges.push_back(
+        Edge{std::min(from, to), std::max(from, to), static_cast<std::int32_t>(ii), side,
+          from > to});
+      vertices.push_back(from);
+    }
+  }
+  std::sort(
+    std::begin(edges), std::end(edges), [](Edge const &a, Edge const &b) {
+      return a.low < b.low || (a.low == b.low && a.high < b.high);
+    });
+  std::sort(std::begin(vertices), std::end(vertices));
+  auto vertex_count = std::unique(std::begin(vertices), std::end(vertices)) - std::begin(vertices);
+
+  _neighbours.assign(triangles.size(), std::array<std::int32_t, 3>{-1, -1, -1});
+  // The boundary edges, each from its start to its end in the direction of the triangles
+  std::unordered_map<std::uint64_t, Edge const *> boundary;
+  std::size_t edge_count{0};
+  for (std::size_t ii = 0; ii < edges.size(); ) {
+    std::size_t end = ii + 1;
+    while (end < edges.size() && edges[end].low == edges[ii].low &&
+      edges[end].high == edges[ii].high)
+    {
+      ++end;
+    }
+    ++edge_count;
+    if (end - ii == 1) {
+      auto start = edges[ii].reversed ? edges[ii].high : edges[ii].low;
+      if (!boundary.emplace(start, &edges[ii]).second) {
+        // Two boundary edges start at the same vertex, so the triangles only touch there
+        clear();
+        return;
+      }
+    } else if (end - ii == 2 && edges[ii].reversed != edges[ii + 1].reversed) {
+      _neighbours[edges[ii].triangle][edges[ii].side] = edges[ii + 1].triangle;
+      _neighbours[edges[ii + 1].triangle][edges[ii + 1].side] = edges[ii].triangle;
+    } else {
+      // The triangles overlap along this edge
+      clear();
+      return;
+    }
+    ii = end;
+  }
+
+  // A single region with no holes has an Euler characteristic of one
+  if (static_cast<std::int64_t>(vertex_count) - static_cast<std::int64_t>(edge_count) +
+    static_cast<std::int64_t>(triangles.size()) != 1)
+  {
+    clear();
+    return;
+  }
+
+  // The boundary must be a single loop that only ever turns the same way as the triangles, and
+  // turns once in total, so that a point beyond any boundary edge is outside every triangle
+  auto edge_points = [&triangles](Edge const &edge) {
+      auto const &t = triangles[edge.triangle];
+      return std::make_pair(t[(edge.side + 1) % 3], t[(edge.side + 2) % 3]);
+    };
+  auto end_key = [](Edge const &edge) {
+      return edge.reversed ? edge.low : edge.high;
+    };
+  Edge const *current = boundary.begin()->second;
+  double turning{0};
+  for (std::size_t ii = 0; ii < boundary.size(); ++ii) {
+    auto next = boundary.find(end_key(*current));
+    if (next == boundary.end()) {
+      clear();
+      return;
+    }
+    auto a = edge_points(*current);
+    auto b = edge_points(*next->second);
+    if (orient2d(a.first, a.second, b.second) * _orientation < 0) {
+      clear();
+      return;
+    }
+    double ax = static_cast<double>(a.second.first) - a.first.first;
+    double ay = static_cast<double>(a.second.second) - a.first.second;
+    double bx = static_cast<double>(b.second.first) - b.first.first;
+    double by = static_cast<double>(b.second.second) - b.first.second;
+    turning += std::abs(std::atan2(ax * by - ay * bx, ax * bx + ay * by));
+    current = next->second;
+  }
+  if (current != boundary.begin()->second || turning > 3 * PI) {
+    clear();
+    return;
+  }
+
+  // Record a starting triangle for each cell of a coarse grid by walking between the cell
+  // centres, row by row in alternating directions, so that each walk is short
+  GridLayout layout(
+    triangles, std::max<std::size_t>(1, triangles.size() / TRIANGLES_PER_WALK_CELL));
+  _min_x = layout.min_x;
+  _min_y = layout.min_y;
+  _max_x = layout.max_x;
+  _max_y = layout.max_y;
+  _scale_x = layout.scale_x;
+  _scale_y = layout.scale_y;
+  _columns = layout.columns;
+  _rows = layout.rows;
+  _cell_starts.assign(static_cast<std::size_t>(_columns) * _rows, 0);
+  std::int32_t start{0};
+  for (std::int32_t row = 0; row < _rows; ++row) {
+    for (std::int32_t step = 0; step < _columns; ++step) {
+      std::int32_t column = row % 2 == 0 ? step : _columns - 1 - step;
+      Point2D centre{
+        _scale_x > 0 ? _min_x + (column + 0.5f) / _scale_x : _min_x,
+        _scale_y > 0 ? _min_y + (row + 0.5f) / _scale_y : _min_y};
+      std::int32_t last{start};
+      auto found = locate(start, centre, triangles, last);
+      start = found >= 0 ? found : last;
+      _cell_starts[static_cast<std::size_t>(row) * _columns + column] = start;
+    }
+  }
+  _valid = true;
+}
+
+void WalkIndex::clear() {
+  _valid = false;
+  _orientation = 1;
+  _neighbours.clear();
+  _min_x = _min_y = _max_x = _max_y = 0;
+  _scale_x = _scale_y = 0;
+  _columns = _rows = 0;
+  _cell_starts.clear();
+}
+
+bool WalkIndex::valid() const {
+  return _valid;
+}
+
+int WalkIndex::find(Point2D const &point, TriangleGeometry const &triangles) const {
+  if (!inside_bounds(point)) {
+    return -1;
+  }
+  auto column = GridLayout::cell(point.first, _min_x, _scale_x, _columns);
+  auto row = GridLayout::cell(point.second, _min_y, _scale_y, _rows);
+  std::int32_t last;
+  return locate(
+    _cell_starts[static_cast<std::size_t>(row) * _columns + column], point, triangles, last);
+}
+
+void WalkIndex::find(
+  Point2D const *points,
+  std::size_t count,
+  TriangleGeometry const &triangles,
+  int *results) const
+{
+  std::int32_t previous{-1};
+  std::int32_t previous_column{0}, previous_row{0};
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    if (!inside_bounds(points[ii])) {
+      results[ii] = -1;
+      continue;
+    }
+    auto column = GridLayout::cell(points[ii].first, _min_x, _scale_x, _columns);
+    auto row = GridLayout::cell(points[ii].second, _min_y, _scale_y, _rows);
+    std::int32_t start = previous >= 0 && std::abs(column - previous_column) <= 1 &&
+      std::abs(row - previous_row) <= 1 ?
+      previous :
+      _cell_starts[static_cast<std::size_t>(row) * _columns + column];
+    results[ii] = locate(start, points[ii], triangles, previous);
+    previous_column = column;
+    previous_row = row;
+  }
+}
+
+std::size_t WalkIndex::memory_usage() const {
+  return _neighbours.capacity() * sizeof(std::array<std::int32_t, 3>) +
+         _cell_starts.capacity() * sizeof(std::int32_t);
+}
+
+int WalkIndex::walk(
+  std::int32_t start,
+  Point2D const &point,
+  TriangleGeometry const &triangles,
+  std::int32_t &last) const
+{
+  // Walks can go round in circles in triangulations that are not Delaunay, which is made unlikely
+  // by testing the edges in a different order at each step, and is stopped by limiting the steps
+  std::int32_t current = start;
+  for (std::size_t step = 0; step <= triangles.size(); ++step) {
+    last = current;
+    auto const &t = triangles[current];
+    bool on_edge{false};
+    std::int32_t next{-1};
+    bool beyond{false};
+    for (std::size_t kk = 0; kk < 3 && !beyond; ++kk) {
+      auto side = (kk + step) % 3;
+      double orientation = orient2d(t[(side + 1) % 3], t[(side + 2) % 3], point) * _orientation;
+      if (orientation < 0) {
+        next = _neighbours[current][side];
+        beyond = true;
+      } else if (orientation == 0) {
+        on_edge = true;
+      }
+    }
+    if (!beyond) {
+      return on_edge ? lowest_containing(current, point, triangles) : current;
+    }
+    if (next < 0) {
+      // The point is beyond the boundary of the triangulation, which is convex
+      return -1;
+    }
+    current = next;
+  }
+  return -2;
+}
+
+int WalkIndex::lowest_containing(
+  int found,
+  Point2D const &point,
+  TriangleGeometry const &triangles) const
+{
+  // The triangles containing a point on an edge or vertex are connected across their edges
+  std::vector<std::int32_t> containing{found};
+  int lowest = found;
+  for (std::size_t ii = 0; ii < containing.size(); ++ii) {
+    for (auto neighbour : _neighbours[containing[ii]]) {
+      if (neighbour >= 0 &&
+        std::find(std::begin(containing), std::end(containing), neighbour) ==
+        std::end(containing) &&
+        triangle_contains(triangles[neighbour], point))
+      {
+        containing.push_back(neighbour);
+        lowest = std::min(lowest, neighbour);
+      }
+    }
+  }
+  return lowest;
+}
+
+int WalkIndex::locate(
+  std::int32_t start,
+  Point2D const &point,
+  TriangleGeometry const &triangles,
+  std::int32_t &last) const
+{
+  auto found = walk(start, point, triangles, last);
+  if (found != -2) {
+    return found;
+  }
+  for (TriangleGeometry::size_type ii = 0; ii < triangles.size(); ++ii) {
+    if (triangle_contains(triangles[ii], point)) {
+      return ii;
+    }
+  }
+  return -1;
+}
+
+bool WalkIndex::inside_bounds(Point2D const &point) const {
+  return !_cell_starts.empty() &&
+         point.first >= _min_x && point.first <= _max_x &&
+         point.second >= _min_y && point.second <= _max_y;
+}
+
+
+void CorrespondencePointIndex::build(CorrespondencePoints const &points) {
+  clear();
+  _indices.reserve(points.size());
+  for (CorrespondencePoints::size_type ii = 0; ii < points.size(); ++ii) {
+    if (std::isnan(points[ii].first) || std::isnan(points[ii].second)) {
+      continue;
+    }
+    // Keep the first of any duplicated points
+    _indices.emplace(key(points[ii]), ii);
+  }
+}
+
+void CorrespondencePointIndex::clear() {
+  _indices.clear();
+}
+
+int CorrespondencePointIndex::find(Point2D const &point) const {
+  if (std::isnan(point.first) || std::isnan(point.second)) {
+    return -1;
+  }
+  auto result = _indices.find(key(point));
+  if (result == _indices.end()) {
+    return -1;
+  }
+  return result->second;
+}
+
+std::uint64_t CorrespondencePointIndex::key(Point2D const &point) {
+  return point_key(point);
+}
+
+
+void PointLocator::build(
+  TriangleGeometry triangles,
+  SearchStrategy strategy,
+  std::size_t memory_limit,
+  bool overlapping)
+{
+  clear();
+  _triangles = std::move(triangles);
+
+  if (strategy == SearchStrategy::automatic) {
+    _selection = select_search_strategy(_triangles, memory_limit);
+    if (!build_index(_selection.strategy)) {
+      _selection.reason += "; the index could not be built";
+      _selection.strategy = SearchStrategy::linear;
+    } else if (_selection.strategy != SearchStrategy::linear && linear_is_faster()) {
+      build_index(SearchStrategy::linear);
+      _selection.reason += "; the linear search was measured to be faster";
+      _selection.strategy = SearchStrategy::linear;
+    }
+    return;
+  }
+
+  _selection.strategy = strategy;
+  _selection.reason = "requested";
+  if (overlapping && (strategy == SearchStrategy::slab || strategy == SearchStrategy::walk)) {
+    _selection.strategy = SearchStrategy::linear;
+    _selection.reason = "the requested " + to_string(strategy) +
+      " index cannot be used with overlapping triangles";
+    return;
+  }
+  if (!build_index(strategy)) {
+    _selection.strategy = SearchStrategy::linear;
+    _selection.reason = "the requested " + to_string(strategy) +
+      " index cannot be used with these triangles";
+  }
+}
+
+void PointLocator::clear() {
+  _selection = SearchStrategySelection{};
+  _triangles.clear();
+  _slab_index.clear();
+  _quadtree.clear();
+  _grid.clear();
+  _walk.clear();
+}
+
+int PointLocator::find(Point2D const &point) const {
+  switch (_selection.strategy) {
+    case SearchStrategy::slab:
+      return _slab_index.find(point, _triangles);
+    case SearchStrategy::quadtree:
+      return _quadtree.find(point, _triangles);
+    case SearchStrategy::grid:
+      return _grid.find(point, _triangles);
+    case SearchStrategy::walk:
+      return _walk.find(point, _triangles);
+    case SearchStrategy::linear:
+    default:
+      return find_linear(point);
+  }
+}
+
+void PointLocator::find(Point2D const *points, std::size_t count, int *results) const {
+  switch (_selection.strategy) {
+    case SearchStrategy::quadtree:
+      _quadtree.find(points, count, _triangles, results);
+      return;
+    case SearchStrategy::grid:
+      _grid.find(points, count, _triangles, results);
+      return;
+    case SearchStrategy::walk:
+      _walk.find(points, count, _triangles, results);
+      return;
+    default:
+      for (std::size_t ii = 0; ii < count; ++ii) {
+        results[ii] = find(points[ii]);
+      }
+  }
+}
+
+std::vector<int> PointLocator::find_in_region(
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
+  std::vector<int> result;
+  if (_selection.strategy == SearchStrategy::quadtree) {
+    _quadtree.find_in_region(top_left, bottom_right, result);
+    return result;
+  }
+
+  std::array<float, 4> region{
+    std::min(top_left.first, bottom_right.first),
+    std::min(top_left.second, bottom_right.second),
+    std::max(top_left.first, bottom_right.first),
+    std::max(top_left.second, bottom_right.second)};
+  for (TriangleGeometry::size_type ii = 0; ii < _triangles.size(); ++ii) {
+    if (boxes_overlap(bounding_box(_triangles[ii]), region)) {
+      result.push_back(ii);
+    }
+  }
+  return result;
+}
+
+SearchStrategy PointLocator::strategy() const {
+  return _selection.strategy;
+}
+
+SearchStrategySelection const &PointLocator::selection() const {
+  return _selection;
+}
+
+TriangleGeometry const &PointLocator::triangles() const {
+  return _triangles;
+}
+
+bool PointLocator::build_index(SearchStrategy strategy) {
+  _slab_index.clear();
+  _quadtree.clear();
+  _grid.clear();
+  _walk.clear();
+  switch (strategy) {
+    case SearchStrategy::slab:
+      _slab_index.build(_triangles);
+      return _slab_index.valid();
+    case SearchStrategy::quadtree:
+      _quadtree.build(_triangles);
+      return true;
+    case SearchStrategy::grid:
+      _grid.build(_triangles);
+      return _grid.valid();
+    case SearchStrategy::walk:
+      _walk.build(_triangles);
+      return _walk.valid();
+    case SearchStrategy::linear:
+      return true;
+    case SearchStrategy::automatic:
+    default:
+      return false;
+  }
+}
+
+bool PointLocator::linear_is_faster() const {
+  // Search for the centres of a spread of triangles, once to warm the caches and once timed. The
+  // linear search is abandoned as soon as it takes longer than the index.
+  std::vector<Point2D> sample;
+  auto stride = std::max<std::size_t>(1, _triangles.size() / TIMING_SAMPLE_SIZE);
+  for (std::size_t ii = 0; ii < _triangles.size(); ii += stride) {
+    auto const &t = _triangles[ii];
+    sample.emplace_back(
+      (t[0].first + t[1].first + t[2].first) / 3,
+      (t[0].second + t[1].second + t[2].second) / 3);
+  }
+
+  volatile int sink{0};
+  for (auto const &point : sample) {
+    sink = find(point);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (auto const &point : sample) {
+    sink = find(point);
+  }
+  auto index_time = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (auto const &point : sample) {
+    sink = find_linear(point);
+    if (std::chrono::steady_clock::now() - start > index_time) {
+      return false;
+    }
+  }
+  static_cast<void>(sink);
+  return true;
+}
+
+int PointLocator::find_linear(Point2D const &point) const {
+  for (TriangleGeometry::size_type ii = 0; ii < _triangles.size(); ++ii) {
+    if (triangle_contains(_triangles[ii], point)) {
+      return ii;
+    }
+  }
+  return -1;
+}
+
+}  // namespace map_transformer
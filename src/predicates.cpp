@@ -0,0 +1,156 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/predicates.hpp"
+
+#include <cmath>
+#include <vector>
+
+
+namespace map_transformer
+{
+
+namespace predicates
+{
+
+namespace
+{
+
+// An exact value, represented as the sum of non-overlapping doubles in order of increasing
+// magnitude. The sign of the value is the sign of its last component.
+using Expansion = std::vector<double>;
+
+// Calculate a + b exactly, as x + y where x is the rounded sum
+inline void two_sum(double a, double b, double &x, double &y) {
+  x = a + b;
+  double b_virtual = x - a;
+  double a_virtual = x - b_virtual;
+  y = (a - a_virtual) + (b - b_virtual);
+}
+
+// Calculate a * b exactly, as x + y where x is the rounded product
+inline void two_product(double a, double b, double &x, double &y) {
+  x = a * b;
+  y = std::fma(a, b, -x);
+}
+
+// Calculate a - b exactly
+Expansion difference(double a, double b) {
+  double x, y;
+  two_sum(a, -b, x, y);
+  if (y == 0) {
+    return Expansion{x};
+  }
+  return Expansion{y, x};
+}
+
+// Add a double to an expansion
+Expansion grow(Expansion const &e, double b) {
+  Expansion h;
+  h.reserve(e.size() + 1);
+  double q = b;
+  for (double component : e) {
+    double hh;
+    two_sum(q, component, q, hh);
+    if (hh != 0) {
+      h.push_back(hh);
+    }
+  }
+  if (q != 0 || h.empty()) {
+    h.push_back(q);
+  }
+  return h;
+}
+
+Expansion sum(Expansion const &e, Expansion const &f) {
+  Expansion h = e;
+  for (double component : f) {
+    h = grow(h, component);
+  }
+  return h;
+}
+
+Expansion negate(Expansion e) {
+  for (double &component : e) {
+    component = -component;
+  }
+  return e;
+}
+
+// Multiply an expansion by a double
+Expansion scale(Expansion const &e, double b) {
+  Expansion h;
+  h.reserve(2 * e.size());
+  double q, hh;
+  two_product(e[0], b, q, hh);
+  if (hh != 0) {
+    h.push_back(hh);
+  }
+  for (Expansion::size_type ii = 1; ii < e.size(); ++ii) {
+    double product, product_error;
+    two_product(e[ii], b, product, product_error);
+    two_sum(q, product_error, q, hh);
+    if (hh != 0) {
+      h.push_back(hh);
+    }
+    two_sum(product, q, q, hh);
+    if (hh != 0) {
+      h.push_back(hh);
+    }
+  }
+  if (q != 0 || h.empty()) {
+    h.push_back(q);
+  }
+  return h;
+}
+
+Expansion product(Expansion const &e, Expansion const &f) {
+  Expansion h{0};
+  for (double component : f) {
+    h = sum(h, scale(e, component));
+  }
+  return h;
+}
+
+}  // namespace
+
+
+double orient2d_exact(Point2D const &a, Point2D const &b, Point2D const &c) {
+  auto acx = difference(a.first, c.first);
+  auto acy = difference(a.second, c.second);
+  auto bcx = difference(b.first, c.first);
+  auto bcy = difference(b.second, c.second);
+  return sum(product(acx, bcy), negate(product(acy, bcx))).back();
+}
+
+double incircle_exact(Point2D const &a, Point2D const &b, Point2D const &c, Point2D const &d) {
+  auto adx = difference(a.first, d.first);
+  auto ady = difference(a.second, d.second);
+  auto bdx = difference(b.first, d.first);
+  auto bdy = difference(b.second, d.second);
+  auto cdx = difference(c.first, d.first);
+  auto cdy = difference(c.second, d.second);
+
+  auto alift = sum(product(adx, adx), product(ady, ady));
+  auto blift = sum(product(bdx, bdx), product(bdy, bdy));
+  auto clift = sum(product(cdx, cdx), product(cdy, cdy));
+  auto bc = sum(product(bdx, cdy), negate(product(cdx, bdy)));
+  auto ca = sum(product(cdx, ady), negate(product(adx, cdy)));
+  auto ab = sum(product(adx, bdy), negate(product(bdx, ady)));
+  return sum(sum(product(alift, bc), product(blift, ca)), product(clift, ab)).back();
+}
+
+}  // namespace predicates
+
+}  // namespace map_transformer
@@ -0,0 +1,287 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "map_transformer/transformer.hpp"
+
+namespace py = pybind11;
+
+using map_transformer::Point2D;
+using map_transformer::Transformer;
+using map_transformer::TriangulationMode;
+
+namespace
+{
+
+// An (N, 2) array of float32 is laid out exactly as an array of points
+static_assert(sizeof(Point2D) == 2 * sizeof(float), "Points must be two packed floats");
+
+using PointArray = py::array_t<float, py::array::c_style>;
+// Arrays of other types and layouts are converted to this, while matching arrays are used as is
+using InputPointArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+
+// Batches smaller than this are not worth starting threads for
+constexpr std::size_t MIN_POINTS_PER_THREAD = 16384;
+
+using BatchTransform = void (Transformer::*)(Point2D const *, std::size_t, Point2D *) const;
+
+// The Transformer bound to Python. Batches are transformed without the GIL, so other Python
+// threads could load or reset the transformer meanwhile; reading it shares the lock, and changing
+// it takes the lock exclusively.
+struct PyTransformer {
+  Transformer transformer;
+  mutable std::shared_mutex mutex;
+};
+
+// Read the transformer while holding the GIL
+template<typename Function>
+auto read_transformer(PyTransformer const &self, Function function) {
+  std::shared_lock<std::shared_mutex> lock(self.mutex);
+  return function(self.transformer);
+}
+
+// Change the transformer, releasing the GIL while waiting for batches being transformed to finish
+template<typename Function>
+void modify_transformer(PyTransformer &self, Function function) {
+  py::gil_scoped_release release;
+  std::unique_lock<std::shared_mutex> lock(self.mutex);
+  function(self.transformer);
+}
+
+// Transform a batch in contiguous slices on separate threads; the batch transforms of a const
+// Transformer may be called concurrently
+void transform_parallel(
+  Transformer const &transformer,
+  BatchTransform transform,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results,
+  unsigned int thread_count)
+{
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::size_t slices = std::min<std::size_t>(
+    thread_count, std::max<std::size_t>(1, count / MIN_POINTS_PER_THREAD));
+  if (slices <= 1) {
+    (transformer.*transform)(points, count, results);
+    return;
+  }
+
+  // Exceptions thrown on the other threads are passed back to be rethrown on this one
+  std::size_t slice_size = (count + slices - 1) / slices;
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> errors(slices);
+  for (std::size_t slice = 1; slice < slices; ++slice) {
+    std::size_t start = slice * slice_size;
+    std::size_t size = start < count ? std::min(slice_size, count - start) : 0;
+    threads.emplace_back(
+      [&transformer, transform, points, results, start, size, &error = errors[slice]]() {
+        try {
+          (transformer.*transform)(points + start, size, results + start);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      });
+  }
+  try {
+    (transformer.*transform)(points, slice_size, results);
+  } catch (...) {
+    errors[0] = std::current_exception();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto const &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+// Get points as an array of float32, using the array's memory if it is already float32 and
+// C-contiguous, and converting it otherwise, such as from a list of pairs
+InputPointArray as_point_array(py::handle points) {
+  auto array = InputPointArray::ensure(points);
+  if (!array) {
+    throw py::type_error("Points must be convertible to a NumPy array of float32");
+  }
+  return array;
+}
+
+py::object transform(
+  PyTransformer const &self,
+  BatchTransform batch_transform,
+  Point2D (Transformer::*single_transform)(Point2D const &) const,
+  py::object const &points,
+  py::object const &out,
+  unsigned int threads)
+{
+  auto input = as_point_array(points);
+  // A single point may be given as any pair of numbers other than an array, and is returned as a
+  // tuple
+  if (!py::isinstance<py::array>(points) && input.ndim() == 1 && input.shape(0) == 2) {
+    Point2D point{input.at(0), input.at(1)};
+    return py::cast(
+      read_transformer(self, [&](Transformer const &transformer) {
+        return (transformer.*single_transform)(point);
+      }));
+  }
+  if (input.ndim() != 2 || input.shape(1) != 2) {
+    throw py::value_error("Points must be an (x, y) pair or an array of shape (N, 2)");
+  }
+
+  PointArray output;
+  if (out.is_none()) {
+    output = PointArray({input.shape(0), py::ssize_t{2}});
+  } else {
+    // The results are written straight into out, so it must not need converting
+    if (!py::isinstance<PointArray>(out) || !out.cast<py::array>().writeable()) {
+      throw py::type_error("out must be a writeable, C-contiguous float32 array");
+    }
+    output = py::reinterpret_borrow<PointArray>(out);
+    if (output.ndim() != 2 || output.shape(0) != input.shape(0) || output.shape(1) != 2) {
+      throw py::value_error("out must have the same shape as the points");
+    }
+  }
+
+  auto const *input_points = reinterpret_cast<Point2D const *>(input.data());
+  auto *output_points = reinterpret_cast<Point2D *>(output.mutable_data());
+  auto count = static_cast<std::size_t>(input.shape(0));
+  {
+    py::gil_scoped_release release;
+    std::shared_lock<std::shared_mutex> lock(self.mutex);
+    transform_parallel(
+      self.transformer, batch_transform, input_points, count, output_points, threads);
+  }
+  return std::move(output);
+}
+
+}  // namespace
+
+
+PYBIND11_MODULE(map_transformer, m) {
+  m.doc() = "Transformations between a reference map and a robot map";
+
+  py::enum_<TriangulationMode>(m, "TriangulationMode")
+  .value("midpoint", TriangulationMode::midpoint)
+  .value("per_direction", TriangulationMode::per_direction);
+
+  py::class_<PyTransformer>(m, "Transformer")
+  .def(py::init<>())
+  .def(
+    py::init(
+      [](std::string const &yaml_doc) {
+        auto self = std::make_unique<PyTransformer>();
+        self->transformer.load(yaml_doc);
+        return self;
+      }),
+    py::arg("yaml_doc"))
+  .def(
+    "load",
+    [](PyTransformer &self, std::string const &yaml_doc) {
+      modify_transformer(self, [&](Transformer &transformer) {transformer.load(yaml_doc);});
+    },
+    py::arg("yaml_doc"),
+    "Load map information from a YAML document. The transformer must be empty.")
+  .def(
+    "load_snapshot",
+    [](PyTransformer &self, py::bytes const &snapshot) {
+      std::string data = snapshot;
+      modify_transformer(
+        self, [&](Transformer &transformer) {
+          transformer.load_snapshot(data.data(), data.size());
+        });
+    },
+    py::arg("snapshot"),
+    "Load map information from a snapshot. The transformer must be empty.")
+  .def(
+    "snapshot",
+    [](PyTransformer const &self) {
+      return py::bytes(
+        read_transformer(
+          self, [](Transformer const &transformer) {return transformer.snapshot();}));
+    },
+    "Take a snapshot of the loaded map information, as bytes.")
+  .def(
+    "reset",
+    [](PyTransformer &self) {
+      modify_transformer(self, [](Transformer &transformer) {transformer.reset();});
+    },
+    "Clear any loaded map information.")
+  .def_property(
+    "triangulation_mode",
+    [](PyTransformer const &self) {
+      return read_transformer(
+        self, [](Transformer const &transformer) {return transformer.triangulation_mode();});
+    },
+    [](PyTransformer &self, TriangulationMode mode) {
+      modify_transformer(
+        self, [mode](Transformer &transformer) {transformer.set_triangulation_mode(mode);});
+    })
+  .def_property_readonly(
+    "ref_map_name",
+    [](PyTransformer const &self) {
+      return read_transformer(
+        self, [](Transformer const &transformer) {return transformer.ref_map_name();});
+    })
+  .def_property_readonly(
+    "robot_map_name",
+    [](PyTransformer const &self) {
+      return read_transformer(
+        self, [](Transformer const &transformer) {return transformer.robot_map_name();});
+    })
+  .def(
+    "to_ref",
+    [](PyTransformer const &self, py::object const &points, py::object const &out,
+    unsigned int threads) {
+      return transform(
+        self,
+        static_cast<BatchTransform>(&Transformer::to_ref),
+        static_cast<Point2D (Transformer::*)(Point2D const &) const>(&Transformer::to_ref),
+        points, out, threads);
+    },
+    py::arg("points"), py::arg("out") = py::none(), py::arg("threads") = 0,
+    "Transform points from the robot map to the reference map.\n\n"
+    "points may be a single (x, y) pair, which is returned as a tuple, or an array of shape\n"
+    "(N, 2), such as a list of pairs, which is returned as a float32 array. A C-contiguous\n"
+    "float32 array is read without copying, and the results are written to out if it is given,\n"
+    "which may be the points array itself. Large batches are split across threads, up to\n"
+    "threads if it is not zero, and the GIL is released while they are transformed. Loading or\n"
+    "resetting the transformer from another thread waits until the batch is done.")
+  .def(
+    "to_robot",
+    [](PyTransformer const &self, py::object const &points, py::object const &out,
+    unsigned int threads) {
+      return transform(
+        self,
+        static_cast<BatchTransform>(&Transformer::to_robot),
+        static_cast<Point2D (Transformer::*)(Point2D const &) const>(&Transformer::to_robot),
+        points, out, threads);
+    },
+    py::arg("points"), py::arg("out") = py::none(), py::arg("threads") = 0,
+    "Transform points from the reference map to the robot map. See to_ref().");
+}
@@ -0,0 +1,169 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/query_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+// The number of shards used when none is given, for caches large enough to fill them
+constexpr std::size_t DEFAULT_SHARD_COUNT = 16;
+// The fewest results a shard holds when the number of shards is chosen automatically
+constexpr std::size_t MIN_SHARD_CAPACITY = 64;
+
+}  // namespace
+
+
+double QueryCacheStatistics::hit_rate() const {
+  auto lookups = hits + misses;
+  return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+}
+
+
+QueryCache::QueryCache(std::size_t capacity, std::size_t shard_count)
+: _capacity(capacity)
+{
+  if (shard_count == 0) {
+    shard_count = std::clamp<std::size_t>(capacity / MIN_SHARD_CAPACITY, 1, DEFAULT_SHARD_COUNT);
+  }
+  create_shards(shard_count);
+}
+
+QueryCache::QueryCache(QueryCache const &other)
+: _capacity(other._capacity)
+{
+  create_shards(other._shards.size());
+}
+
+QueryCache & QueryCache::operator=(QueryCache const &other) {
+  if (this != &other) {
+    _capacity = other._capacity;
+    create_shards(other._shards.size());
+  }
+  return *this;
+}
+
+bool QueryCache::enabled() const {
+  return _capacity > 0;
+}
+
+std::size_t QueryCache::capacity() const {
+  return _capacity;
+}
+
+bool QueryCache::find(Point2D const &point, Point2D &result) {
+  if (!enabled()) {
+    return false;
+  }
+  auto point_key = key(point);
+  auto &selected = shard(point_key);
+  std::lock_guard<std::mutex> lock(selected.mutex);
+  auto entry = selected.index.find(point_key);
+  if (entry == selected.index.end()) {
+    ++selected.misses;
+    return false;
+  }
+  ++selected.hits;
+  selected.entries.splice(selected.entries.begin(), selected.entries, entry->second);
+  result = entry->second->second;
+  return true;
+}
+
+void QueryCache::insert(Point2D const &point, Point2D const &result) {
+  if (!enabled()) {
+    return;
+  }
+  auto point_key = key(point);
+  auto &selected = shard(point_key);
+  std::lock_guard<std::mutex> lock(selected.mutex);
+  auto entry = selected.index.find(point_key);
+  if (entry != selected.index.end()) {
+    // Another thread added the point since it was looked up
+    entry->second->second = result;
+    selected.entries.splice(selected.entries.begin(), selected.entries, entry->second);
+    return;
+  }
+  if (selected.entries.size() >= selected.capacity) {
+    selected.index.erase(selected.entries.back().first);
+    selected.entries.pop_back();
+    ++selected.evictions;
+  }
+  selected.entries.emplace_front(point_key, result);
+  selected.index.emplace(point_key, selected.entries.begin());
+}
+
+void QueryCache::clear() {
+  for (auto &selected : _shards) {
+    std::lock_guard<std::mutex> lock(selected->mutex);
+    selected->entries.clear();
+    selected->index.clear();
+  }
+}
+
+QueryCacheStatistics QueryCache::statistics() const {
+  QueryCacheStatistics result;
+  result.capacity = _capacity;
+  for (auto const &selected : _shards) {
+    std::lock_guard<std::mutex> lock(selected->mutex);
+    result.hits += selected->hits;
+    result.misses += selected->misses;
+    result.evictions += selected->evictions;
+    result.size += selected->entries.size();
+  }
+  return result;
+}
+
+void QueryCache::reset_statistics() {
+  for (auto &selected : _shards) {
+    std::lock_guard<std::mutex> lock(selected->mutex);
+    selected->hits = selected->misses = selected->evictions = 0;
+  }
+}
+
+void QueryCache::create_shards(std::size_t shard_count) {
+  // Every shard must be able to hold at least one result, and together they hold no more than the
+  // capacity
+  shard_count = std::clamp<std::size_t>(shard_count, 1, std::max<std::size_t>(1, _capacity));
+  _shards.clear();
+  for (std::size_t ii = 0; ii < shard_count; ++ii) {
+    _shards.push_back(std::make_unique<Shard>());
+    _shards.back()->capacity = _capacity / shard_count + (ii < _capacity % shard_count ? 1 : 0);
+  }
+}
+
+QueryCache::Shard & QueryCache::shard(std::uint64_t key) {
+  // Mix the bits so that nearby points, which differ only in their low bits, are spread evenly
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return *_shards[key % _shards.size()];
+}
+
+std::uint64_t QueryCache::key(Point2D const &point) {
+  // The exact bits are used, unlike for correspondence points, as the results for positive and
+  // negative zero may differ in the sign of zero
+  std::uint32_t x_bits, y_bits;
+  std::memcpy(&x_bits, &point.first, sizeof(x_bits));
+  std::memcpy(&y_bits, &point.second, sizeof(y_bits));
+  return (static_cast<std::uint64_t>(x_bits) << 32) | y_bits;
+}
+
+}  // namespace map_transformer
@@ -0,0 +1,245 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/shared_memory_client.hpp"
+#include "futex.hpp"
+#include "socket_io.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+
+namespace map_transformer {
+
+namespace
+{
+
+// How often a client waiting for a request checks whether the server has stopped
+constexpr std::chrono::milliseconds SERVER_POLL_INTERVAL{100};
+
+}  // namespace
+
+
+SharedMemoryClient::SharedMemoryClient(
+  std::string const &socket_path,
+  std::uint32_t map,
+  std::uint32_t capacity)
+: _map(map), _capacity(capacity)
+{
+  if (capacity == 0 || capacity > protocol::MAX_CHANNEL_POINTS) {
+    throw std::invalid_argument(
+      "A shared memory channel must hold between 1 and " +
+      std::to_string(protocol::MAX_CHANNEL_POINTS) + " points");
+  }
+  _socket = socket_io::connect_unix(socket_path);
+
+  protocol::RequestHeader request{
+    protocol::REQUEST_MAGIC, 0, map, protocol::Operation::open_channel, capacity,
+    protocol::Lane::latency};
+  protocol::ResponseHeader response;
+  int memory = -1;
+  if (!socket_io::send_all(_socket, &request, sizeof(request), nullptr, 0) ||
+    !socket_io::receive_with_descriptor(_socket, &response, sizeof(response), memory))
+  {
+    ::close(_socket);
+    throw std::runtime_error("The transform server closed the connection");
+  }
+  void *mapping = MAP_FAILED;
+  if (response.status == protocol::Status::ok && memory >= 0) {
+    mapping = ::mmap(
+      nullptr, protocol::channel_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+  }
+  if (memory >= 0) {
+    ::close(memory);
+  }
+  if (mapping == MAP_FAILED) {
+    ::close(_socket);
+    if (response.status == protocol::Status::unknown_map) {
+      throw std::runtime_error(
+        "The transform server has no map with index " + std::to_string(map));
+    }
+    throw std::runtime_error(
+      "The transform server could not open a shared memory channel (status " +
+      std::to_string(static_cast<std::uint32_t>(response.status)) + ")");
+  }
+  _channel = static_cast<protocol::ChannelHeader *>(mapping);
+  if (_channel->magic != protocol::CHANNEL_MAGIC || _channel->capacity != capacity) {
+    ::munmap(mapping, protocol::channel_size(capacity));
+    ::close(_socket);
+    throw std::runtime_error("The transform server opened an invalid shared memory channel");
+  }
+  _points = protocol::channel_points(_channel);
+}
+
+
+SharedMemoryClient::~SharedMemoryClient() {
+  _channel->closed.store(1, std::memory_order_release);
+  futex::wake(_channel->submitted);
+  ::munmap(_channel, protocol::channel_size(_capacity));
+  ::close(_socket);
+}
+
+
+std::uint32_t SharedMemoryClient::capacity() const {
+  return _capacity;
+}
+
+
+Point2D * SharedMemoryClient::reserve(std::size_t count) {
+  if (count == 0 || count > _capacity) {
+    throw std::invalid_argument(
+      "A request must have between 1 and " + std::to_string(_capacity) + " points");
+  }
+  // Reuse the space of the requests that have been waited for
+  while (!_submitted_requests.empty() && _submitted_requests.front().request < _waited) {
+    _tail = _submitted_requests.front().end;
+    _submitted_requests.pop_front();
+  }
+  if (_submitted_requests.empty()) {
+    _head = _tail = 0;
+  }
+
+  // A request's points must be contiguous, so skip the end of the ring if they do not fit there
+  auto position = _head % _capacity;
+  auto start = position + count > _capacity ? _head + (_capacity - position) : _head;
+  if (start + count - _tail > _capacity) {
+    throw std::logic_error(
+      "The shared memory channel has no space for " + std::to_string(count) +
+      " points until more requests have been waited for");
+  }
+  _reserved = true;
+  _reserved_start = start;
+  _reserved_count = static_cast<std::uint32_t>(count);
+  return _points + start % _capacity;
+}
+
+
+std::uint64_t SharedMemoryClient::submit(protocol::Operation operation) {
+  if (!_reserved) {
+    throw std::logic_error("Space must be reserved for a request before it is submitted");
+  }
+  if (_submitted - _waited >= protocol::CHANNEL_SLOTS) {
+    throw std::logic_error(
+      "A shared memory channel holds at most " + std::to_string(protocol::CHANNEL_SLOTS) +
+      " requests that have not been waited for");
+  }
+  auto &slot = _channel->slots[_submitted % protocol::CHANNEL_SLOTS];
+  slot.map = _map;
+  slot.operation = operation;
+  slot.offset = static_cast<std::uint32_t>(_reserved_start % _capacity);
+  slot.count = _reserved_count;
+  slot.status = protocol::Status::ok;
+  _head = _reserved_start + _reserved_count;
+  _submitted_requests.push_back({_submitted, _head});
+  _reserved = false;
+
+  auto request = _submitted++;
+  futex::publish(
+    _channel->submitted, static_cast<std::uint32_t>(_submitted), _channel->server_waiting);
+  return request;
+}
+
+
+Point2D const * SharedMemoryClient::wait(std::uint64_t request) {
+  if (request >= _submitted) {
+    throw std::logic_error("Request " + std::to_string(request) + " has not been submitted");
+  }
+  // The counter wraps around, so compare its distance from the request's
+  auto target = static_cast<std::uint32_t>(request + 1);
+  while (true) {
+    auto completed = _channel->completed.load(std::memory_order_acquire);
+    if (static_cast<std::int32_t>(completed - target) >= 0) {
+      break;
+    }
+    if (!futex::wait_for_change(
+        _channel->completed, completed, _channel->client_waiting, SERVER_POLL_INTERVAL) &&
+      socket_io::peer_closed(_socket))
+    {
+      throw std::runtime_error("The transform server closed the shared memory channel");
+    }
+  }
+  _waited = std::max(_waited, request + 1);
+
+  auto const &slot = _channel->slots[request % protocol::CHANNEL_SLOTS];
+  if (slot.status == protocol::Status::unknown_map) {
+    throw std::runtime_error(
+      "The transform server has no map with index " + std::to_string(slot.map));
+  }
+  if (slot.status != protocol::Status::ok) {
+    throw std::runtime_error(
+      "The transform server failed to transform the points (status " +
+      std::to_string(static_cast<std::uint32_t>(slot.status)) + ")");
+  }
+  return _points + slot.offset;
+}
+
+
+Point2D SharedMemoryClient::to_ref(Point2D const &point) {
+  Point2D result;
+  transform(protocol::Operation::to_ref, &point, 1, &result);
+  return result;
+}
+
+
+Point2D SharedMemoryClient::to_robot(Point2D const &point) {
+  Point2D result;
+  transform(protocol::Operation::to_robot, &point, 1, &result);
+  return result;
+}
+
+
+void SharedMemoryClient::to_ref(Point2D const *points, std::size_t count, Point2D *results) {
+  transform(protocol::Operation::to_ref, points, count, results);
+}
+
+
+std::vector<Point2D> SharedMemoryClient::to_ref(std::vector<Point2D> const &points) {
+  std::vector<Point2D> results(points.size());
+  to_ref(points.data(), points.size(), results.data());
+  return results;
+}
+
+
+void SharedMemoryClient::to_robot(Point2D const *points, std::size_t count, Point2D *results) {
+  transform(protocol::Operation::to_robot, points, count, results);
+}
+
+
+std::vector<Point2D> SharedMemoryClient::to_robot(std::vector<Point2D> const &points) {
+  std::vector<Point2D> results(points.size());
+  to_robot(points.data(), points.size(), results.data());
+  return results;
+}
+
+
+void SharedMemoryClient::transform(
+  protocol::Operation operation,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results)
+{
+  for (std::size_t start = 0; start < count; start += _capacity) {
+    auto size = std::min<std::size_t>(_capacity, count - start);
+    std::copy(points + start, points + start + size, reserve(size));
+    auto transformed = wait(submit(operation));
+    std::copy(transformed, transformed + size, results + start);
+  }
+}
+
+}  // namespace map_transformer
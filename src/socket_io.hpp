@@ -0,0 +1,192 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__SOCKET_IO_HPP_
+#define MAP_TRANSFORMER__SOCKET_IO_HPP_
+
+// Blocking I/O on stream sockets, shared by the transform client and server
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+namespace map_transformer {
+
+namespace socket_io {
+
+// Fill in the address of a Unix domain socket
+inline sockaddr_un unix_address(std::string const &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Invalid socket path: " + path);
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+// Connect to a Unix domain socket, returning the connected socket
+inline int connect_unix(std::string const &path) {
+  auto address = unix_address(path);
+  int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket < 0) {
+    throw std::runtime_error(std::string("Could not create a socket: ") + std::strerror(errno));
+  }
+  if (::connect(socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    auto error = errno;
+    ::close(socket);
+    throw std::runtime_error("Could not connect to " + path + ": " + std::strerror(error));
+  }
+  return socket;
+}
+
+// Receive exactly size bytes, returning false if the connection is closed or fails first
+inline bool receive_all(int socket, void *data, std::size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    auto received = ::recv(socket, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= static_cast<std::size_t>(received);
+  }
+  return true;
+}
+
+// Send two buffers as one message without copying them together, returning false if the
+// connection fails
+inline bool send_all(
+  int socket,
+  void const *header,
+  std::size_t header_size,
+  void const *body,
+  std::size_t body_size)
+{
+  iovec parts[2] = {
+    {const_cast<void *>(header), header_size},
+    {const_cast<void *>(body), body_size}};
+  msghdr message{};
+  message.msg_iov = parts;
+  message.msg_iovlen = 2;
+  while (parts[0].iov_len + parts[1].iov_len > 0) {
+    // Do not raise SIGPIPE if the other end has closed the connection
+    auto sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0) {
+      return false;
+    }
+    auto remaining = static_cast<std::size_t>(sent);
+    for (auto &part : parts) {
+      auto used = std::min(remaining, part.iov_len);
+      part.iov_base = static_cast<char *>(part.iov_base) + used;
+      part.iov_len -= used;
+      remaining -= used;
+    }
+    if (parts[0].iov_len == 0) {
+      message.msg_iov = &parts[1];
+      message.msg_iovlen = 1;
+    }
+  }
+  return true;
+}
+
+// Send a small message along with a file descriptor, returning false if the connection fails
+inline bool send_with_descriptor(int socket, void const *data, std::size_t size, int descriptor) {
+  iovec part{const_cast<void *>(data), size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+  msghdr message{};
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  auto *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  // The descriptor is attached to the first byte, so send the rest separately if need be
+  return sent > 0 && send_all(
+    socket, static_cast<char const *>(data) + sent, size - static_cast<std::size_t>(sent),
+    nullptr, 0);
+}
+
+// Receive exactly size bytes and the file descriptor sent with them, if any, which is stored in
+// descriptor (or -1 if none was sent). Returns false if the connection is closed or fails first.
+inline bool receive_with_descriptor(int socket, void *data, std::size_t size, int &descriptor) {
+  descriptor = -1;
+  iovec part{data, size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+  msghdr message{};
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t received;
+  do {
+    received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received <= 0) {
+    return false;
+  }
+  for (auto *header = CMSG_FIRSTHDR(&message); header != nullptr;
+    header = CMSG_NXTHDR(&message, header))
+  {
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+      std::memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+    }
+  }
+  if (!receive_all(
+      socket, static_cast<char *>(data) + received, size - static_cast<std::size_t>(received)))
+  {
+    if (descriptor >= 0) {
+      ::close(descriptor);
+      descriptor = -1;
+    }
+    return false;
+  }
+  return true;
+}
+
+// Check without blocking whether the other end of a connection has closed it
+inline bool peer_closed(int socket) {
+  char byte;
+  auto received = ::recv(socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+         errno != EINTR);
+}
+
+}  // namespace socket_io
+
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__SOCKET_IO_HPP_
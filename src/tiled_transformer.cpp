@@ -0,0 +1,581 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/tiled_transformer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <yaml-cpp/yaml.h>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+constexpr char TILE_MAGIC[4] = {'M', 'T', 'T', 'L'};
+constexpr std::uint32_t TILE_FORMAT_VERSION = 2;
+// The magic number, version, and counts of correspondence points and triangles
+constexpr std::uint64_t TILE_HEADER_SIZE = sizeof(TILE_MAGIC) + 3 * sizeof(std::uint32_t);
+constexpr char MANIFEST_FILE_NAME[] = "tiles.yaml";
+constexpr char TO_REF_PREFIX[] = "to_ref";
+constexpr char TO_ROBOT_PREFIX[] = "to_robot";
+// The most tiles a grid may have, so that a tile size far too small for the map is refused rather
+// than allocating and writing a file for every tile
+constexpr double MAX_GRID_TILES = 1 << 24;
+
+// The position of a coordinate in a grid, in whole tiles, which is not converted to an integer so
+// that positions far outside the grid, infinite or NaN can be checked against its size first
+double tile_position(float coordinate, float origin, float tile_size) {
+  return std::floor((coordinate - origin) / tile_size);
+}
+
+// The tile that a coordinate known to be in the grid falls in
+int tile_index(float coordinate, float origin, float tile_size) {
+  return static_cast<int>(tile_position(coordinate, origin, tile_size));
+}
+
+std::string tile_file_name(std::string const &prefix, int column, int row) {
+  return prefix + "_" + std::to_string(column) + "_" + std::to_string(row) + ".tile";
+}
+
+template<typename T>
+void write_array(std::ofstream &out, std::vector<T> const &values) {
+  out.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(T));
+}
+
+// Read an array, checking its length against the bytes left in the file before allocating it
+template<typename T>
+bool read_array(
+  std::ifstream &in,
+  std::uint64_t &remaining,
+  std::vector<T> &values,
+  std::uint32_t count)
+{
+  if (count > remaining / sizeof(T)) {
+    return false;
+  }
+  values.resize(count);
+  in.read(reinterpret_cast<char *>(values.data()), count * sizeof(T));
+  remaining -= count * sizeof(T);
+  return static_cast<bool>(in);
+}
+
+void write_tile(std::filesystem::path const &path, Tile const &tile) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Could not open tile file for writing: " + path.string());
+  }
+  std::uint32_t corr_point_count = tile.corr_point_ids.size();
+  std::uint32_t triangle_count = tile.triangle_ids.size();
+  out.write(TILE_MAGIC, sizeof(TILE_MAGIC));
+  out.write(reinterpret_cast<char const *>(&TILE_FORMAT_VERSION), sizeof(TILE_FORMAT_VERSION));
+  out.write(reinterpret_cast<char const *>(&corr_point_count), sizeof(corr_point_count));
+  out.write(reinterpret_cast<char const *>(&triangle_count), sizeof(triangle_count));
+  write_array(out, tile.corr_point_ids);
+  write_array(out, tile.corr_points);
+  write_array(out, tile.corr_point_targets);
+  write_array(out, tile.triangle_ids);
+  write_array(out, tile.triangle_vertices);
+  write_array(out, tile.transforms);
+  tile.index.write(out);
+  if (!out) {
+    throw std::runtime_error("Could not write tile file: " + path.string());
+  }
+}
+
+// Read a tile, or make an empty one if the manifest does not list it, as tiles that contain nothing
+// are not written
+std::shared_ptr<const Tile> read_tile(std::filesystem::path const &path, bool listed) {
+  auto tile = std::make_shared<Tile>();
+  if (!listed) {
+    return tile;
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("Could not open tile file: " + path.string());
+  }
+  char magic[sizeof(TILE_MAGIC)];
+  std::uint32_t version, corr_point_count, triangle_count;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!in || std::memcmp(magic, TILE_MAGIC, sizeof(magic)) != 0 ||
+    version != TILE_FORMAT_VERSION)
+  {
+    throw std::runtime_error("Not a valid tile file: " + path.string());
+  }
+  in.read(reinterpret_cast<char *>(&corr_point_count), sizeof(corr_point_count));
+  in.read(reinterpret_cast<char *>(&triangle_count), sizeof(triangle_count));
+  // The counts are checked against the size of the file, so that a corrupt file cannot make
+  // arrays larger than it be allocated
+  std::uint64_t size = std::filesystem::file_size(path);
+  std::uint64_t remaining = size < TILE_HEADER_SIZE ? 0 : size - TILE_HEADER_SIZE;
+  if (!in ||
+    !read_array(in, remaining, tile->corr_point_ids, corr_point_count) ||
+    !read_array(in, remaining, tile->corr_points, corr_point_count) ||
+    !read_array(in, remaining, tile->corr_point_targets, corr_point_count) ||
+    !read_array(in, remaining, tile->triangle_ids, triangle_count) ||
+    !read_array(in, remaining, tile->triangle_vertices, triangle_count) ||
+    !read_array(in, remaining, tile->transforms, triangle_count) ||
+    !tile->index.read(in, remaining, triangle_count))
+  {
+    throw std::runtime_error("Tile file is truncated: " + path.string());
+  }
+  return tile;
+}
+
+// The origin and dimensions of a grid of tiles, and the columns and rows of its non-empty tiles
+using TileGridLayout = std::tuple<Point2D, int, int, std::vector<std::pair<int, int>>>;
+
+// Finds the origin and dimensions of the grid of tiles covering the points in one query frame,
+// throwing std::invalid_argument if the grid would have too many tiles
+std::tuple<Point2D, int, int> plan_tile_grid(
+  CorrespondencePoints const &query_points,
+  float tile_size)
+{
+  float min_x = query_points[0].first, max_x = query_points[0].first;
+  float min_y = query_points[0].second, max_y = query_points[0].second;
+  for (auto const &p : query_points) {
+    min_x = std::min(min_x, p.first);
+    max_x = std::max(max_x, p.first);
+    min_y = std::min(min_y, p.second);
+    max_y = std::max(max_y, p.second);
+  }
+  Point2D origin{std::floor(min_x), std::floor(min_y)};
+  // The dimensions are checked before they are converted to integers
+  double columns = tile_position(max_x, origin.first, tile_size) + 1;
+  double rows = tile_position(max_y, origin.second, tile_size) + 1;
+  if (!(columns * rows <= MAX_GRID_TILES)) {
+    throw std::invalid_argument(
+      "Tile size is too small for the map: the grid would have more than " +
+      std::to_string(static_cast<std::int64_t>(MAX_GRID_TILES)) + " tiles");
+  }
+  return {origin, static_cast<int>(columns), static_cast<int>(rows)};
+}
+
+// Splits the triangulation in one query frame into tiles on a grid and writes them, returning
+// the grid layout
+TileGridLayout write_tile_grid(
+  std::filesystem::path const &directory,
+  std::string const &prefix,
+  float tile_size,
+  std::tuple<Point2D, int, int> const &grid,
+  TriangleList const &triangles,
+  std::vector<std::int32_t> const &triangle_order,
+  CorrespondencePoints const &query_points,
+  CorrespondencePoints const &target_points,
+  std::vector<AffineTransform> const &transforms)
+{
+  Point2D origin = std::get<0>(grid);
+  int columns = std::get<1>(grid);
+  int rows = std::get<2>(grid);
+
+  std::vector<Tile> tiles(static_cast<std::size_t>(columns) * rows);
+  for (CorrespondencePoints::size_type ii = 0; ii < query_points.size(); ++ii) {
+    auto const &p = query_points[ii];
+    auto &tile = tiles[
+      tile_index(p.second, origin.second, tile_size) * columns +
+      tile_index(p.first, origin.first, tile_size)];
+    tile.corr_point_ids.push_back(ii);
+    tile.corr_points.push_back(p);
+    tile.corr_point_targets.push_back(target_points[ii]);
+  }
+
+  // Triangles are added to the tiles in the order the transformer stores them, so that a point on
+  // the boundary between triangles is matched to the same triangle
+  for (std::vector<std::int32_t>::size_type ii = 0; ii < triangle_order.size(); ++ii) {
+    auto const &t = triangles[triangle_order[ii]];
+    Point2D const &p0 = query_points[std::get<0>(t)];
+    Point2D const &p1 = query_points[std::get<1>(t)];
+    Point2D const &p2 = query_points[std::get<2>(t)];
+    TriangleVertices vertices{p0, p1, p2};
+    auto const &transform = transforms[ii];
+
+    // A point belongs to the tile that its coordinates fall in, so a triangle must be stored in
+    // every tile its bounding box reaches for queries on tile borders to find it
+    int first_column = tile_index(
+      std::min({p0.first, p1.first, p2.first}), origin.first, tile_size);
+    int last_column = tile_index(
+      std::max({p0.first, p1.first, p2.first}), origin.first, tile_size);
+    int first_row = tile_index(
+      std::min({p0.second, p1.second, p2.second}), origin.second, tile_size);
+    int last_row = tile_index(
+      std::max({p0.second, p1.second, p2.second}), origin.second, tile_size);
+    for (int row = first_row; row <= last_row; ++row) {
+      for (int column = first_column; column <= last_column; ++column) {
+        auto &tile = tiles[row * columns + column];
+        tile.triangle_ids.push_back(triangle_order[ii]);
+        tile.triangle_vertices.push_back(vertices);
+        tile.transforms.push_back(transform);
+      }
+    }
+  }
+
+  std::vector<std::pair<int, int>> written;
+  for (int row = 0; row < rows; ++row) {
+    for (int column = 0; column < columns; ++column) {
+      auto &tile = tiles[row * columns + column];
+      if (!tile.corr_point_ids.empty() || !tile.triangle_ids.empty()) {
+        tile.index.build(tile.triangle_vertices);
+        write_tile(directory / tile_file_name(prefix, column, row), tile);
+        written.emplace_back(column, row);
+      }
+    }
+  }
+
+  return {origin, columns, rows, written};
+}
+
+void emit_grid(
+  YAML::Emitter &out,
+  std::string const &prefix,
+  TileGridLayout const &grid)
+{
+  out << YAML::Key << prefix << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "origin" << YAML::Value << YAML::Flow << YAML::BeginSeq <<
+    std::get<0>(grid).first << std::get<0>(grid).second << YAML::EndSeq;
+  out << YAML::Key << "columns" << YAML::Value << std::get<1>(grid);
+  out << YAML::Key << "rows" << YAML::Value << std::get<2>(grid);
+  out << YAML::Key << "tiles" << YAML::Value << YAML::Flow << YAML::BeginSeq;
+  for (auto const &tile : std::get<3>(grid)) {
+    out << YAML::Flow << YAML::BeginSeq << tile.first << tile.second << YAML::EndSeq;
+  }
+  out << YAML::EndSeq;
+  out << YAML::EndMap;
+}
+
+}  // namespace
+
+
+void TiledTransformer::write_tiles(
+  Transformer const &transformer,
+  std::string const &directory,
+  float tile_size)
+{
+  if (transformer._empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+  if (!(std::isfinite(tile_size) && tile_size > 0)) {
+    throw std::invalid_argument("Tile size must be finite and greater than zero");
+  }
+  // Both grids are planned before any tile is written, so that a tile size that is too small
+  // leaves nothing behind
+  auto to_ref_plan = plan_tile_grid(transformer._robot_corr_points, tile_size);
+  auto to_robot_plan = plan_tile_grid(transformer._ref_corr_points, tile_size);
+
+  std::filesystem::path path(directory);
+  std::filesystem::create_directories(path);
+
+  auto to_ref_grid = write_tile_grid(
+    path,
+    TO_REF_PREFIX,
+    tile_size,
+    to_ref_plan,
+    transformer._robot_triangulation.triangles,
+    transformer._robot_triangulation.order,
+    transformer._robot_corr_points,
+    transformer._ref_corr_points,
+    transformer._robot_triangulation.transforms);
+  auto to_robot_grid = write_tile_grid(
+    path,
+    TO_ROBOT_PREFIX,
+    tile_size,
+    to_robot_plan,
+    transformer._ref_triangulation.triangles,
+    transformer._ref_triangulation.order,
+    transformer._ref_corr_points,
+    transformer._robot_corr_points,
+    transformer._ref_triangulation.transforms);
+
+  YAML::Emitter out;
+  out.SetFloatPrecision(9);
+  out.SetDoublePrecision(17);
+  out << YAML::BeginMap;
+  out << YAML::Key << "ref_map" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "name" << YAML::Value << transformer._ref_map_name;
+  out << YAML::EndMap;
+  out << YAML::Key << "robot_map" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "name" << YAML::Value << transformer._robot_map_name;
+  out << YAML::Key << "transform" << YAML::Value << YAML::BeginMap;
+  out << YAML::Key << "scale" << YAML::Value << YAML::Flow << YAML::BeginSeq <<
+    transformer._robot_map_scale.first << transformer._robot_map_scale.second << YAML::EndSeq;
+  out << YAML::Key << "rotation" << YAML::Value << transformer._robot_map_rotation;
+  out << YAML::Key << "translation" << YAML::Value << YAML::Flow << YAML::BeginSeq <<
+    transformer._robot_map_translation.first << transformer._robot_map_translation.second <<
+    YAML::EndSeq;
+  out << YAML::EndMap;
+  out << YAML::EndMap;
+  out << YAML::Key << "tile_size" << YAML::Value << tile_size;
+  emit_grid(out, TO_REF_PREFIX, to_ref_grid);
+  emit_grid(out, TO_ROBOT_PREFIX, to_robot_grid);
+  out << YAML::EndMap;
+
+  std::ofstream manifest(path / MANIFEST_FILE_NAME, std::ios::trunc);
+  manifest << out.c_str() << '\n';
+  if (!manifest) {
+    throw std::runtime_error("Could not write tile manifest");
+  }
+}
+
+TiledTransformer::TiledTransformer(
+  std::string const &directory,
+  std::size_t max_resident_tiles)
+: _directory(directory),
+  _max_resident_tiles(max_resident_tiles)
+{
+  if (max_resident_tiles == 0) {
+    throw std::invalid_argument("At least one tile must be allowed to be resident");
+  }
+
+  auto manifest = (std::filesystem::path(directory) / MANIFEST_FILE_NAME).string();
+  YAML::Node root = YAML::LoadFile(manifest);
+
+  _maps._ref_map_name = root["ref_map"]["name"].as<std::string>();
+  _maps._robot_map_name = root["robot_map"]["name"].as<std::string>();
+  auto transform = root["robot_map"]["transform"];
+  _maps._robot_map_scale.first = transform["scale"][0].as<float>();
+  _maps._robot_map_scale.second = transform["scale"][1].as<float>();
+  _maps._robot_map_rotation = transform["rotation"].as<double>();
+  _maps._robot_map_translation.first = transform["translation"][0].as<float>();
+  _maps._robot_map_translation.second = transform["translation"][1].as<float>();
+
+  // The grids are checked as write_tiles() would have written them, so that every tile position
+  // computed from them is finite and every tile is in range
+  _tile_size = root["tile_size"].as<float>();
+  if (!(std::isfinite(_tile_size) && _tile_size > 0)) {
+    throw std::runtime_error("Tile size must be finite and greater than zero: " + manifest);
+  }
+  char const * prefixes[2] = {TO_REF_PREFIX, TO_ROBOT_PREFIX};
+  for (int ii = 0; ii < 2; ++ii) {
+    auto grid = root[prefixes[ii]];
+    _grids[ii].prefix = prefixes[ii];
+    _grids[ii].origin.first = grid["origin"][0].as<float>();
+    _grids[ii].origin.second = grid["origin"][1].as<float>();
+    _grids[ii].columns = grid["columns"].as<int>();
+    _grids[ii].rows = grid["rows"].as<int>();
+    if (!std::isfinite(_grids[ii].origin.first) || !std::isfinite(_grids[ii].origin.second)) {
+      throw std::runtime_error("Tile grid origin must be finite: " + manifest);
+    }
+    if (_grids[ii].columns <= 0 || _grids[ii].rows <= 0) {
+      throw std::runtime_error(
+        "Tile grid columns and rows must be greater than zero: " + manifest);
+    }
+    // A tile that is listed must be read, so that a missing tile file is an error rather than
+    // treated as an empty tile
+    auto tiles = grid["tiles"];
+    if (!tiles.IsSequence()) {
+      throw std::runtime_error("Tile grid must list its tiles: " + manifest);
+    }
+    for (auto const &tile : tiles) {
+      int column = tile[0].as<int>();
+      int row = tile[1].as<int>();
+      if (column < 0 || column >= _grids[ii].columns || row < 0 || row >= _grids[ii].rows) {
+        throw std::runtime_error("Tile grid lists a tile outside the grid: " + manifest);
+      }
+      _grids[ii].tiles.emplace(column, row);
+    }
+  }
+}
+
+std::string TiledTransformer::ref_map_name() const {
+  return _maps._ref_map_name;
+}
+
+std::string TiledTransformer::robot_map_name() const {
+  return _maps._robot_map_name;
+}
+
+float TiledTransformer::tile_size() const {
+  return _tile_size;
+}
+
+Point2D TiledTransformer::to_ref(Point2D const &point) const {
+  auto tile = tile_at(0, point);
+  if (tile) {
+    bool found;
+    auto transformed_point = transform_in_tile(*tile, point, found);
+    if (found) {
+      return transformed_point;
+    }
+  }
+  // No triangle found, so only transform by the map transform
+  return _maps.transform_by_map_transform<Transformer::Direction::to_ref>(point);
+}
+
+Point2D TiledTransformer::to_robot(Point2D const &point) const {
+  auto tile = tile_at(1, point);
+  if (tile) {
+    bool found;
+    auto transformed_point = transform_in_tile(*tile, point, found);
+    if (found) {
+      return transformed_point;
+    }
+  }
+  // No triangle found, so only transform by the map transform
+  return _maps.transform_by_map_transform<Transformer::Direction::to_robot>(point);
+}
+
+void TiledTransformer::preload_to_ref(
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
+  preload(0, top_left, bottom_right);
+}
+
+void TiledTransformer::preload_to_robot(
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
+  preload(1, top_left, bottom_right);
+}
+
+std::size_t TiledTransformer::resident_tile_count() const {
+  std::lock_guard<std::mutex> lock(_tiles_mutex);
+  return _resident.size();
+}
+
+void TiledTransformer::evict_all() const {
+  std::lock_guard<std::mutex> lock(_tiles_mutex);
+  _resident.clear();
+  _lru.clear();
+}
+
+std::shared_ptr<const Tile> TiledTransformer::tile_at(int grid, Point2D const &point) const {
+  auto const &layout = _grids[grid];
+  double column = tile_position(point.first, layout.origin.first, _tile_size);
+  double row = tile_position(point.second, layout.origin.second, _tile_size);
+  // NaN positions fail these comparisons, as well as those outside the grid
+  if (!(column >= 0 && column < layout.columns && row >= 0 && row < layout.rows)) {
+    return nullptr;
+  }
+  return fetch_tile(TileKey{grid, static_cast<int>(column), static_cast<int>(row)});
+}
+
+std::shared_ptr<const Tile> TiledTransformer::fetch_tile(TileKey const &key) const {
+  {
+    std::lock_guard<std::mutex> lock(_tiles_mutex);
+    auto resident = _resident.find(key);
+    if (resident != _resident.end()) {
+      _lru.splice(_lru.begin(), _lru, resident->second.second);
+      return resident->second.first;
+    }
+  }
+
+  // The tile is read without the lock held, so that queries on resident tiles do not wait for the
+  // disk
+  auto const &layout = _grids[std::get<0>(key)];
+  auto tile = read_tile(
+    std::filesystem::path(_directory) / tile_file_name(
+      layout.prefix,
+      std::get<1>(key),
+      std::get<2>(key)),
+    layout.tiles.count({std::get<1>(key), std::get<2>(key)}) != 0);
+
+  std::lock_guard<std::mutex> lock(_tiles_mutex);
+  // Another thread may have read the same tile meanwhile, in which case its copy is kept
+  auto resident = _resident.find(key);
+  if (resident != _resident.end()) {
+    _lru.splice(_lru.begin(), _lru, resident->second.second);
+    return resident->second.first;
+  }
+  _lru.push_front(key);
+  _resident.emplace(key, std::make_pair(tile, _lru.begin()));
+  while (_resident.size() > _max_resident_tiles) {
+    _resident.erase(_lru.back());
+    _lru.pop_back();
+  }
+  return tile;
+}
+
+void TiledTransformer::preload(
+  int grid,
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
+  auto const &layout = _grids[grid];
+  double left = std::max(tile_position(top_left.first, layout.origin.first, _tile_size), 0.0);
+  double right = std::min(
+    tile_position(bottom_right.first, layout.origin.first, _tile_size),
+    layout.columns - 1.0);
+  double top = std::max(tile_position(top_left.second, layout.origin.second, _tile_size), 0.0);
+  double bottom = std::min(
+    tile_position(bottom_right.second, layout.origin.second, _tile_size),
+    layout.rows - 1.0);
+  // The range is empty if it is outside the grid, or if a corner is NaN
+  if (!(left <= right && top <= bottom)) {
+    return;
+  }
+  int first_column = static_cast<int>(left);
+  int last_column = static_cast<int>(right);
+  int first_row = static_cast<int>(top);
+  int last_row = static_cast<int>(bottom);
+
+  std::size_t loaded{0};
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int column = first_column; column <= last_column; ++column) {
+      if (loaded++ == _max_resident_tiles) {
+        return;
+      }
+      fetch_tile(TileKey{grid, column, row});
+    }
+  }
+}
+
+Point2D TiledTransformer::transform_in_tile(Tile const &tile, Point2D const &point, bool &found) {
+  found = true;
+
+  // Correspondence points are stored in ascending index order, so the first match is the same one
+  // the untiled transformer finds
+  auto corr_point = std::find(
+    std::begin(tile.corr_points),
+    std::end(tile.corr_points),
+    point);
+  if (corr_point != std::end(tile.corr_points)) {
+    return tile.corr_point_targets[std::distance(std::begin(tile.corr_points), corr_point)];
+  }
+
+  int triangle{-1};
+  if (tile.index.valid()) {
+    triangle = tile.index.find(point, tile.triangle_vertices);
+  } else {
+    for (std::vector<int>::size_type ii = 0; ii < tile.triangle_ids.size(); ++ii) {
+      if (triangle_contains(tile.triangle_vertices[ii], point)) {
+        triangle = ii;
+        break;
+      }
+    }
+  }
+  if (triangle >= 0) {
+    auto const &transform = tile.transforms[triangle];
+    Point2D transformed_point;
+    transformed_point.first = transform[0] * point.first + transform[1] * point.second +
+      transform[2];
+    transformed_point.second = transform[3] * point.first + transform[4] * point.second +
+      transform[5];
+    return transformed_point;
+  }
+
+  found = false;
+  return point;
+}
+
+}  // namespace map_transformer
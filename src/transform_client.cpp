@@ -0,0 +1,123 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/transform_client.hpp"
+#include "socket_io.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+namespace map_transformer {
+
+TransformClient::TransformClient(
+  std::string const &socket_path,
+  std::uint32_t map,
+  protocol::Lane lane)
+: _map(map), _lane(lane)
+{
+  _socket = socket_io::connect_unix(socket_path);
+}
+
+
+TransformClient::~TransformClient() {
+  ::close(_socket);
+}
+
+
+Point2D TransformClient::to_ref(Point2D const &point) {
+  Point2D result;
+  transform(protocol::Operation::to_ref, &point, 1, &result);
+  return result;
+}
+
+
+Point2D TransformClient::to_robot(Point2D const &point) {
+  Point2D result;
+  transform(protocol::Operation::to_robot, &point, 1, &result);
+  return result;
+}
+
+
+void TransformClient::to_ref(Point2D const *points, std::size_t count, Point2D *results) {
+  transform(protocol::Operation::to_ref, points, count, results);
+}
+
+
+std::vector<Point2D> TransformClient::to_ref(std::vector<Point2D> const &points) {
+  std::vector<Point2D> results(points.size());
+  to_ref(points.data(), points.size(), results.data());
+  return results;
+}
+
+
+void TransformClient::to_robot(Point2D const *points, std::size_t count, Point2D *results) {
+  transform(protocol::Operation::to_robot, points, count, results);
+}
+
+
+std::vector<Point2D> TransformClient::to_robot(std::vector<Point2D> const &points) {
+  std::vector<Point2D> results(points.size());
+  to_robot(points.data(), points.size(), results.data());
+  return results;
+}
+
+
+void TransformClient::transform(
+  protocol::Operation operation,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results)
+{
+  for (std::size_t start = 0; start < count; start += protocol::MAX_POINTS_PER_REQUEST) {
+    auto size = static_cast<std::uint32_t>(
+      std::min<std::size_t>(protocol::MAX_POINTS_PER_REQUEST, count - start));
+    protocol::RequestHeader request{
+      protocol::REQUEST_MAGIC, _next_id++, _map, operation, size, _lane};
+    // The points are sent straight from the caller's array, and received straight into the
+    // results array
+    if (!socket_io::send_all(
+        _socket, &request, sizeof(request), points + start, size * sizeof(Point2D)))
+    {
+      throw std::runtime_error("Could not send a request to the transform server");
+    }
+    protocol::ResponseHeader response;
+    if (!socket_io::receive_all(_socket, &response, sizeof(response))) {
+      throw std::runtime_error("The transform server closed the connection");
+    }
+    if (response.status == protocol::Status::unknown_map) {
+      throw std::runtime_error(
+        "The transform server has no map with index " + std::to_string(_map));
+    }
+    if (response.status == protocol::Status::overloaded) {
+      throw std::runtime_error(
+        "The transform server refused the request because its lane is full; try again later");
+    }
+    if (response.status != protocol::Status::ok || response.id != request.id ||
+      response.count != size)
+    {
+      throw std::runtime_error(
+        "The transform server failed to transform the points (status " +
+        std::to_string(static_cast<std::uint32_t>(response.status)) + ")");
+    }
+    if (!socket_io::receive_all(_socket, results + start, size * sizeof(Point2D))) {
+      throw std::runtime_error("The transform server closed the connection");
+    }
+  }
+}
+
+}  // namespace map_transformer
@@ -0,0 +1,634 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/transform_server.hpp"
+#include "futex.hpp"
+#include "socket_io.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+
+namespace map_transformer {
+
+namespace
+{
+
+constexpr double LATENCY_BUCKETS_PER_DOUBLING = 8;
+// Latencies up to this many seconds are counted together
+constexpr double MIN_LATENCY = 1e-7;
+
+// After an error accepting connections other than an interruption, such as running out of file
+// descriptors, the server waits this long before trying again, doubling while the error persists
+constexpr int MIN_ACCEPT_RETRY_MS = 10;
+constexpr int MAX_ACCEPT_RETRY_MS = 1000;
+
+bool overlap(cpu_set_t const &a, cpu_set_t const &b) {
+  cpu_set_t both;
+  CPU_AND(&both, &a, &b);
+  return CPU_COUNT(&both) != 0;
+}
+
+}  // namespace
+
+
+TransformServer::TransformServer(
+  std::vector<std::shared_ptr<Transformer const>> maps,
+  std::string const &socket_path,
+  TransformServerOptions options)
+: _maps(std::move(maps)), _socket_path(socket_path)
+{
+  if (_maps.empty()) {
+    throw std::invalid_argument("A transform server needs at least one map");
+  }
+  for (auto const &map : _maps) {
+    if (!map) {
+      throw std::invalid_argument("A transform server cannot serve a null map");
+    }
+    // Throws std::logic_error if the map is empty
+    map->ref_map_corr_points();
+  }
+
+  // Find the CPUs each lane's threads may run on, and so how many threads each needs
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    throw std::runtime_error(
+      std::string("Could not get the CPUs available: ") + std::strerror(errno));
+  }
+  TransformLaneOptions * lane_options[2] = {&options.latency, &options.throughput};
+  cpu_set_t lane_cpus[2];
+  for (std::size_t lane = 0; lane < 2; ++lane) {
+    if (lane_options[lane]->max_batch_points == 0) {
+      throw std::invalid_argument("A lane's batches must have at least one point");
+    }
+    CPU_ZERO(&lane_cpus[lane]);
+    for (auto cpu : lane_options[lane]->cpus) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+        throw std::invalid_argument("CPU " + std::to_string(cpu) + " is not available");
+      }
+      CPU_SET(cpu, &lane_cpus[lane]);
+    }
+  }
+  for (std::size_t lane = 0; lane < 2; ++lane) {
+    if (lane_options[lane]->cpus.empty()) {
+      // Keep off the other lane's CPUs, unless there are no others
+      auto &other = lane_cpus[1 - lane];
+      CPU_ZERO(&lane_cpus[lane]);
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &other)) {
+          CPU_SET(cpu, &lane_cpus[lane]);
+        }
+      }
+      if (CPU_COUNT(&lane_cpus[lane]) == 0) {
+        lane_cpus[lane] = allowed;
+      }
+    }
+  }
+  for (std::size_t lane = 0; lane < 2; ++lane) {
+    if (lane_options[lane]->threads == 0) {
+      std::size_t cpus = static_cast<std::size_t>(CPU_COUNT(&lane_cpus[lane]));
+      if (overlap(lane_cpus[lane], lane_cpus[1 - lane])) {
+        cpus -= std::min(cpus, lane_options[1 - lane]->threads);
+      }
+      lane_options[lane]->threads = std::max<std::size_t>(1, cpus);
+    }
+    _lanes[lane].options = *lane_options[lane];
+  }
+
+  auto address = socket_io::unix_address(socket_path);
+  // Replace a socket left behind by a server that did not stop cleanly, but nothing else
+  struct stat status;
+  if (::stat(socket_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+    ::unlink(socket_path.c_str());
+  }
+  _listen_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_listen_socket < 0 ||
+    ::bind(_listen_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+    ::listen(_listen_socket, SOMAXCONN) != 0 ||
+    ::pipe2(_stop_pipe, O_CLOEXEC) != 0)
+  {
+    auto error = errno;
+    if (_listen_socket >= 0) {
+      ::close(_listen_socket);
+    }
+    throw std::runtime_error(
+      "Could not listen on " + socket_path + ": " + std::strerror(error));
+  }
+
+  for (std::size_t index = 0; index < 2; ++index) {
+    auto &lane = _lanes[index];
+    for (std::size_t thread = 0; thread < lane.options.threads; ++thread) {
+      lane.threads.emplace_back([this, &lane]() {run_lane(lane);});
+      if (!CPU_EQUAL(&lane_cpus[index], &allowed)) {
+        ::pthread_setaffinity_np(
+          lane.threads.back().native_handle(), sizeof(cpu_set_t), &lane_cpus[index]);
+      }
+    }
+  }
+  _acceptor = std::thread([this]() {accept_connections();});
+}
+
+
+TransformServer::~TransformServer() {
+  _stopping = true;
+  char wake = 0;
+  while (::write(_stop_pipe[1], &wake, 1) < 0 && errno == EINTR) {}
+  _acceptor.join();
+  ::close(_listen_socket);
+  ::close(_stop_pipe[0]);
+  ::close(_stop_pipe[1]);
+  ::unlink(_socket_path.c_str());
+
+  // Shutting the connections down wakes their threads; each finishes the request it is serving.
+  // Threads serving shared memory channels sleep on the channel instead.
+  {
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    for (auto &connection : _connections) {
+      ::shutdown(connection.socket, SHUT_RDWR);
+      if (connection.channel != nullptr) {
+        futex::wake(connection.channel->submitted);
+      }
+    }
+  }
+  for (auto &connection : _connections) {
+    connection.thread.join();
+    ::close(connection.socket);
+  }
+
+  for (auto &lane : _lanes) {
+    {
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      lane.stopping = true;
+    }
+    lane.ready.notify_all();
+    for (auto &thread : lane.threads) {
+      thread.join();
+    }
+  }
+}
+
+
+std::string const & TransformServer::socket_path() const {
+  return _socket_path;
+}
+
+
+TransformServerStatistics TransformServer::statistics() const {
+  std::lock_guard<std::mutex> lock(_statistics_mutex);
+  auto statistics = _statistics;
+  for (auto lane : {protocol::Lane::latency, protocol::Lane::throughput}) {
+    auto const &source = _lanes[static_cast<std::size_t>(lane)];
+    auto &lane_statistics =
+      lane == protocol::Lane::latency ? statistics.latency : statistics.throughput;
+    lane_statistics = source.statistics;
+    lane_statistics.threads = source.options.threads;
+    lane_statistics.median_latency = source.latencies.percentile(0.5);
+    lane_statistics.p99_latency = source.latencies.percentile(0.99);
+    lane_statistics.max_latency = source.latencies.maximum;
+  }
+  return statistics;
+}
+
+
+void TransformServer::replace_map(std::size_t index, std::shared_ptr<Transformer const> map) {
+  if (index >= _maps.size()) {
+    throw std::out_of_range("The transform server has no map with index " + std::to_string(index));
+  }
+  if (!map) {
+    throw std::invalid_argument("A transform server cannot serve a null map");
+  }
+  // Throws std::logic_error if the map is empty
+  map->ref_map_corr_points();
+  std::atomic_store(&_maps[index], std::move(map));
+}
+
+
+void TransformServer::LatencyHistogram::add(double seconds) {
+  std::size_t bucket = 0;
+  if (seconds > MIN_LATENCY) {
+    bucket = 1 + static_cast<std::size_t>(
+      std::log2(seconds / MIN_LATENCY) * LATENCY_BUCKETS_PER_DOUBLING);
+  }
+  if (bucket >= counts.size()) {
+    counts.resize(bucket + 1, 0);
+  }
+  ++counts[bucket];
+  ++total;
+  maximum = std::max(maximum, seconds);
+}
+
+
+double TransformServer::LatencyHistogram::percentile(double fraction) const {
+  if (total == 0) {
+    return 0;
+  }
+  auto rank = std::max<std::size_t>(
+    1, static_cast<std::size_t>(std::ceil(fraction * static_cast<double>(total))));
+  std::size_t counted = 0;
+  std::size_t bucket = 0;
+  while (counted + counts[bucket] < rank) {
+    counted += counts[bucket++];
+  }
+  // The top of the bucket, which is within an eighth of a doubling of the true value
+  return std::min(
+    maximum,
+    MIN_LATENCY * std::exp2(static_cast<double>(bucket) / LATENCY_BUCKETS_PER_DOUBLING));
+}
+
+
+void TransformServer::accept_connections() {
+  pollfd events[2] = {{_listen_socket, POLLIN, 0}, {_stop_pipe[0], POLLIN, 0}};
+  int retry_ms = 0;
+  auto back_off = [this, &retry_ms]() {
+      retry_ms = std::clamp(2 * retry_ms, MIN_ACCEPT_RETRY_MS, MAX_ACCEPT_RETRY_MS);
+      // The listening socket stays readable while a connection cannot be accepted, so only the
+      // stop pipe is waited on
+      pollfd stop{_stop_pipe[0], POLLIN, 0};
+      ::poll(&stop, 1, retry_ms);
+    };
+  while (!_stopping) {
+    if (::poll(events, 2, -1) < 0) {
+      if (errno != EINTR) {
+        back_off();
+      }
+      continue;
+    }
+    if ((events[0].revents & (POLLERR | POLLNVAL)) != 0) {
+      back_off();
+      continue;
+    }
+    if ((events[0].revents & POLLIN) == 0) {
+      continue;
+    }
+    int socket = ::accept4(_listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (socket < 0) {
+      // A connection that was closed before it was accepted is not an error of the server's
+      if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN && errno != EWOULDBLOCK) {
+        back_off();
+      }
+      continue;
+    }
+    retry_ms = 0;
+
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    // Clean up after connections that have been closed
+    for (auto connection = _connections.begin(); connection != _connections.end(); ) {
+      if (connection->finished) {
+        connection->thread.join();
+        ::close(connection->socket);
+        connection = _connections.erase(connection);
+      } else {
+        ++connection;
+      }
+    }
+    auto &connection = _connections.emplace_back();
+    connection.socket = socket;
+    connection.thread = std::thread([this, &connection]() {serve(connection);});
+  }
+}
+
+
+void TransformServer::serve(Connection &connection) {
+  // The buffers are kept between requests, so that a connection only allocates memory when it
+  // receives a larger request than before
+  std::vector<Point2D> points, results;
+  while (!_stopping) {
+    protocol::RequestHeader request;
+    if (!socket_io::receive_all(connection.socket, &request, sizeof(request))) {
+      break;
+    }
+    protocol::ResponseHeader response{request.id, protocol::Status::ok, 0};
+    if (request.magic == protocol::REQUEST_MAGIC &&
+      request.operation == protocol::Operation::open_channel)
+    {
+      // The connection is used for nothing else once the channel is open
+      serve_channel(connection, request);
+      break;
+    }
+    if (request.magic != protocol::REQUEST_MAGIC ||
+      request.count > protocol::MAX_POINTS_PER_REQUEST ||
+      (request.operation != protocol::Operation::to_ref &&
+      request.operation != protocol::Operation::to_robot) ||
+      (request.lane != protocol::Lane::latency && request.lane != protocol::Lane::throughput))
+    {
+      // The rest of the stream cannot be understood, so the connection is closed
+      response.status = protocol::Status::bad_request;
+      socket_io::send_all(connection.socket, &response, sizeof(response), nullptr, 0);
+      break;
+    }
+    points.resize(request.count);
+    results.resize(request.count);
+    if (!socket_io::receive_all(
+        connection.socket, points.data(), request.count * sizeof(Point2D)))
+    {
+      break;
+    }
+
+    response.status = transform(
+      request.lane, request.map, request.operation, points.data(), request.count, results.data());
+    if (response.status == protocol::Status::ok) {
+      response.count = request.count;
+    }
+    {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      ++_statistics.requests;
+      _statistics.points += response.count;
+    }
+    if (!socket_io::send_all(
+        connection.socket, &response, sizeof(response),
+        results.data(), response.count * sizeof(Point2D)))
+    {
+      break;
+    }
+  }
+  connection.finished = true;
+}
+
+
+void TransformServer::serve_channel(Connection &connection, protocol::RequestHeader const &request)
+{
+  protocol::ResponseHeader response{request.id, protocol::Status::ok, request.count};
+  if (request.count == 0 || request.count > protocol::MAX_CHANNEL_POINTS) {
+    response = {request.id, protocol::Status::bad_request, 0};
+  } else if (request.map >= _maps.size()) {
+    response = {request.id, protocol::Status::unknown_map, 0};
+  }
+  if (response.status != protocol::Status::ok) {
+    socket_io::send_all(connection.socket, &response, sizeof(response), nullptr, 0);
+    return;
+  }
+
+  // The channel is anonymous memory, so it is freed when both processes have unmapped it, however
+  // they exit
+  auto size = protocol::channel_size(request.count);
+  int memory = ::memfd_create("map_transformer_channel", MFD_CLOEXEC);
+  void *mapping = MAP_FAILED;
+  if (memory >= 0 && ::ftruncate(memory, static_cast<off_t>(size)) == 0) {
+    mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+  }
+  if (mapping == MAP_FAILED) {
+    if (memory >= 0) {
+      ::close(memory);
+    }
+    response = {request.id, protocol::Status::internal_error, 0};
+    socket_io::send_all(connection.socket, &response, sizeof(response), nullptr, 0);
+    return;
+  }
+  auto *channel = new (mapping) protocol::ChannelHeader{};
+  channel->magic = protocol::CHANNEL_MAGIC;
+  channel->capacity = request.count;
+
+  bool sent = socket_io::send_with_descriptor(
+    connection.socket, &response, sizeof(response), memory);
+  ::close(memory);
+  if (sent) {
+    {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      ++_statistics.channels;
+    }
+    {
+      std::lock_guard<std::mutex> lock(_connections_mutex);
+      connection.channel = channel;
+    }
+    run_channel(connection, *channel, request.count);
+    std::lock_guard<std::mutex> lock(_connections_mutex);
+    connection.channel = nullptr;
+  }
+  channel->~ChannelHeader();
+  ::munmap(mapping, size);
+}
+
+
+void TransformServer::run_channel(
+  Connection &connection,
+  protocol::ChannelHeader &channel,
+  std::uint32_t capacity)
+{
+  auto *points = protocol::channel_points(&channel);
+  std::uint32_t next = 0;
+  while (!_stopping && channel.closed.load(std::memory_order_acquire) == 0) {
+    if (channel.submitted.load(std::memory_order_acquire) == next) {
+      // Nothing to do; check that the client is still there every so often
+      if (!futex::wait_for_change(
+          channel.submitted, next, channel.server_waiting, CHANNEL_POLL_INTERVAL) &&
+        socket_io::peer_closed(connection.socket))
+      {
+        break;
+      }
+      continue;
+    }
+
+    // The client could change the request, or the capacity in the header, at any time, so only a
+    // copy of the request is checked, against the capacity the channel was created with
+    auto &slot = channel.slots[next % protocol::CHANNEL_SLOTS];
+    auto request = slot;
+    auto status = protocol::Status::bad_request;
+    if (request.count <= capacity && request.offset <= capacity - request.count) {
+      status = transform_batch(
+        request.map, request.operation, points + request.offset, request.count,
+        points + request.offset);
+    }
+    slot.status = status;
+    {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      ++_statistics.requests;
+      if (status == protocol::Status::ok) {
+        _statistics.points += request.count;
+      }
+    }
+    futex::publish(channel.completed, ++next, channel.client_waiting);
+  }
+}
+
+
+protocol::Status TransformServer::transform(
+  protocol::Lane lane_index,
+  std::uint32_t map,
+  protocol::Operation operation,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results)
+{
+  if (map >= _maps.size()) {
+    return protocol::Status::unknown_map;
+  }
+
+  auto received = std::chrono::steady_clock::now();
+  auto &lane = _lanes[static_cast<std::size_t>(lane_index)];
+  PendingRequest request{map, operation, points, results, protocol::Status::ok, 0};
+  {
+    std::unique_lock<std::mutex> lock(lane.mutex);
+    auto limit = lane.options.max_queued_points;
+    if (limit != 0 && lane.queued_points + count > limit) {
+      lock.unlock();
+      std::lock_guard<std::mutex> statistics_lock(_statistics_mutex);
+      ++lane.statistics.rejected;
+      return protocol::Status::overloaded;
+    }
+    for (std::size_t offset = 0; offset < count; offset += lane.options.max_batch_points) {
+      lane.queue.push_back(
+        {&request, offset, std::min(lane.options.max_batch_points, count - offset)});
+      ++request.chunks_remaining;
+    }
+    lane.queued_points += count;
+    if (request.chunks_remaining > 1) {
+      lane.ready.notify_all();
+    } else {
+      lane.ready.notify_one();
+    }
+    lane.done.wait(lock, [&request]() {return request.chunks_remaining == 0;});
+  }
+  std::chrono::duration<double> latency = std::chrono::steady_clock::now() - received;
+
+  std::lock_guard<std::mutex> lock(_statistics_mutex);
+  ++lane.statistics.requests;
+  if (request.status == protocol::Status::ok) {
+    lane.statistics.points += count;
+  }
+  lane.latencies.add(latency.count());
+  return request.status;
+}
+
+
+protocol::Status TransformServer::transform_batch(
+  std::uint32_t map,
+  protocol::Operation operation,
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results)
+{
+  if (map >= _maps.size()) {
+    return protocol::Status::unknown_map;
+  }
+  // Hold the map, in case it is replaced while the points are being transformed
+  auto transformer = std::atomic_load(&_maps[map]);
+  try {
+    if (operation == protocol::Operation::to_ref) {
+      transformer->to_ref(points, count, results);
+    } else if (operation == protocol::Operation::to_robot) {
+      transformer->to_robot(points, count, results);
+    } else {
+      return protocol::Status::bad_request;
+    }
+  } catch (std::exception const &) {
+    return protocol::Status::internal_error;
+  }
+  return protocol::Status::ok;
+}
+
+
+void TransformServer::run_lane(Lane &lane) {
+  std::vector<Chunk> batch;
+  std::vector<protocol::Status> statuses;
+  std::vector<Point2D> points, results;
+  while (true) {
+    {
+      // Take the chunks waiting, up to a batch's worth; more arrive while this batch is being
+      // transformed, and are combined into the next one
+      std::unique_lock<std::mutex> lock(lane.mutex);
+      lane.ready.wait(lock, [&lane]() {return !lane.queue.empty() || lane.stopping;});
+      if (lane.queue.empty()) {
+        return;
+      }
+      batch.clear();
+      std::size_t batch_points = 0;
+      do {
+        batch_points += lane.queue.front().count;
+        batch.push_back(lane.queue.front());
+        lane.queue.pop_front();
+      } while (!lane.queue.empty() &&
+        batch_points + lane.queue.front().count <= lane.options.max_batch_points);
+    }
+
+    // Transform the chunks for each map and direction together
+    auto key = [](Chunk const &chunk) {
+        return std::make_tuple(chunk.request->map, chunk.request->operation);
+      };
+    std::stable_sort(
+      batch.begin(), batch.end(),
+      [&key](Chunk const &a, Chunk const &b) {return key(a) < key(b);});
+    statuses.assign(batch.size(), protocol::Status::ok);
+    std::size_t batches = 0;
+    for (std::size_t group = 0; group < batch.size(); ) {
+      auto group_end = group + 1;
+      while (group_end < batch.size() && key(batch[group_end]) == key(batch[group])) {
+        ++group_end;
+      }
+      ++batches;
+
+      auto const &first = batch[group];
+      protocol::Status status;
+      if (group_end == group + 1) {
+        status = transform_batch(
+          first.request->map, first.request->operation, first.request->points + first.offset,
+          first.count, first.request->results + first.offset);
+      } else {
+        points.clear();
+        for (auto chunk = group; chunk < group_end; ++chunk) {
+          auto const *start = batch[chunk].request->points + batch[chunk].offset;
+          points.insert(points.end(), start, start + batch[chunk].count);
+        }
+        results.resize(points.size());
+        status = transform_batch(
+          first.request->map, first.request->operation, points.data(), points.size(),
+          results.data());
+        auto result = results.begin();
+        for (auto chunk = group; chunk < group_end; ++chunk) {
+          std::copy(
+            result, result + batch[chunk].count,
+            batch[chunk].request->results + batch[chunk].offset);
+          result += batch[chunk].count;
+        }
+      }
+      std::fill(statuses.begin() + group, statuses.begin() + group_end, status);
+      group = group_end;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      lane.statistics.batches += batches;
+    }
+    {
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      for (std::size_t chunk = 0; chunk < batch.size(); ++chunk) {
+        auto *request = batch[chunk].request;
+        if (statuses[chunk] != protocol::Status::ok) {
+          request->status = statuses[chunk];
+        }
+        --request->chunks_remaining;
+        lane.queued_points -= batch[chunk].count;
+      }
+    }
+    lane.done.notify_all();
+  }
+}
+
+}  // namespace map_transformer
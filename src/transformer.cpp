@@ -13,19 +13,80 @@
 // limitations under the License.
 
 #include "map_transformer/transformer.hpp"
+#include "map_transformer/delaunay.hpp"
+#include "map_transformer/predicates.hpp"
 
 #include <algorithm>
+#include <array>
 #include <filesystem>
-#include <opencv2/core.hpp>
-#include <opencv2/imgcodecs.hpp>
-#include <opencv2/imgproc.hpp>
+#include <numeric>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <yaml-cpp/yaml.h>
 
 
 namespace map_transformer
 {
 
+namespace
+{
+
+// The number of points located at a time by the batch transforms
+constexpr std::size_t BATCH_BLOCK_SIZE = 256;
+// How many points ahead of the point being transformed the batch transforms prefetch transforms
+constexpr std::size_t TRANSFORM_PREFETCH_DISTANCE = 8;
+
+// Hint that memory will be read soon
+inline void prefetch(void const *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  static_cast<void>(address);
+#endif
+}
+
+// The affine transform that maps the vertices of one triangle onto those of another
+AffineTransform affine_transform(TriangleVertices const &from, TriangleVertices const &to) {
+  // Solve relative to the first vertex, so that the system is well-conditioned however far the
+  // triangle is from the origin
+  double dx1 = static_cast<double>(from[1].first) - from[0].first;
+  double dy1 = static_cast<double>(from[1].second) - from[0].second;
+  double dx2 = static_cast<double>(from[2].first) - from[0].first;
+  double dy2 = static_cast<double>(from[2].second) - from[0].second;
+  double det = dx1 * dy2 - dx2 * dy1;
+  AffineTransform transform{{0, 0, 0, 0, 0, 0}};
+  if (det == 0) {
+    // A triangle with no area has no unique transform; like OpenCV, give all zeros
+    return transform;
+  }
+  for (int row = 0; row < 2; ++row) {
+    auto target = [&to, row](int vertex) {
+        return row == 0 ? static_cast<double>(to[vertex].first) : to[vertex].second;
+      };
+    double du1 = target(1) - target(0);
+    double du2 = target(2) - target(0);
+    double a = (du1 * dy2 - du2 * dy1) / det;
+    double b = (dx1 * du2 - dx2 * du1) / det;
+    transform[row * 3] = a;
+    transform[row * 3 + 1] = b;
+    transform[row * 3 + 2] = target(0) - a * from[0].first - b * from[0].second;
+  }
+  return transform;
+}
+
+// The weights of a triangle's vertices that give a point
+std::array<double, 3> barycentric_coordinates(TriangleVertices const &t, Point2D const &point) {
+  double area = orient2d(t[0], t[1], t[2]);
+  return std::array<double, 3>{{
+    orient2d(point, t[1], t[2]) / area,
+    orient2d(t[0], point, t[2]) / area,
+    orient2d(t[0], t[1], point) / area}};
+}
+
+}  // namespace
+
+
 Transformer::Transformer() {
   reset();
 }
@@ -75,9 +136,38 @@ void Transformer::load(std::string const &yaml_doc) {
     loaded._robot_corr_points.push_back(Point2D{p[0].as<int>(), p[1].as<int>()});
   }
 
+  if (root["locations"]) {
+    std::vector<NamedLocation> locations;
+    for (auto l : root["locations"]) {
+      NamedLocation location;
+      location.name = l["name"].as<std::string>();
+      if (static_cast<bool>(l["ref"]) == static_cast<bool>(l["robot"])) {
+        throw std::runtime_error(
+          "Location " + location.name + " must have a position in exactly one map");
+      }
+      location.frame = l["ref"] ? MapFrame::ref : MapFrame::robot;
+      auto position = l["ref"] ? l["ref"] : l["robot"];
+      Point2D point{position[0].as<float>(), position[1].as<float>()};
+      if (location.frame == MapFrame::ref) {
+        location.ref_position = point;
+      } else {
+        location.robot_position = point;
+      }
+      locations.push_back(location);
+    }
+    loaded._locations.build(std::move(locations));
+  }
+
   // Validate the loaded data
+  loaded._image_size_reader = _image_size_reader;
   loaded._validate();
+  loaded._validate_image_files();
   // All checked out, so claim the data
+  loaded._search_strategy = _search_strategy;
+  loaded._search_memory_limit = _search_memory_limit;
+  loaded._triangulation_mode = _triangulation_mode;
+  loaded._to_ref_cache = _to_ref_cache;
+  loaded._to_robot_cache = _to_robot_cache;
   *this = loaded;
   // Pre-calculate that which needs to be pre-calculated
   precalculate();
@@ -95,7 +185,83 @@ void Transformer::reset() {
   _robot_map_translation = Vector2D{0, 0};
   _ref_corr_points.clear();
   _robot_corr_points.clear();
-  _triangles.clear();
+  _ref_triangulation.clear();
+  _robot_triangulation.clear();
+  _ref_corr_point_index.clear();
+  _robot_corr_point_index.clear();
+  _to_ref_cache.clear();
+  _to_robot_cache.clear();
+  _locations.clear();
+}
+
+void Transformer::set_search_strategy(SearchStrategy strategy) {
+  _search_strategy = strategy;
+  if (!_empty()) {
+    build_point_locators();
+  }
+}
+
+SearchStrategy Transformer::search_strategy() const {
+  return _search_strategy;
+}
+
+void Transformer::set_search_memory_limit(std::size_t bytes) {
+  _search_memory_limit = bytes;
+  if (!_empty() && _search_strategy == SearchStrategy::automatic) {
+    build_point_locators();
+  }
+}
+
+std::size_t Transformer::search_memory_limit() const {
+  return _search_memory_limit;
+}
+
+void Transformer::set_triangulation_mode(TriangulationMode mode) {
+  _triangulation_mode = mode;
+  if (!_empty()) {
+    precalculate();
+  }
+}
+
+TriangulationMode Transformer::triangulation_mode() const {
+  return _triangulation_mode;
+}
+
+void Transformer::set_image_size_reader(ImageSizeReader reader) {
+  _image_size_reader = std::move(reader);
+}
+
+void Transformer::set_query_cache_capacity(std::size_t capacity) {
+  _to_ref_cache = QueryCache(capacity);
+  _to_robot_cache = QueryCache(capacity);
+}
+
+std::size_t Transformer::query_cache_capacity() const {
+  return _to_ref_cache.capacity();
+}
+
+QueryCacheStatistics Transformer::to_ref_cache_statistics() const {
+  return _to_ref_cache.statistics();
+}
+
+QueryCacheStatistics Transformer::to_robot_cache_statistics() const {
+  return _to_robot_cache.statistics();
+}
+
+SearchStrategySelection const &Transformer::ref_map_search_selection() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _ref_triangulation.locator.selection();
+}
+
+SearchStrategySelection const &Transformer::robot_map_search_selection() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _robot_triangulation.locator.selection();
 }
 
 std::string Transformer::ref_map_name() const {
@@ -187,11 +353,63 @@ const CorrespondencePoints& Transformer::robot_map_corr_points() const {
 }
 
 const TriangleList& Transformer::triangle_indices() const {
+  return ref_map_triangle_indices();
+}
+
+const TriangleList& Transformer::ref_map_triangle_indices() const {
   if (_empty()) {
     throw std::logic_error("Transformer must not be empty");
   }
 
-  return _triangles;
+  return _ref_triangulation.triangles;
+}
+
+const TriangleList& Transformer::robot_map_triangle_indices() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _robot_triangulation.triangles;
+}
+
+const std::vector<TriangleQuality>& Transformer::triangle_quality() const {
+  return ref_map_triangle_quality();
+}
+
+const std::vector<TriangleQuality>& Transformer::ref_map_triangle_quality() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _ref_triangulation.quality;
+}
+
+const std::vector<TriangleQuality>& Transformer::robot_map_triangle_quality() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _robot_triangulation.quality;
+}
+
+std::vector<int> Transformer::folded_triangles() const {
+  return ref_map_folded_triangles();
+}
+
+std::vector<int> Transformer::ref_map_folded_triangles() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return folded_triangles(_ref_triangulation);
+}
+
+std::vector<int> Transformer::robot_map_folded_triangles() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return folded_triangles(_robot_triangulation);
 }
 
 std::pair<Point2D, Point2D> Transformer::bounding_box() const {
@@ -212,34 +430,38 @@ std::pair<Point2D, Point2D> Transformer::bounding_box() const {
   return std::pair<Point2D, Point2D>{top_left, bottom_right};
 }
 
-Point2D Transformer::to_ref(Point2D const &point) const {
+std::vector<int> Transformer::ref_map_triangles_in_region(
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
   if (_empty()) {
     throw std::logic_error("Transformer must not be empty");
   }
 
-  // Check first it it's a correspondence point because we can shortcircuit much of the
-  // calculations for those
-  int corr_point_index = get_correspondence_point_index(point, _robot_corr_points);
-  if (corr_point_index >= 0) {
-    return _ref_corr_points[corr_point_index];
+  return public_triangle_indices(
+    _ref_triangulation,
+    _ref_triangulation.locator.find_in_region(top_left, bottom_right));
+}
+
+std::vector<int> Transformer::robot_map_triangles_in_region(
+  Point2D const &top_left,
+  Point2D const &bottom_right) const
+{
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
   }
 
-  auto containing_triangle = find_containing_triangle_in_robot(point);
+  return public_triangle_indices(
+    _robot_triangulation,
+    _robot_triangulation.locator.find_in_region(top_left, bottom_right));
+}
 
-  if (containing_triangle < 0) {
-    // No triangle found, so only transform by the map transform
-    return transform_to_ref_by_map_transform(point);
+Point2D Transformer::to_ref(Point2D const &point) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
   }
 
-  cv::Mat transform = _to_ref_transforms[containing_triangle];
-  Point2D transformed_point;
-  transformed_point.first = transform.at<double>(0, 0) *
-    point.first + transform.at<double>(0, 1) * point.second +
-    transform.at<double>(0, 2);
-  transformed_point.second = transform.at<double>(1, 0) *
-    point.first + transform.at<double>(1, 1) * point.second +
-    transform.at<double>(1, 2);
-  return transformed_point;
+  return transform_point<Direction::to_ref>(point);
 }
 
 Point2D Transformer::to_robot(Point2D const &point) const {
@@ -247,29 +469,130 @@ Point2D Transformer::to_robot(Point2D const &point) const {
     throw std::logic_error("Transformer must not be empty");
   }
 
-  // Check first it it's a correspondence point because we can shortcircuit much of the
-  // calculations for those
-  int corr_point_index = get_correspondence_point_index(point, _ref_corr_points);
-  if (corr_point_index >= 0) {
-    return _robot_corr_points[corr_point_index];
+  return transform_point<Direction::to_robot>(point);
+}
+
+void Transformer::to_ref(Point2D const *points, std::size_t count, Point2D *results) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
   }
 
-  auto containing_triangle = find_containing_triangle_in_ref(point);
+  transform_points<Direction::to_ref>(points, count, results);
+}
 
-  if (containing_triangle < 0) {
-    // No triangle found, so only transform by the map transform
-    return transform_from_ref_by_map_transform(point);
+std::vector<Point2D> Transformer::to_ref(std::vector<Point2D> const &points) const {
+  std::vector<Point2D> results(points.size());
+  to_ref(points.data(), points.size(), results.data());
+  return results;
+}
+
+void Transformer::to_robot(Point2D const *points, std::size_t count, Point2D *results) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
   }
 
-  cv::Mat transform = _to_robot_transforms[containing_triangle];
-  Point2D transformed_point;
-  transformed_point.first = transform.at<double>(0, 0) *
-    point.first + transform.at<double>(0, 1) * point.second +
-    transform.at<double>(0, 2);
-  transformed_point.second = transform.at<double>(1, 0) *
-    point.first + transform.at<double>(1, 1) * point.second +
-    transform.at<double>(1, 2);
-  return transformed_point;
+  transform_points<Direction::to_robot>(points, count, results);
+}
+
+std::vector<Point2D> Transformer::to_robot(std::vector<Point2D> const &points) const {
+  std::vector<Point2D> results(points.size());
+  to_robot(points.data(), points.size(), results.data());
+  return results;
+}
+
+std::vector<NamedLocation> const &Transformer::locations() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _locations.locations();
+}
+
+int Transformer::location_id(std::string const &name) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  return _locations.find(name);
+}
+
+NamedLocation const &Transformer::location(std::string const &name) const {
+  auto id = location_id(name);
+  if (id < 0) {
+    throw std::out_of_range("No location named " + name);
+  }
+  return _locations.locations()[id];
+}
+
+NamedLocation const &Transformer::location(std::size_t id) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+  if (id >= _locations.locations().size()) {
+    throw std::out_of_range("No location with ID " + std::to_string(id));
+  }
+
+  return _locations.locations()[id];
+}
+
+QueryResult Transformer::query_to_ref(Point2D const &point) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  int corr_point_index = _robot_corr_point_index.find(point);
+  return query_point<Direction::to_ref>(
+    point,
+    corr_point_index,
+    corr_point_index >= 0 ? -1 : _robot_triangulation.locator.find(point));
+}
+
+QueryResult Transformer::query_to_robot(Point2D const &point) const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  int corr_point_index = _ref_corr_point_index.find(point);
+  return query_point<Direction::to_robot>(
+    point,
+    corr_point_index,
+    corr_point_index >= 0 ? -1 : _ref_triangulation.locator.find(point));
+}
+
+void Transformer::query_to_ref(
+  Point2D const *points,
+  std::size_t count,
+  QueryResult *results) const
+{
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  query_points<Direction::to_ref>(points, count, results);
+}
+
+std::vector<QueryResult> Transformer::query_to_ref(std::vector<Point2D> const &points) const {
+  std::vector<QueryResult> results(points.size());
+  query_to_ref(points.data(), points.size(), results.data());
+  return results;
+}
+
+void Transformer::query_to_robot(
+  Point2D const *points,
+  std::size_t count,
+  QueryResult *results) const
+{
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  query_points<Direction::to_robot>(points, count, results);
+}
+
+std::vector<QueryResult> Transformer::query_to_robot(std::vector<Point2D> const &points) const {
+  std::vector<QueryResult> results(points.size());
+  query_to_robot(points.data(), points.size(), results.data());
+  return results;
 }
 
 bool Transformer::_empty() const {
@@ -284,7 +607,7 @@ bool Transformer::_empty() const {
     _robot_map_translation == Vector2D{0, 0} &&
     _ref_corr_points.empty() &&
     _robot_corr_points.empty() &&
-    _triangles.empty();
+    _ref_triangulation.triangles.empty();
 }
 
 void Transformer::_validate() const {
@@ -314,7 +637,10 @@ void Transformer::_validate() const {
   if (_robot_map_scale.first == 0 || _robot_map_scale.second == 0) {
     throw std::runtime_error("Invalid scale value: 0");
   }
+}
 
+
+void Transformer::_validate_image_files() const {
   // Map image files must exist
   if (!_ref_map_image_file.empty()) {
     auto path = std::filesystem::path(_ref_map_image_file);
@@ -330,21 +656,18 @@ void Transformer::_validate() const {
   }
 
   // Map image file dimensions must match claimed map dimensions
+  if (!_image_size_reader) {
+    return;
+  }
   if (!_ref_map_image_file.empty()) {
-    cv::Mat image = cv::imread(_ref_map_image_file, cv::IMREAD_COLOR);
-    if (image.empty()) {
-      throw std::runtime_error("Reference map image file does not exist or is not accessible");
-    }
-    if (image.cols != _ref_map_size.first || image.rows != _ref_map_size.second) {
+    auto size = _image_size_reader(_ref_map_image_file);
+    if (size && *size != _ref_map_size) {
       throw std::runtime_error("Reference map image file dimensions do not match map dimensions");
     }
   }
   if (!_robot_map_image_file.empty()) {
-    cv::Mat image = cv::imread(_robot_map_image_file, cv::IMREAD_COLOR);
-    if (image.empty()) {
-      throw std::runtime_error("Robot map image file does not exist or is not accessible");
-    }
-    if (image.cols != _robot_map_size.first || image.rows != _robot_map_size.second) {
+    auto size = _image_size_reader(_robot_map_image_file);
+    if (size && *size != _robot_map_size) {
       throw std::runtime_error("Robot map image file dimensions do not match map dimensions");
     }
   }
@@ -352,8 +675,62 @@ void Transformer::_validate() const {
 
 
 void Transformer::precalculate() {
-  subdivide_and_index_triangles();
-  precalculate_triangle_transforms();
+  if (_triangulation_mode == TriangulationMode::per_direction) {
+    precalculate(
+      delaunay_triangulation(_ref_corr_points),
+      delaunay_triangulation(_robot_corr_points));
+  } else {
+    auto triangles = delaunay_triangulation(calculate_correspondence_midpoints());
+    precalculate(triangles, triangles);
+  }
+}
+
+
+void Transformer::precalculate(TriangleList ref_triangles, TriangleList robot_triangles) {
+  index_triangles(
+    _ref_triangulation,
+    std::move(ref_triangles),
+    _ref_corr_points,
+    _robot_corr_points);
+  index_triangles(
+    _robot_triangulation,
+    std::move(robot_triangles),
+    _robot_corr_points,
+    _ref_corr_points);
+  measure_triangles(_ref_triangulation, _ref_corr_points, _robot_corr_points);
+  measure_triangles(_robot_triangulation, _ref_corr_points, _robot_corr_points);
+  _ref_corr_point_index.build(_ref_corr_points);
+  _robot_corr_point_index.build(_robot_corr_points);
+  build_point_locators();
+  // Cached results may have been calculated with a different triangulation
+  _to_ref_cache.clear();
+  _to_robot_cache.clear();
+  transform_locations();
+}
+
+
+void Transformer::transform_locations() {
+  // Each map's locations are transformed to the other map in a single batch
+  auto &locations = _locations.locations();
+  std::vector<Point2D> ref_points, robot_points;
+  for (auto const &location : locations) {
+    if (location.frame == MapFrame::ref) {
+      ref_points.push_back(location.ref_position);
+    } else {
+      robot_points.push_back(location.robot_position);
+    }
+  }
+  to_robot(ref_points.data(), ref_points.size(), ref_points.data());
+  to_ref(robot_points.data(), robot_points.size(), robot_points.data());
+
+  std::size_t next_ref{0}, next_robot{0};
+  for (auto &location : locations) {
+    if (location.frame == MapFrame::ref) {
+      location.robot_position = ref_points[next_ref++];
+    } else {
+      location.ref_position = robot_points[next_robot++];
+    }
+  }
 }
 
 
@@ -370,165 +747,293 @@ CorrespondencePoints Transformer::calculate_correspondence_midpoints() const {
 }
 
 
-void Transformer::subdivide_and_index_triangles() {
-  CorrespondencePoints midpoints = calculate_correspondence_midpoints();
-  auto bb = bounding_box();
-  auto subdiv = cv::Subdiv2D(cv::Rect(0, 0, bb.second.first, bb.second.second));
-  for (auto& p : midpoints) {
-    subdiv.insert(cv::Point2f(p.first, p.second));
+void Transformer::index_triangles(
+  MapTriangulation &triangulation,
+  TriangleList triangles,
+  CorrespondencePoints const &from_points,
+  CorrespondencePoints const &to_points)
+{
+  triangulation.triangles = std::move(triangles);
+  // Store the triangles along a space-filling curve, so that searches for nearby points use nearby
+  // triangles and transforms in memory
+  triangulation.order.resize(triangulation.triangles.size());
+  std::iota(std::begin(triangulation.order), std::end(triangulation.order), 0);
+  triangulation.order = spatial_order(triangle_geometry(triangulation, from_points));
+
+  // The triangulation's vertices are counterclockwise around each triangle in the plane it was
+  // calculated in, so a triangle that is not counterclockwise in this map overlaps its neighbours
+  triangulation.transforms.clear();
+  triangulation.transforms.reserve(triangulation.order.size());
+  triangulation.folded = false;
+  for (auto index : triangulation.order) {
+    auto const &t = triangulation.triangles[index];
+    TriangleVertices from, to;
+    int vertices[3] = {std::get<0>(t), std::get<1>(t), std::get<2>(t)};
+    for (int ii = 0; ii < 3; ++ii) {
+      from[ii] = from_points[vertices[ii]];
+      to[ii] = to_points[vertices[ii]];
+    }
+    triangulation.transforms.push_back(affine_transform(from, to));
+    triangulation.folded = triangulation.folded || orient2d(
+      from_points[vertices[0]],
+      from_points[vertices[1]],
+      from_points[vertices[2]]) <= 0;
   }
+}
 
-  std::vector<cv::Vec6f> raw_triangles;
-  subdiv.getTriangleList(raw_triangles);
-  for (auto& t : raw_triangles) {
-    Point2D p0(t[0], t[1]);
-    Point2D p1(t[2], t[3]);
-    Point2D p2(t[4], t[5]);
-    auto offset = std::find(std::begin(midpoints), std::end(midpoints), p0);
-    if (offset == std::end(midpoints)) {
-      throw std::runtime_error("Could not find expected triangle point");
-    }
-    unsigned int i0 = std::distance(std::begin(midpoints), offset);
-    offset = std::find(std::begin(midpoints), std::end(midpoints), p1);
-    if (offset == std::end(midpoints)) {
-      throw std::runtime_error("Could not find expected triangle point");
-    }
-    unsigned int i1 = std::distance(std::begin(midpoints), offset);
-    offset = std::find(std::begin(midpoints), std::end(midpoints), p2);
-    if (offset == std::end(midpoints)) {
-      throw std::runtime_error("Could not find expected triangle point");
-    }
-    unsigned int i2 = std::distance(std::begin(midpoints), offset);
-    _triangles.push_back(Triangle{i0, i1, i2});
+void Transformer::measure_triangles(
+  MapTriangulation &triangulation,
+  CorrespondencePoints const &ref_points,
+  CorrespondencePoints const &robot_points)
+{
+  triangulation.quality.clear();
+  triangulation.quality.reserve(triangulation.triangles.size());
+  for (auto const &t : triangulation.triangles) {
+    auto vertices = [&t](CorrespondencePoints const &points) {
+        return TriangleVertices{
+          points[std::get<0>(t)], points[std::get<1>(t)], points[std::get<2>(t)]};
+      };
+    triangulation.quality.push_back(
+      measure_triangle(vertices(ref_points), vertices(robot_points)));
   }
 }
 
+void Transformer::build_point_locators() {
+  _ref_triangulation.locator.build(
+    triangle_geometry(_ref_triangulation, _ref_corr_points),
+    _search_strategy,
+    _search_memory_limit,
+    _ref_triangulation.folded);
+  _robot_triangulation.locator.build(
+    triangle_geometry(_robot_triangulation, _robot_corr_points),
+    _search_strategy,
+    _search_memory_limit,
+    _robot_triangulation.folded);
+}
+
+
+void Transformer::MapTriangulation::clear() {
+  triangles.clear();
+  order.clear();
+  transforms.clear();
+  locator.clear();
+  folded = false;
+  quality.clear();
+}
+
+
+template<Transformer::Direction direction>
+Transformer::DirectionData Transformer::direction_data() const {
+  // Points are found in the triangulation of the map they are in
+  if constexpr (direction == Direction::to_ref) {
+    return DirectionData{
+      _robot_corr_point_index, _ref_corr_points, _robot_triangulation, _to_ref_cache};
+  } else {
+    return DirectionData{
+      _ref_corr_point_index, _robot_corr_points, _ref_triangulation, _to_robot_cache};
+  }
+}
 
-void Transformer::precalculate_triangle_transforms() {
-  for (auto& t : _triangles) {
-    cv::Point2f t_ref[3], t_robot[3];
 
-    auto point = _ref_corr_points[std::get<0>(t)];
-    t_ref[0].x = point.first; t_ref[0].y = point.second;
-    point = _ref_corr_points[std::get<1>(t)];
-    t_ref[1].x = point.first; t_ref[1].y = point.second;
-    point = _ref_corr_points[std::get<2>(t)];
-    t_ref[2].x = point.first; t_ref[2].y = point.second;
+template<Transformer::Direction direction>
+Point2D Transformer::transform_by_map_transform(Point2D const &point) const {
+  // The robot map transform takes points to the reference map; its inverse takes them back
+  constexpr bool inverse = direction == Direction::to_robot;
+  Point2D transformed_point;
+  if constexpr (inverse) {
+    transformed_point.first = point.first / _robot_map_scale.first;
+    transformed_point.second = point.second / _robot_map_scale.second;
+  } else {
+    transformed_point.first = point.first * _robot_map_scale.first;
+    transformed_point.second = point.second * _robot_map_scale.second;
+  }
 
-    point = _robot_corr_points[std::get<0>(t)];
-    t_robot[0].x = point.first; t_robot[0].y = point.second;
-    point = _robot_corr_points[std::get<1>(t)];
-    t_robot[1].x = point.first; t_robot[1].y = point.second;
-    point = _robot_corr_points[std::get<2>(t)];
-    t_robot[2].x = point.first; t_robot[2].y = point.second;
+  if (_robot_map_rotation != 0) {
+    double rotation = inverse ? -_robot_map_rotation : _robot_map_rotation;
+    Point2D pre(transformed_point);
+    transformed_point.first = std::cos(rotation) * pre.first - std::sin(rotation) * pre.second;
+    transformed_point.second = std::sin(rotation) * pre.first + std::cos(rotation) * pre.second;
+  }
 
-    _to_ref_transforms.push_back(cv::getAffineTransform(t_robot, t_ref));
-    _to_robot_transforms.push_back(cv::getAffineTransform(t_ref, t_robot));
+  if constexpr (inverse) {
+    transformed_point.first -= _robot_map_translation.first;
+    transformed_point.second -= _robot_map_translation.second;
+  } else {
+    transformed_point.first += _robot_map_translation.first;
+    transformed_point.second += _robot_map_translation.second;
   }
+
+  return transformed_point;
 }
 
-int Transformer::get_correspondence_point_index(
+// The tiled transformer falls back to the same map transforms
+template Point2D Transformer::transform_by_map_transform<Transformer::Direction::to_ref>(
+  Point2D const &point) const;
+template Point2D Transformer::transform_by_map_transform<Transformer::Direction::to_robot>(
+  Point2D const &point) const;
+
+
+template<Transformer::Direction direction>
+Point2D Transformer::transform_located(
   Point2D const &point,
-  CorrespondencePoints const &points) const
+  int corr_point,
+  int stored_triangle) const
 {
-  auto result = std::find(std::begin(points), std::end(points), point);
-  if (result != std::end(points)) {
-    return std::distance(std::begin(points), result);
-  }
-  return -1;
-}
-
-// TODO(gbiggs) Refactor this with the below version
-int Transformer::find_containing_triangle_in_ref(Point2D const &point) const {
-  for (unsigned int ii = 0; ii < _triangles.size(); ++ii) {
-    auto triangle = triangle_points(_triangles[ii], _ref_corr_points);
-    auto in_triangle = cv::pointPolygonTest(
-      triangle,
-      cv::Point2f(point.first, point.second),
-      false);
-    if (in_triangle >= 0) {
-      return ii;
-    }
+  auto data = direction_data<direction>();
+  if (corr_point >= 0) {
+    return data.corr_point_targets[corr_point];
+  }
+  if (stored_triangle < 0) {
+    // No triangle found, so only transform by the map transform
+    return transform_by_map_transform<direction>(point);
   }
-  return -1;
+  return apply_transform(data.triangulation.transforms[stored_triangle], point);
 }
 
-// TODO(gbiggs) Refactor this with the above version
-int Transformer::find_containing_triangle_in_robot(Point2D const &point) const {
-  for (unsigned int ii = 0; ii < _triangles.size(); ++ii) {
-    auto triangle = triangle_points(_triangles[ii], _robot_corr_points);
-    auto in_triangle = cv::pointPolygonTest(
-      triangle,
-      cv::Point2f(point.first, point.second),
-      false);
-    if (in_triangle >= 0) {
-      return ii;
-    }
+
+template<Transformer::Direction direction>
+Point2D Transformer::transform_point(Point2D const &point) const {
+  auto data = direction_data<direction>();
+
+  // Check first it it's a correspondence point because we can shortcircuit much of the
+  // calculations for those
+  int corr_point = data.corr_point_index.find(point);
+  if (corr_point >= 0) {
+    return data.corr_point_targets[corr_point];
   }
-  return -1;
-}
 
+  Point2D result;
+  if (data.cache.find(point, result)) {
+    return result;
+  }
+  result = transform_located<direction>(point, -1, data.triangulation.locator.find(point));
+  data.cache.insert(point, result);
+  return result;
+}
 
-// TODO(gbiggs) Refactor this with the below version
-Point2D Transformer::transform_to_ref_by_map_transform(Point2D const& point) const {
-  Point2D transformed_point;
-  transformed_point.first = point.first * _robot_map_scale.first;
-  transformed_point.second = point.second * _robot_map_scale.second;
 
-  if (_robot_map_rotation != 0) {
-    Point2D pre(transformed_point);
-    transformed_point.first = std::cos(_robot_map_rotation) * pre.first -
-      std::sin(_robot_map_rotation) * pre.second;
-    transformed_point.second = std::sin(_robot_map_rotation) * pre.first +
-      std::cos(_robot_map_rotation) * pre.second;
+template<Transformer::Direction direction, typename Visitor>
+void Transformer::locate_points(Point2D const *points, std::size_t count, Visitor &&visit) const {
+  auto data = direction_data<direction>();
+  auto const &transforms = data.triangulation.transforms;
+  // Points are located a block at a time, so the transforms for the block can be prefetched
+  std::array<int, BATCH_BLOCK_SIZE> triangles;
+  for (std::size_t block = 0; block < count; block += BATCH_BLOCK_SIZE) {
+    std::size_t size = std::min(BATCH_BLOCK_SIZE, count - block);
+    data.triangulation.locator.find(points + block, size, triangles.data());
+
+    for (std::size_t ii = 0; ii < size; ++ii) {
+      if (ii + TRANSFORM_PREFETCH_DISTANCE < size) {
+        auto next = triangles[ii + TRANSFORM_PREFETCH_DISTANCE];
+        if (next >= 0) {
+          prefetch(&transforms[next]);
+        }
+      }
+
+      int corr_point = data.corr_point_index.find(points[block + ii]);
+      visit(block + ii, corr_point, corr_point >= 0 ? -1 : triangles[ii]);
+    }
   }
+}
 
-  transformed_point.first += _robot_map_translation.first;
-  transformed_point.second += _robot_map_translation.second;
 
-  return transformed_point;
+template<Transformer::Direction direction>
+void Transformer::transform_points(
+  Point2D const *points,
+  std::size_t count,
+  Point2D *results) const
+{
+  locate_points<direction>(
+    points, count, [this, points, results](std::size_t ii, int corr_point, int stored_triangle) {
+      results[ii] = transform_located<direction>(points[ii], corr_point, stored_triangle);
+    });
 }
 
 
-// TODO(gbiggs) Refactor this with the above version
-Point2D Transformer::transform_from_ref_by_map_transform(Point2D const& point) const {
+Point2D Transformer::apply_transform(AffineTransform const &transform, Point2D const &point) {
   Point2D transformed_point;
-  transformed_point.first = point.first / _robot_map_scale.first;
-  transformed_point.second = point.second / _robot_map_scale.second;
+  transformed_point.first = transform[0] * point.first + transform[1] * point.second +
+    transform[2];
+  transformed_point.second = transform[3] * point.first + transform[4] * point.second +
+    transform[5];
+  return transformed_point;
+}
 
-  if (_robot_map_rotation != 0) {
-    Point2D pre(transformed_point);
-    transformed_point.first = std::cos(-_robot_map_rotation) * pre.first -
-      std::sin(-_robot_map_rotation) * pre.second;
-    transformed_point.second = std::sin(-_robot_map_rotation) * pre.first +
-      std::cos(-_robot_map_rotation) * pre.second;
+
+template<Transformer::Direction direction>
+QueryResult Transformer::query_point(
+  Point2D const &point,
+  int corr_point,
+  int stored_triangle) const
+{
+  // The point is calculated as by the plain transforms, so it is identical
+  auto const &triangulation = direction_data<direction>().triangulation;
+  QueryResult result;
+  result.point = transform_located<direction>(point, corr_point, stored_triangle);
+  if (corr_point >= 0) {
+    result.path = TransformPath::correspondence_point;
+    result.correspondence_point = corr_point;
+  } else if (stored_triangle < 0) {
+    result.path = TransformPath::map_transform;
+  } else {
+    result.path = TransformPath::triangle;
+    result.triangle = triangulation.order[stored_triangle];
+    result.barycentric = barycentric_coordinates(
+      triangulation.locator.triangles()[stored_triangle], point);
   }
+  return result;
+}
 
-  transformed_point.first -= _robot_map_translation.first;
-  transformed_point.second -= _robot_map_translation.second;
 
-  return transformed_point;
+template<Transformer::Direction direction>
+void Transformer::query_points(
+  Point2D const *points,
+  std::size_t count,
+  QueryResult *results) const
+{
+  locate_points<direction>(
+    points, count, [this, points, results](std::size_t ii, int corr_point, int stored_triangle) {
+      results[ii] = query_point<direction>(points[ii], corr_point, stored_triangle);
+    });
 }
 
 
-cv::Mat Transformer::triangle_points(
-  Triangle const& triangle,
-  CorrespondencePoints const& points) const
+std::vector<int> Transformer::public_triangle_indices(
+  MapTriangulation const &triangulation,
+  std::vector<int> stored_indices)
 {
-  cv::Mat result(3, 2, CV_32F);
+  for (auto &index : stored_indices) {
+    index = triangulation.order[index];
+  }
+  std::sort(std::begin(stored_indices), std::end(stored_indices));
+  return stored_indices;
+}
 
-  Point2D point = points[std::get<0>(triangle)];
-  result.at<float>(0, 0) = point.first;
-  result.at<float>(0, 1) = point.second;
 
-  point = points[std::get<1>(triangle)];
-  result.at<float>(1, 0) = point.first;
-  result.at<float>(1, 1) = point.second;
+std::vector<int> Transformer::folded_triangles(MapTriangulation const &triangulation) {
+  std::vector<int> folded;
+  for (std::size_t ii = 0; ii < triangulation.quality.size(); ++ii) {
+    if (triangulation.quality[ii].folded) {
+      folded.push_back(static_cast<int>(ii));
+    }
+  }
+  return folded;
+}
 
-  point = points[std::get<2>(triangle)];
-  result.at<float>(2, 0) = point.first;
-  result.at<float>(2, 1) = point.second;
 
+TriangleGeometry Transformer::triangle_geometry(
+  MapTriangulation const &triangulation,
+  CorrespondencePoints const &points)
+{
+  TriangleGeometry result;
+  result.reserve(triangulation.order.size());
+  for (auto index : triangulation.order) {
+    auto const &t = triangulation.triangles[index];
+    result.push_back(TriangleVertices{
+      points[std::get<0>(t)],
+      points[std::get<1>(t)],
+      points[std::get<2>(t)]});
+  }
   return result;
 }
 
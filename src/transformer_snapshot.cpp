@@ -0,0 +1,269 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/transformer.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+constexpr char SNAPSHOT_MAGIC[4] = {'M', 'T', 'S', 'N'};
+constexpr std::uint32_t SNAPSHOT_FORMAT_VERSION = 1;
+
+class SnapshotWriter {
+public:
+  template<typename T>
+  void write(T const &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written");
+    _data.append(reinterpret_cast<char const *>(&value), sizeof(T));
+  }
+
+  void write(Point2D const &value) {
+    write(value.first);
+    write(value.second);
+  }
+
+  void write_string(std::string const &value) {
+    write(static_cast<std::uint32_t>(value.size()));
+    _data.append(value);
+  }
+
+  template<typename T>
+  void write_array(std::vector<T> const &values) {
+    write(static_cast<std::uint32_t>(values.size()));
+    for (auto const &value : values) {
+      write(value);
+    }
+  }
+
+  std::string take() {
+    return std::move(_data);
+  }
+
+private:
+  std::string _data;
+};
+
+class SnapshotReader {
+public:
+  SnapshotReader(void const *data, std::size_t size)
+  : _data(static_cast<char const *>(data)), _remaining(size)
+  {}
+
+  template<typename T>
+  T read() {
+    if constexpr (std::is_same<T, Point2D>::value) {
+      auto first = read<float>();
+      return Point2D{first, read<float>()};
+    } else {
+      static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read");
+      T value;
+      take(&value, sizeof(T));
+      return value;
+    }
+  }
+
+  std::string read_string() {
+    auto size = read<std::uint32_t>();
+    check_available(size);
+    std::string value(_data, size);
+    take(nullptr, size);
+    return value;
+  }
+
+  template<typename T>
+  std::vector<T> read_array() {
+    auto count = read<std::uint32_t>();
+    // Check the count before allocating, so that a corrupt count cannot exhaust memory
+    check_available(static_cast<std::size_t>(count) * sizeof(T));
+    std::vector<T> values(count);
+    for (auto &value : values) {
+      value = read<T>();
+    }
+    return values;
+  }
+
+  bool at_end() const {
+    return _remaining == 0;
+  }
+
+private:
+  char const *_data;
+  std::size_t _remaining;
+
+  void check_available(std::size_t size) const {
+    if (size > _remaining) {
+      throw std::runtime_error("Snapshot is truncated");
+    }
+  }
+
+  void take(void *destination, std::size_t size) {
+    check_available(size);
+    if (destination != nullptr) {
+      std::memcpy(destination, _data, size);
+    }
+    _data += size;
+    _remaining -= size;
+  }
+};
+
+// Triangles are written as three 32-bit vertex indices
+void write_triangles(SnapshotWriter &writer, TriangleList const &triangles) {
+  writer.write(static_cast<std::uint32_t>(triangles.size()));
+  for (auto const &t : triangles) {
+    writer.write(static_cast<std::int32_t>(std::get<0>(t)));
+    writer.write(static_cast<std::int32_t>(std::get<1>(t)));
+    writer.write(static_cast<std::int32_t>(std::get<2>(t)));
+  }
+}
+
+TriangleList read_triangles(SnapshotReader &reader, std::size_t point_count) {
+  auto indices = reader.read_array<std::array<std::int32_t, 3>>();
+  TriangleList triangles;
+  triangles.reserve(indices.size());
+  for (auto const &t : indices) {
+    for (auto index : t) {
+      if (index < 0 || static_cast<std::size_t>(index) >= point_count) {
+        throw std::runtime_error("Snapshot triangle refers to a nonexistent point");
+      }
+    }
+    triangles.emplace_back(t[0], t[1], t[2]);
+  }
+  return triangles;
+}
+
+}  // namespace
+
+
+std::string Transformer::snapshot() const {
+  if (_empty()) {
+    throw std::logic_error("Transformer must not be empty");
+  }
+
+  SnapshotWriter writer;
+  for (auto c : SNAPSHOT_MAGIC) {
+    writer.write(c);
+  }
+  writer.write(SNAPSHOT_FORMAT_VERSION);
+  writer.write(static_cast<std::uint32_t>(_triangulation_mode));
+  writer.write_string(_ref_map_name);
+  writer.write_string(_ref_map_image_file);
+  writer.write(_ref_map_size);
+  writer.write_string(_robot_map_name);
+  writer.write_string(_robot_map_image_file);
+  writer.write(_robot_map_size);
+  writer.write(_robot_map_scale);
+  writer.write(_robot_map_rotation);
+  writer.write(_robot_map_translation);
+  writer.write_array(_ref_corr_points);
+  writer.write_array(_robot_corr_points);
+  write_triangles(writer, _ref_triangulation.triangles);
+  write_triangles(writer, _robot_triangulation.triangles);
+
+  // The positions calculated in the other map are recalculated when the snapshot is loaded
+  auto const &locations = _locations.locations();
+  writer.write(static_cast<std::uint32_t>(locations.size()));
+  for (auto const &location : locations) {
+    writer.write_string(location.name);
+    writer.write(static_cast<std::uint32_t>(location.frame));
+    writer.write(
+      location.frame == MapFrame::ref ? location.ref_position : location.robot_position);
+  }
+  return writer.take();
+}
+
+
+void Transformer::load_snapshot(void const *data, std::size_t size) {
+  if (!_empty()) {
+    throw std::logic_error("Transformer must be empty prior to calling load_snapshot()");
+  }
+
+  SnapshotReader reader(data, size);
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  for (auto &c : magic) {
+    c = reader.read<char>();
+  }
+  if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 ||
+    reader.read<std::uint32_t>() != SNAPSHOT_FORMAT_VERSION)
+  {
+    throw std::runtime_error("Not a valid snapshot");
+  }
+
+  Transformer loaded;
+  auto mode = reader.read<std::uint32_t>();
+  if (mode > static_cast<std::uint32_t>(TriangulationMode::per_direction)) {
+    throw std::runtime_error("Snapshot has an unknown triangulation mode");
+  }
+  loaded._triangulation_mode = static_cast<TriangulationMode>(mode);
+  loaded._ref_map_name = reader.read_string();
+  loaded._ref_map_image_file = reader.read_string();
+  loaded._ref_map_size = reader.read<Vector2D>();
+  loaded._robot_map_name = reader.read_string();
+  loaded._robot_map_image_file = reader.read_string();
+  loaded._robot_map_size = reader.read<Vector2D>();
+  loaded._robot_map_scale = reader.read<Vector2D>();
+  loaded._robot_map_rotation = reader.read<double>();
+  loaded._robot_map_translation = reader.read<Vector2D>();
+  loaded._ref_corr_points = reader.read_array<Point2D>();
+  loaded._robot_corr_points = reader.read_array<Point2D>();
+  auto ref_triangles = read_triangles(reader, loaded._ref_corr_points.size());
+  auto robot_triangles = read_triangles(reader, loaded._robot_corr_points.size());
+
+  auto location_count = reader.read<std::uint32_t>();
+  std::vector<NamedLocation> locations;
+  for (std::uint32_t ii = 0; ii < location_count; ++ii) {
+    NamedLocation location;
+    location.name = reader.read_string();
+    auto frame = reader.read<std::uint32_t>();
+    if (frame > static_cast<std::uint32_t>(MapFrame::robot)) {
+      throw std::runtime_error("Snapshot location has an unknown map");
+    }
+    location.frame = static_cast<MapFrame>(frame);
+    auto position = reader.read<Point2D>();
+    if (location.frame == MapFrame::ref) {
+      location.ref_position = position;
+    } else {
+      location.robot_position = position;
+    }
+    locations.push_back(std::move(location));
+  }
+  loaded._locations.build(std::move(locations));
+  if (!reader.at_end()) {
+    throw std::runtime_error("Snapshot has unexpected trailing data");
+  }
+
+  // The map image files are not checked, as the map information was when the snapshot was taken
+  loaded._validate();
+  loaded._search_strategy = _search_strategy;
+  loaded._search_memory_limit = _search_memory_limit;
+  loaded._image_size_reader = _image_size_reader;
+  loaded._to_ref_cache = _to_ref_cache;
+  loaded._to_robot_cache = _to_robot_cache;
+  *this = loaded;
+  precalculate(std::move(ref_triangles), std::move(robot_triangles));
+}
+
+}  // namespace map_transformer
@@ -0,0 +1,99 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/triangle_quality.hpp"
+#include "map_transformer/predicates.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+
+namespace map_transformer
+{
+
+namespace
+{
+
+// A 2x2 matrix, in row-major order
+using Matrix2 = std::array<double, 4>;
+
+// The ratio of the largest to the smallest singular value of a 2x2 matrix
+double condition_number(Matrix2 const &m) {
+  double determinant = m[0] * m[3] - m[1] * m[2];
+  if (determinant == 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double norm = m[0] * m[0] + m[1] * m[1] + m[2] * m[2] + m[3] * m[3];
+  double root = std::sqrt(std::max(0.0, norm * norm - 4 * determinant * determinant));
+  return (norm + root) / (2 * std::abs(determinant));
+}
+
+// The matrix whose columns are the edges of a triangle from its first vertex
+Matrix2 edge_matrix(TriangleVertices const &t) {
+  return Matrix2{
+    static_cast<double>(t[1].first) - t[0].first, static_cast<double>(t[2].first) - t[0].first,
+    static_cast<double>(t[1].second) - t[0].second, static_cast<double>(t[2].second) - t[0].second};
+}
+
+Matrix2 multiply(Matrix2 const &a, Matrix2 const &b) {
+  return Matrix2{
+    a[0] * b[0] + a[1] * b[2], a[0] * b[1] + a[1] * b[3],
+    a[2] * b[0] + a[3] * b[2], a[2] * b[1] + a[3] * b[3]};
+}
+
+Matrix2 inverse(Matrix2 const &m) {
+  double determinant = m[0] * m[3] - m[1] * m[2];
+  return Matrix2{
+    m[3] / determinant, -m[1] / determinant,
+    -m[2] / determinant, m[0] / determinant};
+}
+
+// The edge matrix of a triangle, relative to that of an equilateral triangle, so that equilateral
+// triangles have a condition number of one
+double shape_condition_number(TriangleVertices const &t) {
+  double orientation = orient2d(t[0], t[1], t[2]);
+  if (orientation == 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  // The inverse of the edge matrix of the equilateral triangle (0, 0), (1, 0), (1/2, sqrt(3)/2)
+  double const sqrt3 = std::sqrt(3.0);
+  Matrix2 equilateral_inverse{1, -1 / sqrt3, 0, 2 / sqrt3};
+  return condition_number(multiply(edge_matrix(t), equilateral_inverse));
+}
+
+}  // namespace
+
+
+TriangleQuality measure_triangle(TriangleVertices const &ref, TriangleVertices const &robot) {
+  TriangleQuality quality;
+  double ref_orientation = orient2d(ref[0], ref[1], ref[2]);
+  double robot_orientation = orient2d(robot[0], robot[1], robot[2]);
+  quality.ref_area = ref_orientation / 2;
+  quality.robot_area = robot_orientation / 2;
+  quality.area_ratio = quality.robot_area / quality.ref_area;
+  quality.ref_condition_number = shape_condition_number(ref);
+  quality.robot_condition_number = shape_condition_number(robot);
+  if (ref_orientation == 0 || robot_orientation == 0) {
+    quality.transform_condition_number = std::numeric_limits<double>::infinity();
+  } else {
+    quality.transform_condition_number =
+      condition_number(multiply(edge_matrix(robot), inverse(edge_matrix(ref))));
+  }
+  quality.folded = ref_orientation <= 0 || robot_orientation <= 0;
+  return quality;
+}
+
+}  // namespace map_transformer
@@ -12,12 +12,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include <map_transformer/opencv_image_size.hpp>
 #include <map_transformer/transformer.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 cv::Mat ref_map_image;
 cv::Mat robot_map_image;
@@ -75,59 +82,200 @@ void draw_triangulation(
 }
 
 
-void pick_point_to_ref(int event, int x, int y, int, void*) {
-  if (event != cv::EVENT_LBUTTONUP) {
-    return;
+// The direction of a transformation
+enum class Direction {to_ref, to_robot};
+
+// The image of the map points are transformed from
+cv::Mat & source_image(Direction direction) {
+  return direction == Direction::to_ref ? robot_map_image : ref_map_image;
+}
+
+// The image of the map points are transformed to
+cv::Mat & target_image(Direction direction) {
+  return direction == Direction::to_ref ? ref_map_image : robot_map_image;
+}
+
+// The equivalent position of a point in the other map, without the warping transformations
+map_transformer::Point2D untransformed(Direction direction, map_transformer::Point2D point) {
+  auto const & translation = transformer.robot_map_translation();
+  if (direction == Direction::to_ref) {
+    return {point.first + translation.first, point.second + translation.second};
   }
+  return {point.first - translation.first, point.second - translation.second};
+}
+
+cv::Point image_point(map_transformer::Point2D const & point) {
+  return cv::Point(point.first, point.second);
+}
 
+
+// Draw points, their untransformed positions, and their transformed positions
+void draw_queries(
+  Direction direction,
+  std::vector<map_transformer::Point2D> const & points,
+  std::vector<map_transformer::QueryResult> const & results)
+{
   cv::Scalar colour(0, 0, 255);
-  // Plot the clicked point
-  draw_point(robot_map_image, cv::Point(x, y), colour);
-  // Plot the equivalent position on the reference map
-  draw_point(
-    ref_map_image,
-    cv::Point(
-      x + transformer.robot_map_translation().first,
-      y + transformer.robot_map_translation().first),
-    colour);
-  // Transform the point according to the warping transformations
-  auto transformed_point = transformer.to_ref(map_transformer::Point2D(x, y));
-  // Plot the transformed point on the reference map
-  colour[1] = 255; colour[2] = 0;
-  draw_point(ref_map_image, cv::Point(transformed_point.first, transformed_point.second), colour);
+  cv::Scalar transformed_colour(0, 255, 0);
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    draw_point(source_image(direction), image_point(points[ii]), colour);
+    draw_point(target_image(direction), image_point(untransformed(direction, points[ii])), colour);
+    draw_point(target_image(direction), image_point(results[ii].point), transformed_colour);
+  }
+}
+
+
+// Draw a trajectory as a path in its map, and the path it is transformed to in the other map
+void draw_trajectory(
+  Direction direction,
+  std::vector<map_transformer::Point2D> const & points,
+  std::vector<map_transformer::QueryResult> const & results)
+{
+  cv::Scalar colour(0, 0, 255);
+  cv::Scalar transformed_colour(0, 255, 0);
+  for (std::size_t ii = 1; ii < points.size(); ++ii) {
+    cv::line(
+      source_image(direction), image_point(points[ii - 1]), image_point(points[ii]), colour, 2);
+    cv::line(
+      target_image(direction),
+      image_point(results[ii - 1].point),
+      image_point(results[ii].point),
+      transformed_colour,
+      2);
+  }
+}
+
+
+// Transform a batch of points, reporting how long it took
+std::vector<map_transformer::QueryResult> transform(
+  Direction direction,
+  std::vector<map_transformer::Point2D> const & points,
+  std::chrono::duration<double> & elapsed)
+{
+  std::vector<map_transformer::QueryResult> results(points.size());
+  auto start = std::chrono::steady_clock::now();
+  if (direction == Direction::to_ref) {
+    transformer.query_to_ref(points.data(), points.size(), results.data());
+  } else {
+    transformer.query_to_robot(points.data(), points.size(), results.data());
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  return results;
+}
+
+
+void pick_point(Direction direction, int x, int y) {
+  std::vector<map_transformer::Point2D> points{map_transformer::Point2D(x, y)};
+  std::chrono::duration<double> elapsed;
+  auto results = transform(direction, points, elapsed);
+  draw_queries(direction, points, results);
 
   cv::imshow("Reference map", ref_map_image);
   cv::imshow("Robot map", robot_map_image);
-  std::cout << "Transformed " << x << ", " << y << " (robot) to " << transformed_point.first <<
-    ", " << transformed_point.second << " (reference)\n";
+  char const * from = direction == Direction::to_ref ? " (robot) to " : " (reference) to ";
+  char const * to = direction == Direction::to_ref ? " (reference)\n" : " (robot)\n";
+  std::cout << "Transformed " << x << ", " << y << from << results[0].point.first << ", " <<
+    results[0].point.second << to;
+}
+
+
+void pick_point_to_ref(int event, int x, int y, int, void*) {
+  if (event == cv::EVENT_LBUTTONUP) {
+    pick_point(Direction::to_ref, x, y);
+  }
 }
 
 
 void pick_point_to_robot(int event, int x, int y, int, void*) {
-  if (event != cv::EVENT_LBUTTONUP) {
-    return;
+  if (event == cv::EVENT_LBUTTONUP) {
+    pick_point(Direction::to_robot, x, y);
   }
+}
 
-  cv::Scalar colour(0, 0, 255);
-  // Plot the clicked point
-  draw_point(ref_map_image, cv::Point(x, y), colour);
-  // Plot the equivalent position on the robot map
-  draw_point(
-    robot_map_image,
-    cv::Point(
-      x - transformer.robot_map_translation().first,
-      y - transformer.robot_map_translation().first),
-    colour);
-  // Transform the point according to the warping transformations
-  auto transformed_point = transformer.to_robot(map_transformer::Point2D(x, y));
-  // Plot the transformed point on the robot map
-  colour[1] = 255; colour[2] = 0;
-  draw_point(robot_map_image, cv::Point(transformed_point.first, transformed_point.second), colour);
 
-  cv::imshow("Reference map", ref_map_image);
-  cv::imshow("Robot map", robot_map_image);
-  std::cout << "Transformed " << x << ", " << y << " (reference) to " << transformed_point.first <<
-    ", " << transformed_point.second << " (robot)\n";
+// Read a file of points, one "x,y" per line; blank lines and lines starting with # are skipped
+bool read_points(std::string const & file_name, std::vector<map_transformer::Point2D> & points) {
+  std::ifstream file(file_name);
+  if (!file.is_open()) {
+    std::cerr << "Could not read points file " << file_name << '\n';
+    return false;
+  }
+  std::string line;
+  std::size_t line_number{0};
+  while (std::getline(file, line)) {
+    ++line_number;
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    map_transformer::Point2D point;
+    char comma{0};
+    std::string rest;
+    if (!(fields >> point.first >> comma >> point.second) || comma != ',' || (fields >> rest)) {
+      std::cerr << file_name << ':' << line_number << ": expected \"x,y\", got \"" << line <<
+        "\"\n";
+      return false;
+    }
+    points.push_back(point);
+  }
+  return true;
+}
+
+
+// Print how long a batch took and how its points were transformed
+void print_statistics(
+  std::string const & name,
+  std::vector<map_transformer::QueryResult> const & results,
+  std::chrono::duration<double> elapsed)
+{
+  std::size_t paths[3]{0, 0, 0};
+  for (auto const & result : results) {
+    ++paths[static_cast<int>(result.path)];
+  }
+  std::cout << name << ": " << results.size() << " points in " << elapsed.count() * 1e3 <<
+    " ms";
+  if (!results.empty()) {
+    std::cout << ", " << elapsed.count() * 1e6 / results.size() << " us per query";
+  }
+  std::cout << "\n  correspondence points: " << paths[0] <<
+    "\n  inside a triangle:     " << paths[1] <<
+    "\n  map transform only:    " << paths[2] << '\n';
+}
+
+
+double path_length(std::vector<map_transformer::Point2D> const & points) {
+  double length{0};
+  for (std::size_t ii = 1; ii < points.size(); ++ii) {
+    length += std::hypot(
+      points[ii].first - points[ii - 1].first,
+      points[ii].second - points[ii - 1].second);
+  }
+  return length;
+}
+
+
+// Print the length of a trajectory before and after it is transformed
+void print_trajectory_statistics(
+  Direction direction,
+  std::vector<map_transformer::Point2D> const & points,
+  std::vector<map_transformer::QueryResult> const & results)
+{
+  std::vector<map_transformer::Point2D> transformed;
+  transformed.reserve(results.size());
+  double max_displacement{0};
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    transformed.push_back(results[ii].point);
+    // How far the warping transformations moved the point, in the map it was transformed to
+    auto moved = untransformed(direction, points[ii]);
+    max_displacement = std::max(
+      max_displacement,
+      static_cast<double>(std::hypot(
+        results[ii].point.first - moved.first, results[ii].point.second - moved.second)));
+  }
+  std::cout << "  length: " << path_length(points) << " before, " << path_length(transformed) <<
+    " after transformation\n";
+  std::cout << "  largest displacement by the warping: " << max_displacement << '\n';
 }
 
 
@@ -138,7 +286,13 @@ int main(int argc, char ** argv)
     "{c corr-points | false | display the correspondence points}"
     "{m map-info-file | | the YAML file containing the map information}"
     "{t triangulation | false | display the Delaunay triangulation}"
-    "{n number-triangles | false | number the Delaunay triangles}";
+    "{n number-triangles | false | number the Delaunay triangles}"
+    "{p per-direction | false | triangulate each map separately}"
+    "{q queries | | a file of points to transform, one \"x,y\" per line}"
+    "{r trajectory | | a file of points to transform and draw as a path, one \"x,y\" per line}"
+    "{d direction | to_ref | to_ref if the points are in the robot map, to_robot if in the "
+    "reference map}"
+    "{o output | | render to <output>_ref.png and <output>_robot.png instead of opening windows}";
   cv::CommandLineParser parser(argc, argv, keys);
   parser.about("Map transformer visualisation");
 
@@ -151,6 +305,28 @@ int main(int argc, char ** argv)
     parser.printMessage();
     return 1;
   }
+  Direction direction;
+  if (parser.get<std::string>("direction") == "to_ref") {
+    direction = Direction::to_ref;
+  } else if (parser.get<std::string>("direction") == "to_robot") {
+    direction = Direction::to_robot;
+  } else {
+    std::cerr << "The direction must be to_ref or to_robot\n\n";
+    parser.printMessage();
+    return 1;
+  }
+  std::vector<map_transformer::Point2D> queries;
+  if (parser.get<std::string>("queries").size() != 0 &&
+    !read_points(parser.get<std::string>("queries"), queries))
+  {
+    return 1;
+  }
+  std::vector<map_transformer::Point2D> trajectory;
+  if (parser.get<std::string>("trajectory").size() != 0 &&
+    !read_points(parser.get<std::string>("trajectory"), trajectory))
+  {
+    return 1;
+  }
 
   std::cout << "Loading configuration from " << parser.get<std::string>("map-info-file") << '\n';
 
@@ -163,6 +339,11 @@ int main(int argc, char ** argv)
   sstr << yaml_file.rdbuf();
   std::string yaml_doc(sstr.str());
 
+  if (parser.get<bool>("per-direction")) {
+    transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  }
+  // The images are loaded with OpenCV below, so check their sizes the same way
+  transformer.set_image_size_reader(map_transformer::read_image_size_with_opencv);
   transformer.load(yaml_doc);
 
   // Load the map images for the visualisation background
@@ -185,15 +366,44 @@ int main(int argc, char ** argv)
     draw_triangulation(
       ref_map_image,
       transformer.ref_map_corr_points(),
-      transformer.triangle_indices(),
+      transformer.ref_map_triangle_indices(),
       parser.get<bool>("number-triangles"));
     draw_triangulation(
       robot_map_image,
       transformer.robot_map_corr_points(),
-      transformer.triangle_indices(),
+      transformer.robot_map_triangle_indices(),
       parser.get<bool>("number-triangles"));
   }
 
+  // Each set of points is transformed as a single batch, as a program using the library would
+  if (!queries.empty()) {
+    std::chrono::duration<double> elapsed;
+    auto results = transform(direction, queries, elapsed);
+    draw_queries(direction, queries, results);
+    print_statistics("Queries", results, elapsed);
+  }
+  if (!trajectory.empty()) {
+    std::chrono::duration<double> elapsed;
+    auto results = transform(direction, trajectory, elapsed);
+    draw_trajectory(direction, trajectory, results);
+    print_statistics("Trajectory", results, elapsed);
+    print_trajectory_statistics(direction, trajectory, results);
+  }
+
+  auto output = parser.get<std::string>("output");
+  if (output.size() != 0) {
+    if (!cv::imwrite(output + "_ref.png", ref_map_image)) {
+      std::cerr << "Could not write " << output << "_ref.png\n";
+      return 1;
+    }
+    if (!cv::imwrite(output + "_robot.png", robot_map_image)) {
+      std::cerr << "Could not write " << output << "_robot.png\n";
+      return 1;
+    }
+    std::cout << "Wrote " << output << "_ref.png and " << output << "_robot.png\n";
+    return 0;
+  }
+
   cv::namedWindow("Reference map", cv::WINDOW_NORMAL);
   cv::namedWindow("Robot map", cv::WINDOW_NORMAL);
   cv::imshow("Reference map", ref_map_image);
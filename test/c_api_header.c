@@ -0,0 +1,25 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks that the C interface can be used from C
+#include "map_transformer/c_api.h"
+
+unsigned int c_api_version_from_c(void)
+{
+  map_transformer_t * transformer = map_transformer_create();
+  map_transformer_status_t status = map_transformer_to_ref_float(
+    transformer, 0, NULL, NULL, 0, NULL, NULL, 0);
+  map_transformer_destroy(transformer);
+  return status == MAP_TRANSFORMER_OK ? map_transformer_api_version() : 0;
+}
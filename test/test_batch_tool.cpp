@@ -0,0 +1,231 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include "test_helpers.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::Transformer;
+using map_transformer::test::EmbeddedMapYamlDoc;
+using map_transformer::test::EmbeddedMapYamlFile;
+using map_transformer::test::RandomPoints;
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    directory = std::filesystem::temp_directory_path() /
+      ("map_transformer_test_batch_tool_" +
+      std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    map_file = EmbeddedMapYamlFile();
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(directory);
+  }
+
+  // Run the tool with the given arguments, returning its exit status
+  int Run(std::string const &arguments) {
+    std::string command = std::string(MAP_TRANSFORM_BATCH) + " --map-info-file=" + map_file +
+      " " + arguments + " 2>" + Path("stderr.txt");
+    return std::system(command.c_str());
+  }
+
+  std::string Path(std::string const &name) {
+    return (directory / name).string();
+  }
+
+  std::string ReadFile(std::string const &name) {
+    std::ifstream file(Path(name), std::ios::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  std::filesystem::path directory;
+  std::string map_file;
+};
+
+
+TEST_F(TestData, csv_matches_transformer) {
+  // Enough points for several blocks, with blank lines, white space and carriage returns
+  auto points = RandomPoints(400000);
+  {
+    std::ofstream input(Path("points.csv"));
+    input.precision(9);
+    for (std::size_t ii = 0; ii < points.size(); ++ii) {
+      if (ii % 1000 == 0) {
+        input << "\n";
+      }
+      input << points[ii].first << (ii % 3 == 0 ? " , " : ",") << points[ii].second <<
+        (ii % 7 == 0 ? "\r\n" : "\n");
+    }
+  }
+  ASSERT_EQ(Run("--direction=to_ref --threads=3 -q -o=" + Path("out.csv") + " " +
+    Path("points.csv")), 0) << ReadFile("stderr.txt");
+
+  auto expected = Transformer(EmbeddedMapYamlDoc()).to_ref(points);
+  std::istringstream output(ReadFile("out.csv"));
+  std::string line;
+  std::size_t count = 0;
+  while (std::getline(output, line)) {
+    ASSERT_LT(count, expected.size());
+    auto comma = line.find(',');
+    ASSERT_NE(comma, std::string::npos);
+    float x = std::strtof(line.c_str(), nullptr);
+    float y = std::strtof(line.c_str() + comma + 1, nullptr);
+    ASSERT_EQ(std::memcmp(&x, &expected[count].first, sizeof(float)), 0) << line;
+    ASSERT_EQ(std::memcmp(&y, &expected[count].second, sizeof(float)), 0) << line;
+    ++count;
+  }
+  ASSERT_EQ(count, expected.size());
+}
+
+TEST_F(TestData, binary_matches_transformer) {
+  // The points are split across a file and standard input, and are not a whole number of blocks
+  auto points = RandomPoints(1200000);
+  std::size_t split = 700001;
+  {
+    std::ofstream first(Path("first.bin"), std::ios::binary);
+    first.write(reinterpret_cast<char const *>(points.data()), split * sizeof(Point2D));
+    std::ofstream second(Path("second.bin"), std::ios::binary);
+    second.write(
+      reinterpret_cast<char const *>(points.data() + split),
+      (points.size() - split) * sizeof(Point2D));
+  }
+  ASSERT_EQ(Run("-d=to_robot -f=binary -p -o=" + Path("out.bin") + " " + Path("first.bin") +
+    " - < " + Path("second.bin")), 0) << ReadFile("stderr.txt");
+  ASSERT_NE(ReadFile("stderr.txt").find("Transformed 1200000 points"), std::string::npos);
+
+  Transformer transformer;
+  transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  transformer.load(EmbeddedMapYamlDoc());
+  auto expected = transformer.to_robot(points);
+  auto output = ReadFile("out.bin");
+  ASSERT_EQ(output.size(), expected.size() * sizeof(Point2D));
+  ASSERT_EQ(std::memcmp(output.data(), expected.data(), output.size()), 0);
+}
+
+#if defined(MAP_TRANSFORM_BATCH_MMAP)
+TEST_F(TestData, mapped_file_matches_transformer) {
+  // More points than fit in one mapped window
+  auto points = RandomPoints(2500000);
+  {
+    std::ofstream input(Path("points.bin"), std::ios::binary);
+    input.write(reinterpret_cast<char const *>(points.data()), points.size() * sizeof(Point2D));
+  }
+  ASSERT_EQ(Run("-d=to_ref -f=binary --mmap --progress -t=2 -o=" + Path("out.bin") + " " +
+    Path("points.bin")), 0) << ReadFile("stderr.txt");
+  ASSERT_NE(ReadFile("stderr.txt").find("100% transformed"), std::string::npos);
+
+  auto expected = Transformer(EmbeddedMapYamlDoc()).to_ref(points);
+  auto output = ReadFile("out.bin");
+  ASSERT_EQ(output.size(), expected.size() * sizeof(Point2D));
+  ASSERT_EQ(std::memcmp(output.data(), expected.data(), output.size()), 0);
+
+  // An empty file is transformed to an empty file
+  std::ofstream(Path("empty.bin"), std::ios::binary);
+  ASSERT_EQ(Run("-d=to_ref -f=binary --mmap -o=" + Path("out.bin") + " " +
+    Path("empty.bin")), 0) << ReadFile("stderr.txt");
+  ASSERT_EQ(ReadFile("out.bin").size(), 0u);
+
+  // The input cannot be transformed into itself, and must be a single file
+  ASSERT_NE(Run("-d=to_ref -f=binary --mmap -o=" + Path("points.bin") + " " +
+    Path("points.bin")), 0);
+  ASSERT_EQ(ReadFile("points.bin").size(), points.size() * sizeof(Point2D));
+  ASSERT_NE(Run("-d=to_ref -f=binary --mmap -o=" + Path("out.bin") + " < " +
+    Path("points.bin")), 0);
+}
+#else
+TEST_F(TestData, mapped_file_not_available) {
+  std::ofstream(Path("points.bin"), std::ios::binary);
+  ASSERT_NE(Run("-d=to_ref -f=binary --mmap -o=" + Path("out.bin") + " " +
+    Path("points.bin")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("not available on this platform"), std::string::npos);
+}
+#endif
+
+TEST_F(TestData, batch_tool_errors) {
+  {
+    std::ofstream input(Path("invalid.csv"));
+    input << "1,2\n\n3;4\n5,6";
+  }
+  ASSERT_NE(Run("--direction=to_ref -o=" + Path("out.csv") + " " + Path("invalid.csv")), 0);
+  ASSERT_NE(
+    ReadFile("stderr.txt").find(Path("invalid.csv") + ":3: Invalid point: 3;4"),
+    std::string::npos);
+
+  // Lines are counted from the start of each input file
+  {
+    std::ofstream first(Path("first.csv"));
+    first << "1,2\n3,4\n";
+    std::ofstream second(Path("second.csv"));
+    second << "5,6\n7;8\n";
+  }
+  ASSERT_NE(Run("--direction=to_ref -o=" + Path("out.csv") + " " + Path("first.csv") + " " +
+    Path("second.csv")), 0);
+  ASSERT_NE(
+    ReadFile("stderr.txt").find(Path("second.csv") + ":2: Invalid point: 7;8"),
+    std::string::npos);
+
+  // Values must follow an equals sign, and unknown options are not ignored
+  ASSERT_NE(Run("--direction=to_ref -o " + Path("out.csv") + " " + Path("first.csv")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("The output option needs a value"), std::string::npos);
+  ASSERT_FALSE(std::filesystem::exists("true"));
+  ASSERT_NE(Run("--direction=to_ref --outptu=" + Path("out.csv") + " " + Path("first.csv")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("Unknown option: --outptu"), std::string::npos);
+
+  // Thread counts are checked, and switches do not take values
+  for (auto const &threads : {"-1", "0", "4x", "", "1025", "99999999999999999999"}) {
+    ASSERT_NE(Run("--direction=to_ref -t=" + std::string(threads) + " " + Path("first.csv")), 0);
+    ASSERT_NE(
+      ReadFile("stderr.txt").find("The threads option must be a whole number from 1 to 1024"),
+      std::string::npos);
+  }
+  ASSERT_EQ(
+    Run("--direction=to_ref -t=3 -o=" + Path("out.csv") + " " + Path("first.csv")), 0);
+  ASSERT_NE(Run("--direction=to_ref --quiet=no " + Path("first.csv")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("The quiet option does not take a value"),
+    std::string::npos);
+  ASSERT_NE(Run("--direction=to_ref -f=binary --mmap=false -o=" + Path("out.bin") + " " +
+    Path("first.csv")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("The mmap option does not take a value"),
+    std::string::npos);
+
+  {
+    std::ofstream input(Path("truncated.bin"), std::ios::binary);
+    input.write("123456789", 9);
+  }
+  ASSERT_NE(Run("--direction=to_ref -f=binary -o=" + Path("out.bin") + " " +
+    Path("truncated.bin")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("part of the way through a point"), std::string::npos);
+
+  ASSERT_NE(Run("-o=" + Path("out.csv") + " " + Path("invalid.csv")), 0);
+  ASSERT_NE(Run("--direction=to_ref " + Path("missing.csv")), 0);
+  ASSERT_NE(ReadFile("stderr.txt").find("Could not open"), std::string::npos);
+}
@@ -0,0 +1,196 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/c_api.h"
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include "test_helpers.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::Transformer;
+using map_transformer::test::EmbeddedMapYamlDoc;
+using map_transformer::test::RandomPoints;
+
+extern "C" unsigned int c_api_version_from_c(void);
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    yaml_doc = EmbeddedMapYamlDoc();
+    handle = map_transformer_create();
+    ASSERT_NE(handle, nullptr);
+  }
+
+  void TearDown() override {
+    map_transformer_destroy(handle);
+  }
+
+  static bool Identical(float expected, float actual) {
+    return std::memcmp(&expected, &actual, sizeof(float)) == 0;
+  }
+
+  std::string yaml_doc;
+  map_transformer_t * handle{nullptr};
+};
+
+
+TEST_F(TestData, c_api_transforms_match_transformer) {
+  ASSERT_EQ(map_transformer_api_version(), MAP_TRANSFORMER_C_API_VERSION);
+  ASSERT_EQ(c_api_version_from_c(), MAP_TRANSFORMER_C_API_VERSION);
+  ASSERT_EQ(
+    map_transformer_load_yaml(handle, yaml_doc.data(), yaml_doc.size()),
+    MAP_TRANSFORMER_OK);
+  Transformer transformer(yaml_doc);
+
+  // More points than are transformed at a time, in interleaved and separate arrays
+  auto points = RandomPoints(1000);
+  auto expected_ref = transformer.to_ref(points);
+  auto expected_robot = transformer.to_robot(points);
+  std::vector<float> interleaved;
+  std::vector<double> x, y;
+  for (auto const &p : points) {
+    interleaved.push_back(p.first);
+    interleaved.push_back(p.second);
+    x.push_back(p.first);
+    y.push_back(p.second);
+  }
+
+  std::vector<float> result(interleaved.size());
+  ASSERT_EQ(
+    map_transformer_to_ref_float(
+      handle, points.size(), interleaved.data(), interleaved.data() + 1, 2 * sizeof(float),
+      result.data(), result.data() + 1, 2 * sizeof(float)),
+    MAP_TRANSFORMER_OK);
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    ASSERT_TRUE(Identical(expected_ref[ii].first, result[2 * ii]));
+    ASSERT_TRUE(Identical(expected_ref[ii].second, result[2 * ii + 1]));
+  }
+
+  // In place
+  ASSERT_EQ(
+    map_transformer_to_robot_float(
+      handle, points.size(), interleaved.data(), interleaved.data() + 1, 2 * sizeof(float),
+      interleaved.data(), interleaved.data() + 1, 2 * sizeof(float)),
+    MAP_TRANSFORMER_OK);
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    ASSERT_TRUE(Identical(expected_robot[ii].first, interleaved[2 * ii]));
+    ASSERT_TRUE(Identical(expected_robot[ii].second, interleaved[2 * ii + 1]));
+  }
+
+  std::vector<double> result_x(points.size()), result_y(points.size());
+  ASSERT_EQ(
+    map_transformer_to_ref_double(
+      handle, points.size(), x.data(), y.data(), sizeof(double),
+      result_x.data(), result_y.data(), sizeof(double)),
+    MAP_TRANSFORMER_OK);
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    ASSERT_EQ(result_x[ii], expected_ref[ii].first);
+    ASSERT_EQ(result_y[ii], expected_ref[ii].second);
+  }
+  ASSERT_EQ(
+    map_transformer_to_robot_double(
+      handle, points.size(), x.data(), y.data(), sizeof(double),
+      result_x.data(), result_y.data(), sizeof(double)),
+    MAP_TRANSFORMER_OK);
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    ASSERT_EQ(result_x[ii], expected_robot[ii].first);
+    ASSERT_EQ(result_y[ii], expected_robot[ii].second);
+  }
+}
+
+TEST_F(TestData, c_api_snapshots) {
+  ASSERT_EQ(
+    map_transformer_load_yaml(handle, yaml_doc.data(), yaml_doc.size()),
+    MAP_TRANSFORMER_OK);
+
+  std::size_t size{0};
+  ASSERT_EQ(
+    map_transformer_save_snapshot(handle, nullptr, 0, &size),
+    MAP_TRANSFORMER_BUFFER_TOO_SMALL);
+  std::vector<char> snapshot(size);
+  ASSERT_EQ(
+    map_transformer_save_snapshot(handle, snapshot.data(), snapshot.size() - 1, &size),
+    MAP_TRANSFORMER_BUFFER_TOO_SMALL);
+  ASSERT_EQ(
+    map_transformer_save_snapshot(handle, snapshot.data(), snapshot.size(), &size),
+    MAP_TRANSFORMER_OK);
+  ASSERT_EQ(size, snapshot.size());
+
+  map_transformer_t * loaded = map_transformer_create();
+  ASSERT_EQ(
+    map_transformer_load_snapshot(loaded, snapshot.data(), snapshot.size()),
+    MAP_TRANSFORMER_OK);
+  auto points = RandomPoints(300);
+  std::vector<float> expected(2 * points.size()), actual(2 * points.size());
+  map_transformer_to_ref_float(
+    handle, points.size(), &points[0].first, &points[0].second, sizeof(Point2D),
+    expected.data(), expected.data() + 1, 2 * sizeof(float));
+  ASSERT_EQ(
+    map_transformer_to_ref_float(
+      loaded, points.size(), &points[0].first, &points[0].second, sizeof(Point2D),
+      actual.data(), actual.data() + 1, 2 * sizeof(float)),
+    MAP_TRANSFORMER_OK);
+  ASSERT_EQ(std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)), 0);
+
+  // A failed load leaves the transformer empty
+  ASSERT_EQ(
+    map_transformer_load_snapshot(loaded, snapshot.data(), snapshot.size() / 2),
+    MAP_TRANSFORMER_LOAD_FAILED);
+  ASSERT_STRNE(map_transformer_last_error(), "");
+  ASSERT_EQ(
+    map_transformer_to_ref_float(
+      loaded, points.size(), &points[0].first, &points[0].second, sizeof(Point2D),
+      actual.data(), actual.data() + 1, 2 * sizeof(float)),
+    MAP_TRANSFORMER_NOT_LOADED);
+  map_transformer_destroy(loaded);
+}
+
+TEST_F(TestData, c_api_errors) {
+  float x{1}, y{2};
+  ASSERT_EQ(
+    map_transformer_to_ref_float(handle, 1, &x, &y, 0, &x, &y, 0),
+    MAP_TRANSFORMER_NOT_LOADED);
+  ASSERT_EQ(
+    map_transformer_to_ref_float(nullptr, 1, &x, &y, 0, &x, &y, 0),
+    MAP_TRANSFORMER_INVALID_ARGUMENT);
+  ASSERT_EQ(
+    map_transformer_to_robot_float(handle, 1, nullptr, &y, 0, &x, &y, 0),
+    MAP_TRANSFORMER_INVALID_ARGUMENT);
+  std::size_t size;
+  ASSERT_EQ(map_transformer_save_snapshot(handle, nullptr, 0, &size), MAP_TRANSFORMER_NOT_LOADED);
+
+  std::string not_a_map = "This is not a YAML document.";
+  ASSERT_EQ(
+    map_transformer_load_yaml(handle, not_a_map.data(), not_a_map.size()),
+    MAP_TRANSFORMER_LOAD_FAILED);
+  ASSERT_STRNE(map_transformer_last_error(), "");
+  ASSERT_EQ(map_transformer_load_yaml(nullptr, nullptr, 0), MAP_TRANSFORMER_INVALID_ARGUMENT);
+
+  // Loading replaces the map information already loaded
+  ASSERT_EQ(
+    map_transformer_load_yaml(handle, yaml_doc.data(), yaml_doc.size()),
+    MAP_TRANSFORMER_OK);
+  ASSERT_EQ(
+    map_transformer_load_yaml(handle, yaml_doc.data(), yaml_doc.size()),
+    MAP_TRANSFORMER_OK);
+  ASSERT_EQ(map_transformer_to_ref_float(handle, 1, &x, &y, 0, &x, &y, 0), MAP_TRANSFORMER_OK);
+}
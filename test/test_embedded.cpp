@@ -0,0 +1,119 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/embedded.hpp"
+#include "map_transformer/embedded_generator.hpp"
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/transformer.hpp"
+
+// Generated from embedded_map.yaml at build time
+#include "embedded_test_map.hpp"
+#include "embedded_test_map_per_direction.hpp"
+
+#include "test_helpers.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::EmbeddedMapGenerator;
+using map_transformer::Point2D;
+using map_transformer::Transformer;
+using map_transformer::TriangulationMode;
+using map_transformer::test::EmbeddedMapYamlDoc;
+using map_transformer::test::RandomPoints;
+namespace embedded = map_transformer::embedded;
+
+
+class TestData : public ::testing::Test {
+protected:
+  // Random points over and around both maps, the correspondence points, and the midpoints of the
+  // edges between them, where the choice of triangle is most sensitive to rounding
+  std::vector<Point2D> QueryPoints(Transformer const &transformer) {
+    auto points = RandomPoints(20000, 42, -100.0f, 500.0f);
+    auto add_edge_midpoints = [&points](
+      map_transformer::CorrespondencePoints const &corr_points,
+      map_transformer::TriangleList const &triangles) {
+        points.insert(std::end(points), std::begin(corr_points), std::end(corr_points));
+        for (auto const &t : triangles) {
+          int vertices[3] = {std::get<0>(t), std::get<1>(t), std::get<2>(t)};
+          for (int ii = 0; ii < 3; ++ii) {
+            auto const &a = corr_points[vertices[ii]];
+            auto const &b = corr_points[vertices[(ii + 1) % 3]];
+            points.emplace_back((a.first + b.first) / 2, (a.second + b.second) / 2);
+          }
+        }
+      };
+    add_edge_midpoints(transformer.ref_map_corr_points(), transformer.ref_map_triangle_indices());
+    add_edge_midpoints(
+      transformer.robot_map_corr_points(), transformer.robot_map_triangle_indices());
+    return points;
+  }
+
+  // Whether two points are identical, bit for bit
+  static bool Identical(Point2D const &expected, embedded::Point const &actual) {
+    return std::memcmp(&expected.first, &actual.x, sizeof(float)) == 0 &&
+           std::memcmp(&expected.second, &actual.y, sizeof(float)) == 0;
+  }
+
+  template<typename Map>
+  void ExpectIdenticalResults(Transformer const &transformer) {
+    for (auto const &point : QueryPoints(transformer)) {
+      embedded::Point query{point.first, point.second};
+      auto to_ref = embedded::to_ref<Map>(query);
+      ASSERT_TRUE(Identical(transformer.to_ref(point), to_ref)) <<
+        "to_ref(" << point.first << ", " << point.second << ")";
+      auto to_robot = embedded::to_robot<Map>(query);
+      ASSERT_TRUE(Identical(transformer.to_robot(point), to_robot)) <<
+        "to_robot(" << point.first << ", " << point.second << ")";
+    }
+  }
+};
+
+
+TEST_F(TestData, embedded_matches_transformer)
+{
+  Transformer transformer(EmbeddedMapYamlDoc());
+  ASSERT_GT(embedded_test_map::Map::to_ref.triangle_count, 0u);
+  ExpectIdenticalResults<embedded_test_map::Map>(transformer);
+}
+
+TEST_F(TestData, embedded_matches_transformer_per_direction)
+{
+  Transformer transformer;
+  transformer.set_triangulation_mode(TriangulationMode::per_direction);
+  transformer.load(EmbeddedMapYamlDoc());
+  ExpectIdenticalResults<embedded_test_map_per_direction::Map>(transformer);
+}
+
+TEST_F(TestData, embedded_generator_errors)
+{
+  std::ostringstream output;
+  Transformer empty;
+  EXPECT_THROW(EmbeddedMapGenerator::write(empty, "name", output), std::logic_error);
+
+  Transformer transformer(EmbeddedMapYamlDoc());
+  EXPECT_THROW(EmbeddedMapGenerator::write(transformer, "", output), std::invalid_argument);
+  EXPECT_THROW(EmbeddedMapGenerator::write(transformer, "1map", output), std::invalid_argument);
+  EXPECT_THROW(EmbeddedMapGenerator::write(transformer, "my-map", output), std::invalid_argument);
+  EXPECT_TRUE(output.str().empty());
+
+  EmbeddedMapGenerator::write(transformer, "my_map", output);
+  EXPECT_NE(output.str().find("namespace my_map {"), std::string::npos);
+  EXPECT_NE(output.str().find("#ifndef MY_MAP_HPP_"), std::string::npos);
+}
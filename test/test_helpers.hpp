@@ -0,0 +1,65 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MAP_TRANSFORMER__TEST_HELPERS_HPP_
+#define MAP_TRANSFORMER__TEST_HELPERS_HPP_
+
+// Test data shared by the tests that transform points with embedded_map.yaml
+
+#include <cstddef>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/transformer.hpp"
+
+namespace map_transformer {
+namespace test {
+
+// The path of the map information used by most of the tests
+inline std::string EmbeddedMapYamlFile() {
+  return std::string(TEST_DATA_DIRECTORY) + "/embedded_map.yaml";
+}
+
+inline std::string EmbeddedMapYamlDoc() {
+  std::ifstream file(EmbeddedMapYamlFile());
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Points chosen at random from [min, max) in each axis; the defaults cover both maps of
+// embedded_map.yaml and some of the area around them
+inline std::vector<Point2D> RandomPoints(
+  std::size_t count,
+  unsigned int seed = 42,
+  float min = -50.0f,
+  float max = 400.0f)
+{
+  std::vector<Point2D> points;
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> coordinate(min, max);
+  for (std::size_t ii = 0; ii < count; ++ii) {
+    points.emplace_back(coordinate(generator), coordinate(generator));
+  }
+  return points;
+}
+
+}  // namespace test
+}  // namespace map_transformer
+
+#endif  // MAP_TRANSFORMER__TEST_HELPERS_HPP_
@@ -18,8 +18,12 @@
 #include <gtest/gtest.h>
 #include <yaml-cpp/yaml.h>
 
+#include <filesystem>
+#include <fstream>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 using map_transformer::test::TEST_DATA_DIRECTORY;
 
@@ -867,6 +871,98 @@ TEST_F(TestData, load_nonexistent_robot_map_image_file) {
     std::runtime_error);
 }
 
+TEST_F(TestData, load_non_image_map_image_file) {
+  // Files that exist but are not images, or are only partly written, are rejected
+  auto yaml = RefMapImageFileDoesntExistYamlDoc();
+  auto position = yaml.find("/nonexistent.png");
+  auto text_file = yaml;
+  text_file.replace(position, std::string("/nonexistent.png").size(), "/test_loading.cpp");
+  ASSERT_THROW(map_transformer::Transformer transformer(text_file), std::runtime_error);
+
+  auto partial_file = std::filesystem::temp_directory_path() / "map_transformer_partial.png";
+  {
+    std::ifstream png(std::string(TEST_DATA_DIRECTORY) + "/aligned_map_ref.png", std::ios::binary);
+    char header[12];
+    png.read(header, sizeof(header));
+    std::ofstream partial(partial_file, std::ios::binary);
+    partial.write(header, sizeof(header));
+  }
+  auto partial_image = yaml;
+  partial_image.replace(
+    position - std::string(TEST_DATA_DIRECTORY).size(),
+    std::string(TEST_DATA_DIRECTORY).size() + std::string("/nonexistent.png").size(),
+    partial_file.string());
+  ASSERT_THROW(map_transformer::Transformer transformer(partial_image), std::runtime_error);
+  std::filesystem::remove(partial_file);
+
+  // Skipping the check must be asked for
+  map_transformer::set_default_image_size_reader(nullptr);
+  map_transformer::Transformer unchecked;
+  map_transformer::set_default_image_size_reader(map_transformer::read_image_header_size);
+  ASSERT_NO_THROW(unchecked.load(text_file));
+  ASSERT_THROW(map_transformer::Transformer transformer(text_file), std::runtime_error);
+}
+
+TEST_F(TestData, load_with_image_size_reader) {
+  // An empty reader or one that cannot tell the size skips the check
+  map_transformer::Transformer transformer;
+  transformer.set_image_size_reader(nullptr);
+  ASSERT_NO_THROW(transformer.load(YamlAndRefImageDiffSizesYamlDoc()));
+
+  transformer.reset();
+  int calls{0};
+  transformer.set_image_size_reader(
+    [&calls](std::string const &) -> std::optional<map_transformer::Vector2D> {
+      ++calls;
+      return std::nullopt;
+    });
+  ASSERT_NO_THROW(transformer.load(YamlAndRobotImageDiffSizesYamlDoc()));
+  ASSERT_EQ(calls, 2);
+
+  transformer.reset();
+  transformer.set_image_size_reader(
+    [](std::string const &) -> std::optional<map_transformer::Vector2D> {
+      return map_transformer::Vector2D{694, 387};
+    });
+  ASSERT_THROW(transformer.load(CorrectYamlDoc()), std::runtime_error);
+}
+
+TEST(TestLoading, read_image_header_sizes) {
+  auto size = map_transformer::read_image_header_size(
+    std::string(TEST_DATA_DIRECTORY) + "/aligned_map_ref.png");
+  ASSERT_TRUE(size);
+  ASSERT_EQ(*size, map_transformer::Vector2D(694, 386));
+  size = map_transformer::read_image_header_size(
+    std::string(TEST_DATA_DIRECTORY) + "/robot_map_80_110.png");
+  ASSERT_TRUE(size);
+  ASSERT_EQ(*size, map_transformer::Vector2D(80, 110));
+
+  // Netpbm headers may contain comments
+  auto pgm_file = std::filesystem::temp_directory_path() / "map_transformer_test_map.pgm";
+  {
+    std::ofstream pgm(pgm_file, std::ios::binary);
+    pgm << "P5\n# CREATOR: map_saver\n640 480\n255\n";
+  }
+  size = map_transformer::read_image_header_size(pgm_file.string());
+  ASSERT_TRUE(size);
+  ASSERT_EQ(*size, map_transformer::Vector2D(640, 480));
+  {
+    std::ofstream pgm(pgm_file, std::ios::binary);
+    pgm << "P5\n640 ";
+  }
+  ASSERT_THROW(map_transformer::read_image_header_size(pgm_file.string()), std::runtime_error);
+  std::filesystem::remove(pgm_file);
+
+  ASSERT_THROW(
+    map_transformer::read_image_header_size(
+      std::string(TEST_DATA_DIRECTORY) + "/ref_map_100_100.svg"),
+    std::runtime_error);
+  ASSERT_THROW(
+    map_transformer::read_image_header_size(
+      std::string(TEST_DATA_DIRECTORY) + "/no_such_image.png"),
+    std::runtime_error);
+}
+
 TEST(TestLoading, load_no_data_is_logic_error) {
   map_transformer::Transformer transformer;
 
@@ -887,3 +983,158 @@ TEST(TestLoading, load_no_data_is_logic_error) {
   ASSERT_THROW(transformer.to_ref(point), std::logic_error);
   ASSERT_THROW(transformer.to_robot(point), std::logic_error);
 }
+
+TEST(TestLoading, load_locations) {
+  auto doc = R"(ref_map:
+  name: reference
+  size: [100, 100]
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+    - [40, 20]
+    - [70, 20]
+robot_map:
+  name: robot
+  size: [80, 110]
+  transform:
+    scale: [1, 1]
+    rotation: 0
+    translation: [30, 20]
+  correspondence_points:
+    - [0, 0]
+    - [10, 20]
+    - [46, 20]
+    - [10, 0]
+    - [50, 0]
+locations:
+  - name: charger
+    ref: [40, 50]
+  - name: dock
+    robot: [30, 10]
+  - name: lift door
+    ref: [55.5, 30.25]
+)";
+  map_transformer::Transformer transformer(doc);
+  ASSERT_EQ(transformer.locations().size(), 3u);
+  ASSERT_EQ(transformer.location_id("charger"), 0);
+  ASSERT_EQ(transformer.location_id("dock"), 1);
+  ASSERT_EQ(transformer.location_id("lift door"), 2);
+  ASSERT_EQ(transformer.location_id("lift"), -1);
+
+  auto const &charger = transformer.location("charger");
+  ASSERT_EQ(charger.frame, map_transformer::MapFrame::ref);
+  ASSERT_EQ(charger.ref_position, (map_transformer::Point2D{40, 50}));
+  ASSERT_EQ(charger.robot_position, (map_transformer::Point2D{10, 20}));
+  auto const &dock = transformer.location(1);
+  ASSERT_EQ(dock.name, "dock");
+  ASSERT_EQ(dock.frame, map_transformer::MapFrame::robot);
+  ASSERT_EQ(dock.ref_position, transformer.to_ref(map_transformer::Point2D{30, 10}));
+  auto const &door = transformer.location("lift door");
+  ASSERT_EQ(door.robot_position, transformer.to_robot(map_transformer::Point2D{55.5, 30.25}));
+
+  ASSERT_THROW(transformer.location("lift"), std::out_of_range);
+  ASSERT_THROW(transformer.location(3), std::out_of_range);
+
+  // The positions are recalculated if the triangulation changes
+  transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  ASSERT_EQ(
+    transformer.location(2).robot_position,
+    transformer.to_robot(map_transformer::Point2D{55.5, 30.25}));
+
+  transformer.reset();
+  ASSERT_THROW(transformer.locations(), std::logic_error);
+  ASSERT_THROW(transformer.location_id("dock"), std::logic_error);
+  ASSERT_THROW(transformer.location(0), std::logic_error);
+}
+
+TEST(TestLoading, load_invalid_locations) {
+  std::string maps = R"(ref_map:
+  name: reference
+  size: [100, 100]
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+robot_map:
+  name: robot
+  size: [100, 100]
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+)";
+  map_transformer::Transformer transformer(maps);
+  ASSERT_TRUE(transformer.locations().empty());
+  ASSERT_EQ(transformer.location_id("dock"), -1);
+
+  ASSERT_THROW(
+    map_transformer::Transformer(maps + "locations:\n  - name: dock\n"),
+    std::runtime_error);
+  ASSERT_THROW(
+    map_transformer::Transformer(
+      maps + "locations:\n  - name: dock\n    ref: [1, 2]\n    robot: [1, 2]\n"),
+    std::runtime_error);
+  ASSERT_THROW(
+    map_transformer::Transformer(
+      maps + "locations:\n  - name: dock\n    ref: [1, 2]\n  - name: dock\n    robot: [3, 4]\n"),
+    std::runtime_error);
+  ASSERT_THROW(
+    map_transformer::Transformer(maps + "locations:\n  - ref: [1, 2]\n"),
+    std::runtime_error);
+}
+
+TEST_F(TestData, load_snapshot) {
+  map_transformer::Transformer original;
+  original.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  original.load(CorrectYamlDoc() + "\nlocations:\n  - name: dock\n    robot: [300, 200]\n");
+  auto snapshot = original.snapshot();
+
+  map_transformer::Transformer loaded;
+  loaded.load_snapshot(snapshot.data(), snapshot.size());
+  ASSERT_EQ(loaded.triangulation_mode(), map_transformer::TriangulationMode::per_direction);
+  ASSERT_EQ(loaded.ref_map_name(), original.ref_map_name());
+  ASSERT_EQ(loaded.robot_map_image_file(), original.robot_map_image_file());
+  ASSERT_EQ(loaded.robot_map_scale(), original.robot_map_scale());
+  ASSERT_EQ(loaded.ref_map_corr_points(), original.ref_map_corr_points());
+  ASSERT_EQ(loaded.ref_map_triangle_indices(), original.ref_map_triangle_indices());
+  ASSERT_EQ(loaded.robot_map_triangle_indices(), original.robot_map_triangle_indices());
+  ASSERT_EQ(loaded.location("dock").ref_position, original.location("dock").ref_position);
+  ASSERT_EQ(loaded.snapshot(), snapshot);
+  for (float x = -10; x < 700; x += 7.3f) {
+    for (float y = -10; y < 400; y += 5.1f) {
+      ASSERT_EQ(loaded.to_ref({x, y}), original.to_ref({x, y}));
+      ASSERT_EQ(loaded.to_robot({x, y}), original.to_robot({x, y}));
+    }
+  }
+
+  ASSERT_THROW(loaded.load_snapshot(snapshot.data(), snapshot.size()), std::logic_error);
+  for (auto size : {std::size_t{0}, std::size_t{10}, snapshot.size() - 1}) {
+    map_transformer::Transformer truncated;
+    ASSERT_THROW(truncated.load_snapshot(snapshot.data(), size), std::runtime_error);
+  }
+  auto corrupt = snapshot;
+  corrupt[0] = 'X';
+  map_transformer::Transformer transformer;
+  ASSERT_THROW(transformer.load_snapshot(corrupt.data(), corrupt.size()), std::runtime_error);
+  ASSERT_THROW(map_transformer::Transformer().snapshot(), std::logic_error);
+}
+
+TEST(TestLoading, location_table_lookups) {
+  std::vector<map_transformer::NamedLocation> locations;
+  for (int ii = 0; ii < 500; ++ii) {
+    map_transformer::NamedLocation location;
+    location.name = "waypoint " + std::to_string(ii);
+    locations.push_back(location);
+  }
+  map_transformer::LocationTable table;
+  table.build(locations);
+  for (int ii = 0; ii < 500; ++ii) {
+    ASSERT_EQ(table.find("waypoint " + std::to_string(ii)), ii);
+    ASSERT_EQ(table.find("waypoint " + std::to_string(ii + 500)), -1);
+  }
+
+  locations.push_back(locations[123]);
+  ASSERT_THROW(table.build(locations), std::runtime_error);
+  ASSERT_EQ(table.find("waypoint 0"), -1);
+}
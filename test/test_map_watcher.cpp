@@ -0,0 +1,209 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/map_watcher.hpp"
+#include "map_transformer/test_config.hpp"
+
+#include "test_helpers.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using map_transformer::MapWatcher;
+using map_transformer::MapWatcherOptions;
+using map_transformer::Transformer;
+using map_transformer::test::EmbeddedMapYamlDoc;
+using map_transformer::test::TEST_DATA_DIRECTORY;
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    directory = std::filesystem::temp_directory_path() /
+      ("map_transformer_watcher_" + std::to_string(::getpid()) + "_" +
+      ::testing::UnitTest::GetInstance()->current_test_info()->name());
+    std::filesystem::create_directories(directory);
+    map_file = (directory / "map.yaml").string();
+
+    map_yaml = EmbeddedMapYamlDoc();
+    Write(map_file, map_yaml);
+
+    options.debounce = std::chrono::milliseconds(50);
+    options.on_reload = [this](std::shared_ptr<Transformer const> const &) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++reloads;
+        changed.notify_all();
+      };
+    options.on_error = [this](std::string const &) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++errors;
+        changed.notify_all();
+      };
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove_all(directory.string() + ".old");
+    std::filesystem::remove_all(directory.string() + ".new");
+  }
+
+  // The map information with the robot map renamed
+  std::string RenamedMap(std::string const &name) {
+    auto yaml = map_yaml;
+    auto position = yaml.find("embedded_robot");
+    return yaml.replace(position, std::string("embedded_robot").size(), name);
+  }
+
+  static void Write(std::string const &path, std::string const &contents) {
+    std::ofstream file(path, std::ios::trunc);
+    file << contents;
+  }
+
+  // Write a file and rename it into place, as editors and deployment tools do
+  static void Replace(std::string const &path, std::string const &contents) {
+    Write(path + ".new", contents);
+    std::filesystem::rename(path + ".new", path);
+  }
+
+  // Wait for a number of reloads and errors, returning false if they do not happen in time
+  bool WaitFor(std::size_t expected_reloads, std::size_t expected_errors) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(
+      lock, std::chrono::seconds(10), [&]() {
+        return reloads >= expected_reloads && errors >= expected_errors;
+      });
+  }
+
+  std::filesystem::path directory;
+  std::string map_file;
+  std::string map_yaml;
+  MapWatcherOptions options;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::size_t reloads{0};
+  std::size_t errors{0};
+};
+
+
+TEST_F(TestData, reloads_changed_map) {
+  MapWatcher watcher(map_file, options);
+  auto original = watcher.current();
+  ASSERT_EQ(original->robot_map_name(), "embedded_robot");
+
+  Replace(map_file, RenamedMap("replaced_robot"));
+  ASSERT_TRUE(WaitFor(1, 0));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "replaced_robot");
+  // The map published before is still usable by those holding it
+  ASSERT_EQ(original->robot_map_name(), "embedded_robot");
+  ASSERT_EQ(original->to_ref({10.0f, 10.0f}), watcher.current()->to_ref({10.0f, 10.0f}));
+
+  Write(map_file, RenamedMap("rewritten_robot"));
+  ASSERT_TRUE(WaitFor(2, 0));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "rewritten_robot");
+  ASSERT_EQ(errors, 0u);
+}
+
+TEST_F(TestData, keeps_map_if_invalid) {
+  MapWatcher watcher(map_file, options);
+  auto original = watcher.current();
+
+  Replace(map_file, "ref_map:\n  name: broken\n");
+  ASSERT_TRUE(WaitFor(0, 1));
+  ASSERT_EQ(watcher.current(), original);
+
+  Replace(map_file, RenamedMap("fixed_robot"));
+  ASSERT_TRUE(WaitFor(1, 1));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "fixed_robot");
+
+  ASSERT_THROW(MapWatcher((directory / "missing.yaml").string()), std::runtime_error);
+  Write(map_file, "ref_map:\n  name: broken\n");
+  ASSERT_THROW(MapWatcher watcher(map_file), std::runtime_error);
+}
+
+TEST_F(TestData, debounces_writes) {
+  options.debounce = std::chrono::milliseconds(300);
+  MapWatcher watcher(map_file, options);
+
+  // A burst of writes, each of which changes the file, causes a single reload
+  for (int ii = 0; ii < 20; ++ii) {
+    Write(map_file, RenamedMap("robot_" + std::to_string(ii)));
+  }
+  ASSERT_TRUE(WaitFor(1, 0));
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  ASSERT_EQ(reloads, 1u);
+  ASSERT_EQ(errors, 0u);
+  ASSERT_EQ(watcher.current()->robot_map_name(), "robot_19");
+}
+
+TEST_F(TestData, watches_image_files) {
+  auto image_file = (directory / "ref.png").string();
+  std::filesystem::copy_file(
+    std::string(TEST_DATA_DIRECTORY) + "/ref_map_100_100.png", image_file);
+  auto yaml = map_yaml;
+  yaml.insert(yaml.find("  size:"), "  image_file: " + image_file + "\n");
+  Write(map_file, yaml);
+  // The image does not match the map's size, so only check that it exists
+  options.configure = [](Transformer &map) {
+      map.set_image_size_reader({});
+    };
+  MapWatcher watcher(map_file, options);
+  auto original = watcher.current();
+  ASSERT_EQ(original->ref_map_image_file(), image_file);
+
+  // Without its image the map does not load, so is kept until the image is back
+  std::filesystem::remove(image_file);
+  ASSERT_TRUE(WaitFor(0, 1));
+  ASSERT_EQ(watcher.current(), original);
+  std::filesystem::copy_file(
+    std::string(TEST_DATA_DIRECTORY) + "/ref_map_100_100.png", image_file);
+  ASSERT_TRUE(WaitFor(1, 1));
+  ASSERT_NE(watcher.current(), original);
+}
+
+TEST_F(TestData, watches_replaced_directory) {
+  MapWatcher watcher(map_file, options);
+
+  // A deployment moves a new directory into place of the old one
+  auto replacement = directory.string() + ".new";
+  std::filesystem::create_directories(replacement);
+  Write(replacement + "/map.yaml", RenamedMap("replaced_robot"));
+  std::filesystem::rename(directory, directory.string() + ".old");
+  std::filesystem::rename(replacement, directory);
+  ASSERT_TRUE(WaitFor(1, 0));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "replaced_robot");
+  // The new directory is watched, and the old one no longer is
+  Write(directory.string() + ".old/map.yaml", RenamedMap("old_robot"));
+  Write(map_file, RenamedMap("rewritten_robot"));
+  ASSERT_TRUE(WaitFor(2, 0));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "rewritten_robot");
+
+  // The directory is removed, and only later created again
+  std::filesystem::remove_all(directory);
+  ASSERT_TRUE(WaitFor(2, 1));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "rewritten_robot");
+  std::filesystem::create_directories(directory);
+  Replace(map_file, RenamedMap("restored_robot"));
+  ASSERT_TRUE(WaitFor(3, 1));
+  ASSERT_EQ(watcher.current()->robot_map_name(), "restored_robot");
+}
@@ -0,0 +1,776 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/predicates.hpp"
+#include "map_transformer/transformer.hpp"
+#include "map_transformer/triangle_quality.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::PointLocator;
+using map_transformer::SearchStrategy;
+using map_transformer::TriangleGeometry;
+
+
+class TestData : public ::testing::Test {
+protected:
+  // A mesh of jittered grid cells, each split into two triangles
+  TriangleGeometry GridMesh(int cells) {
+    std::vector<std::vector<Point2D>> vertices(cells + 1, std::vector<Point2D>(cells + 1));
+    for (int ii = 0; ii <= cells; ++ii) {
+      for (int jj = 0; jj <= cells; ++jj) {
+        float jitter_x = (ii > 0 && ii < cells) ? ((ii * 7 + jj * 3) % 5 - 2) : 0;
+        float jitter_y = (jj > 0 && jj < cells) ? ((ii * 3 + jj * 5) % 5 - 2) : 0;
+        vertices[ii][jj] = Point2D{ii * 10.0f + jitter_x, jj * 10.0f + jitter_y};
+      }
+    }
+    TriangleGeometry mesh;
+    for (int ii = 0; ii < cells; ++ii) {
+      for (int jj = 0; jj < cells; ++jj) {
+        mesh.push_back({vertices[ii][jj], vertices[ii + 1][jj], vertices[ii + 1][jj + 1]});
+        mesh.push_back({vertices[ii][jj], vertices[ii + 1][jj + 1], vertices[ii][jj + 1]});
+      }
+    }
+    return mesh;
+  }
+
+  // A grid of correspondence points in which the centre point is moved so far in the robot map
+  // that the triangles around it fold over there
+  const std::string FoldedMapYamlDoc() {
+    return R"(ref_map:
+  name: reference
+  size: [200, 200]
+  correspondence_points:
+    - [0, 0]
+    - [50, 0]
+    - [100, 0]
+    - [0, 50]
+    - [50, 50]
+    - [100, 50]
+    - [0, 100]
+    - [50, 100]
+    - [100, 100]
+robot_map:
+  name: robot
+  size: [200, 200]
+  correspondence_points:
+    - [0, 0]
+    - [50, 0]
+    - [100, 0]
+    - [0, 50]
+    - [130, 110]
+    - [100, 50]
+    - [0, 100]
+    - [50, 100]
+    - [100, 100]
+)";
+  }
+
+  const std::string OffsetMapYamlDoc() {
+    return R"(ref_map:
+  name: reference
+  size: [100, 100]
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+    - [40, 70]
+    - [70, 70]
+    - [40, 20]
+    - [70, 20]
+    - [30, 50]
+    - [99, 50]
+    - [30, 70]
+    - [99, 70]
+    - [40, 99]
+    - [70, 99]
+robot_map:
+  name: robot
+  size: [80, 110]
+  transform:
+    scale: [1, 1]
+    rotation: 0
+    translation: [30, 20]
+  correspondence_points:
+    - [0, 0]
+    - [10, 20]
+    - [46, 20]
+    - [10, 51]
+    - [40, 55]
+    - [10, 0]
+    - [50, 0]
+    - [0, 20]
+    - [69, 20]
+    - [0, 50]
+    - [69, 59]
+    - [10, 79]
+    - [34, 79]
+)";
+  }
+};
+
+
+TEST_F(TestData, slab_matches_linear_on_valid_mesh) {
+  auto mesh = GridMesh(12);
+  PointLocator linear, slab;
+  linear.build(mesh, SearchStrategy::linear);
+  slab.build(mesh, SearchStrategy::slab);
+  ASSERT_EQ(slab.strategy(), SearchStrategy::slab);
+
+  for (float x = -5; x <= 125; x += 0.25) {
+    for (float y = -5; y <= 125; y += 0.25) {
+      Point2D point{x, y};
+      ASSERT_EQ(slab.find(point), linear.find(point)) << x << ", " << y;
+    }
+  }
+  // Vertices and edge midpoints are shared by several triangles
+  for (auto const &t : mesh) {
+    for (int ii = 0; ii < 3; ++ii) {
+      Point2D vertex = t[ii];
+      Point2D edge_midpoint{
+        (t[ii].first + t[(ii + 1) % 3].first) / 2,
+        (t[ii].second + t[(ii + 1) % 3].second) / 2};
+      ASSERT_EQ(slab.find(vertex), linear.find(vertex));
+      ASSERT_EQ(slab.find(edge_midpoint), linear.find(edge_midpoint));
+    }
+  }
+}
+
+TEST_F(TestData, slab_falls_back_on_overlapping_mesh) {
+  TriangleGeometry mesh{
+    {Point2D{0, 0}, Point2D{10, 0}, Point2D{0, 10}},
+    {Point2D{2, 2}, Point2D{12, 2}, Point2D{2, 12}}};
+  map_transformer::SlabIndex index;
+  index.build(mesh);
+  ASSERT_FALSE(index.valid());
+
+  PointLocator locator;
+  locator.build(mesh, SearchStrategy::slab);
+  ASSERT_EQ(locator.strategy(), SearchStrategy::linear);
+  ASSERT_EQ(locator.find(Point2D{3, 3}), 0);
+  ASSERT_EQ(locator.find(Point2D{9, 3}), 1);
+  ASSERT_EQ(locator.find(Point2D{20, 20}), -1);
+}
+
+TEST_F(TestData, slab_empty_and_degenerate_triangles) {
+  map_transformer::SlabIndex index;
+  TriangleGeometry empty;
+  index.build(empty);
+  ASSERT_TRUE(index.valid());
+  ASSERT_EQ(index.find(Point2D{0, 0}, empty), -1);
+
+  // A triangle with no width crosses no slab but must still be found
+  TriangleGeometry mesh{
+    {Point2D{5, 0}, Point2D{5, 5}, Point2D{5, 10}},
+    {Point2D{0, 0}, Point2D{10, 0}, Point2D{0, 10}}};
+  index.build(mesh);
+  ASSERT_TRUE(index.valid());
+  ASSERT_EQ(index.find(Point2D{5, 2}, mesh), 0);
+  ASSERT_EQ(index.find(Point2D{2, 2}, mesh), 1);
+}
+
+TEST_F(TestData, quadtree_matches_linear) {
+  // A coarse mesh with a much finer mesh laid over one corner, so that the triangles overlap and
+  // vary greatly in density
+  auto mesh = GridMesh(6);
+  for (auto t : GridMesh(20)) {
+    for (auto &p : t) {
+      p.first = p.first / 20 + 3;
+      p.second = p.second / 20 + 3;
+    }
+    mesh.push_back(t);
+  }
+  PointLocator linear, quadtree;
+  linear.build(mesh, SearchStrategy::linear);
+  quadtree.build(mesh, SearchStrategy::quadtree);
+  ASSERT_EQ(quadtree.strategy(), SearchStrategy::quadtree);
+
+  for (float x = -5; x <= 65; x += 0.125) {
+    for (float y = -5; y <= 65; y += 0.125) {
+      Point2D point{x, y};
+      ASSERT_EQ(quadtree.find(point), linear.find(point)) << x << ", " << y;
+    }
+  }
+  for (auto const &t : mesh) {
+    for (auto const &vertex : t) {
+      ASSERT_EQ(quadtree.find(vertex), linear.find(vertex));
+    }
+  }
+
+  map_transformer::QuadtreeIndex index;
+  index.build(mesh);
+  ASSERT_GT(index.node_count(), 1u);
+  TriangleGeometry empty;
+  index.build(empty);
+  ASSERT_EQ(index.find(Point2D{0, 0}, empty), -1);
+}
+
+TEST_F(TestData, quadtree_shared_vertex) {
+  // Every triangle touches every quadrant, so the tree cannot usefully be split
+  TriangleGeometry fan;
+  for (int ii = 0; ii < 32; ++ii) {
+    float a = ii * 2 * M_PI / 32;
+    float b = (ii + 1) * 2 * M_PI / 32;
+    fan.push_back({Point2D{0, 0}, Point2D{10 * std::cos(a), 10 * std::sin(a)},
+        Point2D{10 * std::cos(b), 10 * std::sin(b)}});
+  }
+  map_transformer::QuadtreeIndex index;
+  index.build(fan, 4);
+  ASSERT_LE(index.node_count(), 5u * 32);
+  ASSERT_EQ(index.find(Point2D{0, 0}, fan), 0);
+  ASSERT_EQ(index.find(Point2D{-5, 0.1}, fan), 15);
+}
+
+TEST_F(TestData, region_queries) {
+  auto mesh = GridMesh(12);
+  PointLocator linear, quadtree;
+  linear.build(mesh, SearchStrategy::linear);
+  quadtree.build(mesh, SearchStrategy::quadtree);
+
+  std::vector<std::pair<Point2D, Point2D>> regions{
+    {Point2D{-10, -10}, Point2D{200, 200}},
+    {Point2D{35, 35}, Point2D{36, 36}},
+    {Point2D{60, 10}, Point2D{20, 90}},
+    {Point2D{50, 50}, Point2D{50, 50}},
+    {Point2D{130, 130}, Point2D{140, 140}}};
+  for (auto const &region : regions) {
+    auto expected = linear.find_in_region(region.first, region.second);
+    ASSERT_EQ(quadtree.find_in_region(region.first, region.second), expected);
+    ASSERT_TRUE(std::is_sorted(std::begin(expected), std::end(expected)));
+  }
+  ASSERT_EQ(linear.find_in_region(Point2D{-10, -10}, Point2D{200, 200}).size(), mesh.size());
+  ASSERT_TRUE(linear.find_in_region(Point2D{130, 130}, Point2D{140, 140}).empty());
+
+  map_transformer::Transformer transformer;
+  ASSERT_THROW(
+    transformer.ref_map_triangles_in_region(Point2D{0, 0}, Point2D{1, 1}),
+    std::logic_error);
+  transformer.set_search_strategy(SearchStrategy::quadtree);
+  transformer.load(OffsetMapYamlDoc());
+  ASSERT_EQ(
+    transformer.ref_map_triangles_in_region(Point2D{0, 0}, Point2D{100, 100}).size(),
+    transformer.triangle_indices().size());
+  ASSERT_FALSE(transformer.robot_map_triangles_in_region(Point2D{5, 5}, Point2D{6, 6}).empty());
+}
+
+TEST_F(TestData, grid_matches_linear) {
+  auto mesh = GridMesh(12);
+  // A large triangle overlapping the others, spanning many cells
+  mesh.push_back({Point2D{-20, -20}, Point2D{60, 0}, Point2D{0, 60}});
+  PointLocator linear, grid;
+  linear.build(mesh, SearchStrategy::linear);
+  grid.build(mesh, SearchStrategy::grid);
+  ASSERT_EQ(grid.strategy(), SearchStrategy::grid);
+
+  for (float x = -25; x <= 125; x += 0.25) {
+    for (float y = -25; y <= 125; y += 0.25) {
+      Point2D point{x, y};
+      ASSERT_EQ(grid.find(point), linear.find(point)) << x << ", " << y;
+    }
+  }
+  for (auto const &t : mesh) {
+    for (auto const &vertex : t) {
+      ASSERT_EQ(grid.find(vertex), linear.find(vertex));
+    }
+  }
+
+  // Triangulations with no height or no width
+  TriangleGeometry flat{
+    {Point2D{0, 5}, Point2D{5, 5}, Point2D{10, 5}},
+    {Point2D{5, 0}, Point2D{5, 5}, Point2D{5, 10}}};
+  map_transformer::GridIndex index;
+  index.build(TriangleGeometry{flat[0]});
+  ASSERT_TRUE(index.valid());
+  ASSERT_EQ(index.find(Point2D{7, 5}, flat), 0);
+  index.build(TriangleGeometry{flat[1]});
+  ASSERT_EQ(index.find(Point2D{5, 7}, TriangleGeometry{flat[1]}), 0);
+  ASSERT_EQ(index.find(Point2D{6, 7}, TriangleGeometry{flat[1]}), -1);
+}
+
+TEST_F(TestData, automatic_strategy_selection) {
+  auto few = GridMesh(4);
+  auto selection = map_transformer::select_search_strategy(few);
+  ASSERT_EQ(selection.strategy, SearchStrategy::linear);
+  ASSERT_FALSE(selection.reason.empty());
+
+  auto uniform = GridMesh(40);
+  ASSERT_EQ(map_transformer::select_search_strategy(uniform).strategy, SearchStrategy::grid);
+
+  auto skewed = GridMesh(10);
+  for (auto t : GridMesh(40)) {
+    for (auto &p : t) {
+      p.first = p.first / 100;
+      p.second = p.second / 100;
+    }
+    skewed.push_back(t);
+  }
+  ASSERT_EQ(map_transformer::select_search_strategy(skewed).strategy, SearchStrategy::quadtree);
+
+  // The preferred index is skipped if it does not fit within the memory limit
+  ASSERT_EQ(map_transformer::select_search_strategy(uniform, 1).strategy, SearchStrategy::linear);
+
+  // Whatever is chosen, the results are the same
+  PointLocator linear, automatic;
+  linear.build(skewed, SearchStrategy::linear);
+  automatic.build(skewed, SearchStrategy::automatic);
+  ASSERT_NE(automatic.strategy(), SearchStrategy::automatic);
+  for (float x = -5; x <= 105; x += 0.5) {
+    for (float y = -5; y <= 105; y += 0.5) {
+      ASSERT_EQ(automatic.find(Point2D{x, y}), linear.find(Point2D{x, y}));
+    }
+  }
+}
+
+TEST_F(TestData, transformer_automatic_strategy) {
+  map_transformer::Transformer transformer;
+  ASSERT_EQ(transformer.search_strategy(), SearchStrategy::automatic);
+  ASSERT_THROW(transformer.ref_map_search_selection(), std::logic_error);
+  ASSERT_THROW(transformer.robot_map_search_selection(), std::logic_error);
+
+  // A map as small as the samples is searched linearly
+  transformer.load(OffsetMapYamlDoc());
+  ASSERT_EQ(transformer.ref_map_search_selection().strategy, SearchStrategy::linear);
+  ASSERT_EQ(transformer.robot_map_search_selection().strategy, SearchStrategy::linear);
+  ASSERT_FALSE(transformer.ref_map_search_selection().reason.empty());
+
+  // Overriding the choice
+  transformer.set_search_strategy(SearchStrategy::quadtree);
+  ASSERT_EQ(transformer.ref_map_search_selection().strategy, SearchStrategy::quadtree);
+  ASSERT_EQ(transformer.ref_map_search_selection().reason, "requested");
+
+  transformer.set_search_memory_limit(1024);
+  transformer.reset();
+  ASSERT_EQ(transformer.search_memory_limit(), 1024u);
+}
+
+TEST_F(TestData, spatial_order) {
+  auto mesh = GridMesh(16);
+  auto order = map_transformer::spatial_order(mesh);
+  ASSERT_EQ(order.size(), mesh.size());
+  auto sorted = order;
+  std::sort(std::begin(sorted), std::end(sorted));
+  for (std::size_t ii = 0; ii < sorted.size(); ++ii) {
+    ASSERT_EQ(sorted[ii], static_cast<int>(ii));
+  }
+
+  // Consecutive triangles along the curve are mostly neighbours
+  std::size_t near{0};
+  for (std::size_t ii = 1; ii < order.size(); ++ii) {
+    auto const &a = mesh[order[ii - 1]][0];
+    auto const &b = mesh[order[ii]][0];
+    if (std::abs(a.first - b.first) <= 15 && std::abs(a.second - b.second) <= 15) {
+      ++near;
+    }
+  }
+  ASSERT_GT(near, order.size() * 3 / 4);
+
+  TriangleGeometry empty;
+  ASSERT_TRUE(map_transformer::spatial_order(empty).empty());
+}
+
+TEST_F(TestData, region_queries_use_public_triangle_indices) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  auto const &triangles = transformer.triangle_indices();
+  auto const &points = transformer.ref_map_corr_points();
+  Point2D top_left{35, 45}, bottom_right{45, 55};
+  auto found = transformer.ref_map_triangles_in_region(top_left, bottom_right);
+  ASSERT_TRUE(std::is_sorted(std::begin(found), std::end(found)));
+
+  std::vector<int> expected;
+  for (std::size_t ii = 0; ii < triangles.size(); ++ii) {
+    auto const &a = points[std::get<0>(triangles[ii])];
+    auto const &b = points[std::get<1>(triangles[ii])];
+    auto const &c = points[std::get<2>(triangles[ii])];
+    if (std::max({a.first, b.first, c.first}) >= top_left.first &&
+      std::min({a.first, b.first, c.first}) <= bottom_right.first &&
+      std::max({a.second, b.second, c.second}) >= top_left.second &&
+      std::min({a.second, b.second, c.second}) <= bottom_right.second)
+    {
+      expected.push_back(ii);
+    }
+  }
+  ASSERT_FALSE(expected.empty());
+  ASSERT_EQ(found, expected);
+}
+
+TEST_F(TestData, batch_matches_single_points) {
+  auto mesh = GridMesh(30);
+  std::vector<Point2D> points;
+  for (float x = -5; x <= 305; x += 1.25) {
+    for (float y = -5; y <= 305; y += 7.5) {
+      points.emplace_back(x, y);
+    }
+  }
+  for (auto strategy : {SearchStrategy::linear, SearchStrategy::slab, SearchStrategy::quadtree,
+      SearchStrategy::grid})
+  {
+    PointLocator locator;
+    locator.build(mesh, strategy);
+    for (std::size_t count : {std::size_t{0}, std::size_t{1}, std::size_t{7}, points.size()}) {
+      std::vector<int> results(count, -2);
+      locator.find(points.data(), count, results.data());
+      for (std::size_t ii = 0; ii < count; ++ii) {
+        ASSERT_EQ(results[ii], locator.find(points[ii])) << points[ii].first << ", " <<
+          points[ii].second;
+      }
+    }
+  }
+
+  // Triangles in three corners of their bounding box, so that the cells and leaves in the
+  // fourth corner, which are stored last, hold no triangles
+  TriangleGeometry corners;
+  for (auto t : GridMesh(8)) {
+    for (auto &p : t) {
+      p.first /= 4;
+      p.second /= 4;
+    }
+    corners.push_back(t);
+  }
+  corners.push_back({Point2D{90, 0}, Point2D{100, 0}, Point2D{100, 10}});
+  corners.push_back({Point2D{0, 90}, Point2D{10, 100}, Point2D{0, 100}});
+  std::vector<Point2D> corner_points(4 * 8, Point2D{95, 95});
+  corner_points.emplace_back(5, 5);
+  for (auto strategy : {SearchStrategy::quadtree, SearchStrategy::grid}) {
+    PointLocator locator;
+    locator.build(corners, strategy);
+    std::vector<int> results(corner_points.size(), -2);
+    locator.find(corner_points.data(), corner_points.size(), results.data());
+    for (std::size_t ii = 0; ii < corner_points.size(); ++ii) {
+      ASSERT_EQ(results[ii], locator.find(corner_points[ii]));
+    }
+  }
+
+  map_transformer::Transformer transformer;
+  ASSERT_THROW(transformer.to_ref(points), std::logic_error);
+  ASSERT_THROW(transformer.to_robot(points), std::logic_error);
+  transformer.load(OffsetMapYamlDoc());
+  points.clear();
+  for (float x = -35; x <= 115; x += 0.5) {
+    for (float y = -25; y <= 135; y += 2.5) {
+      points.emplace_back(x, y);
+    }
+  }
+  for (auto const &p : transformer.ref_map_corr_points()) {
+    points.push_back(p);
+  }
+  for (auto const &p : transformer.robot_map_corr_points()) {
+    points.push_back(p);
+  }
+  for (auto strategy : {SearchStrategy::linear, SearchStrategy::grid, SearchStrategy::quadtree}) {
+    transformer.set_search_strategy(strategy);
+    auto to_ref = transformer.to_ref(points);
+    auto to_robot = transformer.to_robot(points);
+    ASSERT_EQ(to_ref.size(), points.size());
+    for (std::size_t ii = 0; ii < points.size(); ++ii) {
+      ASSERT_EQ(to_ref[ii], transformer.to_ref(points[ii]));
+      ASSERT_EQ(to_robot[ii], transformer.to_robot(points[ii]));
+    }
+
+    // Transforming in place
+    auto in_place = points;
+    transformer.to_ref(in_place.data(), in_place.size(), in_place.data());
+    ASSERT_EQ(in_place, to_ref);
+  }
+}
+
+TEST_F(TestData, correspondence_point_index) {
+  map_transformer::CorrespondencePoints points{
+    Point2D{1, 2}, Point2D{0, 0}, Point2D{1, 2}, Point2D{3, 4}};
+  map_transformer::CorrespondencePointIndex index;
+  index.build(points);
+  ASSERT_EQ(index.find(Point2D{1, 2}), 0);
+  ASSERT_EQ(index.find(Point2D{3, 4}), 3);
+  ASSERT_EQ(index.find(Point2D{-0.0f, 0.0f}), 1);
+  ASSERT_EQ(index.find(Point2D{5, 5}), -1);
+  ASSERT_EQ(index.find(Point2D{std::numeric_limits<float>::quiet_NaN(), 0}), -1);
+}
+
+TEST_F(TestData, transformer_search_strategies_agree) {
+  map_transformer::Transformer linear;
+  linear.set_search_strategy(SearchStrategy::linear);
+  linear.load(OffsetMapYamlDoc());
+  ASSERT_EQ(linear.search_strategy(), SearchStrategy::linear);
+
+  map_transformer::Transformer slab;
+  slab.set_search_strategy(SearchStrategy::slab);
+  slab.load(OffsetMapYamlDoc());
+  ASSERT_EQ(slab.search_strategy(), SearchStrategy::slab);
+
+  map_transformer::Transformer quadtree;
+  quadtree.set_search_strategy(SearchStrategy::quadtree);
+  quadtree.load(OffsetMapYamlDoc());
+
+  map_transformer::Transformer grid;
+  grid.set_search_strategy(SearchStrategy::grid);
+  grid.load(OffsetMapYamlDoc());
+
+  map_transformer::Transformer switched(OffsetMapYamlDoc());
+  switched.set_search_strategy(SearchStrategy::slab);
+
+  for (float x = -35; x <= 115; x += 0.5) {
+    for (float y = -25; y <= 135; y += 0.5) {
+      Point2D point{x, y};
+      ASSERT_EQ(slab.to_ref(point), linear.to_ref(point));
+      ASSERT_EQ(slab.to_robot(point), linear.to_robot(point));
+      ASSERT_EQ(quadtree.to_ref(point), linear.to_ref(point));
+      ASSERT_EQ(quadtree.to_robot(point), linear.to_robot(point));
+      ASSERT_EQ(grid.to_ref(point), linear.to_ref(point));
+      ASSERT_EQ(grid.to_robot(point), linear.to_robot(point));
+      ASSERT_EQ(switched.to_ref(point), linear.to_ref(point));
+      ASSERT_EQ(switched.to_robot(point), linear.to_robot(point));
+    }
+  }
+}
+
+TEST_F(TestData, transformer_search_strategy_survives_reset) {
+  map_transformer::Transformer transformer;
+  transformer.set_search_strategy(SearchStrategy::slab);
+  transformer.load(OffsetMapYamlDoc());
+  transformer.reset();
+  ASSERT_EQ(transformer.search_strategy(), SearchStrategy::slab);
+  transformer.load(OffsetMapYamlDoc());
+  ASSERT_EQ(transformer.search_strategy(), SearchStrategy::slab);
+}
+
+TEST_F(TestData, triangle_quality_measurements) {
+  using map_transformer::TriangleVertices;
+  TriangleVertices equilateral{Point2D{0, 0}, Point2D{2, 0}, Point2D{1, std::sqrt(3.0f)}};
+  TriangleVertices right{Point2D{0, 0}, Point2D{4, 0}, Point2D{0, 4}};
+  // The right triangle rotated by 90 degrees, doubled in size and moved
+  TriangleVertices rotated{Point2D{10, 10}, Point2D{10, 18}, Point2D{2, 10}};
+  // A thin triangle with its vertices in clockwise order
+  TriangleVertices sliver{Point2D{0, 0}, Point2D{1, 100}, Point2D{4, 0}};
+  TriangleVertices degenerate{Point2D{0, 0}, Point2D{1, 1}, Point2D{2, 2}};
+
+  auto quality = map_transformer::measure_triangle(equilateral, equilateral);
+  ASSERT_NEAR(quality.ref_condition_number, 1, 1e-6);
+  ASSERT_NEAR(quality.transform_condition_number, 1, 1e-6);
+  ASSERT_FALSE(quality.folded);
+
+  quality = map_transformer::measure_triangle(right, rotated);
+  ASSERT_DOUBLE_EQ(quality.ref_area, 8);
+  ASSERT_DOUBLE_EQ(quality.robot_area, 32);
+  ASSERT_DOUBLE_EQ(quality.area_ratio, 4);
+  ASSERT_DOUBLE_EQ(quality.ref_condition_number, quality.robot_condition_number);
+  ASSERT_GT(quality.ref_condition_number, 1);
+  ASSERT_DOUBLE_EQ(quality.transform_condition_number, 1);
+  ASSERT_FALSE(quality.folded);
+
+  quality = map_transformer::measure_triangle(right, sliver);
+  ASSERT_LT(quality.robot_area, 0);
+  ASSERT_LT(quality.area_ratio, 0);
+  ASSERT_GT(quality.robot_condition_number, 10);
+  ASSERT_GT(quality.transform_condition_number, 10);
+  ASSERT_TRUE(quality.folded);
+
+  quality = map_transformer::measure_triangle(right, degenerate);
+  ASSERT_EQ(quality.robot_area, 0);
+  ASSERT_TRUE(std::isinf(quality.robot_condition_number));
+  ASSERT_TRUE(std::isinf(quality.transform_condition_number));
+  ASSERT_TRUE(quality.folded);
+}
+
+TEST_F(TestData, transformer_folded_triangles) {
+  map_transformer::Transformer transformer;
+  transformer.set_search_strategy(SearchStrategy::slab);
+  transformer.load(OffsetMapYamlDoc());
+  ASSERT_EQ(transformer.triangle_quality().size(), transformer.triangle_indices().size());
+  ASSERT_TRUE(transformer.folded_triangles().empty());
+  for (auto const &quality : transformer.triangle_quality()) {
+    ASSERT_GT(quality.ref_area, 0);
+    ASSERT_GT(quality.robot_area, 0);
+  }
+
+  transformer.reset();
+  transformer.load(FoldedMapYamlDoc());
+  auto folded = transformer.folded_triangles();
+  ASSERT_FALSE(folded.empty());
+  for (std::size_t ii = 0; ii < transformer.triangle_quality().size(); ++ii) {
+    auto const &quality = transformer.triangle_quality()[ii];
+    bool expected = quality.ref_area <= 0 || quality.robot_area <= 0;
+    ASSERT_EQ(quality.folded, expected);
+    ASSERT_EQ(std::count(std::begin(folded), std::end(folded), ii), expected ? 1 : 0);
+  }
+  ASSERT_EQ(transformer.robot_map_search_selection().strategy, SearchStrategy::linear);
+  // Both maps' points are found in the same triangles
+  ASSERT_EQ(transformer.robot_map_folded_triangles(), folded);
+  ASSERT_EQ(
+    transformer.robot_map_triangle_quality().size(), transformer.triangle_quality().size());
+
+  transformer.reset();
+  ASSERT_THROW(transformer.triangle_quality(), std::logic_error);
+  ASSERT_THROW(transformer.folded_triangles(), std::logic_error);
+  ASSERT_THROW(transformer.robot_map_triangle_quality(), std::logic_error);
+  ASSERT_THROW(transformer.robot_map_folded_triangles(), std::logic_error);
+}
+
+TEST_F(TestData, walk_matches_linear) {
+  auto mesh = GridMesh(12);
+  // The same mesh with clockwise triangles, stored in spatial order
+  TriangleGeometry clockwise;
+  for (auto ii : map_transformer::spatial_order(mesh)) {
+    clockwise.push_back({mesh[ii][0], mesh[ii][2], mesh[ii][1]});
+  }
+
+  for (auto const &triangles : {mesh, clockwise}) {
+    PointLocator linear, walk;
+    linear.build(triangles, SearchStrategy::linear);
+    walk.build(triangles, SearchStrategy::walk);
+    ASSERT_EQ(walk.strategy(), SearchStrategy::walk);
+
+    // Points along a path back and forth across the mesh, so that batches walk between neighbours
+    std::vector<Point2D> points;
+    for (float y = -5; y <= 125; y += 0.25) {
+      for (float x = -5; x <= 125; x += 0.25) {
+        points.emplace_back(static_cast<int>(y * 4) % 2 == 0 ? x : 120 - x, y);
+      }
+    }
+    for (auto const &t : triangles) {
+      for (int ii = 0; ii < 3; ++ii) {
+        points.push_back(t[ii]);
+        points.emplace_back(
+          (t[ii].first + t[(ii + 1) % 3].first) / 2,
+          (t[ii].second + t[(ii + 1) % 3].second) / 2);
+      }
+    }
+    std::vector<int> results(points.size());
+    walk.find(points.data(), points.size(), results.data());
+    for (std::size_t ii = 0; ii < points.size(); ++ii) {
+      auto expected = linear.find(points[ii]);
+      ASSERT_EQ(walk.find(points[ii]), expected) << points[ii].first << ", " << points[ii].second;
+      ASSERT_EQ(results[ii], expected) << points[ii].first << ", " << points[ii].second;
+    }
+  }
+}
+
+TEST_F(TestData, walk_falls_back_on_invalid_meshes) {
+  map_transformer::WalkIndex index;
+  TriangleGeometry empty;
+  index.build(empty);
+  ASSERT_TRUE(index.valid());
+  ASSERT_EQ(index.find(Point2D{0, 0}, empty), -1);
+
+  auto mesh = GridMesh(4);
+  index.build(mesh);
+  ASSERT_TRUE(index.valid());
+
+  // Overlapping triangles
+  TriangleGeometry overlapping{
+    {Point2D{0, 0}, Point2D{10, 0}, Point2D{0, 10}},
+    {Point2D{2, 2}, Point2D{12, 2}, Point2D{2, 12}}};
+  // A hole in the middle of the mesh
+  auto holed = mesh;
+  holed.erase(std::begin(holed) + 12);
+  // A corner cut out of the mesh, so that it is not convex
+  auto concave = mesh;
+  concave.erase(std::begin(concave));
+  // A triangle with the opposite orientation to the others
+  auto mixed = mesh;
+  std::swap(mixed[5][1], mixed[5][2]);
+  for (auto const &triangles : {overlapping, holed, concave, mixed}) {
+    index.build(triangles);
+    ASSERT_FALSE(index.valid());
+
+    PointLocator locator;
+    locator.build(triangles, SearchStrategy::walk);
+    ASSERT_EQ(locator.strategy(), SearchStrategy::linear);
+  }
+
+  PointLocator locator;
+  locator.build(mesh, SearchStrategy::walk, 0, true);
+  ASSERT_EQ(locator.strategy(), SearchStrategy::linear);
+}
+
+TEST_F(TestData, transformer_per_direction_triangulation) {
+  map_transformer::Transformer transformer;
+  transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  transformer.set_search_strategy(SearchStrategy::walk);
+  transformer.load(FoldedMapYamlDoc());
+  ASSERT_EQ(transformer.ref_map_search_selection().strategy, SearchStrategy::walk);
+  ASSERT_EQ(transformer.robot_map_search_selection().strategy, SearchStrategy::walk);
+  ASSERT_NE(transformer.ref_map_triangle_indices(), transformer.robot_map_triangle_indices());
+  ASSERT_EQ(transformer.triangle_indices(), transformer.ref_map_triangle_indices());
+
+  // Each triangulation is measured in both maps, and is folded over only in the other map
+  auto check_quality = [](
+    std::vector<map_transformer::TriangleQuality> const &quality,
+    std::vector<int> const &folded, std::size_t triangle_count, bool in_ref_map) {
+      ASSERT_EQ(quality.size(), triangle_count);
+      for (std::size_t ii = 0; ii < quality.size(); ++ii) {
+        ASSERT_GT(in_ref_map ? quality[ii].ref_area : quality[ii].robot_area, 0) << ii;
+        bool expected = quality[ii].ref_area <= 0 || quality[ii].robot_area <= 0;
+        ASSERT_EQ(quality[ii].folded, expected) << ii;
+        ASSERT_EQ(std::count(std::begin(folded), std::end(folded), ii), expected ? 1 : 0) << ii;
+      }
+    };
+  check_quality(
+    transformer.ref_map_triangle_quality(), transformer.ref_map_folded_triangles(),
+    transformer.ref_map_triangle_indices().size(), true);
+  check_quality(
+    transformer.robot_map_triangle_quality(), transformer.robot_map_folded_triangles(),
+    transformer.robot_map_triangle_indices().size(), false);
+  ASSERT_EQ(transformer.triangle_quality().size(), transformer.ref_map_triangle_quality().size());
+  ASSERT_EQ(transformer.folded_triangles(), transformer.ref_map_folded_triangles());
+  // The folded map's triangulations are each folded over somewhere in the other map
+  ASSERT_FALSE(transformer.ref_map_folded_triangles().empty());
+  ASSERT_FALSE(transformer.robot_map_folded_triangles().empty());
+
+  // Each triangulation is valid in the map it is searched in
+  auto ref_points = transformer.ref_map_corr_points();
+  for (auto const &t : transformer.ref_map_triangle_indices()) {
+    ASSERT_GT(
+      map_transformer::orient2d(
+        ref_points[std::get<0>(t)], ref_points[std::get<1>(t)], ref_points[std::get<2>(t)]), 0);
+  }
+  auto robot_points = transformer.robot_map_corr_points();
+  for (auto const &t : transformer.robot_map_triangle_indices()) {
+    ASSERT_GT(
+      map_transformer::orient2d(
+        robot_points[std::get<0>(t)], robot_points[std::get<1>(t)],
+        robot_points[std::get<2>(t)]), 0);
+  }
+
+  // The strategy does not change the results, and correspondence points map onto each other
+  map_transformer::Transformer linear;
+  linear.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  linear.set_search_strategy(SearchStrategy::linear);
+  linear.load(FoldedMapYamlDoc());
+  for (float x = -10; x <= 150; x += 2.5) {
+    for (float y = -10; y <= 150; y += 2.5) {
+      Point2D point{x, y};
+      ASSERT_EQ(transformer.to_ref(point), linear.to_ref(point)) << x << ", " << y;
+      ASSERT_EQ(transformer.to_robot(point), linear.to_robot(point)) << x << ", " << y;
+    }
+  }
+  for (std::size_t ii = 0; ii < robot_points.size(); ++ii) {
+    auto ref = transformer.to_ref(robot_points[ii]);
+    ASSERT_NEAR(ref.first, ref_points[ii].first, 1e-3);
+    ASSERT_NEAR(ref.second, ref_points[ii].second, 1e-3);
+  }
+
+  transformer.reset();
+  ASSERT_EQ(
+    transformer.triangulation_mode(), map_transformer::TriangulationMode::per_direction);
+}
@@ -0,0 +1,208 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/delaunay.hpp"
+#include "map_transformer/point_location.hpp"
+#include "map_transformer/predicates.hpp"
+
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::CorrespondencePoints;
+using map_transformer::Point2D;
+using map_transformer::PointLocator;
+using map_transformer::SearchStrategy;
+using map_transformer::TriangleGeometry;
+using map_transformer::TriangleList;
+using map_transformer::TriangleVertices;
+using map_transformer::delaunay_triangulation;
+using map_transformer::incircle;
+using map_transformer::orient2d;
+using map_transformer::triangle_contains;
+
+
+class TestData : public ::testing::Test {
+protected:
+  int Sign(double value) {
+    return (value > 0) - (value < 0);
+  }
+
+  // Check that no point is strictly inside the circumcircle of any triangle, and that every
+  // triangle is counterclockwise
+  void ExpectDelaunay(CorrespondencePoints const &points, TriangleList const &triangles) {
+    for (auto const &t : triangles) {
+      Point2D const &a = points[std::get<0>(t)];
+      Point2D const &b = points[std::get<1>(t)];
+      Point2D const &c = points[std::get<2>(t)];
+      EXPECT_GT(orient2d(a, b, c), 0);
+      for (auto const &p : points) {
+        EXPECT_LE(incircle(a, b, c, p), 0);
+      }
+    }
+  }
+
+  double Area(CorrespondencePoints const &points, TriangleList const &triangles) {
+    double area = 0;
+    for (auto const &t : triangles) {
+      area += orient2d(points[std::get<0>(t)], points[std::get<1>(t)], points[std::get<2>(t)]) / 2;
+    }
+    return area;
+  }
+};
+
+
+TEST_F(TestData, orient2d_near_collinear) {
+  // Points on and a tiny distance either side of the line through a and b, checked with both the
+  // filtered predicate and the exact calculation it falls back on
+  Point2D a{12, 12};
+  Point2D b{24, 24};
+  float step = std::numeric_limits<float>::epsilon() / 2;
+  for (int ii = 0; ii < 64; ++ii) {
+    for (int jj = 0; jj < 64; ++jj) {
+      Point2D c{0.5f + ii * step, 0.5f + jj * step};
+      int expected = Sign(c.second - c.first);
+      ASSERT_EQ(Sign(orient2d(a, b, c)), expected) << ii << ", " << jj;
+      ASSERT_EQ(Sign(orient2d(b, a, c)), -expected) << ii << ", " << jj;
+      ASSERT_EQ(Sign(map_transformer::predicates::orient2d_exact(a, b, c)), expected);
+      ASSERT_EQ(Sign(map_transformer::predicates::orient2d_exact(c, b, a)), -expected);
+    }
+  }
+
+  ASSERT_GT(orient2d(Point2D{0, 0}, Point2D{1, 0}, Point2D{0, 1}), 0);
+  ASSERT_LT(orient2d(Point2D{0, 0}, Point2D{0, 1}, Point2D{1, 0}), 0);
+  ASSERT_EQ(orient2d(Point2D{1e7f, 1e7f}, Point2D{2e7f, 2e7f}, Point2D{3e7f, 3e7f}), 0);
+}
+
+TEST_F(TestData, incircle_near_cocircular) {
+  for (float offset : {0.0f, 1000.0f, 65536.0f}) {
+    Point2D a{offset, offset};
+    Point2D b{offset + 1, offset};
+    Point2D c{offset, offset + 1};
+    Point2D d{offset + 1, offset + 1};
+    Point2D inside{d.first, std::nextafter(d.second, 0.0f)};
+    Point2D outside{d.first, std::nextafter(d.second, 1e9f)};
+    ASSERT_EQ(incircle(a, b, c, d), 0);
+    ASSERT_GT(incircle(a, b, c, inside), 0);
+    ASSERT_LT(incircle(a, b, c, outside), 0);
+    ASSERT_EQ(map_transformer::predicates::incircle_exact(a, b, c, d), 0);
+    ASSERT_GT(map_transformer::predicates::incircle_exact(a, b, c, inside), 0);
+    ASSERT_LT(map_transformer::predicates::incircle_exact(a, b, c, outside), 0);
+    // The sign is reversed when the first three points are clockwise
+    ASSERT_LT(incircle(a, c, b, Point2D{offset + 0.5f, offset + 0.5f}), 0);
+  }
+}
+
+TEST_F(TestData, shared_edge_points_are_in_both_triangles) {
+  // Two triangles sharing the edge from (0, 0) to (3, 1)
+  TriangleGeometry mesh{
+    {Point2D{0, 0}, Point2D{3, 1}, Point2D{0, 1}},
+    {Point2D{0, 0}, Point2D{3, 0}, Point2D{3, 1}}};
+  PointLocator linear, quadtree, grid;
+  linear.build(mesh, SearchStrategy::linear);
+  quadtree.build(mesh, SearchStrategy::quadtree);
+  grid.build(mesh, SearchStrategy::grid);
+  for (int ii = 0; ii <= 64; ++ii) {
+    Point2D on_edge{3.0f * ii / 64, ii / 64.0f};
+    ASSERT_TRUE(triangle_contains(mesh[0], on_edge)) << ii;
+    ASSERT_TRUE(triangle_contains(mesh[1], on_edge)) << ii;
+    ASSERT_EQ(linear.find(on_edge), 0) << ii;
+    ASSERT_EQ(quadtree.find(on_edge), 0) << ii;
+    ASSERT_EQ(grid.find(on_edge), 0) << ii;
+
+    if (ii > 0 && ii < 64) {
+      Point2D above{on_edge.first, std::nextafter(on_edge.second, 2.0f)};
+      Point2D below{on_edge.first, std::nextafter(on_edge.second, -1.0f)};
+      ASSERT_TRUE(triangle_contains(mesh[0], above)) << ii;
+      ASSERT_FALSE(triangle_contains(mesh[1], above)) << ii;
+      ASSERT_FALSE(triangle_contains(mesh[0], below)) << ii;
+      ASSERT_TRUE(triangle_contains(mesh[1], below)) << ii;
+      ASSERT_EQ(grid.find(below), 1) << ii;
+    }
+  }
+
+  // A triangle with no area contains only the points on it
+  TriangleVertices segment{Point2D{0, 0}, Point2D{2, 2}, Point2D{1, 1}};
+  ASSERT_TRUE(triangle_contains(segment, Point2D{0.5, 0.5}));
+  ASSERT_FALSE(triangle_contains(segment, Point2D{3, 3}));
+  ASSERT_FALSE(triangle_contains(segment, Point2D{0.5, 0.6}));
+
+  // Nor does any triangle contain an infinite or NaN point
+  float const infinity = std::numeric_limits<float>::infinity();
+  TriangleVertices triangle{Point2D{0, 0}, Point2D{0, 2}, Point2D{2, 0}};
+  ASSERT_FALSE(triangle_contains(triangle, Point2D{0.5, -infinity}));
+  ASSERT_FALSE(triangle_contains(triangle, Point2D{infinity, 0.5}));
+  ASSERT_FALSE(triangle_contains(
+    triangle, Point2D{std::numeric_limits<float>::quiet_NaN(), 0.5}));
+}
+
+TEST_F(TestData, delaunay_cocircular_grid) {
+  // Every square of a grid has four cocircular corners
+  CorrespondencePoints points;
+  for (int ii = 0; ii < 10; ++ii) {
+    for (int jj = 0; jj < 10; ++jj) {
+      points.emplace_back(ii, jj);
+    }
+  }
+  auto triangles = delaunay_triangulation(points);
+  ASSERT_EQ(triangles.size(), 2u * 9 * 9);
+  ExpectDelaunay(points, triangles);
+  ASSERT_DOUBLE_EQ(Area(points, triangles), 81);
+  ASSERT_EQ(triangles, delaunay_triangulation(points));
+}
+
+TEST_F(TestData, delaunay_scattered_points) {
+  CorrespondencePoints points;
+  unsigned int state = 12345;
+  auto next = [&state]() {
+      state = state * 1103515245u + 12345u;
+      return static_cast<float>((state >> 8) % 100000) / 100;
+    };
+  for (int ii = 0; ii < 300; ++ii) {
+    float x = next();
+    points.emplace_back(x, next());
+  }
+  // Points on the edges of the bounding square, some of them collinear along the hull
+  for (int ii = 0; ii <= 10; ++ii) {
+    points.emplace_back(ii * 100.0f, 0.0f);
+    points.emplace_back(ii * 100.0f, 1000.0f);
+    points.emplace_back(0.0f, ii * 100.0f);
+    points.emplace_back(1000.0f, ii * 100.0f);
+  }
+  auto triangles = delaunay_triangulation(points);
+  ExpectDelaunay(points, triangles);
+  ASSERT_DOUBLE_EQ(Area(points, triangles), 1000.0 * 1000.0);
+}
+
+TEST_F(TestData, delaunay_degenerate_input) {
+  ASSERT_TRUE(delaunay_triangulation(CorrespondencePoints{}).empty());
+  ASSERT_TRUE(delaunay_triangulation(CorrespondencePoints{{0, 0}, {1, 1}}).empty());
+  ASSERT_TRUE(delaunay_triangulation(CorrespondencePoints{{0, 0}, {1, 1}, {2, 2}, {3, 3}}).empty());
+  ASSERT_TRUE(delaunay_triangulation(CorrespondencePoints{{0, 0}, {0, 0}, {0, 0}}).empty());
+
+  // Only the first of any duplicated points is used
+  CorrespondencePoints points{{0, 0}, {4, 0}, {4, 0}, {0, 4}, {0, 0}, {1, 1}};
+  auto triangles = delaunay_triangulation(points);
+  ASSERT_EQ(triangles.size(), 3u);
+  for (auto const &t : triangles) {
+    for (int v : {std::get<0>(t), std::get<1>(t), std::get<2>(t)}) {
+      ASSERT_NE(v, 2);
+      ASSERT_NE(v, 4);
+    }
+  }
+  ExpectDelaunay(points, triangles);
+}
@@ -0,0 +1,127 @@
+# Copyright 2020 Open Source Robotics Foundation, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import threading
+import unittest
+
+import numpy
+
+import map_transformer
+
+
+class TestData(unittest.TestCase):
+
+    def setUp(self):
+        path = os.path.join(os.environ['TEST_DATA_DIRECTORY'], 'embedded_map.yaml')
+        with open(path) as f:
+            self.yaml_doc = f.read()
+        self.transformer = map_transformer.Transformer(self.yaml_doc)
+        generator = numpy.random.default_rng(42)
+        self.points = generator.uniform(-50.0, 400.0, (100000, 2)).astype(numpy.float32)
+
+    def test_batches_match_single_points(self):
+        for transform in (self.transformer.to_ref, self.transformer.to_robot):
+            results = transform(self.points)
+            self.assertEqual(results.shape, self.points.shape)
+            self.assertEqual(results.dtype, numpy.float32)
+            for ii in range(0, len(self.points), 997):
+                expected = transform((self.points[ii, 0], self.points[ii, 1]))
+                self.assertEqual(tuple(results[ii]), expected)
+
+            # The number of threads does not change the results
+            numpy.testing.assert_array_equal(transform(self.points, threads=1), results)
+            numpy.testing.assert_array_equal(transform(self.points, threads=3), results)
+
+            # Other types and layouts are converted
+            numpy.testing.assert_array_equal(
+                transform(self.points.astype(numpy.float64)), results)
+            numpy.testing.assert_array_equal(
+                transform(numpy.asfortranarray(self.points)), results)
+            numpy.testing.assert_array_equal(
+                transform(self.points[:100].tolist()), results[:100])
+            self.assertEqual(
+                transform([float(self.points[0, 0]), float(self.points[0, 1])]),
+                tuple(results[0]))
+
+    def test_invalid_points(self):
+        with self.assertRaises(TypeError):
+            self.transformer.to_ref('not points')
+        with self.assertRaises(TypeError):
+            self.transformer.to_ref([[1.0, 2.0], ['x', 'y']])
+        with self.assertRaises(ValueError):
+            self.transformer.to_ref([1.0, 2.0, 3.0])
+        with self.assertRaises(ValueError):
+            self.transformer.to_ref(numpy.array([1.0, 2.0], numpy.float32))
+
+    def test_output_arrays(self):
+        expected = self.transformer.to_ref(self.points)
+        out = numpy.empty_like(self.points)
+        self.assertIs(self.transformer.to_ref(self.points, out=out), out)
+        numpy.testing.assert_array_equal(out, expected)
+
+        in_place = self.points.copy()
+        self.transformer.to_ref(in_place, out=in_place)
+        numpy.testing.assert_array_equal(in_place, expected)
+
+        with self.assertRaises(TypeError):
+            self.transformer.to_ref(self.points, out=numpy.empty((len(self.points), 2)))
+        with self.assertRaises(ValueError):
+            self.transformer.to_ref(self.points, out=numpy.empty((1, 2), numpy.float32))
+        with self.assertRaises(ValueError):
+            self.transformer.to_ref(numpy.zeros((10, 3), numpy.float32))
+
+    def test_snapshots(self):
+        loaded = map_transformer.Transformer()
+        loaded.load_snapshot(self.transformer.snapshot())
+        numpy.testing.assert_array_equal(
+            loaded.to_robot(self.points), self.transformer.to_robot(self.points))
+        self.assertEqual(loaded.ref_map_name, self.transformer.ref_map_name)
+
+    def test_changes_during_batches(self):
+        # Batches are transformed without the GIL, while other threads load and reset the
+        # transformer; each batch sees it either loaded or empty, never part way through a change
+        expected = self.transformer.to_ref(self.points)
+        stop = threading.Event()
+        errors = []
+
+        def transform():
+            while not stop.is_set():
+                try:
+                    results = self.transformer.to_ref(self.points, threads=2)
+                except RuntimeError:
+                    # The transformer was empty
+                    continue
+                if not numpy.array_equal(results, expected):
+                    errors.append('A batch was transformed while the transformer changed')
+
+        threads = [threading.Thread(target=transform) for _ in range(2)]
+        for thread in threads:
+            thread.start()
+        snapshot = self.transformer.snapshot()
+        for ii in range(50):
+            self.transformer.reset()
+            if ii % 2 == 0:
+                self.transformer.load(self.yaml_doc)
+            else:
+                self.transformer.load_snapshot(snapshot)
+            self.transformer.triangulation_mode = map_transformer.TriangulationMode.midpoint
+        stop.set()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+
+
+if __name__ == '__main__':
+    unittest.main()
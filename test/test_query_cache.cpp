@@ -0,0 +1,188 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/query_cache.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::QueryCache;
+using map_transformer::Transformer;
+
+
+class TestData : public ::testing::Test {
+protected:
+  const std::string OffsetMapYamlDoc() {
+    return R"(ref_map:
+  name: reference
+  size: [100, 100]
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+    - [40, 70]
+    - [70, 70]
+    - [40, 20]
+    - [70, 20]
+    - [30, 50]
+    - [99, 50]
+    - [30, 70]
+    - [99, 70]
+    - [40, 99]
+    - [70, 99]
+robot_map:
+  name: robot
+  size: [80, 110]
+  transform:
+    scale: [1, 1]
+    rotation: 0
+    translation: [30, 20]
+  correspondence_points:
+    - [0, 0]
+    - [10, 20]
+    - [46, 20]
+    - [10, 51]
+    - [40, 55]
+    - [10, 0]
+    - [50, 0]
+    - [0, 20]
+    - [69, 20]
+    - [0, 50]
+    - [69, 59]
+    - [10, 79]
+    - [34, 79]
+)";
+  }
+};
+
+
+TEST_F(TestData, least_recently_used_results_are_evicted) {
+  QueryCache cache(3, 1);
+  Point2D result;
+  ASSERT_FALSE(cache.find(Point2D{1, 1}, result));
+  cache.insert(Point2D{1, 1}, Point2D{10, 10});
+  cache.insert(Point2D{2, 2}, Point2D{20, 20});
+  cache.insert(Point2D{3, 3}, Point2D{30, 30});
+  ASSERT_TRUE(cache.find(Point2D{1, 1}, result));
+  ASSERT_EQ(result, (Point2D{10, 10}));
+
+  // The second point is now the least recently used
+  cache.insert(Point2D{4, 4}, Point2D{40, 40});
+  ASSERT_FALSE(cache.find(Point2D{2, 2}, result));
+  ASSERT_TRUE(cache.find(Point2D{3, 3}, result));
+  ASSERT_TRUE(cache.find(Point2D{4, 4}, result));
+
+  // Points are matched by their exact bits
+  cache.insert(Point2D{0.0f, 0.0f}, Point2D{1, 2});
+  ASSERT_FALSE(cache.find(Point2D{-0.0f, 0.0f}, result));
+
+  auto statistics = cache.statistics();
+  ASSERT_EQ(statistics.hits, 3u);
+  ASSERT_EQ(statistics.misses, 3u);
+  ASSERT_EQ(statistics.evictions, 2u);
+  ASSERT_EQ(statistics.size, 3u);
+  ASSERT_EQ(statistics.capacity, 3u);
+  ASSERT_DOUBLE_EQ(statistics.hit_rate(), 0.5);
+
+  cache.clear();
+  ASSERT_EQ(cache.statistics().size, 0u);
+  ASSERT_EQ(cache.statistics().hits, 3u);
+  cache.reset_statistics();
+  ASSERT_EQ(cache.statistics().hits, 0u);
+  ASSERT_DOUBLE_EQ(cache.statistics().hit_rate(), 0);
+
+  // A copy has the same capacity but none of the results
+  cache.insert(Point2D{1, 1}, Point2D{10, 10});
+  QueryCache copy(cache);
+  ASSERT_EQ(copy.capacity(), 3u);
+  ASSERT_FALSE(copy.find(Point2D{1, 1}, result));
+
+  QueryCache disabled;
+  ASSERT_FALSE(disabled.enabled());
+  disabled.insert(Point2D{1, 1}, Point2D{10, 10});
+  ASSERT_FALSE(disabled.find(Point2D{1, 1}, result));
+  ASSERT_EQ(disabled.statistics().misses, 0u);
+}
+
+TEST_F(TestData, concurrent_use) {
+  QueryCache cache(1000);
+  std::vector<std::thread> threads;
+  for (int tt = 0; tt < 8; ++tt) {
+    threads.emplace_back(
+      [&cache, tt]() {
+        for (int ii = 0; ii < 20000; ++ii) {
+          float value = static_cast<float>((ii * 7 + tt) % 1500);
+          Point2D result;
+          if (cache.find(Point2D{value, -value}, result)) {
+            ASSERT_EQ(result, (Point2D{-value, value}));
+          } else {
+            cache.insert(Point2D{value, -value}, Point2D{-value, value});
+          }
+        }
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto statistics = cache.statistics();
+  ASSERT_EQ(statistics.hits + statistics.misses, 8u * 20000u);
+  ASSERT_LE(statistics.size, 1000u);
+  ASSERT_GT(statistics.hits, 0u);
+}
+
+TEST_F(TestData, transformer_caches_results) {
+  Transformer uncached(OffsetMapYamlDoc());
+  Transformer transformer;
+  ASSERT_EQ(transformer.query_cache_capacity(), 0u);
+  transformer.set_query_cache_capacity(100);
+  transformer.load(OffsetMapYamlDoc());
+  ASSERT_EQ(transformer.query_cache_capacity(), 100u);
+
+  std::vector<Point2D> points{{50, 60}, {35, 25}, {109, 60}, {50, 60}, {50, 60}};
+  for (auto const &point : points) {
+    ASSERT_EQ(transformer.to_robot(point), uncached.to_robot(point));
+    ASSERT_EQ(transformer.to_ref(point), uncached.to_ref(point));
+  }
+  auto statistics = transformer.to_robot_cache_statistics();
+  ASSERT_EQ(statistics.hits, 2u);
+  ASSERT_EQ(statistics.misses, 3u);
+  ASSERT_EQ(statistics.size, 3u);
+  ASSERT_EQ(transformer.to_ref_cache_statistics().hits, 2u);
+
+  // Correspondence points are found without the cache
+  transformer.to_robot(Point2D{40, 50});
+  ASSERT_EQ(transformer.to_robot_cache_statistics().misses, 3u);
+
+  transformer.reset();
+  ASSERT_EQ(transformer.to_robot_cache_statistics().size, 0u);
+  ASSERT_EQ(transformer.query_cache_capacity(), 100u);
+  transformer.load(OffsetMapYamlDoc());
+  transformer.to_robot(Point2D{50, 60});
+  statistics = transformer.to_robot_cache_statistics();
+  ASSERT_EQ(statistics.hits, 0u);
+  ASSERT_EQ(statistics.misses, 1u);
+
+  // Changing the triangulation changes the results, so the cache is emptied
+  transformer.set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+  ASSERT_EQ(transformer.to_robot_cache_statistics().size, 0u);
+
+  transformer.set_query_cache_capacity(0);
+  transformer.to_robot(Point2D{50, 60});
+  ASSERT_EQ(transformer.to_robot_cache_statistics().misses, 0u);
+}
@@ -0,0 +1,196 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/transformer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::SearchStrategy;
+using map_transformer::Transformer;
+
+
+class TestData : public ::testing::Test {
+protected:
+  // A map with a jittered grid of correspondence points, large enough for the automatic search
+  // strategy to choose an index, and with a map transform for points outside the triangulation
+  const std::string GridMapYamlDoc() {
+    std::ostringstream ref, robot;
+    for (int ii = 0; ii < 40; ++ii) {
+      for (int jj = 0; jj < 40; ++jj) {
+        int x = 10 + ii * 10 + (ii * 7 + jj * 3) % 5 - 2;
+        int y = 10 + jj * 10 + (ii * 3 + jj * 5) % 5 - 2;
+        ref << "    - [" << x << ", " << y << "]\n";
+        robot << "    - [" << x / 2 + (jj % 3) << ", " << y / 2 + 5 + (ii % 4) << "]\n";
+      }
+    }
+    return "ref_map:\n  name: reference\n  size: [420, 420]\n  correspondence_points:\n" +
+           ref.str() +
+           "robot_map:\n  name: robot\n  size: [220, 220]\n  transform:\n"
+           "    scale: [2, 2]\n    rotation: 0.1\n    translation: [2, 3]\n"
+           "  correspondence_points:\n" + robot.str();
+  }
+
+  // Query points covering every way a point can be transformed: inside triangles, exactly on
+  // correspondence points and triangle edges, and outside the triangulated area
+  std::vector<Point2D> QueryPoints(std::vector<Point2D> const &corr_points, float size) {
+    std::vector<Point2D> points;
+    std::uint32_t state = 1;
+    auto next = [&state, size]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1 << 24) * size * 1.2f -
+               size * 0.1f;
+      };
+    for (int ii = 0; ii < 1000; ++ii) {
+      float x = next();
+      points.emplace_back(x, next());
+    }
+    for (std::size_t ii = 0; ii + 1 < corr_points.size(); ii += 7) {
+      points.push_back(corr_points[ii]);
+      points.emplace_back(
+        (corr_points[ii].first + corr_points[ii + 1].first) / 2,
+        (corr_points[ii].second + corr_points[ii + 1].second) / 2);
+    }
+    return points;
+  }
+
+  // Compare results bit for bit, so that differences in the last place or in the sign of zero are
+  // not hidden by a floating point comparison
+  void ExpectBitIdentical(
+    std::vector<Point2D> const &expected,
+    std::vector<Point2D> const &actual,
+    std::string const &path)
+  {
+    ASSERT_EQ(expected.size(), actual.size()) << path;
+    for (std::size_t ii = 0; ii < expected.size(); ++ii) {
+      ASSERT_EQ(std::memcmp(&expected[ii].first, &actual[ii].first, sizeof(float)), 0) <<
+        path << " point " << ii;
+      ASSERT_EQ(std::memcmp(&expected[ii].second, &actual[ii].second, sizeof(float)), 0) <<
+        path << " point " << ii;
+    }
+  }
+
+  using BatchTransform = std::function<void(Point2D const *, std::size_t, Point2D *)>;
+
+  // Transform the points in chunks of the given size, shared between the given number of threads
+  std::vector<Point2D> TransformInParallel(
+    BatchTransform const &transform,
+    std::vector<Point2D> const &points,
+    std::size_t chunk_size,
+    unsigned int thread_count)
+  {
+    std::vector<Point2D> results(points.size());
+    std::vector<std::thread> threads;
+    for (unsigned int tt = 0; tt < thread_count; ++tt) {
+      threads.emplace_back(
+        [&, tt]() {
+          for (std::size_t start = tt * chunk_size; start < points.size();
+          start += thread_count * chunk_size)
+          {
+            std::size_t count = std::min(chunk_size, points.size() - start);
+            transform(points.data() + start, count, results.data() + start);
+          }
+        });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    return results;
+  }
+
+  // Transform the points by every available execution path and check that the results match
+  // transforming them one at a time with the linear search
+  void ExpectAllPathsIdentical(bool to_ref) {
+    Transformer transformer;
+    transformer.set_search_strategy(SearchStrategy::linear);
+    transformer.load(GridMapYamlDoc());
+    auto points = QueryPoints(
+      to_ref ? transformer.robot_map_corr_points() : transformer.ref_map_corr_points(),
+      to_ref ? 220 : 420);
+
+    std::vector<Point2D> expected;
+    for (auto const &point : points) {
+      expected.push_back(to_ref ? transformer.to_ref(point) : transformer.to_robot(point));
+    }
+
+    for (auto strategy : {SearchStrategy::linear, SearchStrategy::slab, SearchStrategy::quadtree,
+        SearchStrategy::grid, SearchStrategy::walk, SearchStrategy::automatic})
+    {
+      transformer.set_search_strategy(strategy);
+      std::string name = map_transformer::to_string(strategy);
+
+      std::vector<Point2D> single;
+      for (auto const &point : points) {
+        single.push_back(to_ref ? transformer.to_ref(point) : transformer.to_robot(point));
+      }
+      ExpectBitIdentical(expected, single, name + " single");
+      ExpectBitIdentical(
+        expected,
+        to_ref ? transformer.to_ref(points) : transformer.to_robot(points),
+        name + " vector");
+
+      BatchTransform batch = [&transformer, to_ref](
+        Point2D const *in, std::size_t count, Point2D *out) {
+          if (to_ref) {
+            transformer.to_ref(in, count, out);
+          } else {
+            transformer.to_robot(in, count, out);
+          }
+        };
+      auto in_place = points;
+      batch(in_place.data(), in_place.size(), in_place.data());
+      ExpectBitIdentical(expected, in_place, name + " in place");
+
+      for (std::size_t chunk_size : {1, 7, 256, 257}) {
+        for (unsigned int thread_count : {1, 3, 8}) {
+          ExpectBitIdentical(
+            expected,
+            TransformInParallel(batch, points, chunk_size, thread_count),
+            name + " chunk " + std::to_string(chunk_size) + " threads " +
+            std::to_string(thread_count));
+        }
+      }
+    }
+  }
+};
+
+
+TEST_F(TestData, all_paths_identical_to_ref) {
+  ExpectAllPathsIdentical(true);
+}
+
+TEST_F(TestData, all_paths_identical_to_robot) {
+  ExpectAllPathsIdentical(false);
+}
+
+TEST_F(TestData, reload_is_identical) {
+  Transformer first(GridMapYamlDoc());
+  Transformer second;
+  second.set_search_strategy(SearchStrategy::quadtree);
+  second.load(GridMapYamlDoc());
+  ASSERT_EQ(first.triangle_indices(), second.triangle_indices());
+
+  auto points = QueryPoints(first.robot_map_corr_points(), 220);
+  ExpectBitIdentical(first.to_ref(points), second.to_ref(points), "reloaded");
+}
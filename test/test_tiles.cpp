@@ -0,0 +1,305 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/tiled_transformer.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <yaml-cpp/yaml.h>
+
+using map_transformer::test::TEST_DATA_DIRECTORY;
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    tile_directory = std::filesystem::temp_directory_path() /
+      ("map_transformer_test_tiles_" +
+      std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+    std::filesystem::remove_all(tile_directory);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(tile_directory);
+  }
+
+  const std::string OffsetMapYamlDoc() {
+    return std::string(
+R"(ref_map:
+  name: reference
+  size: [100, 100]
+  image_file: )") + TEST_DATA_DIRECTORY + R"(/ref_map_100_100.png
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+    - [40, 70]
+    - [70, 70]
+    - [40, 20]
+    - [70, 20]
+    - [30, 50]
+    - [99, 50]
+    - [30, 70]
+    - [99, 70]
+    - [40, 99]
+    - [70, 99]
+robot_map:
+  name: robot
+  image_file: )" + TEST_DATA_DIRECTORY + R"(/robot_map_80_110.png
+  size: [80, 110]
+  transform:
+    scale: [1, 1]
+    rotation: 0
+    translation: [30, 20]
+  correspondence_points:
+    - [0, 0]
+    - [10, 20]
+    - [46, 20]
+    - [10, 51]
+    - [40, 55]
+    - [10, 0]
+    - [50, 0]
+    - [0, 20]
+    - [69, 20]
+    - [0, 50]
+    - [69, 59]
+    - [10, 79]
+    - [34, 79]
+)";
+  }
+
+  std::filesystem::path tile_directory;
+};
+
+
+TEST_F(TestData, tiles_match_untiled_transformer) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  // A tile size that does not divide the map evenly puts many triangle edges and correspondence
+  // points on or near tile borders
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 7);
+  map_transformer::TiledTransformer tiled(tile_directory.string(), 4);
+
+  ASSERT_EQ(tiled.ref_map_name(), "reference");
+  ASSERT_EQ(tiled.robot_map_name(), "robot");
+  ASSERT_EQ(tiled.tile_size(), 7);
+
+  for (float x = -35; x <= 115; x += 0.5) {
+    for (float y = -25; y <= 135; y += 0.5) {
+      map_transformer::Point2D point{x, y};
+      ASSERT_EQ(tiled.to_ref(point), transformer.to_ref(point));
+      ASSERT_EQ(tiled.to_robot(point), transformer.to_robot(point));
+    }
+  }
+  for (auto const &p : transformer.robot_map_corr_points()) {
+    ASSERT_EQ(tiled.to_ref(p), transformer.to_ref(p));
+  }
+  for (auto const &p : transformer.ref_map_corr_points()) {
+    ASSERT_EQ(tiled.to_robot(p), transformer.to_robot(p));
+  }
+}
+
+TEST_F(TestData, tiles_single_tile) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 1000);
+  map_transformer::TiledTransformer tiled(tile_directory.string(), 1);
+
+  for (float x = -35; x <= 115; x += 1) {
+    for (float y = -25; y <= 135; y += 1) {
+      map_transformer::Point2D point{x, y};
+      ASSERT_EQ(tiled.to_ref(point), transformer.to_ref(point));
+      ASSERT_EQ(tiled.to_robot(point), transformer.to_robot(point));
+    }
+  }
+  ASSERT_EQ(tiled.resident_tile_count(), 1u);
+}
+
+TEST_F(TestData, tiles_paged_in_on_demand) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 10);
+  map_transformer::TiledTransformer tiled(tile_directory.string(), 3);
+  ASSERT_EQ(tiled.resident_tile_count(), 0u);
+
+  tiled.to_robot(map_transformer::Point2D{55, 70});
+  ASSERT_EQ(tiled.resident_tile_count(), 1u);
+  // Queries in the same tile do not page in more tiles
+  tiled.to_robot(map_transformer::Point2D{56, 71});
+  ASSERT_EQ(tiled.resident_tile_count(), 1u);
+  // Queries outside the tiled area do not page in any tiles
+  tiled.to_robot(map_transformer::Point2D{1000, 1000});
+  ASSERT_EQ(tiled.resident_tile_count(), 1u);
+
+  for (float x = 30; x < 100; x += 10) {
+    tiled.to_ref(map_transformer::Point2D{x, 30});
+    ASSERT_LE(tiled.resident_tile_count(), 3u);
+  }
+  ASSERT_EQ(tiled.resident_tile_count(), 3u);
+
+  tiled.evict_all();
+  ASSERT_EQ(tiled.resident_tile_count(), 0u);
+
+  tiled.preload_to_ref(map_transformer::Point2D{0, 0}, map_transformer::Point2D{15, 5});
+  ASSERT_EQ(tiled.resident_tile_count(), 2u);
+  tiled.preload_to_robot(map_transformer::Point2D{0, 0}, map_transformer::Point2D{1000, 1000});
+  ASSERT_EQ(tiled.resident_tile_count(), 3u);
+}
+
+TEST_F(TestData, tiles_far_and_nan_points) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 10);
+  map_transformer::TiledTransformer tiled(tile_directory.string(), 4);
+
+  // Points that are not in any tile are transformed by the map transform alone, as the untiled
+  // transformer does, whether they are NaN or too far away for their tile to be an int
+  auto same = [](float a, float b) {return a == b || (std::isnan(a) && std::isnan(b));};
+  float const nan = std::numeric_limits<float>::quiet_NaN();
+  float const infinity = std::numeric_limits<float>::infinity();
+  map_transformer::Point2D points[] = {
+    {1e30f, 1e30f}, {-1e30f, 40}, {40, -1e30f}, {3e9f, 3e9f}, {infinity, 40}, {40, -infinity},
+    {nan, 40}, {40, nan}, {nan, nan}};
+  for (auto const &point : points) {
+    auto tiled_point = tiled.to_ref(point);
+    auto expected = transformer.to_ref(point);
+    ASSERT_TRUE(same(tiled_point.first, expected.first) &&
+      same(tiled_point.second, expected.second)) << point.first << ", " << point.second;
+    tiled_point = tiled.to_robot(point);
+    expected = transformer.to_robot(point);
+    ASSERT_TRUE(same(tiled_point.first, expected.first) &&
+      same(tiled_point.second, expected.second)) << point.first << ", " << point.second;
+  }
+  ASSERT_EQ(tiled.resident_tile_count(), 0u);
+
+  // Preloading an area with a corner that is NaN or outside the grid loads only tiles in it
+  tiled.preload_to_ref({nan, 0}, {1000, 1000});
+  tiled.preload_to_ref({1e30f, 1e30f}, {infinity, infinity});
+  ASSERT_EQ(tiled.resident_tile_count(), 0u);
+  tiled.preload_to_ref({-1e30f, -1e30f}, {5, 5});
+  ASSERT_EQ(tiled.resident_tile_count(), 1u);
+}
+
+TEST_F(TestData, tiles_write_errors) {
+  map_transformer::Transformer empty;
+  ASSERT_THROW(
+    map_transformer::TiledTransformer::write_tiles(empty, tile_directory.string(), 10),
+    std::logic_error);
+
+  // Tile sizes that are not finite and positive are refused, and so are those so small that the
+  // grid would not fit in memory or its dimensions in an int, before any tile is written
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  for (float tile_size : {
+      0.0f, -10.0f, std::numeric_limits<float>::quiet_NaN(),
+      std::numeric_limits<float>::infinity(), 1e-3f, 1e-30f,
+      std::numeric_limits<float>::denorm_min()})
+  {
+    ASSERT_THROW(
+      map_transformer::TiledTransformer::write_tiles(
+        transformer, tile_directory.string(), tile_size),
+      std::invalid_argument) << tile_size;
+    ASSERT_FALSE(std::filesystem::exists(tile_directory / "tiles.yaml"));
+  }
+}
+
+TEST_F(TestData, tiles_read_errors) {
+  ASSERT_THROW(
+    map_transformer::TiledTransformer(tile_directory.string()),
+    std::runtime_error);
+
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 10);
+  ASSERT_THROW(
+    map_transformer::TiledTransformer(tile_directory.string(), 0),
+    std::invalid_argument);
+
+  // Counts larger than the file are reported as errors rather than allocated, and so are files
+  // that end early
+  std::uint32_t huge_count = 0xffffffff;
+  for (auto const &entry : std::filesystem::directory_iterator(tile_directory)) {
+    auto name = entry.path().filename().string();
+    if (name.rfind("to_ref_", 0) == 0) {
+      std::fstream tile(entry.path(), std::ios::binary | std::ios::in | std::ios::out);
+      tile.seekp(12);
+      tile.write(reinterpret_cast<char const *>(&huge_count), sizeof(huge_count));
+    } else if (name.rfind("to_robot_", 0) == 0) {
+      std::filesystem::resize_file(entry.path(), std::filesystem::file_size(entry.path()) - 4);
+    }
+  }
+  map_transformer::TiledTransformer tiled(tile_directory.string());
+  ASSERT_THROW(tiled.to_ref({40, 40}), std::runtime_error);
+  ASSERT_THROW(tiled.to_robot({50, 50}), std::runtime_error);
+}
+
+TEST_F(TestData, tiles_missing_file) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 10);
+  map_transformer::TiledTransformer tiled(tile_directory.string());
+  auto expected = tiled.to_ref({40, 40});
+
+  // A tile the manifest lists must be read, rather than treated as empty if its file is missing
+  auto origin = YAML::LoadFile((tile_directory / "tiles.yaml").string())["to_ref"]["origin"];
+  auto tile_file = tile_directory / (
+    "to_ref_" + std::to_string(static_cast<int>((40 - origin[0].as<float>()) / 10)) + "_" +
+    std::to_string(static_cast<int>((40 - origin[1].as<float>()) / 10)) + ".tile");
+  ASSERT_TRUE(std::filesystem::remove(tile_file));
+  tiled.evict_all();
+  ASSERT_THROW(tiled.to_ref({40, 40}), std::runtime_error);
+  ASSERT_THROW(tiled.preload_to_ref({40, 40}, {40, 40}), std::runtime_error);
+  ASSERT_EQ(tiled.to_robot({50, 50}), transformer.to_robot({50, 50}));
+  ASSERT_EQ(expected, transformer.to_ref({40, 40}));
+}
+
+TEST_F(TestData, tiles_manifest_errors) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  map_transformer::TiledTransformer::write_tiles(transformer, tile_directory.string(), 10);
+  auto manifest_file = (tile_directory / "tiles.yaml").string();
+  auto manifest = YAML::LoadFile(manifest_file);
+
+  // A tile size or grid that write_tiles() would not have written is rejected when the manifest
+  // is read, rather than used to find tiles
+  std::vector<std::function<void(YAML::Node &)>> changes{
+    [](YAML::Node &m) {m["tile_size"] = 0;},
+    [](YAML::Node &m) {m["tile_size"] = -10;},
+    [](YAML::Node &m) {m["tile_size"] = ".nan";},
+    [](YAML::Node &m) {m["tile_size"] = ".inf";},
+    [](YAML::Node &m) {m["to_ref"]["columns"] = 0;},
+    [](YAML::Node &m) {m["to_robot"]["rows"] = -1;},
+    [](YAML::Node &m) {m["to_ref"]["origin"][0] = ".nan";},
+    [](YAML::Node &m) {m["to_robot"]["origin"][1] = "-.inf";},
+    [](YAML::Node &m) {m["to_ref"].remove("tiles");},
+    [](YAML::Node &m) {m["to_robot"]["tiles"].push_back(std::vector<int>{-1, 0});},
+    [](YAML::Node &m) {
+      m["to_ref"]["tiles"].push_back(
+        std::vector<int>{m["to_ref"]["columns"].as<int>(), 0});
+    }};
+  for (std::size_t ii = 0; ii < changes.size(); ++ii) {
+    auto changed = YAML::Clone(manifest);
+    changes[ii](changed);
+    std::ofstream(manifest_file, std::ios::trunc) << changed << '\n';
+    ASSERT_THROW(
+      map_transformer::TiledTransformer(tile_directory.string()),
+      std::runtime_error) << ii;
+  }
+
+  std::ofstream(manifest_file, std::ios::trunc) << manifest << '\n';
+  ASSERT_NO_THROW(map_transformer::TiledTransformer(tile_directory.string()));
+}
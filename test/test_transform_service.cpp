@@ -0,0 +1,420 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/shared_memory_client.hpp"
+#include "map_transformer/test_config.hpp"
+#include "map_transformer/transform_client.hpp"
+#include "map_transformer/transform_server.hpp"
+#include "map_transformer/transformer.hpp"
+
+#include "test_helpers.hpp"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using map_transformer::Point2D;
+using map_transformer::SharedMemoryClient;
+using map_transformer::TransformClient;
+using map_transformer::Transformer;
+using map_transformer::TransformServer;
+using map_transformer::TransformServerOptions;
+using map_transformer::protocol::Lane;
+using map_transformer::test::EmbeddedMapYamlDoc;
+using map_transformer::test::EmbeddedMapYamlFile;
+using map_transformer::test::RandomPoints;
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto yaml_doc = EmbeddedMapYamlDoc();
+    auto midpoint = std::make_shared<Transformer>(yaml_doc);
+    auto per_direction = std::make_shared<Transformer>();
+    per_direction->set_triangulation_mode(map_transformer::TriangulationMode::per_direction);
+    per_direction->load(yaml_doc);
+    maps = {midpoint, per_direction};
+    socket_path = (std::filesystem::temp_directory_path() /
+      ("map_transformer_test_" + std::to_string(::getpid()) + "_" +
+      ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".sock")).string();
+  }
+
+  static bool Identical(std::vector<Point2D> const &expected, std::vector<Point2D> const &actual) {
+    return expected.size() == actual.size() &&
+           std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(Point2D)) == 0;
+  }
+
+  std::vector<std::shared_ptr<Transformer const>> maps;
+  std::string socket_path;
+};
+
+
+TEST_F(TestData, client_matches_transformer) {
+  TransformServer server(maps, socket_path);
+  // Batches both smaller and larger than the latency lane's batches
+  for (std::size_t count : {std::size_t{1}, std::size_t{50}, std::size_t{5000}}) {
+    auto points = RandomPoints(count);
+    for (std::uint32_t map = 0; map < maps.size(); ++map) {
+      TransformClient client(socket_path, map);
+      ASSERT_TRUE(Identical(maps[map]->to_ref(points), client.to_ref(points)));
+      ASSERT_TRUE(Identical(maps[map]->to_robot(points), client.to_robot(points)));
+    }
+  }
+
+  TransformClient client(socket_path);
+  Point2D point{12.5f, 3.0f};
+  auto expected = maps[0]->to_ref(point);
+  auto actual = client.to_ref(point);
+  ASSERT_EQ(std::memcmp(&expected, &actual, sizeof(Point2D)), 0);
+  expected = maps[0]->to_robot(point);
+  actual = client.to_robot(point);
+  ASSERT_EQ(std::memcmp(&expected, &actual, sizeof(Point2D)), 0);
+
+  auto statistics = server.statistics();
+  ASSERT_EQ(statistics.requests, 14u);
+  ASSERT_EQ(statistics.points, 2 * 2 * (1 + 50 + 5000) + 2u);
+  ASSERT_EQ(statistics.latency.requests, 14u);
+  ASSERT_EQ(statistics.latency.points, statistics.points);
+  // The requests are sent one at a time, so each is a batch, except that the largest are split
+  ASSERT_EQ(statistics.latency.batches, 2 * 2 * (1 + 1 + 5) + 2u);
+  ASSERT_EQ(statistics.throughput.requests, 0u);
+  ASSERT_GT(statistics.latency.median_latency, 0.0);
+  ASSERT_LE(statistics.latency.median_latency, statistics.latency.p99_latency);
+  ASSERT_LE(statistics.latency.p99_latency, statistics.latency.max_latency);
+}
+
+TEST_F(TestData, concurrent_small_requests) {
+  TransformServer server(maps, socket_path);
+  constexpr std::size_t clients = 8;
+  constexpr std::size_t requests = 300;
+  std::vector<std::thread> threads;
+  std::vector<bool> matched(clients, false);
+  for (std::size_t ii = 0; ii < clients; ++ii) {
+    threads.emplace_back(
+      [&, ii]() {
+        // Each client uses a different map and direction from its neighbours, so that combined
+        // batches must be split up between them, and half of them use each lane
+        TransformClient client(
+          socket_path, ii % 2, ii < clients / 2 ? Lane::latency : Lane::throughput);
+        auto points = RandomPoints(requests * 3, static_cast<unsigned int>(ii));
+        std::vector<Point2D> results(points.size());
+        bool to_ref = (ii / 2) % 2 == 0;
+        for (std::size_t request = 0; request < requests; ++request) {
+          auto *start = points.data() + request * 3;
+          if (to_ref) {
+            client.to_ref(start, 1 + request % 3, results.data() + request * 3);
+          } else {
+            client.to_robot(start, 1 + request % 3, results.data() + request * 3);
+          }
+        }
+        bool all_match = true;
+        for (std::size_t request = 0; request < requests; ++request) {
+          std::vector<Point2D> sent(
+            points.begin() + request * 3, points.begin() + request * 3 + 1 + request % 3);
+          std::vector<Point2D> received(
+            results.begin() + request * 3, results.begin() + request * 3 + 1 + request % 3);
+          auto expected = to_ref ? maps[ii % 2]->to_ref(sent) : maps[ii % 2]->to_robot(sent);
+          all_match = all_match && Identical(expected, received);
+        }
+        matched[ii] = all_match;
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (std::size_t ii = 0; ii < clients; ++ii) {
+    ASSERT_TRUE(matched[ii]) << "client " << ii;
+  }
+
+  auto statistics = server.statistics();
+  ASSERT_EQ(statistics.requests, clients * requests);
+  for (auto const &lane : {statistics.latency, statistics.throughput}) {
+    ASSERT_EQ(lane.requests, clients / 2 * requests);
+    ASSERT_GE(lane.batches, 1u);
+    ASSERT_LE(lane.batches, lane.requests);
+    ASSERT_EQ(lane.rejected, 0u);
+  }
+}
+
+TEST_F(TestData, lanes_and_admission) {
+  TransformServerOptions options;
+  options.latency.threads = 1;
+  options.latency.max_batch_points = 100;
+  options.throughput.threads = 3;
+  options.throughput.max_batch_points = 1000;
+  options.throughput.max_queued_points = 5000;
+  TransformServer server(maps, socket_path, options);
+
+  // Results from both lanes are identical whatever the batches they are split into
+  TransformClient latency(socket_path, 0);
+  TransformClient throughput(socket_path, 1, Lane::throughput);
+  auto points = RandomPoints(5000);
+  ASSERT_TRUE(Identical(maps[0]->to_ref(points), latency.to_ref(points)));
+  ASSERT_TRUE(Identical(maps[1]->to_robot(points), throughput.to_robot(points)));
+
+  // Requests that would take the lane over its limit are refused, and the connection stays open
+  ASSERT_THROW(throughput.to_ref(RandomPoints(5001)), std::runtime_error);
+  ASSERT_TRUE(Identical(maps[1]->to_ref(points), throughput.to_ref(points)));
+
+  auto statistics = server.statistics();
+  ASSERT_EQ(statistics.latency.threads, 1u);
+  ASSERT_EQ(statistics.throughput.threads, 3u);
+  ASSERT_EQ(statistics.requests, 4u);
+  ASSERT_EQ(statistics.latency.requests, 1u);
+  ASSERT_EQ(statistics.latency.batches, 50u);
+  ASSERT_EQ(statistics.latency.rejected, 0u);
+  ASSERT_EQ(statistics.throughput.requests, 2u);
+  ASSERT_EQ(statistics.throughput.points, 10000u);
+  ASSERT_EQ(statistics.throughput.rejected, 1u);
+
+  TransformServerOptions invalid;
+  invalid.throughput.max_batch_points = 0;
+  ASSERT_THROW(TransformServer(maps, socket_path, invalid), std::invalid_argument);
+  invalid = {};
+  invalid.latency.cpus = {-1};
+  ASSERT_THROW(TransformServer(maps, socket_path, invalid), std::invalid_argument);
+}
+
+TEST_F(TestData, default_lane_split) {
+  // The latency lane has two threads, and the throughput lane the remaining CPUs
+  cpu_set_t allowed;
+  ASSERT_EQ(::sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  auto throughput_threads = std::max(2, CPU_COUNT(&allowed)) - 2;
+  auto expected = std::to_string(2) + " latency and " +
+    std::to_string(std::max(1, throughput_threads)) + " throughput threads";
+  {
+    TransformServer server(maps, socket_path);
+    auto statistics = server.statistics();
+    ASSERT_EQ(statistics.latency.threads, 2u);
+    ASSERT_EQ(statistics.throughput.threads, std::max<std::size_t>(1, throughput_threads));
+  }
+
+  // So does a daemon given no lane options
+  auto output = std::filesystem::path(socket_path).replace_extension(".txt");
+  auto map_file = EmbeddedMapYamlFile();
+  auto socket_option = "--socket=" + socket_path;
+  pid_t daemon = ::fork();
+  ASSERT_GE(daemon, 0);
+  if (daemon == 0) {
+    int file = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ::dup2(file, STDOUT_FILENO);
+    ::execl(
+      MAP_TRANSFORM_DAEMON, MAP_TRANSFORM_DAEMON, socket_option.c_str(), map_file.c_str(),
+      static_cast<char *>(nullptr));
+    ::_exit(127);
+  }
+  std::string listening;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (listening.empty() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::ifstream file(output);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (line.rfind("Listening on", 0) == 0) {
+        listening = line;
+      }
+    }
+  }
+  ::kill(daemon, SIGTERM);
+  int status;
+  ::waitpid(daemon, &status, 0);
+  std::filesystem::remove(output);
+  ASSERT_NE(listening.find(expected), std::string::npos) << listening;
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+TEST_F(TestData, shared_memory_matches_transformer) {
+  TransformServer server(maps, socket_path);
+  for (std::uint32_t map = 0; map < maps.size(); ++map) {
+    SharedMemoryClient client(socket_path, map, 50000);
+    // A frame that fits in the channel, and a batch that must be split into several requests
+    for (std::size_t count : {std::size_t{40000}, std::size_t{120000}}) {
+      auto points = RandomPoints(count);
+      ASSERT_TRUE(Identical(maps[map]->to_ref(points), client.to_ref(points)));
+      ASSERT_TRUE(Identical(maps[map]->to_robot(points), client.to_robot(points)));
+    }
+    Point2D point{12.5f, 3.0f};
+    auto expected = maps[map]->to_ref(point);
+    auto actual = client.to_ref(point);
+    ASSERT_EQ(std::memcmp(&expected, &actual, sizeof(Point2D)), 0);
+    expected = maps[map]->to_robot(point);
+    actual = client.to_robot(point);
+    ASSERT_EQ(std::memcmp(&expected, &actual, sizeof(Point2D)), 0);
+  }
+
+  auto statistics = server.statistics();
+  ASSERT_EQ(statistics.channels, 2u);
+  ASSERT_EQ(statistics.requests, 2 * (2 + 6 + 2u));
+  ASSERT_EQ(statistics.points, 2 * 2 * (40000 + 120000 + 1u));
+  ASSERT_EQ(statistics.latency.requests + statistics.throughput.requests, 0u);
+}
+
+TEST_F(TestData, shared_memory_requests_in_flight) {
+  TransformServer server(maps, socket_path);
+  SharedMemoryClient client(socket_path, 1, 1000);
+  ASSERT_EQ(client.capacity(), 1000u);
+  ASSERT_THROW(client.reserve(0), std::invalid_argument);
+  ASSERT_THROW(client.reserve(1001), std::invalid_argument);
+  ASSERT_THROW(client.submit(map_transformer::protocol::Operation::to_ref), std::logic_error);
+  ASSERT_THROW(client.wait(0), std::logic_error);
+
+  // Several requests are written into the channel before any is waited for, until it is full
+  std::vector<std::vector<Point2D>> sent;
+  std::vector<std::uint64_t> requests;
+  for (unsigned int ii = 0; ii < 3; ++ii) {
+    sent.push_back(RandomPoints(300, ii));
+    std::copy(sent.back().begin(), sent.back().end(), client.reserve(300));
+    requests.push_back(client.submit(
+        ii % 2 == 0 ?
+        map_transformer::protocol::Operation::to_ref :
+        map_transformer::protocol::Operation::to_robot));
+  }
+  ASSERT_THROW(client.reserve(300), std::logic_error);
+
+  // Waiting for the last request waits for all of them, and each one's results stay in place
+  auto last = client.wait(requests.back());
+  for (std::size_t ii = 0; ii < requests.size(); ++ii) {
+    auto results = ii == 2 ? last : client.wait(requests[ii]);
+    auto expected = ii % 2 == 0 ? maps[1]->to_ref(sent[ii]) : maps[1]->to_robot(sent[ii]);
+    ASSERT_TRUE(Identical(expected, std::vector<Point2D>(results, results + 300))) << ii;
+  }
+
+  // Once every request has been waited for the whole channel can be used again
+  auto points = RandomPoints(1000);
+  std::copy(points.begin(), points.end(), client.reserve(1000));
+  auto results = client.wait(client.submit(map_transformer::protocol::Operation::to_ref));
+  ASSERT_TRUE(Identical(maps[1]->to_ref(points), std::vector<Point2D>(results, results + 1000)));
+}
+
+TEST_F(TestData, shared_memory_header_not_trusted) {
+  TransformServer server(maps, socket_path);
+  auto client = std::make_unique<SharedMemoryClient>(socket_path, 0, 1000);
+  // The ring follows the header, so the first point reserved finds it
+  auto *channel = reinterpret_cast<map_transformer::protocol::ChannelHeader *>(
+    client->reserve(1)) - 1;
+
+  // A request outside the ring is refused even when the header claims that the ring is larger
+  channel->capacity = 0xFFFFFFFF;
+  channel->slots[0] = {
+    0, map_transformer::protocol::Operation::to_ref, 1u << 30, 1,
+    map_transformer::protocol::Status::ok};
+  channel->submitted.store(1, std::memory_order_release);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (channel->completed.load(std::memory_order_acquire) != 1 &&
+    std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(channel->completed.load(), 1u);
+  ASSERT_EQ(channel->slots[0].status, map_transformer::protocol::Status::bad_request);
+  client.reset();
+
+  // The server is still serving
+  SharedMemoryClient other(socket_path);
+  auto points = RandomPoints(10);
+  ASSERT_TRUE(Identical(maps[0]->to_ref(points), other.to_ref(points)));
+}
+
+TEST_F(TestData, replace_map) {
+  TransformServer server({maps[0]}, socket_path);
+  TransformClient client(socket_path);
+  auto points = RandomPoints(100);
+  ASSERT_TRUE(Identical(maps[0]->to_ref(points), client.to_ref(points)));
+
+  // Connected clients use the new map from their next request
+  server.replace_map(0, maps[1]);
+  ASSERT_TRUE(Identical(maps[1]->to_ref(points), client.to_ref(points)));
+
+  ASSERT_THROW(server.replace_map(1, maps[0]), std::out_of_range);
+  ASSERT_THROW(server.replace_map(0, nullptr), std::invalid_argument);
+  ASSERT_THROW(server.replace_map(0, std::make_shared<Transformer const>()), std::logic_error);
+}
+
+TEST_F(TestData, accept_errors_back_off) {
+  TransformServer server(maps, socket_path);
+  int pending = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ASSERT_GE(pending, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  // With no file descriptors free, the connection waits to be accepted and keeps the listening
+  // socket readable, which must not keep the server busy
+  int lowest_free = ::dup(0);
+  ASSERT_GE(lowest_free, 0);
+  ::close(lowest_free);
+  rlimit original;
+  ASSERT_EQ(::getrlimit(RLIMIT_NOFILE, &original), 0);
+  rlimit limited = original;
+  limited.rlim_cur = lowest_free;
+  ASSERT_EQ(::setrlimit(RLIMIT_NOFILE, &limited), 0);
+  ASSERT_EQ(::connect(pending, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+  auto cpu_time = []() {
+      rusage usage;
+      ::getrusage(RUSAGE_SELF, &usage);
+      return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+             (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+    };
+  auto cpu_before = cpu_time();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  auto cpu_used = cpu_time() - cpu_before;
+  ASSERT_EQ(::setrlimit(RLIMIT_NOFILE, &original), 0);
+  ASSERT_LT(cpu_used, 0.1);
+
+  // Once descriptors are free again, connections are accepted
+  TransformClient client(socket_path);
+  auto points = RandomPoints(10);
+  ASSERT_TRUE(Identical(maps[0]->to_ref(points), client.to_ref(points)));
+  ::close(pending);
+}
+
+TEST_F(TestData, service_errors) {
+  ASSERT_THROW(TransformClient client(socket_path), std::runtime_error);
+  ASSERT_THROW(TransformServer({}, socket_path), std::invalid_argument);
+  ASSERT_THROW(
+    TransformServer({std::make_shared<Transformer const>()}, socket_path), std::logic_error);
+
+  auto server = std::make_unique<TransformServer>(maps, socket_path);
+  TransformClient unknown_map(socket_path, 2);
+  ASSERT_THROW(unknown_map.to_ref(Point2D{1.0f, 2.0f}), std::runtime_error);
+  ASSERT_THROW(SharedMemoryClient(socket_path, 2), std::runtime_error);
+  ASSERT_THROW(SharedMemoryClient(socket_path, 0, 0), std::invalid_argument);
+
+  // Clients fail once their server has stopped, and the socket is removed
+  TransformClient client(socket_path);
+  client.to_ref(Point2D{1.0f, 2.0f});
+  SharedMemoryClient shared_memory_client(socket_path);
+  shared_memory_client.to_ref(Point2D{1.0f, 2.0f});
+  server.reset();
+  ASSERT_FALSE(std::filesystem::exists(socket_path));
+  ASSERT_THROW(client.to_ref(Point2D{1.0f, 2.0f}), std::runtime_error);
+  ASSERT_THROW(shared_memory_client.to_ref(Point2D{1.0f, 2.0f}), std::runtime_error);
+}
@@ -17,6 +17,8 @@
 
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <yaml-cpp/yaml.h>
@@ -602,3 +604,97 @@ TEST_F(TestData, transform_calculate_bounding_box) {
   expected.second.first = 110; expected.second.second = 130;
   ASSERT_EQ(offset_transformer.bounding_box(), expected);
 }
+
+TEST_F(TestData, query_results_to_ref) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  auto const &corr_points = transformer.robot_map_corr_points();
+  auto const &triangles = transformer.robot_map_triangle_indices();
+
+  std::vector<map_transformer::Point2D> points;
+  for (float x = -10; x <= 90; x += 2.5) {
+    for (float y = -10; y <= 120; y += 2.5) {
+      points.emplace_back(x, y);
+    }
+  }
+  points.insert(std::end(points), std::begin(corr_points), std::end(corr_points));
+
+  auto batch = transformer.query_to_ref(points);
+  ASSERT_EQ(batch.size(), points.size());
+  bool found_triangle{false}, found_map_transform{false};
+  for (std::size_t ii = 0; ii < points.size(); ++ii) {
+    auto result = transformer.query_to_ref(points[ii]);
+    ASSERT_EQ(result.point, transformer.to_ref(points[ii]));
+    ASSERT_EQ(batch[ii].point, result.point);
+    ASSERT_EQ(batch[ii].path, result.path);
+    ASSERT_EQ(batch[ii].triangle, result.triangle);
+    ASSERT_EQ(batch[ii].barycentric, result.barycentric);
+
+    switch (result.path) {
+      case map_transformer::TransformPath::correspondence_point:
+        ASSERT_EQ(corr_points[result.correspondence_point], points[ii]);
+        ASSERT_EQ(result.triangle, -1);
+        break;
+      case map_transformer::TransformPath::triangle: {
+          found_triangle = true;
+          ASSERT_EQ(result.correspondence_point, -1);
+          ASSERT_GE(result.triangle, 0);
+          ASSERT_LT(result.triangle, static_cast<int>(triangles.size()));
+          // The barycentric coordinates give the point in the robot map, and the result in the
+          // reference map
+          auto const &t = triangles[result.triangle];
+          int vertices[3] = {std::get<0>(t), std::get<1>(t), std::get<2>(t)};
+          double weight{0}, x{0}, y{0}, ref_x{0}, ref_y{0};
+          for (int jj = 0; jj < 3; ++jj) {
+            ASSERT_GE(result.barycentric[jj], -1e-9);
+            weight += result.barycentric[jj];
+            x += result.barycentric[jj] * corr_points[vertices[jj]].first;
+            y += result.barycentric[jj] * corr_points[vertices[jj]].second;
+            ref_x += result.barycentric[jj] * transformer.ref_map_corr_points()[vertices[jj]].first;
+            ref_y +=
+              result.barycentric[jj] * transformer.ref_map_corr_points()[vertices[jj]].second;
+          }
+          ASSERT_NEAR(weight, 1, 1e-9);
+          ASSERT_NEAR(x, points[ii].first, 1e-3);
+          ASSERT_NEAR(y, points[ii].second, 1e-3);
+          ASSERT_NEAR(ref_x, result.point.first, 1e-3);
+          ASSERT_NEAR(ref_y, result.point.second, 1e-3);
+          break;
+        }
+      case map_transformer::TransformPath::map_transform:
+        found_map_transform = true;
+        ASSERT_EQ(result.correspondence_point, -1);
+        ASSERT_EQ(result.triangle, -1);
+        break;
+    }
+  }
+  ASSERT_TRUE(found_triangle);
+  ASSERT_TRUE(found_map_transform);
+}
+
+TEST_F(TestData, query_results_to_robot) {
+  map_transformer::Transformer transformer(OffsetMapYamlDoc());
+  auto result = transformer.query_to_robot(map_transformer::Point2D{40, 50});
+  ASSERT_EQ(result.path, map_transformer::TransformPath::correspondence_point);
+  ASSERT_EQ(result.correspondence_point, 1);
+  ASSERT_FLOAT_EQ(result.point.first, 10);
+  ASSERT_FLOAT_EQ(result.point.second, 20);
+
+  result = transformer.query_to_robot(map_transformer::Point2D{109, 60});
+  ASSERT_EQ(result.path, map_transformer::TransformPath::map_transform);
+  ASSERT_FLOAT_EQ(result.point.first, 79);
+  ASSERT_FLOAT_EQ(result.point.second, 40);
+
+  map_transformer::Point2D centre{50, 60};
+  result = transformer.query_to_robot(centre);
+  ASSERT_EQ(result.path, map_transformer::TransformPath::triangle);
+  ASSERT_EQ(result.point, transformer.to_robot(centre));
+  ASSERT_NEAR(result.barycentric[0] + result.barycentric[1] + result.barycentric[2], 1, 1e-9);
+  map_transformer::QueryResult batch;
+  transformer.query_to_robot(&centre, 1, &batch);
+  ASSERT_EQ(batch.triangle, result.triangle);
+
+  map_transformer::Transformer empty;
+  ASSERT_THROW(empty.query_to_ref(centre), std::logic_error);
+  ASSERT_THROW(
+    empty.query_to_robot(std::vector<map_transformer::Point2D>{centre}), std::logic_error);
+}
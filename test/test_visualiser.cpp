@@ -0,0 +1,155 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "map_transformer/test_config.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using map_transformer::test::TEST_DATA_DIRECTORY;
+
+
+class TestData : public ::testing::Test {
+protected:
+  void SetUp() override {
+    directory = std::filesystem::temp_directory_path() /
+      ("map_transformer_test_visualiser_" +
+      std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::ofstream map(Path("map.yaml"));
+    map << OffsetMapYamlDoc();
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(directory);
+  }
+
+  // The offset sample map, with its images in the test data directory
+  std::string OffsetMapYamlDoc() {
+    return std::string(
+R"(ref_map:
+  name: reference
+  size: [100, 100]
+  image_file: )") + TEST_DATA_DIRECTORY + R"(/ref_map_100_100.png
+  correspondence_points:
+    - [30, 20]
+    - [40, 50]
+    - [70, 50]
+    - [40, 70]
+    - [70, 70]
+    - [40, 20]
+    - [70, 20]
+    - [30, 50]
+    - [99, 50]
+    - [30, 70]
+    - [99, 70]
+    - [40, 99]
+    - [70, 99]
+robot_map:
+  name: robot
+  image_file: )" + TEST_DATA_DIRECTORY + R"(/robot_map_80_110.png
+  size: [80, 110]
+  transform:
+    scale: [1, 1]
+    rotation: 0
+    translation: [30, 20]
+  correspondence_points:
+    - [0, 0]
+    - [10, 20]
+    - [46, 20]
+    - [10, 51]
+    - [40, 55]
+    - [10, 0]
+    - [50, 0]
+    - [0, 20]
+    - [69, 20]
+    - [0, 50]
+    - [69, 59]
+    - [10, 79]
+    - [34, 79]
+)";
+  }
+
+  // Run the visualiser with the given arguments, returning its exit status
+  int Run(std::string const &arguments) {
+    std::string command = std::string(TRANSFORM_VISUALISER) + " --map-info-file=" +
+      Path("map.yaml") + " " + arguments + " >" + Path("stdout.txt") + " 2>&1";
+    return std::system(command.c_str());
+  }
+
+  std::string Path(std::string const &name) {
+    return (directory / name).string();
+  }
+
+  std::string ReadFile(std::string const &name) {
+    std::ifstream file(Path(name), std::ios::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  std::filesystem::path directory;
+};
+
+
+TEST_F(TestData, headless_render) {
+  {
+    // A correspondence point, a point inside a triangle, and one outside the triangulation
+    std::ofstream queries(Path("queries.csv"));
+    queries << "# x,y in the robot map\n10,20\n\n20, 30\n500,500\n";
+    std::ofstream trajectory(Path("trajectory.csv"));
+    trajectory << "5,5\n20,30\n40,40\n";
+  }
+  ASSERT_EQ(
+    Run("-c -t --queries=" + Path("queries.csv") + " --trajectory=" + Path("trajectory.csv") +
+    " --output=" + Path("render")), 0) << ReadFile("stdout.txt");
+  ASSERT_TRUE(std::filesystem::exists(Path("render_ref.png")));
+  ASSERT_TRUE(std::filesystem::exists(Path("render_robot.png")));
+  ASSERT_GT(std::filesystem::file_size(Path("render_ref.png")), 0u);
+  ASSERT_GT(std::filesystem::file_size(Path("render_robot.png")), 0u);
+
+  auto output = ReadFile("stdout.txt");
+  ASSERT_NE(output.find("Queries: 3 points"), std::string::npos) << output;
+  ASSERT_NE(output.find("correspondence points: 1\n"), std::string::npos) << output;
+  ASSERT_NE(output.find("inside a triangle:     1\n"), std::string::npos) << output;
+  ASSERT_NE(output.find("map transform only:    1\n"), std::string::npos) << output;
+  ASSERT_NE(output.find("Trajectory: 3 points"), std::string::npos) << output;
+  ASSERT_NE(output.find("length: "), std::string::npos) << output;
+  ASSERT_NE(output.find("largest displacement by the warping: "), std::string::npos) << output;
+
+  // Points in the reference map
+  ASSERT_EQ(
+    Run("--direction=to_robot --queries=" + Path("queries.csv") + " --output=" +
+    Path("reverse")), 0) << ReadFile("stdout.txt");
+  ASSERT_TRUE(std::filesystem::exists(Path("reverse_ref.png")));
+  ASSERT_TRUE(std::filesystem::exists(Path("reverse_robot.png")));
+}
+
+TEST_F(TestData, headless_render_errors) {
+  {
+    std::ofstream queries(Path("invalid.csv"));
+    queries << "1,2\n3;4\n";
+  }
+  ASSERT_NE(Run("--queries=" + Path("invalid.csv") + " --output=" + Path("render")), 0);
+  ASSERT_NE(ReadFile("stdout.txt").find(Path("invalid.csv") + ":2"), std::string::npos);
+  ASSERT_NE(Run("--direction=sideways --output=" + Path("render")), 0);
+  ASSERT_NE(Run("--queries=" + Path("missing.csv") + " --output=" + Path("render")), 0);
+  ASSERT_FALSE(std::filesystem::exists(Path("render_ref.png")));
+}